@@ -18,6 +18,7 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <atomic>
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "freertos/FreeRTOS.h"
@@ -45,11 +46,23 @@
 //#define UNVERBOSE_PRINT(...) Serial.printf(__VA_ARGS__)
 #define UNVERBOSE_PRINT(...) do {} while(0)
 
+#define SERVICE_TASK_STACK 4096
+#define SERVICE_TASK_TX_POLL_MS 1 // max wait for RX before TX is serviced again
+
 #define RX_QUEUE_SIZE 32
 #define TX_QUEUE_SIZE 32
 xQueueHandle ESP32Wiimote::rxQueue = NULL;
 xQueueHandle ESP32Wiimote::txQueue = NULL;
 
+// Packet pool backing txQueue/rxQueue (HciPool.h).
+// A slot holds one HCI packet up to the max event size (H4 type + 2 byte header + 255)
+// after the queuedata_t header (len, slot).
+#define HCI_POOL_SLOT_LEN 288
+#define HCI_POOL_SLOTS (RX_QUEUE_SIZE + TX_QUEUE_SIZE)
+#define HCI_POOL_SLOT_SIZE (2 * sizeof(size_t) + HCI_POOL_SLOT_LEN)
+
+static HciPool<HCI_POOL_SLOTS, HCI_POOL_SLOT_SIZE> hciPool;
+
 const TwHciInterface ESP32Wiimote::tinywii_hci_interface = {
   ESP32Wiimote::hciHostSendPacket
 };
@@ -60,6 +73,9 @@ ESP32Wiimote::ESP32Wiimote(int NUNCHUK_STICK_THRESHOLD)
 {
     _nunStickThreshold = NUNCHUK_STICK_THRESHOLD;
     _filter = FILTER_NONE;
+    _serviceStarted.store(false);
+    _snapshotSeq.store(0);
+    memset(&_snapshot, 0, sizeof(_snapshot));
 }
 
 void ESP32Wiimote::notifyHostSendAvailable(void) {
@@ -70,6 +86,7 @@ void ESP32Wiimote::notifyHostSendAvailable(void) {
 }
 
 void ESP32Wiimote::createQueue(void) {
+  hciPool.reset();
   txQueue = xQueueCreate(TX_QUEUE_SIZE, sizeof(queuedata_t*));
   if (txQueue == NULL){
     VERBOSE_PRINTLN("xQueueCreate(txQueue) failed");
@@ -91,7 +108,7 @@ void ESP32Wiimote::handleTxQueue(void) {
       if(xQueueReceive(txQueue, &queuedata, 0) == pdTRUE){
         esp_vhci_host_send_packet(queuedata->data, queuedata->len);
         UNVERBOSE_PRINT("SEND => %s\n", format2Hex(queuedata->data, queuedata->len));
-        free(queuedata);
+        freeQueueData(queuedata);
       }
     }
   }
@@ -102,20 +119,38 @@ void ESP32Wiimote::handleRxQueue(void) {
     queuedata_t *queuedata = NULL;
     if(xQueueReceive(rxQueue, &queuedata, 0) == pdTRUE){
       handleHciData(queuedata->data, queuedata->len);
-      free(queuedata);
+      freeQueueData(queuedata);
     }
   }
 }
 
+ESP32Wiimote::queuedata_t* ESP32Wiimote::allocQueueData(size_t len) {
+    // falls back to the heap for oversize packets or when the pool is empty
+    int slot;
+    queuedata_t * queuedata = (queuedata_t*)hciPool.alloc(sizeof(queuedata_t) + len, &slot);
+    if (queuedata) {
+        queuedata->slot = slot;
+    }
+    return queuedata;
+}
+
+void ESP32Wiimote::freeQueueData(queuedata_t *queuedata) {
+    hciPool.release(queuedata, queuedata->slot);
+}
+
+HciPoolStats ESP32Wiimote::getPoolStats(void) {
+    return hciPool.stats();
+}
+
 esp_err_t ESP32Wiimote::sendQueueData(xQueueHandle queue, uint8_t *data, size_t len) {
     VERBOSE_PRINTLN("sendQueueData");
     if(!data || !len){
         VERBOSE_PRINTLN("no data");
         return ESP_OK;
     }
-    queuedata_t * queuedata = (queuedata_t*)malloc(sizeof(queuedata_t) + len);
+    queuedata_t * queuedata = allocQueueData(len);
     if(!queuedata){
-        VERBOSE_PRINTLN("malloc failed");
+        VERBOSE_PRINTLN("alloc failed");
         return ESP_FAIL;
     }
     queuedata->len = len;
@@ -123,7 +158,7 @@ esp_err_t ESP32Wiimote::sendQueueData(xQueueHandle queue, uint8_t *data, size_t
     UNVERBOSE_PRINT("RECV <= %s\n", format2Hex(queuedata->data, queuedata->len));
     if (xQueueSend(queue, &queuedata, portMAX_DELAY) != pdPASS) {
         VERBOSE_PRINTLN("xQueueSend failed");
-        free(queuedata);
+        freeQueueData(queuedata);
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -169,16 +204,91 @@ void ESP32Wiimote::init(void)
 
 void ESP32Wiimote::task(void)
 {
-  if(!btStarted()){
+  // the service task drains the same queues and TinyWiimote state without a lock
+  if(_serviceStarted.load() || !btStarted()){
     return;
   }
   handleTxQueue();
   handleRxQueue();
 }
 
+bool ESP32Wiimote::startTask(int core, int priority)
+{
+  bool expected = false;
+  if (!_serviceStarted.compare_exchange_strong(expected, true)) {
+    return false;
+  }
+  BaseType_t ret = xTaskCreatePinnedToCore(serviceTask, "wiimote", SERVICE_TASK_STACK, this, priority, NULL, core);
+  if (ret != pdPASS) {
+    _serviceStarted.store(false);
+    return false;
+  }
+  return true;
+}
+
+void ESP32Wiimote::serviceTask(void *arg)
+{
+  ESP32Wiimote *self = (ESP32Wiimote*)arg;
+  while (1) {
+    if (!btStarted()) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+
+    // block until an HCI packet arrives, then drain everything queued
+    queuedata_t *queuedata = NULL;
+    if (xQueueReceive(rxQueue, &queuedata, pdMS_TO_TICKS(SERVICE_TASK_TX_POLL_MS)) == pdTRUE) {
+      do {
+        handleHciData(queuedata->data, queuedata->len);
+        freeQueueData(queuedata);
+      } while (xQueueReceive(rxQueue, &queuedata, 0) == pdTRUE);
+    }
+
+    // send everything the handlers queued, as far as the controller accepts it
+    while (uxQueueMessagesWaiting(txQueue) && esp_vhci_host_check_send_available()) {
+      if (xQueueReceive(txQueue, &queuedata, 0) != pdTRUE) {
+        break;
+      }
+      esp_vhci_host_send_packet(queuedata->data, queuedata->len);
+      UNVERBOSE_PRINT("SEND => %s\n", format2Hex(queuedata->data, queuedata->len));
+      freeQueueData(queuedata);
+    }
+
+    // only the newest report is kept by TinyWiimote, publish it
+    if (TinyWiimoteAvailable()) {
+      self->available();
+      self->publishSnapshot();
+    }
+  }
+}
+
+void ESP32Wiimote::publishSnapshot(void)
+{
+  uint32_t seq = _snapshotSeq.load(std::memory_order_relaxed);
+  _snapshotSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  _snapshot.buttonState  = _buttonState;
+  _snapshot.accelState   = _accelState;
+  _snapshot.nunchukState = _nunchukState;
+  _snapshot.reports++;
+  std::atomic_thread_fence(std::memory_order_release);
+  _snapshotSeq.store(seq + 2, std::memory_order_relaxed);
+}
+
+bool ESP32Wiimote::getSnapshot(WiimoteSnapshot *snapshot)
+{
+  uint32_t seq1, seq2;
+  do {
+    seq1 = _snapshotSeq.load(std::memory_order_acquire);
+    *snapshot = _snapshot;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    seq2 = _snapshotSeq.load(std::memory_order_relaxed);
+  } while ((seq1 & 1) || (seq1 != seq2));
+  return snapshot->reports > 0;
+}
+
 int ESP32Wiimote::available(void)
 {
-    int offs = 0;
     int buttonIsChanged = false;
 //  int nunchukButtonIsChanged = false;
     int accelIsChanged = false;
@@ -186,40 +296,23 @@ int ESP32Wiimote::available(void)
     uint8_t cBtn = 0;
     uint8_t zBtn = 0;
 
-    if (! TinyWiimoteAvailable())
+    TinyWiimoteState st;
+    if (! TinyWiimoteReadLatest(&st))
         return 0;
 
-    TinyWiimoteData rd = TinyWiimoteRead();
-
-    if (rd.len < 4) // 
-        return 0;
-    if (rd.data[0] != 0xA1) // no data input
-        return 0;
-      
     // update old states
     _oldButtonState  = _buttonState;
     _oldAccelState   = _accelState;
     _oldNunchukState = _nunchukState;
 
-    if ((rd.data[1] >= 0x30) && (rd.data[1] <= 0x37)) // data report with button data
-        offs = 2;
-
-    if (offs) // update button state
-        _buttonState = (ButtonState)((rd.data[offs + 0] << 8) | rd.data[offs + 1]);
+    // update button state
+    _buttonState = (ButtonState)st.buttons;
 
-    // get accelerometer offset
-    switch (rd.data[1])
+    if (st.hasAccel) // update accelerometer
     {
-    case 0x31: offs = 4; break; // Core Buttons and Accelerometer
-    case 0x35: offs = 4; break; // Core Buttons and Accelerometer with 16 Extension Bytes
-    default:   offs = 0;
-    }
-
-    if (offs) // update accelerometer
-    {
-        _accelState.xAxis  = rd.data[offs + 0];
-        _accelState.yAxis  = rd.data[offs + 1];
-        _accelState.zAxis  = rd.data[offs + 2];
+        _accelState.xAxis  = st.accel[0];
+        _accelState.yAxis  = st.accel[1];
+        _accelState.zAxis  = st.accel[2];
 
         // check accel change
         if (_filter & FILTER_ACCEL) {
@@ -236,25 +329,18 @@ int ESP32Wiimote::available(void)
         _accelState.zAxis  = 0;
     }
 
-    // get extension offset
-    switch (rd.data[1])
-    {
-    case 0x32: offs = 4; break; // Core Buttons with 8 Extension bytes
-    case 0x35: offs = 7; break; // Core Buttons and Accelerometer with 16 Extension Bytes
-    default:   offs = 0;
-    }
-
-    if (offs) // update nunchuk state
+    bool hasNunchuk = (st.extLen >= 6);
+    if (hasNunchuk) // update nunchuk state
     {
-        _nunchukState.xStick = rd.data[offs + 0];
-        _nunchukState.yStick = rd.data[offs + 1];
-        _nunchukState.xAxis  = rd.data[offs + 2];
-        _nunchukState.yAxis  = rd.data[offs + 3];
-        _nunchukState.zAxis  = rd.data[offs + 4];
+        _nunchukState.xStick = st.ext[0];
+        _nunchukState.yStick = st.ext[1];
+        _nunchukState.xAxis  = st.ext[2];
+        _nunchukState.yAxis  = st.ext[3];
+        _nunchukState.zAxis  = st.ext[4];
 
         // update nunchuk buttons
-        cBtn = ((rd.data[offs + 5] & 0x02) >> 1) ^ 0x01;
-        zBtn =  (rd.data[offs + 5] & 0x01)       ^ 0x01;
+        cBtn = ((st.ext[5] & 0x02) >> 1) ^ 0x01;
+        zBtn =  (st.ext[5] & 0x01)       ^ 0x01;
     }
     else
     {
@@ -281,7 +367,7 @@ int ESP32Wiimote::available(void)
     }
 
     // check nunchuk stick change
-    if (offs)
+    if (hasNunchuk)
     {
         int nunXStickDelta = (int)(_nunchukState.xStick) - _oldNunchukState.xStick;
         int nunYStickDelta = (int)(_nunchukState.yStick) - _oldNunchukState.yStick;
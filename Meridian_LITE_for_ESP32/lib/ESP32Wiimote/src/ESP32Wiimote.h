@@ -15,7 +15,9 @@
 #ifndef __ESP32_WIIMOTE_H__
 #define __ESP32_WIIMOTE_H__
 
+#include <atomic>
 #include "esp_bt.h"
+#include "HciPool.h"
 #include "TinyWiimote.h"
 
 typedef struct {
@@ -66,23 +68,35 @@ enum
   ACTION_IGNORE,
 };
 
+typedef struct {
+    ButtonState  buttonState;
+    AccelState   accelState;
+    NunchukState nunchukState;
+    uint32_t     reports;    // number of reports processed so far (0: not connected yet)
+} WiimoteSnapshot;
+
 class ESP32Wiimote
 {
 public:
   ESP32Wiimote(int NUNCHUK_STICK_THRESHOLD = 1); // was 2
 
   void init(void);
-  void task(void);
+  void task(void);  // polls the HCI queues from loop(); does nothing once startTask() has succeeded
+  bool startTask(int core = 0, int priority = 5);  // false if it could not start or is already running
+  bool getSnapshot(WiimoteSnapshot *snapshot);
   int available(void);
   ButtonState getButtonState(void);
   AccelState getAccelState(void);
   NunchukState getNunchukState(void);
   void addFilter(int action, int filter);
 
+  static HciPoolStats getPoolStats(void);
+
 private:
 
   typedef struct {
           size_t len;
+          int slot;           // pool slot index, -1 if allocated from the heap
           uint8_t data[];
   } queuedata_t;
 
@@ -99,12 +113,24 @@ private:
 
   int _filter;
 
+  // set by startTask(); the service task then owns the HCI queues and the state above
+  std::atomic<bool> _serviceStarted;
+
+  // latest state published by the service task (seqlock: odd while being written)
+  std::atomic<uint32_t> _snapshotSeq;
+  WiimoteSnapshot _snapshot;
+
+  void publishSnapshot(void);
+  static void serviceTask(void *arg);
+
   static const TwHciInterface tinywii_hci_interface;
   static esp_vhci_host_callback_t vhci_callback;
   static xQueueHandle txQueue;
   static xQueueHandle rxQueue;
 
   static void createQueue(void);
+  static queuedata_t* allocQueueData(size_t len);
+  static void freeQueueData(queuedata_t *queuedata);
   static void handleTxQueue(void);
   static void handleRxQueue(void);
   static esp_err_t sendQueueData(xQueueHandle queue, uint8_t *data, size_t len);
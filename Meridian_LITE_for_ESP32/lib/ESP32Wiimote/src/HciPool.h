@@ -0,0 +1,122 @@
+// Copyright (c) 2020 Daiki Yasuda
+//
+// This is licensed under
+// - Creative Commons Attribution-NonCommercial 3.0 Unported
+// - https://creativecommons.org/licenses/by-nc/3.0/
+// - Or see LICENSE.md
+//
+// The short of it is...
+//   You are free to:
+//     Share — copy and redistribute the material in any medium or format
+//     Adapt — remix, transform, and build upon the material
+//   Under the following terms:
+//     NonCommercial — You may not use the material for commercial purposes.
+
+#ifndef __HCI_POOL_H__
+#define __HCI_POOL_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+typedef struct {
+    uint32_t allocs;     // packets taken from the pool
+    uint32_t exhausted;  // pool was empty, packet went to the heap
+    uint32_t oversize;   // packet larger than a slot, packet went to the heap
+    uint32_t inUse;      // slots currently held by txQueue/rxQueue
+    uint32_t highWater;  // max slots held at the same time
+} HciPoolStats;
+
+// Fixed slot pool backing the HCI packet queues.
+// Free slots are tracked in a bitmap updated with CAS, so the BT controller task and the
+// service task can allocate and release without a lock and without touching the heap.
+// Requests larger than a slot, or made while every slot is taken, fall back to malloc().
+// Header only (no ESP-IDF dependency) so it can be tested on the host.
+template <int SLOTS, size_t SLOT_SIZE>
+class HciPool
+{
+public:
+  HciPool() { reset(); }
+
+  // mark every slot free (only while no slot is held)
+  void reset(void) {
+    for (int w = 0; w < WORDS; w++) {
+      int bits = SLOTS - w * 32;
+      _free[w].store(bits >= 32 ? 0xFFFFFFFF : ((1UL << bits) - 1));
+    }
+  }
+
+  // size bytes from a slot, or from the heap (*slot = -1). NULL if the heap is out of memory too.
+  void *alloc(size_t size, int *slot) {
+    if (size > SLOT_SIZE) {
+      _oversize.fetch_add(1);
+    }
+    else {
+      int s = take();
+      if (s >= 0) {
+        *slot = s;
+        return _slots[s];
+      }
+      _exhausted.fetch_add(1);
+    }
+    *slot = -1;
+    return malloc(size);
+  }
+
+  // give back what alloc() returned with the same slot
+  void release(void *p, int slot) {
+    if (slot >= 0) {
+      give(slot);
+    }
+    else {
+      free(p);
+    }
+  }
+
+  HciPoolStats stats(void) const {
+    HciPoolStats stats;
+    stats.allocs    = _allocs.load();
+    stats.exhausted = _exhausted.load();
+    stats.oversize  = _oversize.load();
+    stats.inUse     = _inUse.load();
+    stats.highWater = _highWater.load();
+    return stats;
+  }
+
+private:
+  static const int WORDS = (SLOTS + 31) / 32;
+
+  uint8_t _slots[SLOTS][(SLOT_SIZE + 7) & ~(size_t)7] __attribute__((aligned(8)));
+  std::atomic<uint32_t> _free[WORDS];
+  std::atomic<uint32_t> _allocs{0};
+  std::atomic<uint32_t> _exhausted{0};
+  std::atomic<uint32_t> _oversize{0};
+  std::atomic<uint32_t> _inUse{0};
+  std::atomic<uint32_t> _highWater{0};
+
+  int take(void) {
+    for (int w = 0; w < WORDS; w++) {
+      uint32_t bits = _free[w].load();
+      while (bits) {
+        int b = __builtin_ctz(bits);
+        if (_free[w].compare_exchange_weak(bits, bits & ~(1UL << b))) {
+          uint32_t used = _inUse.fetch_add(1) + 1;
+          uint32_t hw = _highWater.load();
+          while (used > hw && !_highWater.compare_exchange_weak(hw, used)) {
+          }
+          _allocs.fetch_add(1);
+          return w * 32 + b;
+        }
+      }
+    }
+    return -1;
+  }
+
+  // inUse goes down before the slot is free again, so it never counts a slot twice
+  void give(int slot) {
+    _inUse.fetch_sub(1);
+    _free[slot / 32].fetch_or(1UL << (slot % 32));
+  }
+};
+
+#endif // __HCI_POOL_H__
@@ -18,6 +18,7 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <atomic>
 #include <HardwareSerial.h> // for Arduino
 
 #include "time.h"
@@ -955,32 +956,85 @@ static void handleExtensionControllerReports(uint16_t ch, uint16_t channelID, ui
 
 /**
  * Received Data
+ * The newest data report is kept in a seqlock slot (odd sequence while being written),
+ * so the reader always gets the latest input and never blocks the HCI handler.
  */
-struct recv_data_rb {
-  uint8_t wp;
-  uint8_t rp;
-  uint8_t cnt;
-};
-static recv_data_rb receivedDataRb;
-#define RECIEVED_DATA_MAX_NUM     (5)
-static TinyWiimoteData receivedData[RECIEVED_DATA_MAX_NUM];
-
-void putWiimoteReceivedData(uint8_t number, uint8_t* data, uint8_t len) {
-  if(receivedDataRb.cnt < RECIEVED_DATA_MAX_NUM) {
-    TinyWiimoteData *target = &(receivedData[receivedDataRb.wp]);
-    memcpy(target->data, data, len);
-    target->number = number;
-    target->len = len;
-    receivedDataRb.wp = (receivedDataRb.wp + 1) % RECIEVED_DATA_MAX_NUM;
-    receivedDataRb.cnt++;
+static std::atomic<uint32_t> latestSeq(0);
+static std::atomic<uint32_t> latestReadSeq(0);
+static TinyWiimoteState latestState;
+
+static std::atomic<bool> useButtonEvents(false);
+static std::atomic<uint8_t> buttonEventWp(0);
+static std::atomic<uint8_t> buttonEventRp(0);
+static TinyWiimoteButtonEvent buttonEvents[TWII_BUTTON_EVENT_MAX_NUM];
+
+static std::atomic<uint32_t> statReports(0);
+static std::atomic<uint32_t> statOverwritten(0);
+static std::atomic<uint32_t> statEventsDropped(0);
+
+static void putButtonEvent(uint32_t seq, uint16_t oldButtons, uint16_t newButtons) {
+  uint8_t wp = buttonEventWp.load(std::memory_order_relaxed);
+  uint8_t next = (wp + 1) % TWII_BUTTON_EVENT_MAX_NUM;
+  if(next == buttonEventRp.load(std::memory_order_acquire)) {
+    statEventsDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
   }
-  VERBOSE_PRINTLN("");
+  buttonEvents[wp].seq = seq;
+  buttonEvents[wp].pressed = newButtons & ~oldButtons;
+  buttonEvents[wp].released = oldButtons & ~newButtons;
+  buttonEventWp.store(next, std::memory_order_release);
 }
 
 static void handleReport(uint8_t* data, uint16_t len) {
   VERBOSE_PRINT("REPORT len=%d data=%s", len, format2Hex(data, len));
-  uint8_t idx = 0; //only supports one wiimote
-  putWiimoteReceivedData(idx, data, len);
+  if(len < 4 || data[0] != 0xA1) { // no data input
+    return;
+  }
+  uint8_t id = data[1];
+  if(id < 0x30 || id > 0x37) { // not a data report with button data
+    return;
+  }
+
+  uint8_t accelOffs = 0;
+  uint8_t extOffs = 0;
+  switch(id) {
+  case 0x31: accelOffs = 4; break;              // Core Buttons and Accelerometer
+  case 0x32: extOffs = 4; break;                // Core Buttons with 8 Extension bytes
+  case 0x35: accelOffs = 4; extOffs = 7; break; // Core Buttons and Accelerometer with 16 Extension Bytes
+  default: break;
+  }
+
+  uint16_t oldButtons = latestState.buttons;
+  uint32_t seq = latestSeq.load(std::memory_order_relaxed);
+  latestSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  latestState.seq++;
+  latestState.reportId = id;
+  latestState.buttons = (data[2] << 8) | data[3];
+  latestState.hasAccel = (accelOffs && len >= accelOffs + 3);
+  if(latestState.hasAccel) {
+    memcpy(latestState.accel, data + accelOffs, 3);
+  }
+  latestState.extLen = 0;
+  if(extOffs && len > extOffs) {
+    latestState.extLen = (len - extOffs > TWII_EXT_MAX_LEN) ? TWII_EXT_MAX_LEN : (len - extOffs);
+    memcpy(latestState.ext, data + extOffs, latestState.extLen);
+  }
+  uint32_t stateSeq = latestState.seq;
+  uint16_t newButtons = latestState.buttons;
+
+  std::atomic_thread_fence(std::memory_order_release);
+  latestSeq.store(seq + 2, std::memory_order_relaxed);
+
+  statReports.fetch_add(1, std::memory_order_relaxed);
+  if(latestReadSeq.load(std::memory_order_relaxed) != stateSeq - 1) { // the previous report was never read
+    statOverwritten.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if(useButtonEvents.load(std::memory_order_relaxed) && newButtons != oldButtons) {
+    putButtonEvent(stateSeq, oldButtons, newButtons);
+  }
 }
 
 static void handleL2capData(uint16_t ch, uint16_t channelID, uint8_t* data, uint16_t len) {
@@ -1067,25 +1121,77 @@ bool TinyWiimoteDeviceIsInited(void) {
 }
 
 int TinyWiimoteAvailable() {
-  return receivedDataRb.cnt;
+  uint32_t seq = latestSeq.load(std::memory_order_acquire) >> 1; // two steps per report
+  return seq != latestReadSeq.load(std::memory_order_relaxed);
+}
+
+bool TinyWiimoteReadLatest(TinyWiimoteState *state) {
+  uint32_t seq1, seq2;
+  do {
+    seq1 = latestSeq.load(std::memory_order_acquire);
+    *state = latestState;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    seq2 = latestSeq.load(std::memory_order_relaxed);
+  } while((seq1 & 1) || (seq1 != seq2));
+  bool isNew = (state->seq != latestReadSeq.load(std::memory_order_relaxed));
+  latestReadSeq.store(state->seq, std::memory_order_relaxed);
+  return isNew;
 }
 
-TinyWiimoteData TinyWiimoteRead() {
+TinyWiimoteData TinyWiimoteRead(void) {
   TinyWiimoteData target;
   target.number = 0;
   target.len = 0;
-  if(receivedDataRb.cnt > 0) {
-    target = receivedData[receivedDataRb.rp];
-    receivedDataRb.rp = (receivedDataRb.rp + 1) % RECIEVED_DATA_MAX_NUM;
-    receivedDataRb.cnt--;
+  TinyWiimoteState state;
+  if(!TinyWiimoteReadLatest(&state)) {
+    return target;
   }
+  uint8_t posi = 0;
+  target.data[posi++] = 0xA1;
+  target.data[posi++] = state.reportId;
+  target.data[posi++] = (uint8_t)(state.buttons >> 8);
+  target.data[posi++] = (uint8_t)(state.buttons & 0xFF);
+  if(state.hasAccel) {
+    memcpy(target.data + posi, state.accel, 3);
+    posi += 3;
+  }
+  if(state.extLen) {
+    posi = (state.reportId == 0x35) ? 7 : 4; // same offsets as handleReport()
+    memcpy(target.data + posi, state.ext, state.extLen);
+    posi += state.extLen;
+  }
+  target.len = posi;
   return target;
 }
 
+void TinyWiimoteEnableButtonEvents(bool use) {
+  useButtonEvents.store(use);
+}
+
+bool TinyWiimoteReadButtonEvent(TinyWiimoteButtonEvent *event) {
+  uint8_t rp = buttonEventRp.load(std::memory_order_relaxed);
+  if(rp == buttonEventWp.load(std::memory_order_acquire)) {
+    return false;
+  }
+  *event = buttonEvents[rp];
+  buttonEventRp.store((rp + 1) % TWII_BUTTON_EVENT_MAX_NUM, std::memory_order_release);
+  return true;
+}
+
+TinyWiimoteStats TinyWiimoteGetStats(void) {
+  TinyWiimoteStats stats;
+  stats.reports = statReports.load();
+  stats.overwritten = statOverwritten.load();
+  stats.eventsDropped = statEventsDropped.load();
+  return stats;
+}
+
 void TinyWiimoteInit(TwHciInterface hciInterface) {
-    receivedDataRb.cnt = 0;
-    receivedDataRb.wp = 0;
-    receivedDataRb.rp = 0;
+    memset(&latestState, 0, sizeof(latestState));
+    latestSeq.store(0);
+    latestReadSeq.store(0);
+    buttonEventWp.store(0);
+    buttonEventRp.store(0);
     _hciInterface = hciInterface;
 }
 
@@ -15,6 +15,34 @@
 #ifndef _TINY_WIIMOTE_H_
 #define _TINY_WIIMOTE_H_
 
+#define TWII_EXT_MAX_LEN          (16)
+#define TWII_BUTTON_EVENT_MAX_NUM (16)
+
+// Latest decoded data report (0x30-0x37). Only the newest report is kept.
+struct TinyWiimoteState {
+  uint32_t seq;                     // incremented for every data report
+  uint8_t  reportId;                // 0x30-0x37
+  uint8_t  hasAccel;                // accel[] is valid for this report
+  uint8_t  extLen;                  // number of valid bytes in ext[]
+  uint16_t buttons;                 // core buttons (BB BB)
+  uint8_t  accel[3];                // core accelerometer x,y,z
+  uint8_t  ext[TWII_EXT_MAX_LEN];   // extension controller bytes
+};
+
+// Edge-triggered button change, queued only when enabled.
+struct TinyWiimoteButtonEvent {
+  uint32_t seq;       // report that caused the change
+  uint16_t pressed;   // buttons that went down
+  uint16_t released;  // buttons that went up
+};
+
+struct TinyWiimoteStats {
+  uint32_t reports;        // data reports received
+  uint32_t overwritten;    // reports replaced before they were read
+  uint32_t eventsDropped;  // button events lost because the queue was full
+};
+
+// Raw report as returned by TinyWiimoteRead(), kept for sketches written against the old API.
 #define RECIEVED_DATA_MAX_LEN     (50)
 struct TinyWiimoteData {
   uint8_t number;
@@ -31,7 +59,13 @@ typedef struct tinywii_device_callback {
 
 void TinyWiimoteInit(TwHciInterface hciInterface);
 int TinyWiimoteAvailable(void);
+bool TinyWiimoteReadLatest(TinyWiimoteState *state);
+// Newest data report rebuilt as (a1) RR BB BB [AA AA AA] [EE ...] from TinyWiimoteReadLatest().
+// len is 0 when no new report came in. Reports in between and non-data reports are not queued any more.
 TinyWiimoteData TinyWiimoteRead(void);
+void TinyWiimoteEnableButtonEvents(bool use);
+bool TinyWiimoteReadButtonEvent(TinyWiimoteButtonEvent *event);
+TinyWiimoteStats TinyWiimoteGetStats(void);
 
 void TinyWiimoteResetDevice(void);
 bool TinyWiimoteDeviceIsInited(void);
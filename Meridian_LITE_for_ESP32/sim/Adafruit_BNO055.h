@@ -0,0 +1,87 @@
+#ifndef __MERIDIAN_SIM_ADAFRUIT_BNO055__
+#define __MERIDIAN_SIM_ADAFRUIT_BNO055__
+
+#include <Arduino.h>
+#include <Wire.h>
+
+namespace imu
+{
+  template <uint8_t N>
+  class Vector
+  {
+  public:
+    Vector() { memset(p_vec, 0, sizeof(p_vec)); }
+    Vector(double a, double b, double c)
+    {
+      memset(p_vec, 0, sizeof(p_vec));
+      p_vec[0] = a;
+      p_vec[1] = b;
+      p_vec[2] = c;
+    }
+    double &operator[](int n) { return p_vec[n]; }
+    double operator[](int n) const { return p_vec[n]; }
+    double &x() { return p_vec[0]; }
+    double &y() { return p_vec[1]; }
+    double &z() { return p_vec[2]; }
+    double x() const { return p_vec[0]; }
+    double y() const { return p_vec[1]; }
+    double z() const { return p_vec[2]; }
+
+  private:
+    double p_vec[N];
+  };
+
+  class Quaternion
+  {
+  public:
+    Quaternion() : _w(1), _x(0), _y(0), _z(0) {}
+    Quaternion(double w, double x, double y, double z) : _w(w), _x(x), _y(y), _z(z) {}
+    double w() const { return _w; }
+    double x() const { return _x; }
+    double y() const { return _y; }
+    double z() const { return _z; }
+
+  private:
+    double _w, _x, _y, _z;
+  };
+}
+
+/**
+ * @brief Trace-driven BNO055.
+ *
+ * Without MRD_SIM_BNO_TRACE the sensor sits level and still.
+ * With it, rows of a CSV file are played back by virtual time:
+ *   t_ms, acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z, mag_x, mag_y, mag_z, heading, roll, pitch
+ * (units as returned by getVector(), '#' lines are comments). The trace repeats at its end.
+ * Each getVector() costs one 6-byte I2C read at 400 kHz.
+ */
+class Adafruit_BNO055
+{
+public:
+  typedef enum
+  {
+    VECTOR_ACCELEROMETER = 0x08,
+    VECTOR_MAGNETOMETER = 0x0E,
+    VECTOR_GYROSCOPE = 0x14,
+    VECTOR_EULER = 0x1A,
+    VECTOR_LINEARACCEL = 0x28,
+    VECTOR_GRAVITY = 0x2E
+  } adafruit_vector_type_t;
+
+  typedef enum
+  {
+    OPERATION_MODE_CONFIG = 0x00,
+    OPERATION_MODE_NDOF = 0x0C
+  } adafruit_bno055_opmode_t;
+
+  Adafruit_BNO055(int32_t sensor_id = -1, uint8_t address = 0x28, TwoWire *wire = &Wire);
+
+  bool begin(adafruit_bno055_opmode_t mode = OPERATION_MODE_NDOF);
+  void setExtCrystalUse(bool use_ext) { (void)use_ext; }
+  imu::Vector<3> getVector(adafruit_vector_type_t type);
+  imu::Quaternion getQuat();
+  int8_t getTemp() { return 25; }
+  void getCalibration(uint8_t *sys, uint8_t *gyro, uint8_t *accel, uint8_t *mag);
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef __MERIDIAN_SIM_ARDUINO__
+#define __MERIDIAN_SIM_ARDUINO__
+
+/*
+  ESP32 Arduino core (1.0.6) のうちMeridianで使う部分のPC用代替.
+  millis()/micros()は仮想時計(sim.h)を返し, ESP32と同様に32ビットで桁あふれする.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "HardwareSerial.h"
+#include "IPAddress.h"
+#include "Print.h"
+#include "WString.h"
+#include "binary.h"
+#include "freertos/FreeRTOS.h"
+
+using std::abs;
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define INPUT_PULLUP 0x05
+#define A0 36
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+#define radians(deg) ((deg)*DEG_TO_RAD)
+#define degrees(rad) ((rad)*RAD_TO_DEG)
+#define sq(x) ((x) * (x))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define lowByte(w) ((uint8_t)((w)&0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+void randomSeed(unsigned long seed);
+long random(long howbig);
+long random(long howsmall, long howbig);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+typedef enum
+{
+  ESP_MAC_WIFI_STA,
+  ESP_MAC_WIFI_SOFTAP,
+  ESP_MAC_BT,
+  ESP_MAC_ETH,
+} esp_mac_type_t;
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+/**
+ * @brief ESP object. getCycleCount() counts host CPU time at 240 MHz so that code
+ *        timed with it (fusion cycles, run_bench()) reports what the host really spent,
+ *        plus the virtual time the loop thread spent on devices (servo UART, SPI).
+ */
+class EspClass
+{
+public:
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint32_t getFreeHeap() { return 200000; }
+  void restart();
+};
+extern EspClass ESP;
+
+#endif
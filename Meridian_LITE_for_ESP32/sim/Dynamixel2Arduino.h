@@ -0,0 +1,55 @@
+#ifndef __MERIDIAN_SIM_DYNAMIXEL2ARDUINO__
+#define __MERIDIAN_SIM_DYNAMIXEL2ARDUINO__
+
+#include <Arduino.h>
+
+enum OperatingMode
+{
+  OP_CURRENT = 0,
+  OP_VELOCITY = 1,
+  OP_POSITION = 3,
+  OP_EXTENDED_POSITION = 4,
+  OP_CURRENT_BASED_POSITION = 5,
+  OP_PWM = 16,
+};
+
+enum ParamUnit
+{
+  UNIT_RAW = 0,
+  UNIT_PERCENT,
+  UNIT_RPM,
+  UNIT_DEGREE,
+  UNIT_MILLI_AMPERE,
+};
+
+/**
+ * @brief Dynamixel X-series bus stand-in (protocol 2.0 timing).
+ *
+ * Every servo listed in MRD_SIM_DXL_IDS_<uart> (default "0-14") answers.
+ * A transaction costs the instruction and status packets on the wire plus
+ * MRD_SIM_DXL_RETURN_DELAY_US (default 0, the factory setting of the servo is 500).
+ * A missing servo, or a UART not at begin()'s baud rate with 8N1, costs the full timeout, as on the real bus.
+ * Positions move towards the goal at MRD_SIM_DXL_SPEED_DPS (default 360 deg/s).
+ */
+class Dynamixel2Arduino
+{
+public:
+  Dynamixel2Arduino(HardwareSerial &port, int dir_pin = -1);
+
+  void begin(unsigned long baud = 57600);
+  bool setPortProtocolVersion(float version);
+  bool ping(uint8_t id);
+  bool setOperatingMode(uint8_t id, uint8_t mode);
+  bool torqueOn(uint8_t id);
+  bool torqueOff(uint8_t id);
+  bool setGoalPosition(uint8_t id, float value, uint8_t unit = UNIT_RAW);
+  float getPresentPosition(uint8_t id, uint8_t unit = UNIT_RAW);
+  bool write(uint8_t id, uint16_t addr, const uint8_t *data, uint16_t len, uint32_t timeout_ms = 10);
+  int32_t read(uint8_t id, uint16_t addr, uint16_t addr_len, uint8_t *recv_buf, uint16_t recv_buf_capacity, uint32_t timeout_ms = 10);
+
+private:
+  HardwareSerial &port;
+  unsigned long baud = 57600;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef __MERIDIAN_SIM_ESP32WIIMOTE__
+#define __MERIDIAN_SIM_ESP32WIIMOTE__
+
+#include <Arduino.h>
+
+typedef struct {
+    uint8_t xAxis;
+    uint8_t yAxis;
+    uint8_t zAxis;
+} AccelState;
+
+typedef enum {
+    BUTTON_Z          = 0x00020000,
+    BUTTON_C          = 0x00010000,
+    BUTTON_PLUS       = 0x00001000,
+    BUTTON_UP         = 0x00000800,
+    BUTTON_DOWN       = 0x00000400,
+    BUTTON_RIGHT      = 0x00000200,
+    BUTTON_LEFT       = 0x00000100,
+    BUTTON_HOME       = 0x00000080,
+    BUTTON_MINUS      = 0x00000010,
+    BUTTON_A          = 0x00000008,
+    BUTTON_B          = 0x00000004,
+    BUTTON_ONE        = 0x00000002,
+    BUTTON_TWO        = 0x00000001,
+    NO_BUTTON         = 0x00000000
+} ButtonState;
+
+typedef struct {
+        uint8_t xStick;
+        uint8_t yStick;
+        uint8_t xAxis;
+        uint8_t yAxis;
+        uint8_t zAxis;
+} NunchukState;
+
+enum
+{
+  FILTER_NONE                = 0x0000,
+  FILTER_BUTTON              = 0x0001,
+  FILTER_NUNCHUK_STICK       = 0x0004,
+  FILTER_ACCEL               = 0x0008,
+};
+
+enum
+{
+  ACTION_IGNORE,
+};
+
+typedef struct {
+    ButtonState  buttonState;
+    AccelState   accelState;
+    NunchukState nunchukState;
+    uint32_t     reports;
+} WiimoteSnapshot;
+
+typedef struct {
+    uint32_t allocs;
+    uint32_t exhausted;
+    uint32_t oversize;
+    uint32_t inUse;
+    uint32_t highWater;
+} HciPoolStats;
+
+/**
+ * @brief Wiimote stand-in with the same interface as lib/ESP32Wiimote.
+ *        No controller is connected unless MRD_SIM_WIIMOTE_BUTTONS is set,
+ *        in which case that button word is reported once.
+ */
+class ESP32Wiimote
+{
+public:
+  ESP32Wiimote(int NUNCHUK_STICK_THRESHOLD = 1) { (void)NUNCHUK_STICK_THRESHOLD; }
+
+  void init(void) {}
+  void task(void) {}
+  bool startTask(int core = 0, int priority = 5) { (void)core; (void)priority; return true; }
+  bool getSnapshot(WiimoteSnapshot *snapshot);
+  int available(void);
+  ButtonState getButtonState(void);
+  AccelState getAccelState(void) { AccelState s = {0, 0, 0}; return s; }
+  NunchukState getNunchukState(void) { NunchukState s = {128, 128, 0, 0, 0}; return s; }
+  void addFilter(int action, int filter) { (void)action; (void)filter; }
+
+  static HciPoolStats getPoolStats(void) { HciPoolStats s = {0, 0, 0, 0, 0}; return s; }
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __MERIDIAN_SIM_ETHERNET2__
+#define __MERIDIAN_SIM_ETHERNET2__
+
+#include <Arduino.h>
+
+/**
+ * @brief W5500 stand-in. The host network stack is used, only the address is kept.
+ */
+class EthernetClass
+{
+public:
+  int begin(uint8_t *mac);
+  void begin(uint8_t *mac, IPAddress local_ip);
+  IPAddress localIP() { return ip; }
+
+private:
+  IPAddress ip;
+};
+
+extern EthernetClass Ethernet;
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __MERIDIAN_SIM_ETHERNETUDP2__
+#define __MERIDIAN_SIM_ETHERNETUDP2__
+
+#include <Arduino.h>
+
+#define SIM_UDP_MAX 1500
+
+/**
+ * @brief EthernetUDP on a POSIX UDP socket.
+ *        The W5500 SPI traffic of each call is charged to the virtual clock as Ethernet2
+ *        does it, byte by byte (MRD_SIM_SPI_MHZ, default 8), and every packet is sent to MRD_SIM_PEER
+ *        (default 127.0.0.1) instead of the configured PC address.
+ */
+class EthernetUDP : public Print
+{
+public:
+  uint8_t begin(uint16_t port);
+  void stop();
+
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacket(const char *host, uint16_t port);
+  int endPacket();
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t len) override;
+
+  int parsePacket();
+  int available() { return rx_len - rx_pos; }
+  int read();
+  int read(unsigned char *buf, size_t len);
+  int read(char *buf, size_t len) { return read((unsigned char *)buf, len); }
+  int peek() { return (rx_pos < rx_len) ? rx_buf[rx_pos] : -1; }
+  void flush() { rx_pos = rx_len; }
+
+  IPAddress remoteIP() { return remote_ip; }
+  uint16_t remotePort() { return remote_port; }
+
+private:
+  int sock = -1;
+  uint8_t rx_buf[SIM_UDP_MAX];
+  int rx_len = 0;
+  int rx_pos = 0;
+  uint8_t tx_buf[SIM_UDP_MAX];
+  int tx_len = 0;
+  uint16_t tx_port = 0;
+  IPAddress remote_ip;
+  uint16_t remote_port = 0;
+};
+
+#endif
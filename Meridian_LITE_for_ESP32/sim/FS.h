@@ -0,0 +1,87 @@
+#ifndef __MERIDIAN_SIM_FS__
+#define __MERIDIAN_SIM_FS__
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "Print.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+  enum SeekMode
+  {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+  };
+
+  /**
+   * @brief File on the host file system (same interface as the ESP32 core fs::File).
+   */
+  class File : public Print
+  {
+  public:
+    File() {}
+    File(FILE *fp, const std::string &path, int us_per_kb, int stall_every, int stall_us, const std::shared_ptr<int> &write_count);
+
+    using Print::write;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t len) override;
+    size_t read(uint8_t *buf, size_t len);
+    int read();
+    int peek();
+    int available();
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void flush();
+    void close();
+    const char *name() const { return path.c_str(); }
+    operator bool() const { return fp != NULL; }
+
+  private:
+    std::shared_ptr<FILE> fp;
+    std::string path;
+    int us_per_kb = 0;   // 1KBあたりの転送時間(us)
+    int stall_every = 0; // 書き込みN回ごとに発生させる遅延の間隔(0:なし)
+    int stall_us = 0;    // 上記の遅延時間(us)
+    std::shared_ptr<int> write_count;
+  };
+
+  /**
+   * @brief File system rooted in a host directory.
+   */
+  class FS
+  {
+  public:
+    FS(const char *sub_dir, int us_per_kb, int stall_every = 0, int stall_us = 0) : sub(sub_dir), us_per_kb(us_per_kb), stall_every(stall_every), stall_us(stall_us) {}
+
+    File open(const char *path, const char *mode = FILE_READ);
+    File open(const String &path, const char *mode = FILE_READ) { return open(path.c_str(), mode); }
+    bool exists(const char *path);
+    bool remove(const char *path);
+    bool mkdir(const char *path);
+
+  protected:
+    bool mount();
+    std::string host_path(const char *path) const;
+
+  private:
+    std::string sub;
+    std::string root;
+    int us_per_kb;
+    int stall_every;
+    int stall_us;
+    std::shared_ptr<int> write_count = std::make_shared<int>(0);
+  };
+}
+
+using fs::File;
+using fs::FS;
+
+#endif
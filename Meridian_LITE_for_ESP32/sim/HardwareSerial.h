@@ -0,0 +1,56 @@
+#ifndef __MERIDIAN_SIM_HARDWARESERIAL__
+#define __MERIDIAN_SIM_HARDWARESERIAL__
+
+#include "Print.h"
+
+#define SERIAL_8N1 0x800001c
+#define SERIAL_8E1 0x800001e
+
+/**
+ * @brief UART stand-in. Serial (uart 0) goes to stdout, Serial1/Serial2 are servo buses
+ *        whose traffic is modeled by the Dynamixel/ICS stand-ins, so bytes written here are dropped.
+ *        With MRD_SIM_SERIAL_PTY=path, Serial is a pseudo terminal linked at path instead (both ways):
+ *        the 128 byte TX FIFO drains at the baud rate on the clock and write() waits for room like
+ *        the ESP32 core, so availableForWrite() tells how much can be written without waiting.
+ *        The baud rate and format are kept so that the servo stand-ins only answer at their own
+ *        (uart_set_parity() in driver/uart.h changes the parity bits of the format).
+ */
+class HardwareSerial : public Print
+{
+public:
+  explicit HardwareSerial(int uart_nr) : uart(uart_nr) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rx_pin = -1, int8_t tx_pin = -1, bool invert = false, unsigned long timeout_ms = 20000UL);
+  void updateBaudRate(unsigned long baud_rate) { baud = baud_rate; }
+  void end() {}
+  int available();
+  int read();
+  int peek();
+  int availableForWrite();
+  size_t setRxBufferSize(size_t size) { return size; }
+  void flush();
+  void setTimeout(unsigned long) {}
+
+  using Print::write;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t len) override;
+
+  int uart_nr() const { return uart; }
+  unsigned long baud_rate() const { return baud; }
+  uint32_t format() const { return config; }
+  void set_parity(uint32_t parity) { config = (config & ~0x3u) | (parity & 0x3u); }
+  int begin_count() const { return begins; } // begin()でUARTを開いた回数
+  operator bool() const { return true; }
+
+private:
+  int uart;
+  unsigned long baud = 115200;
+  uint32_t config = SERIAL_8N1;
+  int begins = 0;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __MERIDIAN_SIM_IPADDRESS__
+#define __MERIDIAN_SIM_IPADDRESS__
+
+#include <cstdint>
+#include <cstdio>
+
+#include "WString.h"
+
+/**
+ * @brief IPv4 address (same interface as the Arduino core class).
+ */
+class IPAddress
+{
+public:
+  IPAddress() : addr{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr{a, b, c, d} {}
+  IPAddress(uint32_t v) : addr{(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)} {}
+
+  bool fromString(const char *s)
+  {
+    unsigned int a, b, c, d;
+    if (sscanf(s, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+    {
+      return false;
+    }
+    addr[0] = a;
+    addr[1] = b;
+    addr[2] = c;
+    addr[3] = d;
+    return true;
+  }
+
+  String toString() const
+  {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
+    return String(buf);
+  }
+
+  operator uint32_t() const { return addr[0] | (addr[1] << 8) | (addr[2] << 16) | ((uint32_t)addr[3] << 24); }
+  uint8_t operator[](int i) const { return addr[i]; }
+  uint8_t &operator[](int i) { return addr[i]; }
+  bool operator==(const IPAddress &o) const { return (uint32_t) * this == (uint32_t)o; }
+  bool operator!=(const IPAddress &o) const { return !(*this == o); }
+
+private:
+  uint8_t addr[4];
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __MERIDIAN_SIM_ICSHARDSERIALCLASS__
+#define __MERIDIAN_SIM_ICSHARDSERIALCLASS__
+
+#include <Arduino.h>
+
+enum KRR_BUTTON : unsigned short
+{
+  KRR_BUTTON_NONE = 0x0000,
+  KRR_BUTTON_UP = 0x0001,
+  KRR_BUTTON_DOWN = 0x0002,
+  KRR_BUTTON_RIGHT = 0x0004,
+  KRR_BUTTON_LEFT = 0x0008,
+  KRR_BUTTON_TRIANGLE = 0x0010,
+  KRR_BUTTON_CROSS = 0x0020,
+  KRR_BUTTON_CIRCLE = 0x0040,
+  KRR_BUTTON_SQUARE = 0x0100,
+  KRR_BUTTON_S1 = 0x0200,
+  KRR_BUTTON_S2 = 0x0400,
+  KRR_BUTTON_S3 = 0x0800,
+  KRR_BUTTON_S4 = 0x1000,
+  KRR_BUTTON_FALSE = 0xFFFF
+};
+
+/**
+ * @brief ICS 3.5 servo/KRR bus stand-in.
+ *
+ * Servos listed in MRD_SIM_ICS_IDS_<uart> (default "0-14") answer setPos/setFree.
+ * A KRR-5FH answers getKrrAllData() only when MRD_SIM_KRR_BUTTONS is set
+ * (button word, analog values from MRD_SIM_KRR_ANALOG "a,b,c,d").
+ * Nothing answers unless the UART is at this class's baud rate with even parity.
+ */
+class IcsHardSerialClass
+{
+public:
+  static constexpr int ICS_FALSE = -1;
+
+  IcsHardSerialClass() : serial(NULL) {}
+  IcsHardSerialClass(HardwareSerial *serial, byte enpin) : serial(serial) { (void)enpin; }
+  IcsHardSerialClass(HardwareSerial *serial, byte enpin, long baudrate, int timeout) : serial(serial), baudrate(baudrate), timeout(timeout) { (void)enpin; }
+
+  bool begin();
+  bool begin(long baudrate, int timeout);
+  bool begin(HardwareSerial *serial, int enpin, long baudrate, int timeout);
+
+  int setPos(byte id, unsigned int pos);
+  int setFree(byte id);
+  bool getKrrAllData(unsigned short *button, int adData[4]);
+
+private:
+  HardwareSerial *serial;
+  long baudrate = 115200;
+  int timeout = 1000;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef __MERIDIAN_SIM_MERIDIAN__
+#define __MERIDIAN_SIM_MERIDIAN__
+
+#include <Arduino.h>
+
+/*
+  Meridianライブラリ(ninagawa123/Meridian)の代わり. main.cppが使う関数だけを同じ名前と引数で持ち,
+  ネイティブ環境をネットワーク無しでビルドできるようにする.
+  チェックサムはMeridim仕様の「最後以外の合計のビット反転」, シーケンス番号は0～59999の巡回.
+  起動時の表示は同じ項目を短く出す.
+*/
+
+namespace MERIDIANFLOW
+{
+  /**
+   * @brief Stand-in for the Meridian library class (the parts main.cpp uses).
+   */
+  class Meridian
+  {
+  public:
+    short cksm_val(short arr[], int len)
+    {
+      int cksm = 0;
+      for (int i = 0; i < len - 1; i++)
+      {
+        cksm += int(arr[i]);
+      }
+      return short(~cksm);
+    }
+
+    bool cksm_rslt(short arr[], int len) { return cksm_val(arr, len) == arr[len - 1]; }
+
+    short float2HfShort(float val)
+    {
+      int x = (int)roundf(val * 100);
+      if (x > 32766)
+      {
+        x = 32766;
+      }
+      else if (x < -32766)
+      {
+        x = -32766;
+      }
+      return short(x);
+    }
+
+    int seq_increase_num(int previous_num) { return (previous_num >= 59999) ? 0 : previous_num + 1; }
+    int seq_predict_num(int previous_num) { return seq_increase_num(previous_num); }
+    bool seq_compare_nums(int predict_num, int received_num) { return predict_num == received_num; }
+
+    int Deg2Krs(float degree, float trim, int cw)
+    {
+      float x = 7500 + (trim * 29.6296f) + (degree * 29.6296f * cw);
+      if (x > 11500)
+      {
+        return 11500;
+      }
+      if (x < 3500)
+      {
+        return 3500;
+      }
+      return int(x);
+    }
+
+    float Krs2Deg(int krs, float trim, int cw) { return ((krs - 7500 - trim * 29.6296f) * 0.03375f) * cw; }
+
+    void monitor_check_flow(const String &text, bool monitor_flow)
+    {
+      if (monitor_flow)
+      {
+        Serial.print(text);
+      }
+    }
+
+    void monitor_servo_error(const String &lr, int id, bool monitor_servo)
+    {
+      if (monitor_servo)
+      {
+        Serial.print("Found servo err ");
+        Serial.print(lr);
+        Serial.println(id);
+      }
+    }
+
+    void print_esp_hello_start(const String &version, const String &serial_speed, const String &wifi_ap_ssid)
+    {
+      Serial.println();
+      Serial.print("Hi, This is ");
+      Serial.println(version);
+      Serial.print("Set PC-USB ");
+      Serial.print(serial_speed);
+      Serial.println(" bps");
+      Serial.print("WiFi connecting to => ");
+      Serial.println(wifi_ap_ssid);
+    }
+
+    void print_esp_hello_ip(const String &send_ip, const String &local_ip, const String &fixed_ip, bool mode_fixed_ip)
+    {
+      Serial.println("WiFi successfully connected.");
+      Serial.print("PC's IP address target => ");
+      Serial.println(send_ip);
+      Serial.print("ESP32's IP address => ");
+      Serial.println(mode_fixed_ip ? fixed_ip : local_ip);
+    }
+
+    void print_servo_mounts(int idl_mount[], int idr_mount[], int id3_mount[])
+    {
+      (void)id3_mount;
+      Serial.print("Servo mount L: ");
+      for (int i = 0; i < 15; i++)
+      {
+        Serial.print(idl_mount[i]);
+        Serial.print(" ");
+      }
+      Serial.println();
+      Serial.print("Servo mount R: ");
+      for (int i = 0; i < 15; i++)
+      {
+        Serial.print(idr_mount[i]);
+        Serial.print(" ");
+      }
+      Serial.println();
+    }
+
+    void print_controlpad(int mount_pad, int pad_frames)
+    {
+      Serial.print("Pad Receiver mounted : ");
+      Serial.print(mount_pad);
+      Serial.print(", polling every ");
+      Serial.print(pad_frames);
+      Serial.println(" frames");
+    }
+  };
+}
+
+#endif
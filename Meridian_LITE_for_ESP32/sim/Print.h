@@ -0,0 +1,89 @@
+#ifndef __MERIDIAN_SIM_PRINT__
+#define __MERIDIAN_SIM_PRINT__
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "WString.h"
+
+/**
+ * @brief Arduino Print: formatting on top of write().
+ */
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len)
+  {
+    size_t n = 0;
+    while (len--)
+    {
+      n += write(*buf++);
+    }
+    return n;
+  }
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen_(s)) : 0; }
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0)
+    {
+      return 0;
+    }
+    return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+  }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC)
+  {
+    if (base == DEC)
+    {
+      return print(String(v));
+    }
+    return print(String((unsigned long)v, base));
+  }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(long long v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned long long v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(double v, int digits = 2) { return print(String(v, (unsigned int)digits)); }
+
+  size_t println() { return write((const uint8_t *)"\r\n", 2); }
+  template <typename T>
+  size_t println(const T &v)
+  {
+    size_t n = print(v);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(const T &v, int fmt)
+  {
+    size_t n = print(v, fmt);
+    return n + println();
+  }
+
+private:
+  static size_t strlen_(const char *s)
+  {
+    size_t n = 0;
+    while (s[n])
+    {
+      n++;
+    }
+    return n;
+  }
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __MERIDIAN_SIM_SD__
+#define __MERIDIAN_SIM_SD__
+
+#include "FS.h"
+#include "SPI.h"
+
+/**
+ * @brief SD card backed by $MRD_SIM_FS_ROOT/sd.
+ */
+class SDFS : public fs::FS
+{
+public:
+  SDFS();
+  bool begin(uint8_t ss_pin = 5, SPIClass &spi = SPI, uint32_t frequency = 4000000, const char *mountpoint = "/sd", uint8_t max_files = 5);
+  void end() {}
+};
+
+extern SDFS SD;
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __MERIDIAN_SIM_SPI__
+#define __MERIDIAN_SIM_SPI__
+
+#include <cstdint>
+
+#define SPI_MODE0 0x00
+#define MSBFIRST 1
+
+class SPISettings
+{
+public:
+  SPISettings(uint32_t clock = 1000000, uint8_t bit_order = MSBFIRST, uint8_t data_mode = SPI_MODE0) : clock(clock), bit_order(bit_order), data_mode(data_mode) {}
+  uint32_t clock;
+  uint8_t bit_order;
+  uint8_t data_mode;
+};
+
+/**
+ * @brief SPI bus stand-in (sim_spi.cpp).
+ *        Bytes go to the device whose CS pin is low (sim::spi_attach), and the time of each call
+ *        is charged to the virtual clock at the clock of beginTransaction().
+ *        Bytes read above MRD_SIM_SPI_MAX_MHZ may get bit errors (clock tuning).
+ *        Devices modelled above the SPI level (SD card) do not use it.
+ */
+class SPIClass
+{
+public:
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+  void end() {}
+  void beginTransaction(SPISettings settings);
+  void endTransaction();
+  uint8_t transfer(uint8_t data);
+  void transfer(uint8_t *data, uint32_t size);
+  void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size);
+  void writeBytes(const uint8_t *data, uint32_t size);
+  void setFrequency(uint32_t freq) { hz = freq; }
+
+private:
+  uint32_t hz = 1000000;
+};
+
+extern SPIClass SPI;
+
+#endif
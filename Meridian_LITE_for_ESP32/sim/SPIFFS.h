@@ -0,0 +1,25 @@
+#ifndef __MERIDIAN_SIM_SPIFFS__
+#define __MERIDIAN_SIM_SPIFFS__
+
+#include "FS.h"
+
+/**
+ * @brief SPIFFS backed by $MRD_SIM_FS_ROOT/spiffs.
+ */
+class SPIFFSFS : public fs::FS
+{
+public:
+  SPIFFSFS() : fs::FS("spiffs", 0) {}
+  bool begin(bool format_on_fail = false, const char *base_path = "/spiffs", uint8_t max_open_files = 10)
+  {
+    (void)format_on_fail;
+    (void)base_path;
+    (void)max_open_files;
+    return mount();
+  }
+  void end() {}
+};
+
+extern SPIFFSFS SPIFFS;
+
+#endif
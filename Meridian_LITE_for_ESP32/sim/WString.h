@@ -0,0 +1,79 @@
+#ifndef __MERIDIAN_SIM_WSTRING__
+#define __MERIDIAN_SIM_WSTRING__
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+/**
+ * @brief Arduino String on top of std::string (the parts Meridian uses).
+ */
+class String
+{
+public:
+  String(const char *s = "") : str(s ? s : "") {}
+  String(const std::string &s) : str(s) {}
+  explicit String(char c) : str(1, c) {}
+  explicit String(unsigned char v, unsigned char base = 10) : str(to_base(v, base)) {}
+  explicit String(int v, unsigned char base = 10) : str(v < 0 && base == 10 ? "-" + to_base(-(long)v, base) : to_base((unsigned int)v, base)) {}
+  explicit String(unsigned int v, unsigned char base = 10) : str(to_base(v, base)) {}
+  explicit String(long v, unsigned char base = 10) : str(v < 0 && base == 10 ? "-" + to_base(-v, base) : to_base((unsigned long)v, base)) {}
+  explicit String(unsigned long v, unsigned char base = 10) : str(to_base(v, base)) {}
+  explicit String(float v, unsigned int decimals = 2) : str(to_fixed(v, decimals)) {}
+  explicit String(double v, unsigned int decimals = 2) : str(to_fixed(v, decimals)) {}
+
+  const char *c_str() const { return str.c_str(); }
+  unsigned int length() const { return str.length(); }
+  char charAt(unsigned int i) const { return i < str.length() ? str[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+  int indexOf(char c) const { std::string::size_type p = str.find(c); return p == std::string::npos ? -1 : (int)p; }
+  String substring(unsigned int from) const { return from < str.length() ? String(str.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const { return from < to && from < str.length() ? String(str.substr(from, to - from)) : String(); }
+  long toInt() const { return strtol(str.c_str(), NULL, 10); }
+  float toFloat() const { return strtof(str.c_str(), NULL); }
+  bool equals(const String &s) const { return str == s.str; }
+  bool operator==(const String &s) const { return str == s.str; }
+  bool operator!=(const String &s) const { return str != s.str; }
+
+  String &operator+=(const String &s) { str += s.str; return *this; }
+  String &operator+=(const char *s) { str += s; return *this; }
+  String &operator+=(char c) { str += c; return *this; }
+  String &concat(const String &s) { str += s.str; return *this; }
+
+  friend String operator+(const String &a, const String &b) { return String(a.str + b.str); }
+  friend String operator+(const String &a, const char *b) { return String(a.str + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.str); }
+
+private:
+  std::string str;
+
+  static std::string to_base(unsigned long v, unsigned char base)
+  {
+    const char *digits = "0123456789abcdef";
+    if (base < 2 || base > 16)
+    {
+      base = 10;
+    }
+    std::string s;
+    do
+    {
+      s.insert(s.begin(), digits[v % base]);
+      v /= base;
+    } while (v);
+    return s;
+  }
+
+  static std::string to_fixed(double v, unsigned int decimals)
+  {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+    return buf;
+  }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __MERIDIAN_SIM_WIRE__
+#define __MERIDIAN_SIM_WIRE__
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief I2C bus stand-in. Transactions go to the device attached at the address
+ *        (sim::i2c_attach(), e.g. the MPU6050/MPU9250 of sim_mpu.cpp), other addresses NACK.
+ *        Each transaction costs 9 bit times per byte (address included) at the bus clock
+ *        (100 kHz unless set by begin()/setClock(), as on the ESP32 core).
+ *        (The BNO055 stand-in does not go through Wire.)
+ */
+class TwoWire
+{
+public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+  void setClock(uint32_t frequency) { hz = frequency; }
+  void beginTransmission(uint16_t address);
+  uint8_t endTransmission(bool send_stop = true);
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *data, size_t len);
+  uint8_t requestFrom(uint16_t address, uint8_t len, bool send_stop = true);
+  int available() { return rx_len - rx_pos; }
+  int read() { return (rx_pos < rx_len) ? rx_buf[rx_pos++] : -1; }
+
+private:
+  uint32_t hz = 100000;
+  uint16_t tx_addr = 0;
+  uint8_t tx_buf[128];
+  int tx_len = 0;
+  uint8_t rx_buf[128];
+  int rx_len = 0;
+  int rx_pos = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
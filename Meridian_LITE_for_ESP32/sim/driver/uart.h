@@ -0,0 +1,25 @@
+#ifndef __MERIDIAN_SIM_DRIVER_UART__
+#define __MERIDIAN_SIM_DRIVER_UART__
+
+#include <Arduino.h>
+
+typedef enum
+{
+  UART_NUM_0 = 0,
+  UART_NUM_1 = 1,
+  UART_NUM_2 = 2,
+} uart_port_t;
+
+typedef enum
+{
+  UART_PARITY_DISABLE = 0x0,
+  UART_PARITY_EVEN = 0x2,
+  UART_PARITY_ODD = 0x3,
+} uart_parity_t;
+
+/**
+ * @brief Change the parity of Serial/Serial1/Serial2 (same bits as the SERIAL_8x1 configs).
+ */
+esp_err_t uart_set_parity(uart_port_t uart_num, uart_parity_t parity_mode);
+
+#endif
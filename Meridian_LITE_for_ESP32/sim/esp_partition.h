@@ -0,0 +1,66 @@
+#ifndef __MERIDIAN_SIM_ESP_PARTITION__
+#define __MERIDIAN_SIM_ESP_PARTITION__
+
+#include <Arduino.h>
+
+/*
+  フラッシュのパーティションの代替. data パーティションを $MRD_SIM_FS_ROOT/partition/<label>.bin で表す.
+  ファイルの大きさは MRD_SIM_PARTITION_KB (既定512, partitions_meridian.csv の motion と同じ).
+  書き込みはNORフラッシュと同じく1→0にしか変えられず(消去で0xFFに戻す), 消去と書き込みの時間を仮想時計に加える.
+  esp_partition_mmap はファイルをそのままメモリに割り当てるので, 割り当て中の書き込みも見える.
+*/
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum
+{
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum
+{
+  ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+  ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef enum
+{
+  SPI_FLASH_MMAP_DATA,
+  SPI_FLASH_MMAP_INST,
+} spi_flash_mmap_memory_t;
+
+typedef uint32_t spi_flash_mmap_handle_t;
+
+typedef struct
+{
+  void *flash_chip;
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+/**
+ * @brief Find a data partition by label (MRD_SIM_PARTITION=0: none).
+ */
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+
+/**
+ * @brief Erase whole sectors (offset and size aligned to SPI_FLASH_SEC_SIZE).
+ */
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size, spi_flash_mmap_memory_t memory,
+                             const void **out_ptr, spi_flash_mmap_handle_t *out_handle);
+void spi_flash_munmap(spi_flash_mmap_handle_t handle);
+
+#endif
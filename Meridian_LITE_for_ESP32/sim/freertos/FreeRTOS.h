@@ -0,0 +1,26 @@
+#ifndef __MERIDIAN_SIM_FREERTOS__
+#define __MERIDIAN_SIM_FREERTOS__
+
+#include <cstdint>
+
+/* ESP32のFreeRTOSのうちMeridianで使う部分だけをstd::threadで置き換える */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef struct SimTask *TaskHandle_t;
+typedef struct SimSemaphore *SemaphoreHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFF
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#include "task.h"
+#include "semphr.h"
+
+#endif
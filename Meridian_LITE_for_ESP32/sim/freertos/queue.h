@@ -0,0 +1,6 @@
+#ifndef __MERIDIAN_SIM_FREERTOS_QUEUE__
+#define __MERIDIAN_SIM_FREERTOS_QUEUE__
+
+#include "FreeRTOS.h"
+
+#endif
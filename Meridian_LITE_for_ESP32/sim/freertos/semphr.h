@@ -0,0 +1,10 @@
+#ifndef __MERIDIAN_SIM_FREERTOS_SEMPHR__
+#define __MERIDIAN_SIM_FREERTOS_SEMPHR__
+
+#include "FreeRTOS.h"
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef __MERIDIAN_SIM_FREERTOS_TASK__
+#define __MERIDIAN_SIM_FREERTOS_TASK__
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * @brief Start fn on a new host thread. Core and priority are ignored.
+ */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle);
+
+/**
+ * @brief End the calling task (task == NULL only).
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *prev_wake, TickType_t period);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xPortGetCoreID();
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+void xTaskNotifyGive(TaskHandle_t task);
+
+#endif
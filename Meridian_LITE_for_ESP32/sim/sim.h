@@ -0,0 +1,172 @@
+#ifndef __MERIDIAN_SIM__
+#define __MERIDIAN_SIM__
+
+#include <cstdint>
+
+/*
+  PC上でmain.cppを動かすためのシミュレーション環境の共通関数.
+  時計は仮想時計で, delay()やデバイスの通信時間のモデルでのみ進む(MRD_SIM_CLOCK=real で実時間).
+  setup()/loop()を呼ぶスレッドを「ループスレッド」と呼び, 仮想時計はこのスレッドが進める.
+  タスク(別コア相当)のスレッドは仮想時計を進めず, 必要な時刻まで待つ.
+*/
+namespace sim
+{
+  /**
+   * @brief Current virtual time (us since start).
+   */
+  uint64_t now_us();
+
+  /**
+   * @brief Spend time talking to a device.
+   *        Advances the clock on the loop thread, waits for it on task threads.
+   */
+  void busy_us(uint64_t us);
+
+  /**
+   * @brief Spend time doing nothing (delay()). Counted as idle time on the loop thread.
+   */
+  void idle_us(uint64_t us);
+
+  /**
+   * @brief Block the calling task thread until the virtual clock reaches t_us.
+   */
+  void wait_until_us(uint64_t t_us);
+
+  /**
+   * @brief Bracket a blocking wait of the loop thread on a task (e.g. a mutex).
+   *        While the loop thread is blocked, task threads advance the clock themselves,
+   *        so the loop thread is charged for the time the task held the resource.
+   */
+  void loop_block_begin();
+  void loop_block_end();
+
+  /**
+   * @brief Small clock step taken by every micros()/millis() call on the loop thread,
+   *        so that busy-wait loops terminate. Counted as idle time.
+   */
+  void spin_step();
+
+  /**
+   * @brief Total idle time of the loop thread (us).
+   */
+  uint64_t idle_total_us();
+
+  /**
+   * @brief Mark the calling thread as the loop thread.
+   */
+  void set_loop_thread();
+
+  bool is_loop_thread();
+
+  /**
+   * @brief true if the clock follows the host clock (MRD_SIM_CLOCK=real).
+   */
+  bool realtime();
+
+  /**
+   * @brief Read a numeric/string setting from the environment.
+   */
+  long env_long(const char *name, long def);
+  const char *env_str(const char *name, const char *def);
+
+  /**
+   * @brief Time to move n bytes over a UART (10 bits per byte).
+   */
+  inline uint64_t uart_us(uint32_t bytes, uint32_t baud)
+  {
+    return baud ? ((uint64_t)bytes * 10 * 1000000 + baud - 1) / baud : 0;
+  }
+
+  /**
+   * @brief busy_us() in ns. The fraction below 1us is carried over to the next call of the thread
+   *        (dropped by spin_step(), so frames stay aligned to whole us after a busy wait).
+   */
+  void busy_ns(uint64_t ns);
+
+  /**
+   * @brief A device on the SPI bus, selected by its CS pin (sim_spi.cpp).
+   */
+  class SpiDevice
+  {
+  public:
+    virtual ~SpiDevice() {}
+    virtual void select() = 0;
+    virtual uint8_t transfer(uint8_t mosi) = 0;
+    /**
+     * @brief CS went high. frame_ns is the SPI time of the frame including the transaction overhead.
+     */
+    virtual void deselect(uint64_t frame_ns) = 0;
+  };
+
+  /**
+   * @brief Put a device on the SPI bus at cs_pin.
+   */
+  void spi_attach(uint8_t cs_pin, SpiDevice *dev);
+
+  /**
+   * @brief digitalWrite() hook: selects/deselects the device on the pin.
+   */
+  void spi_cs(uint8_t pin, uint8_t val);
+
+  /**
+   * @brief SPI time (ns) of frames CS frames, each in its own transaction, made of calls
+   *        transfer calls moving bytes bytes in total at hz. Same model as SPIClass.
+   */
+  uint64_t spi_ns(uint32_t frames, uint32_t calls, uint32_t bytes, uint32_t hz);
+
+  /**
+   * @brief A device on the I2C bus, selected by its 7-bit address (sim_wire.cpp).
+   */
+  class I2cDevice
+  {
+  public:
+    virtual ~I2cDevice() {}
+    /**
+     * @brief Bytes of a write transaction (register address first). false to NACK the address.
+     */
+    virtual bool write(const uint8_t *data, int len) = 0;
+    /**
+     * @brief Fill a read transaction. Returns the number of bytes sent, 0 to NACK the address.
+     */
+    virtual int read(uint8_t *buf, int len) = 0;
+  };
+
+  /**
+   * @brief Put a device on the I2C bus at address.
+   */
+  void i2c_attach(uint8_t address, I2cDevice *dev);
+
+  /**
+   * @brief Host UDP socket bound to port + MRD_SIM_UDP_PORT_OFFSET, -1 on failure.
+   */
+  int net_open(uint16_t port);
+  void net_close(int sock);
+
+  /**
+   * @brief Next datagram from the host socket or from the built-in PC (MRD_SIM_PC_HZ).
+   *
+   * @return Size, 0 if none. ip is in network byte order.
+   */
+  int net_recv(int sock, uint8_t *buf, int cap, uint32_t *ip, uint16_t *port);
+
+  /**
+   * @brief Send a datagram to MRD_SIM_PEER:port.
+   */
+  bool net_send(int sock, uint16_t port, const uint8_t *buf, int len);
+
+  /**
+   * @brief Account W5500 SPI time for the exit report.
+   *
+   * @param[in] kind 0:send, 1:receive, 2:poll without a packet.
+   * @param[in] frames CS frames of the call.
+   * @param[in] packet true on the call that completes a packet.
+   */
+  void net_spi(int kind, uint32_t frames, uint64_t ns, bool packet);
+
+  /**
+   * @brief Print the W5500 SPI time and frames per packet (called at exit).
+   */
+  void net_report();
+}
+
+#endif
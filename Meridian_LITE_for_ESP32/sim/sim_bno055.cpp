@@ -0,0 +1,155 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_bno055.cpp
+ * @brief   Trace-driven BNO055 stand-in.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Adafruit_BNO055.h>
+
+#include "sim.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#define BNO_TRACE_COLS 13
+
+namespace
+{
+  struct Sample
+  {
+    double v[BNO_TRACE_COLS]; // t_ms, 加速度, ジャイロ, 地磁気, オイラー角
+  };
+
+  std::vector<Sample> trace;
+
+  void load_trace()
+  {
+    static bool loaded = false;
+    if (loaded)
+    {
+      return;
+    }
+    loaded = true;
+    const char *path = getenv("MRD_SIM_BNO_TRACE");
+    if (path == NULL)
+    {
+      return;
+    }
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+      Serial.printf("[sim] BNO055 trace %s not found.\n", path);
+      return;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+      if (line[0] == '#')
+      {
+        continue;
+      }
+      Sample s;
+      char *p = line;
+      int n = 0;
+      for (; n < BNO_TRACE_COLS; n++)
+      {
+        char *end;
+        s.v[n] = strtod(p, &end);
+        if (end == p)
+        {
+          break;
+        }
+        p = end;
+        while ((*p == ',') or (*p == ' ') or (*p == '\t'))
+        {
+          p++;
+        }
+      }
+      if (n == BNO_TRACE_COLS)
+      {
+        trace.push_back(s);
+      }
+    }
+    fclose(fp);
+  }
+
+  // 仮想時刻に対応する行(繰り返し再生)
+  const Sample *current()
+  {
+    load_trace();
+    if (trace.empty())
+    {
+      return NULL;
+    }
+    double span = trace.back().v[0] + 1;
+    double t = fmod(sim::now_us() / 1000.0, span);
+    std::vector<Sample>::const_iterator it = std::upper_bound(trace.begin(), trace.end(), t, [](double t_ms, const Sample &s) { return t_ms < s.v[0]; });
+    return (it == trace.begin()) ? &trace[0] : &*(it - 1);
+  }
+}
+
+Adafruit_BNO055::Adafruit_BNO055(int32_t sensor_id, uint8_t address, TwoWire *wire)
+{
+  (void)sensor_id;
+  (void)address;
+  (void)wire;
+}
+
+bool Adafruit_BNO055::begin(adafruit_bno055_opmode_t mode)
+{
+  (void)mode;
+  load_trace();
+  return sim::env_long("MRD_SIM_BNO", 1) != 0; // MRD_SIM_BNO=0でセンサーなし
+}
+
+imu::Vector<3> Adafruit_BNO055::getVector(adafruit_vector_type_t type)
+{
+  sim::busy_us(200); // 6byteのI2C読み出し(400kHz)
+  const Sample *s = current();
+  int col;
+  switch (type)
+  {
+  case VECTOR_ACCELEROMETER:
+  case VECTOR_GRAVITY:
+    col = 1;
+    break;
+  case VECTOR_GYROSCOPE:
+    col = 4;
+    break;
+  case VECTOR_MAGNETOMETER:
+    col = 7;
+    break;
+  case VECTOR_EULER:
+    col = 10;
+    break;
+  default:
+    return imu::Vector<3>();
+  }
+  if (s == NULL) // トレースなし: 水平に静止
+  {
+    return (col == 1) ? imu::Vector<3>(0, 0, 9.8) : imu::Vector<3>();
+  }
+  return imu::Vector<3>(s->v[col], s->v[col + 1], s->v[col + 2]);
+}
+
+imu::Quaternion Adafruit_BNO055::getQuat()
+{
+  imu::Vector<3> e = getVector(VECTOR_EULER);
+  double h = e.x() * DEG_TO_RAD / 2;
+  double r = e.y() * DEG_TO_RAD / 2;
+  double p = e.z() * DEG_TO_RAD / 2;
+  return imu::Quaternion(cos(r) * cos(p) * cos(h) + sin(r) * sin(p) * sin(h),
+                         sin(r) * cos(p) * cos(h) - cos(r) * sin(p) * sin(h),
+                         cos(r) * sin(p) * cos(h) + sin(r) * cos(p) * sin(h),
+                         cos(r) * cos(p) * sin(h) - sin(r) * sin(p) * cos(h));
+}
+
+void Adafruit_BNO055::getCalibration(uint8_t *sys, uint8_t *gyro, uint8_t *accel, uint8_t *mag)
+{
+  *sys = 3;
+  *gyro = 3;
+  *accel = 3;
+  *mag = 3;
+}
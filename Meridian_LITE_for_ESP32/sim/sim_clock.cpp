@@ -0,0 +1,188 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_clock.cpp
+ * @brief   Virtual clock for the native simulation.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "sim.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+  std::atomic<uint64_t> clock_us(0);   // 仮想時刻
+  std::atomic<uint64_t> idle_us_sum(0); // ループスレッドの待ち時間の合計
+  std::mutex clock_mtx;
+  std::condition_variable clock_cv;
+  std::atomic<int> waiters(0);
+  std::atomic<int> loop_blocked(0); // ループスレッドがタスクを待っている
+  thread_local bool loop_thread = false;
+  thread_local uint64_t carry_ns = 0; // busy_ns()の1us未満の端数
+
+  int clock_mode()
+  {
+    static int mode = -1; // 0:仮想, 1:実時間
+    if (mode < 0)
+    {
+      const char *s = getenv("MRD_SIM_CLOCK");
+      mode = (s and (strcmp(s, "real") == 0)) ? 1 : 0;
+    }
+    return mode;
+  }
+
+  uint64_t host_us()
+  {
+    static const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+  void advance(uint64_t us)
+  {
+    clock_us += us;
+    if (waiters.load() > 0)
+    {
+      std::lock_guard<std::mutex> lock(clock_mtx);
+      clock_cv.notify_all();
+    }
+  }
+}
+
+namespace sim
+{
+  bool realtime()
+  {
+    return clock_mode() == 1;
+  }
+
+  uint64_t now_us()
+  {
+    return realtime() ? host_us() : clock_us.load();
+  }
+
+  void busy_us(uint64_t us)
+  {
+    if (realtime())
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+    else if (loop_thread)
+    {
+      advance(us);
+    }
+    else
+    {
+      wait_until_us(now_us() + us);
+    }
+  }
+
+  void busy_ns(uint64_t ns)
+  {
+    carry_ns += ns;
+    busy_us(carry_ns / 1000);
+    carry_ns %= 1000;
+  }
+
+  void idle_us(uint64_t us)
+  {
+    if (loop_thread)
+    {
+      idle_us_sum += us;
+    }
+    busy_us(us);
+  }
+
+  void wait_until_us(uint64_t t_us)
+  {
+    if (realtime())
+    {
+      uint64_t now = host_us();
+      if (t_us > now)
+      {
+        std::this_thread::sleep_for(std::chrono::microseconds(t_us - now));
+      }
+      return;
+    }
+    if (loop_thread) // ループスレッドは自分で時計を進める
+    {
+      uint64_t now = clock_us.load();
+      if (t_us > now)
+      {
+        advance(t_us - now);
+      }
+      return;
+    }
+    std::unique_lock<std::mutex> lock(clock_mtx);
+    waiters++;
+    clock_cv.wait(lock, [t_us] { return (clock_us.load() >= t_us) or (loop_blocked.load() > 0); });
+    waiters--;
+    lock.unlock();
+    // ループスレッドがこのタスクを待っている間は, タスク側が時計を進める
+    uint64_t now = clock_us.load();
+    if (t_us > now)
+    {
+      advance(t_us - now);
+    }
+  }
+
+  void loop_block_begin()
+  {
+    if (loop_thread)
+    {
+      std::lock_guard<std::mutex> lock(clock_mtx);
+      loop_blocked++;
+      clock_cv.notify_all();
+    }
+  }
+
+  void loop_block_end()
+  {
+    if (loop_thread)
+    {
+      loop_blocked--;
+    }
+  }
+
+  void spin_step()
+  {
+    if (loop_thread and !realtime())
+    {
+      carry_ns = 0; // 待っている間に端数は吸収される(待ちの後の処理の時刻がフレームごとに揃う)
+      idle_us_sum += 1;
+      advance(1);
+    }
+  }
+
+  uint64_t idle_total_us()
+  {
+    return idle_us_sum.load();
+  }
+
+  void set_loop_thread()
+  {
+    loop_thread = true;
+  }
+
+  bool is_loop_thread()
+  {
+    return loop_thread;
+  }
+
+  long env_long(const char *name, long def)
+  {
+    const char *s = getenv(name);
+    return (s and *s) ? strtol(s, NULL, 0) : def;
+  }
+
+  const char *env_str(const char *name, const char *def)
+  {
+    const char *s = getenv(name);
+    return (s and *s) ? s : def;
+  }
+}
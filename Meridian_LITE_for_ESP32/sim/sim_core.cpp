@@ -0,0 +1,301 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_core.cpp
+ * @brief   Arduino core stand-ins (time, GPIO, Serial, ESP) for the native simulation.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <driver/uart.h>
+
+#include "sim.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+EspClass ESP;
+
+namespace
+{
+  std::mutex stdout_mtx;
+  uint8_t pin_state[64] = {0};
+
+  /*
+    MRD_SIM_SERIAL_PTY: Serialを擬似端末にする. PC側のプログラムはリンク先の端末を開く.
+    送信はUARTのFIFO(128byte)がボーレートで空いていくモデルで, 書いたバイトはすぐ端末に出す.
+    端末を開いているプログラムが無く書けない分は捨てる(USBシリアル変換ICと同じ).
+  */
+  const int uart_fifo = 128;
+
+  struct SimPty
+  {
+    int fd = -1;
+    uint64_t tx_done_ns = 0; // FIFOが空になる時刻
+    uint8_t rx[4096];        // 端末から読んだバイト
+    int rx_head = 0;
+    int rx_tail = 0;
+
+    SimPty()
+    {
+      const char *link = sim::env_str("MRD_SIM_SERIAL_PTY", "");
+      if (link[0] == '\0')
+      {
+        return;
+      }
+      fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+      if ((fd < 0) or (grantpt(fd) != 0) or (unlockpt(fd) != 0))
+      {
+        perror("posix_openpt");
+        exit(1);
+      }
+      const char *name = ptsname(fd);
+      int slave = open(name, O_RDWR | O_NOCTTY); // 端末を生(raw)にして, 開いたままにする(エコーを止めるため)
+      termios tio;
+      if ((slave < 0) or (tcgetattr(slave, &tio) != 0))
+      {
+        perror(name);
+        exit(1);
+      }
+      cfmakeraw(&tio);
+      tcsetattr(slave, TCSANOW, &tio);
+      unlink(link);
+      if (symlink(name, link) != 0)
+      {
+        perror(link);
+        exit(1);
+      }
+      fprintf(stderr, "[sim] serial pty: %s -> %s\n", link, name);
+    }
+
+    int fifo_level(unsigned long baud) const
+    {
+      uint64_t now = sim::now_us() * 1000;
+      return (tx_done_ns > now) ? (int)(((tx_done_ns - now) * baud + 9999999999ULL) / 10000000000ULL) : 0;
+    }
+
+    void fill()
+    {
+      if (rx_head == rx_tail)
+      {
+        rx_head = 0;
+        rx_tail = 0;
+      }
+      if (rx_tail < (int)sizeof(rx))
+      {
+        ssize_t n = ::read(fd, rx + rx_tail, sizeof(rx) - rx_tail);
+        rx_tail += (n > 0) ? (int)n : 0;
+      }
+    }
+  };
+
+  SimPty &pty()
+  {
+    static SimPty p;
+    return p;
+  }
+}
+
+unsigned long millis()
+{
+  sim::spin_step();
+  return (uint32_t)(sim::now_us() / 1000);
+}
+
+unsigned long micros()
+{
+  sim::spin_step();
+  return (uint32_t)sim::now_us();
+}
+
+void delay(uint32_t ms)
+{
+  // ESP32のdelay()はvTaskDelay()なので, msティック後のティック境界で戻る
+  uint64_t now = sim::now_us();
+  sim::idle_us((now / 1000 + ms) * 1000 - now);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  sim::busy_us(us); // ESP32ではビジーウェイトのため処理時間として扱う
+}
+
+void yield()
+{
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  if (pin < sizeof(pin_state))
+  {
+    pin_state[pin] = val;
+  }
+  sim::spi_cs(pin, val); // SPIデバイスのCSピンなら選択/解除
+}
+
+int digitalRead(uint8_t pin)
+{
+  return (pin < sizeof(pin_state)) ? pin_state[pin] : LOW;
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+  (void)pin;
+  return (uint16_t)(rand() & 0x0FFF); // 未接続ピンのノイズ相当
+}
+
+void randomSeed(unsigned long seed)
+{
+  if (seed != 0)
+  {
+    srand((unsigned int)seed);
+  }
+}
+
+long random(long howbig)
+{
+  return (howbig <= 0) ? 0 : rand() % howbig;
+}
+
+long random(long howsmall, long howbig)
+{
+  return (howsmall >= howbig) ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+  const uint8_t base[6] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x00};
+  memcpy(mac, base, 6);
+  mac[5] = (uint8_t)type;
+  return ESP_OK;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+  // 計算時間の計測に使われるため仮想時計ではなくホストの時計で数える.
+  // ループスレッドではデバイスとの通信(サーボのUARTなど)で進めた仮想時間を足す(実機ではその間もカウントが進む)
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  if (sim::is_loop_thread() and !sim::realtime())
+  {
+    ns += (sim::now_us() - sim::idle_total_us()) * 1000;
+  }
+  return (uint32_t)(ns * 240 / 1000);
+}
+
+void EspClass::restart()
+{
+  fflush(stdout);
+  _Exit(0);
+}
+
+void HardwareSerial::begin(unsigned long baud_rate, uint32_t config_bits, int8_t rx_pin, int8_t tx_pin, bool invert, unsigned long timeout_ms)
+{
+  (void)rx_pin;
+  (void)tx_pin;
+  (void)invert;
+  (void)timeout_ms;
+  baud = baud_rate;
+  config = config_bits;
+  begins++;
+}
+
+esp_err_t uart_set_parity(uart_port_t uart_num, uart_parity_t parity_mode)
+{
+  HardwareSerial *ports[3] = {&Serial, &Serial1, &Serial2};
+  if ((uart_num < 0) or (uart_num > 2))
+  {
+    return ESP_FAIL;
+  }
+  ports[uart_num]->set_parity((uint32_t)parity_mode);
+  return ESP_OK;
+}
+
+int HardwareSerial::available()
+{
+  if ((uart != 0) or (pty().fd < 0))
+  {
+    return 0;
+  }
+  pty().fill();
+  return pty().rx_tail - pty().rx_head;
+}
+
+int HardwareSerial::read()
+{
+  int c = peek();
+  pty().rx_head += (c >= 0) ? 1 : 0;
+  return c;
+}
+
+int HardwareSerial::peek()
+{
+  return (available() > 0) ? pty().rx[pty().rx_head] : -1;
+}
+
+int HardwareSerial::availableForWrite()
+{
+  return ((uart == 0) and (pty().fd >= 0)) ? uart_fifo - pty().fifo_level(baud) : uart_fifo;
+}
+
+void HardwareSerial::flush()
+{
+  if (uart == 0)
+  {
+    std::lock_guard<std::mutex> lock(stdout_mtx);
+    fflush(stdout);
+  }
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len)
+{
+  if (uart != 0) // サーボ用UARTの通信時間はサーボのモデル側で計上する
+  {
+    return len;
+  }
+  SimPty &p = pty();
+  if (p.fd >= 0)
+  {
+    uint64_t byte_ns = 10000000000ULL / baud;
+    for (size_t i = 0; i < len; i++)
+    {
+      if (p.fifo_level(baud) >= uart_fifo) // FIFOが一杯なら1byte分空くまで待つ
+      {
+        sim::busy_ns(p.tx_done_ns - sim::now_us() * 1000 - (uart_fifo - 1) * byte_ns);
+      }
+      p.tx_done_ns = std::max(p.tx_done_ns, sim::now_us() * 1000) + byte_ns;
+    }
+    ssize_t n = ::write(p.fd, buf, len); // 読む側がいなければ捨てる
+    (void)n;
+    return len;
+  }
+  static const bool quiet = sim::env_long("MRD_SIM_QUIET", 0) != 0; // シリアル表示を捨てる
+  if (quiet)
+  {
+    return len;
+  }
+  std::lock_guard<std::mutex> lock(stdout_mtx);
+  return fwrite(buf, 1, len, stdout);
+}
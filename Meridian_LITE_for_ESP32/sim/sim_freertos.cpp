@@ -0,0 +1,222 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_freertos.cpp
+ * @brief   FreeRTOS task, notification and mutex stand-ins on std::thread.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "sim.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct SimTask
+{
+  std::mutex mtx;
+  std::condition_variable cv;
+  uint32_t notify = 0; // 通知カウンタ
+};
+
+struct SimSemaphore
+{
+  // FreeRTOSと同じく, 返されたミューテックスは待っているタスクに順に渡す
+  // (std::mutexのままだと, 返したスレッドがすぐに取り直して待っている側が仮想時間で長く止まる)
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool held = false;
+  std::deque<uint64_t> waiting; // 待っている順の受付番号
+  uint64_t next_ticket = 0;
+};
+
+namespace
+{
+  thread_local SimTask *current_task = NULL;
+
+  struct TaskExit // vTaskDelete(NULL)でスレッドを抜けるための例外
+  {
+  };
+
+  SimTask *self_task()
+  {
+    if (current_task == NULL) // ループスレッドなどタスク以外から呼ばれた場合
+    {
+      current_task = new SimTask();
+    }
+    return current_task;
+  }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  (void)name;
+  (void)stack;
+  (void)priority;
+  (void)core;
+  SimTask *task = new SimTask();
+  if (handle)
+  {
+    *handle = task;
+  }
+  std::thread([fn, arg, task]() {
+    current_task = task;
+    try
+    {
+      fn(arg);
+    }
+    catch (TaskExit &)
+    {
+    }
+  }).detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+  return xTaskCreatePinnedToCore(fn, name, stack, arg, priority, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  if ((task == NULL) or (task == current_task))
+  {
+    throw TaskExit();
+  }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  // ticksティック後のティック境界まで待つ
+  const uint64_t tick_us = portTICK_PERIOD_MS * 1000;
+  uint64_t now = sim::now_us();
+  sim::idle_us((now / tick_us + ticks) * tick_us - now);
+}
+
+void vTaskDelayUntil(TickType_t *prev_wake, TickType_t period)
+{
+  *prev_wake += period;
+  sim::wait_until_us((uint64_t)*prev_wake * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount()
+{
+  return (TickType_t)(sim::now_us() / (portTICK_PERIOD_MS * 1000));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return self_task();
+}
+
+BaseType_t xPortGetCoreID()
+{
+  return sim::is_loop_thread() ? 1 : 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+  // タイムアウトは実時間で扱う(通知が来ない場合の保険としてのみ使われるため)
+  SimTask *task = self_task();
+  std::unique_lock<std::mutex> lock(task->mtx);
+  if (ticks == portMAX_DELAY)
+  {
+    task->cv.wait(lock, [task] { return task->notify > 0; });
+  }
+  else
+  {
+    task->cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), [task] { return task->notify > 0; });
+  }
+  uint32_t n = task->notify;
+  if (n > 0)
+  {
+    task->notify = clear_on_exit ? 0 : n - 1;
+  }
+  return n;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+  if (task == NULL)
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(task->mtx);
+    task->notify++;
+  }
+  task->cv.notify_all();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return new SimSemaphore();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+  if (sem == NULL)
+  {
+    return pdFALSE;
+  }
+  std::unique_lock<std::mutex> lock(sem->mtx);
+  if (!sem->held and sem->waiting.empty())
+  {
+    sem->held = true;
+    return pdTRUE;
+  }
+  if (ticks == 0)
+  {
+    return pdFALSE;
+  }
+  uint64_t ticket = sem->next_ticket++;
+  sem->waiting.push_back(ticket);
+  lock.unlock();
+  sim::loop_block_begin(); // 保持しているタスクの処理時間をループスレッドに計上する
+  lock.lock();
+  auto turn = [sem, ticket] { return !sem->held and (sem->waiting.front() == ticket); };
+  bool ok = true;
+  if (ticks == portMAX_DELAY)
+  {
+    sem->cv.wait(lock, turn);
+  }
+  else
+  {
+    ok = sem->cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), turn);
+  }
+  for (auto it = sem->waiting.begin(); it != sem->waiting.end(); ++it)
+  {
+    if (*it == ticket)
+    {
+      sem->waiting.erase(it);
+      break;
+    }
+  }
+  if (ok)
+  {
+    sem->held = true;
+  }
+  else
+  {
+    sem->cv.notify_all(); // 先頭が抜けたので次の番の待ちを起こす
+  }
+  lock.unlock();
+  sim::loop_block_end();
+  return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  if (sem == NULL)
+  {
+    return pdFALSE;
+  }
+  {
+    std::lock_guard<std::mutex> lock(sem->mtx);
+    sem->held = false;
+  }
+  sem->cv.notify_all();
+  return pdTRUE;
+}
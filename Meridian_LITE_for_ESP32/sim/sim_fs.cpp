@@ -0,0 +1,195 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_fs.cpp
+ * @brief   File-backed SD/SPIFFS.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <SD.h>
+#include <SPIFFS.h>
+
+#include "sim.h"
+
+#include <cerrno>
+#include <sys/stat.h>
+
+SDFS SD;
+SPIFFSFS SPIFFS;
+
+namespace
+{
+  bool mkdir_p(const std::string &dir)
+  {
+    std::string cur;
+    for (size_t i = 0; i <= dir.size(); i++)
+    {
+      if ((i == dir.size()) or (dir[i] == '/'))
+      {
+        if (!cur.empty() and (::mkdir(cur.c_str(), 0755) != 0) and (errno != EEXIST))
+        {
+          return false;
+        }
+      }
+      if (i < dir.size())
+      {
+        cur += dir[i];
+      }
+    }
+    return true;
+  }
+}
+
+/* SDカード: 転送時間と, 書き込み時にまれに起きる長い待ち(ウェアレベリング等)をモデル化 */
+SDFS::SDFS()
+    : fs::FS("sd", (int)sim::env_long("MRD_SIM_SD_US_PER_KB", 500), (int)sim::env_long("MRD_SIM_SD_STALL_EVERY", 0), (int)sim::env_long("MRD_SIM_SD_STALL_US", 0))
+{
+}
+
+bool SDFS::begin(uint8_t ss_pin, SPIClass &spi, uint32_t frequency, const char *mountpoint, uint8_t max_files)
+{
+  (void)ss_pin;
+  (void)spi;
+  (void)frequency;
+  (void)mountpoint;
+  (void)max_files;
+  return sim::env_long("MRD_SIM_SD", 1) and mount(); // MRD_SIM_SD=0でカードなし
+}
+
+namespace fs
+{
+  File::File(FILE *fp, const std::string &path, int us_per_kb, int stall_every, int stall_us, const std::shared_ptr<int> &write_count)
+      : fp(fp, fclose), path(path), us_per_kb(us_per_kb), stall_every(stall_every), stall_us(stall_us), write_count(write_count)
+  {
+  }
+
+  size_t File::write(const uint8_t *buf, size_t len)
+  {
+    if (!fp)
+    {
+      return 0;
+    }
+    sim::busy_us((uint64_t)len * us_per_kb / 1024);
+    if ((stall_every > 0) and write_count and ((++*write_count % stall_every) == 0))
+    {
+      sim::busy_us(stall_us);
+    }
+    return fwrite(buf, 1, len, fp.get());
+  }
+
+  size_t File::read(uint8_t *buf, size_t len)
+  {
+    if (!fp)
+    {
+      return 0;
+    }
+    sim::busy_us((uint64_t)len * us_per_kb / 1024);
+    return fread(buf, 1, len, fp.get());
+  }
+
+  int File::read()
+  {
+    uint8_t c;
+    return (read(&c, 1) == 1) ? c : -1;
+  }
+
+  int File::peek()
+  {
+    if (!fp)
+    {
+      return -1;
+    }
+    int c = fgetc(fp.get());
+    if (c != EOF)
+    {
+      ungetc(c, fp.get());
+    }
+    return (c == EOF) ? -1 : c;
+  }
+
+  int File::available()
+  {
+    return fp ? (int)(size() - position()) : 0;
+  }
+
+  bool File::seek(uint32_t pos, SeekMode mode)
+  {
+    return fp and (fseek(fp.get(), pos, (mode == SeekSet) ? SEEK_SET : (mode == SeekCur) ? SEEK_CUR : SEEK_END) == 0);
+  }
+
+  size_t File::position() const
+  {
+    return fp ? (size_t)ftell(fp.get()) : 0;
+  }
+
+  size_t File::size() const
+  {
+    if (!fp)
+    {
+      return 0;
+    }
+    long pos = ftell(fp.get());
+    fseek(fp.get(), 0, SEEK_END);
+    long end = ftell(fp.get());
+    fseek(fp.get(), pos, SEEK_SET);
+    return (size_t)end;
+  }
+
+  void File::flush()
+  {
+    if (fp)
+    {
+      fflush(fp.get());
+    }
+  }
+
+  void File::close()
+  {
+    fp.reset();
+  }
+
+  bool FS::mount()
+  {
+    root = std::string(sim::env_str("MRD_SIM_FS_ROOT", "sim_fs")) + "/" + sub;
+    return mkdir_p(root);
+  }
+
+  std::string FS::host_path(const char *path) const
+  {
+    return root + ((path[0] == '/') ? "" : "/") + path;
+  }
+
+  File FS::open(const char *path, const char *mode)
+  {
+    if (root.empty())
+    {
+      return File();
+    }
+    std::string mode_str = mode;
+    if (mode_str.find('b') == std::string::npos)
+    {
+      mode_str += "b";
+    }
+    FILE *fp = fopen(host_path(path).c_str(), mode_str.c_str());
+    if (fp == NULL)
+    {
+      return File();
+    }
+    return File(fp, path, us_per_kb, stall_every, stall_us, write_count);
+  }
+
+  bool FS::exists(const char *path)
+  {
+    struct stat st;
+    return !root.empty() and (stat(host_path(path).c_str(), &st) == 0);
+  }
+
+  bool FS::remove(const char *path)
+  {
+    return !root.empty() and (::remove(host_path(path).c_str()) == 0);
+  }
+
+  bool FS::mkdir(const char *path)
+  {
+    return !root.empty() and mkdir_p(host_path(path));
+  }
+}
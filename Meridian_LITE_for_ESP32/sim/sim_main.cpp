@@ -0,0 +1,173 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_main.cpp
+ * @brief   Entry point of the native simulation: runs the unmodified setup()/loop().
+ *
+ *   .pio/build/native/program [--frames N] [--budget-us US]
+ *   .pio/build/native/program --bench
+ *
+ * Prints the loop() timing on the virtual clock when done:
+ *   work   = time spent in loop() minus delay()/busy-wait time (the frame budget used)
+ *   period = full loop() time including the wait for the next frame
+ * With --budget-us the exit code is 1 if the 99th percentile of work exceeds it (for CI).
+ * --bench runs run_bench() after setup() instead of the loop, prints the JSON report
+ * (host CPU time) and exits with 1 if a stage is over its budget.
+ * Under `pio test -e native` (PIO_UNIT_TESTING) this main() is left out; the tests in test/
+ * call sim::set_loop_thread() and setup() themselves.
+ *
+ * Environment (all optional):
+ *   MRD_SIM_CLOCK=real          follow the host clock instead of the virtual one
+ *   MRD_SIM_QUIET=1             drop Serial output
+ *   MRD_SIM_SERIAL_PTY=path     Serial on a pseudo terminal linked at path, paced at the baud rate (SERIAL_LINK)
+ *   MRD_SIM_PEER=ip             UDP destination (default 127.0.0.1)
+ *   MRD_SIM_UDP_PORT_OFFSET=n   added to the local UDP port
+ *   MRD_SIM_SPI_MHZ=n           W5500 SPI clock of the Ethernet2 stub (default 8, W5500_BURST 0)
+ *   MRD_SIM_W5500_CS=pin        CS pin of the W5500 register model (default 5, W5500_BURST 1)
+ *   MRD_SIM_W5500_RSR_TEAR=1    Sn_RX_RSR reads straddle packet arrivals (torn high/low byte)
+ *   MRD_SIM_SPI_MAX_MHZ=n       SPI bytes read above n MHz get bit errors (SPI_TUNE, default 0: none)
+ *   MRD_SIM_SPI_ERR_EVERY=n     one bit error per n bytes above MRD_SIM_SPI_MAX_MHZ (default 1000)
+ *   MRD_SIM_PC_HZ=n             feed a Meridim from a built-in PC at n Hz on the virtual clock
+ *   MRD_SIM_PC_PORT=n           source port of the built-in PC packets (default 22222, PEER_LEARN 2)
+ *                               (master 90, all servos position-controlled on a sine)
+ *   MRD_SIM_PC_MOTION_FRAMES=n  Meridim[MRD_MOTION_FRAMES] of the built-in PC frames (keyframe interpolation)
+ *   MRD_SIM_PC_SEGMENT_FRAMES=n send the built-in PC motion as n-frame trajectory segments (mrd_traj.h)
+ *   MRD_SIM_PC_BATCH=n          send the built-in PC frames n at a time as batch packets (mrd_jitter.h)
+ *   MRD_SIM_NET_JITTER_US=us    delay each built-in PC packet by a random 0..us (may reorder)
+ *   MRD_SIM_DXL_IDS_<uart>      answering Dynamixel IDs per UART, e.g. "0-10" (default 0-14)
+ *   MRD_SIM_DXL_RETURN_DELAY_US Dynamixel return delay (default 0)
+ *   MRD_SIM_DXL_SPEED_DPS       Dynamixel speed (default 360)
+ *   MRD_SIM_ICS_IDS_<uart>      answering ICS IDs per UART (default 0-14)
+ *   MRD_SIM_KRR_BUTTONS=word    KRR-5FH button word (no receiver if unset)
+ *   MRD_SIM_KRR_ANALOG=a,b,c,d  KRR-5FH analog values
+ *   MRD_SIM_BNO=0               no BNO055
+ *   MRD_SIM_BNO_TRACE=file.csv  BNO055 trace (see Adafruit_BNO055.h)
+ *   MRD_SIM_MPU=who             MPU6050/MPU9250 at I2C 0x68 with this WHO_AM_I (0x68, 0x71, 0x73; none if unset)
+ *   MRD_SIM_MPU_TRACE=file.csv  MPU trace played from the device reset (see sim_mpu.cpp)
+ *   MRD_SIM_MPU_GYRO_BIAS=x,y,z raw gyro offset added by the MPU
+ *   MRD_SIM_WIIMOTE_BUTTONS=w   Wiimote button word (not connected if unset)
+ *   MRD_SIM_FS_ROOT=dir         host directory for SD, SPIFFS and flash partitions (default sim_fs)
+ *   MRD_SIM_SD=0                no SD card
+ *   MRD_SIM_SD_US_PER_KB        SD transfer time (default 500)
+ *   MRD_SIM_SD_STALL_EVERY/US   add a stall of US every N SD writes
+ *   MRD_SIM_PARTITION=0         no flash partitions (motion asset)
+ *   MRD_SIM_PARTITION_KB=n      size of each data partition file $MRD_SIM_FS_ROOT/partition/<label>.bin (default 512)
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+void setup();
+void loop();
+bool run_bench();
+
+#ifndef PIO_UNIT_TESTING // pio testではテスト側のmain()を使う
+namespace
+{
+  uint64_t percentile(const std::vector<uint64_t> &sorted, double p)
+  {
+    if (sorted.empty())
+    {
+      return 0;
+    }
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+  }
+}
+
+int main(int argc, char **argv)
+{
+  long frames = 1000;
+  long budget_us = 0;
+  bool bench = false;
+  for (int i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "--frames") == 0) and (i + 1 < argc))
+    {
+      frames = strtol(argv[++i], NULL, 0);
+    }
+    else if ((strcmp(argv[i], "--budget-us") == 0) and (i + 1 < argc))
+    {
+      budget_us = strtol(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--bench") == 0)
+    {
+      bench = true;
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--frames N] [--budget-us US] [--bench]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  sim::set_loop_thread();
+  setup();
+
+  if (bench)
+  {
+    bool ok = run_bench();
+    fflush(stdout);
+    _Exit(ok ? 0 : 1);
+  }
+
+  std::vector<uint64_t> work;
+  std::vector<uint64_t> period;
+  work.reserve(frames);
+  period.reserve(frames);
+  long overruns = 0;
+  const uint64_t frame_us = (uint64_t)FRAME_DURATION_US;
+  const uint64_t v_start = sim::now_us();
+  const std::chrono::steady_clock::time_point h_start = std::chrono::steady_clock::now();
+
+  for (long i = 0; i < frames; i++)
+  {
+    uint64_t v0 = sim::now_us();
+    uint64_t i0 = sim::idle_total_us();
+    loop();
+    uint64_t dv = sim::now_us() - v0;
+    uint64_t di = sim::idle_total_us() - i0;
+    work.push_back((dv > di) ? dv - di : 0);
+    period.push_back(dv);
+    if (dv > frame_us)
+    {
+      overruns++;
+    }
+  }
+
+  double v_sec = (sim::now_us() - v_start) / 1e6;
+  double h_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - h_start).count();
+  uint64_t work_sum = 0;
+  for (size_t i = 0; i < work.size(); i++)
+  {
+    work_sum += work[i];
+  }
+  std::sort(work.begin(), work.end());
+  std::sort(period.begin(), period.end());
+  uint64_t p99 = percentile(work, 0.99);
+
+  fflush(stdout);
+  printf("\n[sim] frames:%ld virtual:%.3fs host:%.3fs (x%.1f)\n", frames, v_sec, h_sec, (h_sec > 0) ? v_sec / h_sec : 0.0);
+  printf("[sim] work us avg:%.1f p50:%llu p99:%llu max:%llu budget:%llu\n", frames ? (double)work_sum / frames : 0.0,
+         (unsigned long long)percentile(work, 0.5), (unsigned long long)p99, (unsigned long long)(work.empty() ? 0 : work.back()), (unsigned long long)frame_us);
+  printf("[sim] period us p50:%llu max:%llu overruns:%ld\n", (unsigned long long)percentile(period, 0.5),
+         (unsigned long long)(period.empty() ? 0 : period.back()), overruns);
+  sim::net_report();
+
+  int rc = 0;
+  if ((budget_us > 0) and (p99 > (uint64_t)budget_us))
+  {
+    printf("[sim] FAIL: work p99 %llu us exceeds %ld us\n", (unsigned long long)p99, budget_us);
+    rc = 1;
+  }
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
+#endif
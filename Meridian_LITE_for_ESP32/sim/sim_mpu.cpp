@@ -0,0 +1,321 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_mpu.cpp
+ * @brief   Trace-driven MPU6050/MPU9250 register model on the simulated I2C bus.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+
+#include "sim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+/*
+  MPU6050/MPU9250をI2Cアドレス0x68に置き, main.cppが使うレジスタ(WHO_AM_I, 電源, レンジ, 分周,
+  センサ値, 温度, FIFO)を持つ. MRD_SIM_MPU=0x68(MPU6050)/0x71(MPU9250)/0x73(MPU9255) がWHO_AM_Iの値で,
+  未設定(0)ならアドレスはNACKする.
+  MRD_SIM_MPU_TRACE=file.csv の行
+    t_ms, acc_x, acc_y, acc_z (m/s^2), gyro_x, gyro_y, gyro_z (deg/s), temp (℃)
+  をデバイスリセット(PWR_MGMT_1のbit7)からの時間で再生し('#'行はコメント, 末尾で繰り返す),
+  トレースが無ければ水平に静止して25℃. ジャイロには MRD_SIM_MPU_GYRO_BIAS=x,y,z の生値を足す.
+  FIFOは有効な間, 1kHz/(SMPLRT_DIV+1)で [加速度6byte][ジャイロ6byte] を積み, 容量(MPU6050 1024byte,
+  MPU9250 512byte)を超えると古いサンプルを捨ててINT_STATUSのbit4を立てる.
+  温度は型番ごとの換算式(MPU6050: /340+36.53, MPU9250/9255: /333.87+21)の逆で生値にする.
+*/
+#define MPU_SIM_ADDR 0x68
+#define MPU_TRACE_COLS 8
+
+namespace
+{
+  enum
+  {
+    SMPLRT_DIV = 0x19,
+    GYRO_CONFIG = 0x1B,
+    ACCEL_CONFIG = 0x1C,
+    FIFO_EN = 0x23,
+    INT_STATUS = 0x3A,
+    ACCEL_XOUT_H = 0x3B,
+    USER_CTRL = 0x6A,
+    PWR_MGMT_1 = 0x6B,
+    FIFO_COUNTH = 0x72,
+    FIFO_COUNTL = 0x73,
+    FIFO_R_W = 0x74,
+    WHO_AM_I = 0x75,
+  };
+
+  struct Sample
+  {
+    double v[MPU_TRACE_COLS]; // t_ms, 加速度, ジャイロ, 温度
+  };
+
+  class SimMpu : public sim::I2cDevice
+  {
+  public:
+    SimMpu()
+    {
+      sim::i2c_attach(MPU_SIM_ADDR, this);
+      memset(reg, 0, sizeof(reg));
+      reg[PWR_MGMT_1] = 0x40; // スリープ
+    }
+
+    bool write(const uint8_t *data, int len) override
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (!present() or (len < 1))
+      {
+        return false;
+      }
+      ptr = data[0];
+      for (int i = 1; i < len; i++)
+      {
+        reg_write(ptr, data[i]);
+        if (ptr != FIFO_R_W)
+        {
+          ptr++;
+        }
+      }
+      return true;
+    }
+
+    int read(uint8_t *buf, int len) override
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (!present())
+      {
+        return 0;
+      }
+      fifo_fill();
+      uint8_t out[14];
+      sensor_regs(sample_at(sim::now_us()), out); // 1回の読み出しの中で値をそろえる
+      for (int i = 0; i < len; i++)
+      {
+        if (ptr == FIFO_R_W)
+        {
+          buf[i] = fifo.empty() ? 0 : fifo.front();
+          if (!fifo.empty())
+          {
+            fifo.erase(fifo.begin());
+          }
+          continue;
+        }
+        buf[i] = reg_read(ptr, out);
+        ptr++;
+      }
+      return len;
+    }
+
+  private:
+    std::mutex mtx;
+    uint8_t reg[128];
+    uint8_t ptr = 0;
+    std::vector<uint8_t> fifo;
+    uint64_t reset_us = 0;       // トレースの0ms
+    uint64_t next_sample_us = 0; // 次にFIFOへ積む時刻
+    std::vector<Sample> trace;
+    bool loaded = false;
+
+    uint8_t who() const { return (uint8_t)sim::env_long("MRD_SIM_MPU", 0); }
+    bool present() const { return who() != 0; }
+    size_t fifo_cap() const { return (who() == 0x68) ? 1024 : 512; }
+    bool fifo_on() const { return (reg[USER_CTRL] & 0x40) and ((reg[FIFO_EN] & 0x78) == 0x78); }
+    uint64_t sample_period_us() const { return 1000ULL * (reg[SMPLRT_DIV] + 1); }
+
+    void reset()
+    {
+      memset(reg, 0, sizeof(reg));
+      reg[PWR_MGMT_1] = 0x40; // スリープ
+      fifo.clear();
+      reset_us = sim::now_us();
+    }
+
+    void reg_write(uint8_t a, uint8_t v)
+    {
+      if (a >= sizeof(reg))
+      {
+        return;
+      }
+      switch (a)
+      {
+      case PWR_MGMT_1:
+        if (v & 0x80)
+        {
+          reset();
+          return;
+        }
+        break;
+      case USER_CTRL:
+        fifo_fill();
+        if (v & 0x04) // FIFO_RESET (自動で0に戻る)
+        {
+          fifo.clear();
+          v &= ~0x04;
+        }
+        if ((v & 0x40) and !(reg[USER_CTRL] & 0x40))
+        {
+          next_sample_us = sim::now_us() + sample_period_us();
+        }
+        break;
+      case INT_STATUS:
+      case FIFO_COUNTH:
+      case FIFO_COUNTL:
+      case WHO_AM_I:
+        return; // 読み出し専用
+      }
+      reg[a] = v;
+    }
+
+    uint8_t reg_read(uint8_t a, const uint8_t out[14])
+    {
+      if ((a >= ACCEL_XOUT_H) and (a < ACCEL_XOUT_H + 14))
+      {
+        return out[a - ACCEL_XOUT_H];
+      }
+      switch (a)
+      {
+      case WHO_AM_I:
+        return who();
+      case FIFO_COUNTH:
+        return (uint8_t)(fifo.size() >> 8);
+      case FIFO_COUNTL:
+        return (uint8_t)fifo.size();
+      case INT_STATUS:
+      {
+        uint8_t v = reg[INT_STATUS];
+        reg[INT_STATUS] = 0; // 読むと消える
+        return v;
+      }
+      }
+      return (a < sizeof(reg)) ? reg[a] : 0;
+    }
+
+    // 前回から今までのサンプルをFIFOに積む
+    void fifo_fill()
+    {
+      if (!fifo_on())
+      {
+        return;
+      }
+      uint64_t now = sim::now_us();
+      uint64_t period = sample_period_us();
+      uint64_t cap_samples = fifo_cap() / 12;
+      if ((next_sample_us <= now) and ((now - next_sample_us) / period >= cap_samples)) // 長く読まれなかった時は最後の容量分だけ積む
+      {
+        next_sample_us += ((now - next_sample_us) / period + 1 - cap_samples) * period;
+        reg[INT_STATUS] |= 0x10;
+      }
+      while (next_sample_us <= now)
+      {
+        uint8_t out[14];
+        sensor_regs(sample_at(next_sample_us), out);
+        if (fifo.size() + 12 > fifo_cap())
+        {
+          fifo.erase(fifo.begin(), fifo.begin() + 12);
+          reg[INT_STATUS] |= 0x10; // FIFO_OFLOW_INT
+        }
+        fifo.insert(fifo.end(), out, out + 6);     // 加速度
+        fifo.insert(fifo.end(), out + 8, out + 14); // ジャイロ
+        next_sample_us += period;
+      }
+    }
+
+    // ACCEL_XOUT_HからGYRO_ZOUT_Lまでの14byte
+    void sensor_regs(const Sample &s, uint8_t out[14])
+    {
+      static const double g = 9.80665;
+      double acc_lsb = 16384.0 / (1 << ((reg[ACCEL_CONFIG] >> 3) & 3)); // LSB/g
+      double gyro_lsb = 131.0 / (1 << ((reg[GYRO_CONFIG] >> 3) & 3));   // LSB/dps
+      int bias[3] = {0, 0, 0};
+      sscanf(sim::env_str("MRD_SIM_MPU_GYRO_BIAS", "0,0,0"), "%d,%d,%d", &bias[0], &bias[1], &bias[2]);
+      double temp = (who() == 0x68) ? (s.v[7] - 36.53) * 340.0 : (s.v[7] - 21.0) * 333.87;
+      int16_t v[7];
+      for (int i = 0; i < 3; i++)
+      {
+        v[i] = clamp16(s.v[1 + i] / g * acc_lsb);
+        v[4 + i] = clamp16(s.v[4 + i] * gyro_lsb + bias[i]);
+      }
+      v[3] = clamp16(temp);
+      for (int i = 0; i < 7; i++)
+      {
+        out[i * 2] = (uint8_t)((uint16_t)v[i] >> 8);
+        out[i * 2 + 1] = (uint8_t)v[i];
+      }
+    }
+
+    static int16_t clamp16(double x)
+    {
+      return (int16_t)std::max(-32768.0, std::min(32767.0, std::round(x)));
+    }
+
+    // リセットからの時間に対応する行(繰り返し再生)
+    Sample sample_at(uint64_t t_us)
+    {
+      load_trace();
+      if (trace.empty()) // トレースなし: 水平に静止
+      {
+        Sample s = {{0, 0, 0, 9.80665, 0, 0, 0, 25}};
+        return s;
+      }
+      double span = trace.back().v[0] + 1;
+      double t = fmod((t_us - reset_us) / 1000.0, span);
+      std::vector<Sample>::const_iterator it = std::upper_bound(trace.begin(), trace.end(), t, [](double t_ms, const Sample &s) { return t_ms < s.v[0]; });
+      return (it == trace.begin()) ? trace[0] : *(it - 1);
+    }
+
+    void load_trace()
+    {
+      if (loaded)
+      {
+        return;
+      }
+      loaded = true;
+      const char *path = getenv("MRD_SIM_MPU_TRACE");
+      if (path == NULL)
+      {
+        return;
+      }
+      FILE *fp = fopen(path, "r");
+      if (fp == NULL)
+      {
+        Serial.printf("[sim] MPU trace %s not found.\n", path);
+        return;
+      }
+      char line[512];
+      while (fgets(line, sizeof(line), fp))
+      {
+        if (line[0] == '#')
+        {
+          continue;
+        }
+        Sample s;
+        char *p = line;
+        int n = 0;
+        for (; n < MPU_TRACE_COLS; n++)
+        {
+          char *end;
+          s.v[n] = strtod(p, &end);
+          if (end == p)
+          {
+            break;
+          }
+          p = end;
+          while ((*p == ',') or (*p == ' ') or (*p == '\t'))
+          {
+            p++;
+          }
+        }
+        if (n == MPU_TRACE_COLS)
+        {
+          trace.push_back(s);
+        }
+      }
+      fclose(fp);
+    }
+  };
+
+  SimMpu mpu;
+}
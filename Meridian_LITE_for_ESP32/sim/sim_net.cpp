@@ -0,0 +1,398 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_net.cpp
+ * @brief   Ethernet2/EthernetUDP stand-ins on POSIX sockets.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Ethernet2.h>
+#include <EthernetUDP2.h>
+
+#include "sim.h"
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cmath>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+EthernetClass Ethernet;
+
+namespace
+{
+  // Ethernet2のW5500アクセス. frames回のフレーム(各フレームでbeginTransactionし, 3byteのヘッダとデータを1byteずつ転送)
+  void ethernet2_spi(int kind, uint32_t frames, uint32_t bytes, bool packet)
+  {
+    static const long mhz = sim::env_long("MRD_SIM_SPI_MHZ", 8);
+    uint64_t ns = sim::spi_ns(frames, frames * 3 + bytes, frames * 3 + bytes, (uint32_t)(mhz > 0 ? mhz : 1) * 1000000);
+    sim::busy_ns(ns);
+    sim::net_spi(kind, frames, ns, packet);
+  }
+
+  // W5500のSPI時間とフレーム数の集計 (送信, 受信, 受信なしの確認)
+  uint64_t spi_ns_sum[3] = {0};
+  uint64_t spi_frames[3] = {0};
+  uint64_t spi_count[3] = {0};
+
+  // PCが送る1フレーム分のMeridim. マスターコマンド90, 全サーボ位置指定(コマンド1)でサインカーブの目標角度
+  void synthetic_meridim(short *m, uint64_t n)
+  {
+    static const long motion_frames = sim::env_long("MRD_SIM_PC_MOTION_FRAMES", 0);
+    memset(m, 0, 90 * sizeof(short));
+    m[0] = 90;
+    m[1] = (short)(n % 60000);
+    m[19] = (short)motion_frames; // MRD_MOTION_FRAMES
+    for (int i = 0; i < 15; i++)
+    {
+      short deg100 = (short)(3000 * sin((double)n * 0.02 + i));
+      m[20 + i * 2] = 1;
+      m[21 + i * 2] = deg100;
+      m[50 + i * 2] = 1;
+      m[51 + i * 2] = deg100;
+    }
+    int sum = 0;
+    for (int i = 0; i < 89; i++)
+    {
+      sum += m[i];
+    }
+    m[89] = (short)~sum;
+  }
+
+  // PCが送る軌道セグメント(mrd_traj.h の形式). k番目の区間の終点の角度と角速度
+  void synthetic_segment(short *m, uint64_t k, long frames, long hz)
+  {
+    uint64_t f1 = (k + 1) * frames; // 区間の終点のフレーム
+    memset(m, 0, 90 * sizeof(short));
+    m[0] = 10013; // MCMD_TRAJ_SEGMENT
+    m[1] = (short)(k % 60000);
+    for (int i = 0; i < 15; i++)
+    {
+      short deg100 = (short)(3000 * sin((double)f1 * 0.02 + i));
+      short dps10 = (short)(6 * cos((double)f1 * 0.02 + i) * hz); // degree/s x 10
+      m[20 + i * 2] = deg100;
+      m[21 + i * 2] = dps10;
+      m[50 + i * 2] = deg100;
+      m[51 + i * 2] = dps10;
+    }
+    m[80] = (short)((k * frames) & 0xFFFF);
+    m[81] = (short)frames;
+    int sum = 0;
+    for (int i = 0; i < 89; i++)
+    {
+      sum += m[i];
+    }
+    m[89] = (short)~sum;
+  }
+
+  struct SimPacket
+  {
+    uint64_t arrive_us;
+    std::vector<uint8_t> data;
+  };
+
+  // 揺らぎを加えた到着時刻でパケットを回線に載せる
+  void launch(std::vector<SimPacket> &in_flight, uint64_t send_us, const void *data, size_t len)
+  {
+    static const long jitter_us = sim::env_long("MRD_SIM_NET_JITTER_US", 0);
+    static uint32_t rng = 1;
+    SimPacket pkt;
+    rng = rng * 1103515245u + 12345u;
+    pkt.arrive_us = send_us + (jitter_us > 0 ? (rng >> 8) % (uint32_t)(jitter_us + 1) : 0);
+    pkt.data.assign((const uint8_t *)data, (const uint8_t *)data + len);
+    in_flight.push_back(pkt);
+  }
+
+  // MRD_SIM_PC_HZ: 仮想時計でこの周期ごとにPCからのMeridimが届いたことにする(ソケット不要)
+  // MRD_SIM_PC_BATCH=n: nフレームごとにnフレーム分をまとめたバッチパケット(mrd_jitter.h)で送る
+  // MRD_SIM_NET_JITTER_US=us: 各パケットの到着を0〜usの乱数だけ遅らせる(順序の入れ替わりも起こる)
+  // MRD_SIM_PC_SEGMENT_FRAMES=n: 位置の代わりにnフレームの軌道セグメントを1区間先まで送る
+  int synthetic_pc_frame(uint8_t *buf)
+  {
+    static const long hz = sim::env_long("MRD_SIM_PC_HZ", 0);
+    static const long batch = std::max(1L, std::min(8L, sim::env_long("MRD_SIM_PC_BATCH", 1)));
+    static const long segment = sim::env_long("MRD_SIM_PC_SEGMENT_FRAMES", 0);
+    static uint64_t start_us = 0;
+    static uint64_t sent = 0;
+    static std::vector<SimPacket> in_flight;
+    if (hz <= 0)
+    {
+      return 0;
+    }
+    uint64_t now = sim::now_us();
+    if (start_us == 0)
+    {
+      start_us = now;
+    }
+
+    // 送信時刻になったパケットを作り, 揺らぎを加えた到着時刻で回線に載せる
+    while ((now - start_us) * hz >= sent * 1000000ULL)
+    {
+      uint64_t send_us = start_us + sent * 1000000ULL / hz;
+      if (segment > 0) // 区間の始まりごとに次の区間を送る(最初は2区間分)
+      {
+        short m[90];
+        if (sent % segment == 0)
+        {
+          if (sent == 0)
+          {
+            synthetic_segment(m, 0, segment, hz);
+            launch(in_flight, send_us, m, sizeof(m));
+          }
+          synthetic_segment(m, sent / segment + 1, segment, hz);
+          launch(in_flight, send_us, m, sizeof(m));
+        }
+        sent++;
+      }
+      else if (batch == 1)
+      {
+        short m[90];
+        synthetic_meridim(m, sent);
+        launch(in_flight, send_us, m, sizeof(m));
+        sent++;
+      }
+      else
+      {
+        std::vector<short> b(2 + batch * 91);
+        b[0] = (short)0x424D; // MRD_BATCH_MAGIC
+        b[1] = (short)batch;
+        for (long i = 0; i < batch; i++)
+        {
+          b[2 + i] = (short)((sent + i) & 0xFFFF);
+          synthetic_meridim(&b[2 + batch + i * 90], sent + i);
+        }
+        launch(in_flight, send_us, b.data(), b.size() * sizeof(short));
+        sent += batch;
+      }
+    }
+
+    // 到着済みで最も早いものを1つ受け取る
+    int first = -1;
+    for (size_t i = 0; i < in_flight.size(); i++)
+    {
+      if ((in_flight[i].arrive_us <= now) and ((first < 0) or (in_flight[i].arrive_us < in_flight[first].arrive_us)))
+      {
+        first = (int)i;
+      }
+    }
+    if (first < 0)
+    {
+      return 0; // 次のパケットはまだ届いていない
+    }
+    int len = (int)std::min(in_flight[first].data.size(), (size_t)SIM_UDP_MAX);
+    memcpy(buf, in_flight[first].data.data(), len);
+    in_flight.erase(in_flight.begin() + first);
+    return len;
+  }
+}
+
+namespace sim
+{
+  int net_open(uint16_t port)
+  {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+      return -1;
+    }
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)(port + sim::env_long("MRD_SIM_UDP_PORT_OFFSET", 0)));
+    if (bind(sock, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+      Serial.printf("[sim] UDP bind to port %u failed.\n", (unsigned)ntohs(addr.sin_port));
+      close(sock);
+      return -1;
+    }
+    return sock;
+  }
+
+  void net_close(int sock)
+  {
+    if (sock >= 0)
+    {
+      close(sock);
+    }
+  }
+
+  int net_recv(int sock, uint8_t *buf, int cap, uint32_t *ip, uint16_t *port)
+  {
+    if (sock < 0)
+    {
+      return 0;
+    }
+    sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    ssize_t n = recvfrom(sock, buf, cap, 0, (sockaddr *)&addr, &addr_len);
+    if (n <= 0)
+    {
+      static uint8_t pc_buf[SIM_UDP_MAX];
+      n = synthetic_pc_frame(pc_buf);
+      if (n <= 0)
+      {
+        return 0;
+      }
+      n = std::min((int)n, cap);
+      memcpy(buf, pc_buf, n);
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons((uint16_t)sim::env_long("MRD_SIM_PC_PORT", 22222)); // 内蔵PCの送信元ポート
+    }
+    *ip = (uint32_t)addr.sin_addr.s_addr;
+    *port = ntohs(addr.sin_port);
+    return (int)n;
+  }
+
+  bool net_send(int sock, uint16_t port, const uint8_t *buf, int len)
+  {
+    if (sock < 0)
+    {
+      return false;
+    }
+    IPAddress peer;
+    peer.fromString(sim::env_str("MRD_SIM_PEER", "127.0.0.1"));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = (uint32_t)peer; // IPAddressはネットワークバイト順で保持
+    addr.sin_port = htons(port);
+    return sendto(sock, buf, len, 0, (sockaddr *)&addr, sizeof(addr)) == len;
+  }
+
+  void net_spi(int kind, uint32_t frames, uint64_t ns, bool packet)
+  {
+    spi_ns_sum[kind] += ns;
+    spi_frames[kind] += frames;
+    if (packet)
+    {
+      spi_count[kind]++;
+    }
+  }
+
+  void net_report()
+  {
+    if (spi_count[0] + spi_count[1] + spi_count[2] == 0)
+    {
+      return;
+    }
+    const char *names[3] = {"send", "receive", "poll"};
+    printf("[sim] w5500 spi us/frames per packet");
+    for (int i = 0; i < 3; i++)
+    {
+      double n = spi_count[i] ? (double)spi_count[i] : 1.0;
+      printf(" %s:%.1f/%.1ffr(%llu)", names[i], spi_ns_sum[i] / 1000.0 / n, spi_frames[i] / n, (unsigned long long)spi_count[i]);
+    }
+    printf("\n");
+  }
+}
+
+int EthernetClass::begin(uint8_t *mac)
+{
+  (void)mac;
+  ip = IPAddress(127, 0, 0, 1);
+  return 1;
+}
+
+void EthernetClass::begin(uint8_t *mac, IPAddress local_ip)
+{
+  (void)mac;
+  ip = local_ip;
+}
+
+/*
+  以下のSPI時間はEthernet2の実際のアクセス手順に合わせる.
+  16bitレジスタは1byteずつ2フレームで読み, Sn_RX_RSRとSn_TX_FSRは値が揃うまで2回読む.
+  コマンドはSn_CRを書いてから0に戻るまで読む.
+*/
+uint8_t EthernetUDP::begin(uint16_t port)
+{
+  stop();
+  sock = sim::net_open(port);
+  return sock >= 0;
+}
+
+void EthernetUDP::stop()
+{
+  sim::net_close(sock);
+  sock = -1;
+}
+
+int EthernetUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  (void)ip;
+  return beginPacket((const char *)NULL, port);
+}
+
+int EthernetUDP::beginPacket(const char *host, uint16_t port)
+{
+  (void)host;
+  tx_port = port;
+  tx_len = 0;
+  ethernet2_spi(0, 2, 6, false); // Sn_DIPR, Sn_DPORT
+  return 1;
+}
+
+size_t EthernetUDP::write(const uint8_t *buf, size_t len)
+{
+  size_t n = min(len, (size_t)(SIM_UDP_MAX - tx_len));
+  memcpy(tx_buf + tx_len, buf, n);
+  tx_len += n;
+  ethernet2_spi(0, 8, n + 8, false); // Sn_TX_FSR x2, Sn_TX_WRの読み出し, データ, Sn_TX_WR
+  return n;
+}
+
+int EthernetUDP::endPacket()
+{
+  // SEND, Sn_CRの確認, 100Mbpsでの送出が終わるまでSn_IRを読み, SEND_OKを消す
+  uint64_t wire_ns = (uint64_t)(tx_len + 42) * 80;
+  uint64_t poll_ns = sim::spi_ns(1, 4, 4, (uint32_t)sim::env_long("MRD_SIM_SPI_MHZ", 8) * 1000000);
+  ethernet2_spi(0, 3 + (uint32_t)(wire_ns / poll_ns + 1), 3 + (uint32_t)(wire_ns / poll_ns + 1), true);
+  return sim::net_send(sock, tx_port, tx_buf, tx_len);
+}
+
+int EthernetUDP::parsePacket()
+{
+  rx_len = 0;
+  rx_pos = 0;
+  uint32_t ip = 0;
+  uint16_t port = 0;
+  int n = sim::net_recv(sock, rx_buf, sizeof(rx_buf), &ip, &port);
+  if (n <= 0)
+  {
+    ethernet2_spi(2, 2, 2, true); // Sn_RX_RSR (0なので1回)
+    return 0;
+  }
+  // Sn_RX_RSR x2, recv(8): Sn_RX_RSR x2, Sn_RX_RD, ヘッダ, Sn_RX_RD, RECV, Sn_CR
+  ethernet2_spi(1, 14, 22, true);
+  rx_len = n;
+  remote_ip = IPAddress(ip);
+  remote_port = port;
+  return rx_len;
+}
+
+int EthernetUDP::read()
+{
+  unsigned char c;
+  return (read(&c, 1) == 1) ? c : -1;
+}
+
+int EthernetUDP::read(unsigned char *buf, size_t len)
+{
+  int n = min((int)len, rx_len - rx_pos);
+  if (n <= 0)
+  {
+    return -1;
+  }
+  memcpy(buf, rx_buf + rx_pos, n);
+  rx_pos += n;
+  ethernet2_spi(1, 10, n + 10, false); // Sn_RX_RSR x2, Sn_RX_RD, データ, Sn_RX_RD, RECV, Sn_CR
+  return n;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_partition.cpp
+ * @brief   File-backed flash partitions.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <esp_partition.h>
+
+#include "sim.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#define SIM_FLASH_ERASE_US 45000 // 1セクタの消去時間
+#define SIM_FLASH_WRITE_NS 2500  // 1バイトの書き込み時間 (256バイトのページで約0.6ms)
+
+namespace
+{
+  struct SimPartition
+  {
+    esp_partition_t part; // 先頭に置き, esp_partition_t* から戻せるようにする
+    int fd;
+  };
+
+  std::map<std::string, SimPartition *> partitions;
+  std::map<spi_flash_mmap_handle_t, std::pair<void *, size_t>> mappings;
+  spi_flash_mmap_handle_t next_handle = 1;
+
+  int fd_of(const esp_partition_t *partition)
+  {
+    return ((const SimPartition *)partition)->fd;
+  }
+
+  bool in_range(const esp_partition_t *partition, size_t offset, size_t size)
+  {
+    return (partition != NULL) and (offset <= partition->size) and (size <= partition->size - offset);
+  }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+  if ((type != ESP_PARTITION_TYPE_DATA) or (label == NULL) or !sim::env_long("MRD_SIM_PARTITION", 1))
+  {
+    return NULL;
+  }
+  auto it = partitions.find(label);
+  if (it != partitions.end())
+  {
+    return &it->second->part;
+  }
+
+  std::string dir = std::string(sim::env_str("MRD_SIM_FS_ROOT", "sim_fs"));
+  ::mkdir(dir.c_str(), 0755);
+  dir += "/partition";
+  ::mkdir(dir.c_str(), 0755);
+  std::string path = dir + "/" + label + ".bin";
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+  uint32_t size = (uint32_t)sim::env_long("MRD_SIM_PARTITION_KB", 512) * 1024;
+  struct stat sb;
+  if ((fstat(fd, &sb) == 0) and ((uint32_t)sb.st_size < size)) // 新しい部分は消去済み(0xFF)にする
+  {
+    std::vector<uint8_t> ff(size - sb.st_size, 0xFF);
+    if (pwrite(fd, ff.data(), ff.size(), sb.st_size) != (ssize_t)ff.size())
+    {
+      ::close(fd);
+      return NULL;
+    }
+  }
+
+  SimPartition *p = new SimPartition();
+  p->fd = fd;
+  p->part.flash_chip = NULL;
+  p->part.type = type;
+  p->part.subtype = subtype;
+  p->part.address = 0x380000;
+  p->part.size = size;
+  snprintf(p->part.label, sizeof(p->part.label), "%s", label);
+  p->part.encrypted = false;
+  partitions[label] = p;
+  return &p->part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+  if (!in_range(partition, src_offset, size))
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  return (pread(fd_of(partition), dst, size, src_offset) == (ssize_t)size) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+  if (!in_range(partition, dst_offset, size))
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  std::vector<uint8_t> cur(size);
+  if (pread(fd_of(partition), cur.data(), size, dst_offset) != (ssize_t)size)
+  {
+    return ESP_FAIL;
+  }
+  for (size_t i = 0; i < size; i++) // NORフラッシュは1→0にしか書けない
+  {
+    cur[i] &= ((const uint8_t *)src)[i];
+  }
+  sim::busy_us((uint64_t)size * SIM_FLASH_WRITE_NS / 1000);
+  return (pwrite(fd_of(partition), cur.data(), size, dst_offset) == (ssize_t)size) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+  if (!in_range(partition, offset, size))
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if ((offset % SPI_FLASH_SEC_SIZE != 0) or (size % SPI_FLASH_SEC_SIZE != 0))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::vector<uint8_t> ff(size, 0xFF);
+  sim::busy_us((uint64_t)(size / SPI_FLASH_SEC_SIZE) * SIM_FLASH_ERASE_US);
+  return (pwrite(fd_of(partition), ff.data(), size, offset) == (ssize_t)size) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size, spi_flash_mmap_memory_t memory,
+                             const void **out_ptr, spi_flash_mmap_handle_t *out_handle)
+{
+  (void)memory;
+  if (!in_range(partition, offset, size) or (size == 0))
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t skip = offset % page; // mmapの位置はページ境界に揃える(ESP32の64KBページと同じ扱い)
+  void *p = mmap(NULL, size + skip, PROT_READ, MAP_SHARED, fd_of(partition), offset - skip);
+  if (p == MAP_FAILED)
+  {
+    return ESP_FAIL;
+  }
+  mappings[next_handle] = std::make_pair(p, size + skip);
+  *out_handle = next_handle++;
+  *out_ptr = (const uint8_t *)p + skip;
+  return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+  auto it = mappings.find(handle);
+  if (it != mappings.end())
+  {
+    munmap(it->second.first, it->second.second);
+    mappings.erase(it);
+  }
+}
@@ -0,0 +1,327 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_servo.cpp
+ * @brief   Simulated Dynamixel and ICS servo buses.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Dynamixel2Arduino.h>
+#include <IcsHardSerialClass.h>
+
+#include "sim.h"
+
+#include <cstdio>
+#include <mutex>
+
+#define DXL_ID_MAX 253
+#define DXL_ADDR_OPERATING_MODE 11
+#define DXL_ADDR_TORQUE_ENABLE 64
+#define DXL_ADDR_GOAL_POSITION 116
+#define DXL_ADDR_PRESENT_POSITION 132
+#define DXL_TICKS_PER_DEG (4096.0 / 360.0)
+#define ICS_ID_MAX 32
+
+namespace
+{
+  struct DxlServo
+  {
+    bool present = false;
+    uint8_t table[256] = {0}; // コントロールテーブル
+    double position = 2048;   // 現在位置(生値)
+    uint64_t updated_us = 0;  // 現在位置を更新した時刻
+  };
+
+  struct IcsServo
+  {
+    bool present = false;
+    int position = 7500;
+  };
+
+  /* UARTごとのバスの状態 */
+  struct Bus
+  {
+    DxlServo dxl[DXL_ID_MAX];
+    IcsServo ics[ICS_ID_MAX];
+  };
+
+  std::mutex bus_mtx;
+  Bus buses[3];
+
+  // "0-14" や "0,2,4-6" の形式のID一覧を解釈する
+  template <typename T, int N>
+  void parse_ids(const char *s, T (&servos)[N])
+  {
+    while (*s)
+    {
+      char *end;
+      long a = strtol(s, &end, 10);
+      if (end == s)
+      {
+        break;
+      }
+      long b = a;
+      s = end;
+      if (*s == '-')
+      {
+        b = strtol(s + 1, &end, 10);
+        s = end;
+      }
+      for (long id = a; id <= b; id++)
+      {
+        if ((id >= 0) and (id < N))
+        {
+          servos[id].present = true;
+        }
+      }
+      if (*s == ',')
+      {
+        s++;
+      }
+    }
+  }
+
+  Bus &bus(int uart)
+  {
+    static bool initialized = false;
+    if (!initialized)
+    {
+      initialized = true;
+      for (int i = 0; i < 3; i++)
+      {
+        char name[32];
+        snprintf(name, sizeof(name), "MRD_SIM_DXL_IDS_%d", i);
+        parse_ids(sim::env_str(name, "0-14"), buses[i].dxl);
+        snprintf(name, sizeof(name), "MRD_SIM_ICS_IDS_%d", i);
+        parse_ids(sim::env_str(name, "0-14"), buses[i].ics);
+        for (int id = 0; id < DXL_ID_MAX; id++)
+        {
+          buses[i].dxl[id].table[DXL_ADDR_OPERATING_MODE] = OP_POSITION;
+        }
+      }
+    }
+    return buses[(uart >= 0 and uart < 3) ? uart : 0];
+  }
+
+  int32_t get_i32(const uint8_t *p)
+  {
+    return (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+  }
+
+  void put_i32(uint8_t *p, int32_t v)
+  {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+  }
+
+  // 目標位置に向かって一定速度で動かす
+  void dxl_update(DxlServo &s)
+  {
+    static const double speed = sim::env_long("MRD_SIM_DXL_SPEED_DPS", 360) * DXL_TICKS_PER_DEG / 1000000.0; // 生値/us
+    uint64_t now = sim::now_us();
+    double step = speed * (double)(now - s.updated_us);
+    s.updated_us = now;
+    if (s.table[DXL_ADDR_TORQUE_ENABLE])
+    {
+      double goal = get_i32(&s.table[DXL_ADDR_GOAL_POSITION]);
+      double diff = goal - s.position;
+      s.position = (std::abs(diff) <= step) ? goal : s.position + ((diff > 0) ? step : -step);
+    }
+    put_i32(&s.table[DXL_ADDR_PRESENT_POSITION], (int32_t)lround(s.position));
+  }
+
+  uint64_t dxl_return_delay_us()
+  {
+    static const long us = sim::env_long("MRD_SIM_DXL_RETURN_DELAY_US", 0);
+    return us;
+  }
+
+  // UARTが相手と同じ速度と形式で開かれている時だけ応答が届く (Dynamixelは8N1, ICSとKRR-5FHは8E1)
+  bool port_matches(const HardwareSerial &port, unsigned long baud, uint32_t parity)
+  {
+    return (port.baud_rate() == baud) and ((port.format() & 0x3u) == parity);
+  }
+}
+
+Dynamixel2Arduino::Dynamixel2Arduino(HardwareSerial &port, int dir_pin) : port(port)
+{
+  (void)dir_pin;
+}
+
+void Dynamixel2Arduino::begin(unsigned long baud_rate)
+{
+  baud = baud_rate;
+  port.begin(baud_rate);
+}
+
+bool Dynamixel2Arduino::setPortProtocolVersion(float version)
+{
+  return version == 2.0f;
+}
+
+bool Dynamixel2Arduino::ping(uint8_t id)
+{
+  uint8_t buf[3];
+  return read(id, 0, 3, buf, sizeof(buf)) == 3;
+}
+
+bool Dynamixel2Arduino::setOperatingMode(uint8_t id, uint8_t mode)
+{
+  return write(id, DXL_ADDR_OPERATING_MODE, &mode, 1);
+}
+
+bool Dynamixel2Arduino::torqueOn(uint8_t id)
+{
+  uint8_t v = 1;
+  return write(id, DXL_ADDR_TORQUE_ENABLE, &v, 1);
+}
+
+bool Dynamixel2Arduino::torqueOff(uint8_t id)
+{
+  uint8_t v = 0;
+  return write(id, DXL_ADDR_TORQUE_ENABLE, &v, 1);
+}
+
+bool Dynamixel2Arduino::setGoalPosition(uint8_t id, float value, uint8_t unit)
+{
+  uint8_t buf[4];
+  put_i32(buf, (int32_t)lroundf((unit == UNIT_DEGREE) ? value * DXL_TICKS_PER_DEG : value));
+  return write(id, DXL_ADDR_GOAL_POSITION, buf, 4);
+}
+
+float Dynamixel2Arduino::getPresentPosition(uint8_t id, uint8_t unit)
+{
+  uint8_t buf[4];
+  if (read(id, DXL_ADDR_PRESENT_POSITION, 4, buf, sizeof(buf)) != 4)
+  {
+    return 0;
+  }
+  float v = (float)get_i32(buf);
+  return (unit == UNIT_DEGREE) ? v / DXL_TICKS_PER_DEG : v;
+}
+
+bool Dynamixel2Arduino::write(uint8_t id, uint16_t addr, const uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+  sim::busy_us(sim::uart_us(12 + len, baud)); // インストラクションパケット
+  bool ok = false;
+  {
+    std::lock_guard<std::mutex> lock(bus_mtx);
+    DxlServo *s = (id < DXL_ID_MAX) ? &bus(port.uart_nr()).dxl[id] : NULL;
+    if (s and s->present and (addr + len <= 256) and port_matches(port, baud, 0x0))
+    {
+      dxl_update(*s);
+      memcpy(&s->table[addr], data, len);
+      ok = true;
+    }
+  }
+  if (ok)
+  {
+    sim::busy_us(dxl_return_delay_us() + sim::uart_us(11, baud)); // ステータスパケット
+  }
+  else
+  {
+    sim::busy_us((uint64_t)timeout_ms * 1000); // 応答なし
+  }
+  return ok;
+}
+
+int32_t Dynamixel2Arduino::read(uint8_t id, uint16_t addr, uint16_t addr_len, uint8_t *recv_buf, uint16_t recv_buf_capacity, uint32_t timeout_ms)
+{
+  sim::busy_us(sim::uart_us(14, baud)); // インストラクションパケット
+  bool ok = false;
+  {
+    std::lock_guard<std::mutex> lock(bus_mtx);
+    DxlServo *s = (id < DXL_ID_MAX) ? &bus(port.uart_nr()).dxl[id] : NULL;
+    if (s and s->present and (addr + addr_len <= 256) and (addr_len <= recv_buf_capacity) and port_matches(port, baud, 0x0))
+    {
+      dxl_update(*s);
+      memcpy(recv_buf, &s->table[addr], addr_len);
+      ok = true;
+    }
+  }
+  if (!ok)
+  {
+    sim::busy_us((uint64_t)timeout_ms * 1000); // 応答なし
+    return -1;
+  }
+  sim::busy_us(dxl_return_delay_us() + sim::uart_us(11 + addr_len, baud)); // ステータスパケット
+  return addr_len;
+}
+
+bool IcsHardSerialClass::begin()
+{
+  if (serial)
+  {
+    serial->begin(baudrate, SERIAL_8E1);
+  }
+  return serial != NULL;
+}
+
+bool IcsHardSerialClass::begin(long baud_rate, int timeout_ms)
+{
+  baudrate = baud_rate;
+  timeout = timeout_ms;
+  return begin();
+}
+
+bool IcsHardSerialClass::begin(HardwareSerial *ics_serial, int enpin, long baud_rate, int timeout_ms)
+{
+  (void)enpin;
+  serial = ics_serial;
+  return begin(baud_rate, timeout_ms);
+}
+
+int IcsHardSerialClass::setPos(byte id, unsigned int pos)
+{
+  sim::busy_us(sim::uart_us(3 * 11 / 10 + 1, baudrate)); // 3byte(8E1)
+  int ret = ICS_FALSE;
+  {
+    std::lock_guard<std::mutex> lock(bus_mtx);
+    IcsServo *s = (serial and (id < ICS_ID_MAX)) ? &bus(serial->uart_nr()).ics[id] : NULL;
+    if (s and s->present and port_matches(*serial, baudrate, 0x2))
+    {
+      ret = s->position;
+      s->position = pos;
+    }
+  }
+  sim::busy_us((ret == ICS_FALSE) ? (uint64_t)timeout * 1000 : sim::uart_us(3 * 11 / 10 + 1, baudrate));
+  return ret;
+}
+
+int IcsHardSerialClass::setFree(byte id)
+{
+  sim::busy_us(sim::uart_us(3 * 11 / 10 + 1, baudrate));
+  int ret = ICS_FALSE;
+  {
+    std::lock_guard<std::mutex> lock(bus_mtx);
+    IcsServo *s = (serial and (id < ICS_ID_MAX)) ? &bus(serial->uart_nr()).ics[id] : NULL;
+    if (s and s->present and port_matches(*serial, baudrate, 0x2))
+    {
+      ret = s->position;
+    }
+  }
+  sim::busy_us((ret == ICS_FALSE) ? (uint64_t)timeout * 1000 : sim::uart_us(3 * 11 / 10 + 1, baudrate));
+  return ret;
+}
+
+bool IcsHardSerialClass::getKrrAllData(unsigned short *button, int adData[4])
+{
+  sim::busy_us(sim::uart_us(4 * 11 / 10 + 1, baudrate));
+  const char *buttons = getenv("MRD_SIM_KRR_BUTTONS");
+  if ((buttons == NULL) or (serial == NULL) or !port_matches(*serial, baudrate, 0x2))
+  {
+    sim::busy_us((uint64_t)timeout * 1000); // 受信機なし
+    *button = KRR_BUTTON_FALSE;
+    return false;
+  }
+  *button = (unsigned short)strtol(buttons, NULL, 0);
+  int a[4] = {0, 0, 0, 0};
+  sscanf(sim::env_str("MRD_SIM_KRR_ANALOG", "0,0,0,0"), "%d,%d,%d,%d", &a[0], &a[1], &a[2], &a[3]);
+  for (int i = 0; i < 4; i++)
+  {
+    adData[i] = a[i];
+  }
+  sim::busy_us(sim::uart_us(11 * 11 / 10 + 1, baudrate));
+  return true;
+}
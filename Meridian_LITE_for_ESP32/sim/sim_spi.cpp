@@ -0,0 +1,150 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_spi.cpp
+ * @brief   SPI bus stand-in with a transfer time model.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <SPI.h>
+
+#include "sim.h"
+
+#include <cstddef>
+#include <map>
+
+/*
+  ESP32のArduinoコアのSPI転送時間のモデル (240MHz, 目安の値)
+  beginTransaction/endTransaction はバスのロックとクロック設定, 1回の転送関数の呼び出しは
+  レジスタの設定と完了待ち, 64byteを超える転送はFIFOの詰め替えが加わる.
+*/
+#define SIM_SPI_TRANSACTION_NS 2500 // beginTransaction + endTransaction
+#define SIM_SPI_CS_NS 300           // CSピンの操作2回
+#define SIM_SPI_CALL_NS 600         // 転送関数1回の呼び出し
+#define SIM_SPI_FIFO_NS 300         // 64byteのFIFOの詰め替え1回
+
+/*
+  配線の限界のモデル: MRD_SIM_SPI_MAX_MHZ を超えるクロックでは, デバイスから読んだバイトが
+  MRD_SIM_SPI_ERR_EVERY バイトに1回の割合で1ビット化ける(速いクロックで先に崩れるのはMISOの取り込み).
+  0(既定)なら化けない. トランザクションの開始ごとに読み直すので, テストの途中で変えられる.
+*/
+
+SPIClass SPI;
+
+namespace
+{
+  std::map<uint8_t, sim::SpiDevice *> &devices() // 静的初期化の順序に依らないように関数内に置く
+  {
+    static std::map<uint8_t, sim::SpiDevice *> map;
+    return map;
+  }
+  sim::SpiDevice *selected = NULL;
+  uint64_t frame_ns = 0;   // 前のフレームの終わりから使ったSPI時間
+  uint64_t fault_hz = 0;   // MRD_SIM_SPI_MAX_MHZ
+  long fault_every = 1000; // MRD_SIM_SPI_ERR_EVERY
+
+  void charge(uint64_t ns)
+  {
+    frame_ns += ns;
+    sim::busy_ns(ns);
+  }
+
+  uint64_t bits_ns(uint32_t bytes, uint32_t hz)
+  {
+    return hz ? (uint64_t)bytes * 8 * 1000000000ULL / hz : 0;
+  }
+
+  uint8_t line(uint8_t miso, uint32_t hz)
+  {
+    static uint32_t seed = 88172645UL; // xorshift. 実行ごとに同じ誤りになる
+    if ((fault_hz == 0) or (hz <= fault_hz) or (fault_every <= 0))
+    {
+      return miso;
+    }
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return ((seed % fault_every) == 0) ? (uint8_t)(miso ^ (1 << ((seed >> 16) & 7))) : miso;
+  }
+
+  uint64_t call_ns(uint32_t bytes, uint32_t hz)
+  {
+    return SIM_SPI_CALL_NS + (uint64_t)(bytes > 0 ? (bytes - 1) / 64 : 0) * SIM_SPI_FIFO_NS + bits_ns(bytes, hz);
+  }
+}
+
+namespace sim
+{
+  void spi_attach(uint8_t cs_pin, SpiDevice *dev)
+  {
+    devices()[cs_pin] = dev;
+  }
+
+  void spi_cs(uint8_t pin, uint8_t val)
+  {
+    auto it = devices().find(pin);
+    if (it == devices().end())
+    {
+      return;
+    }
+    if ((val == 0) and (selected == NULL))
+    {
+      selected = it->second;
+      selected->select();
+    }
+    else if ((val != 0) and (selected == it->second))
+    {
+      charge(SIM_SPI_CS_NS);
+      selected->deselect(frame_ns);
+      selected = NULL;
+      frame_ns = 0;
+    }
+  }
+
+  uint64_t spi_ns(uint32_t frames, uint32_t calls, uint32_t bytes, uint32_t hz)
+  {
+    return (uint64_t)frames * (SIM_SPI_TRANSACTION_NS + SIM_SPI_CS_NS) + (uint64_t)calls * SIM_SPI_CALL_NS +
+           (uint64_t)(bytes / 64) * SIM_SPI_FIFO_NS + bits_ns(bytes, hz);
+  }
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+  hz = settings.clock;
+  fault_hz = (uint64_t)sim::env_long("MRD_SIM_SPI_MAX_MHZ", 0) * 1000000;
+  fault_every = sim::env_long("MRD_SIM_SPI_ERR_EVERY", 1000);
+  charge(SIM_SPI_TRANSACTION_NS / 2);
+}
+
+void SPIClass::endTransaction()
+{
+  charge(SIM_SPI_TRANSACTION_NS - SIM_SPI_TRANSACTION_NS / 2);
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  charge(call_ns(1, hz));
+  return selected ? line(selected->transfer(data), hz) : 0xFF;
+}
+
+void SPIClass::transfer(uint8_t *data, uint32_t size)
+{
+  transferBytes(data, data, size);
+}
+
+void SPIClass::transferBytes(const uint8_t *data, uint8_t *out, uint32_t size)
+{
+  charge(call_ns(size, hz));
+  for (uint32_t i = 0; i < size; i++)
+  {
+    uint8_t miso = selected ? line(selected->transfer(data ? data[i] : 0xFF), hz) : 0xFF;
+    if (out)
+    {
+      out[i] = miso;
+    }
+  }
+}
+
+void SPIClass::writeBytes(const uint8_t *data, uint32_t size)
+{
+  transferBytes(data, NULL, size);
+}
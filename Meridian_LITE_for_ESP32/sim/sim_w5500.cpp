@@ -0,0 +1,337 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_w5500.cpp
+ * @brief   W5500 register model on the simulated SPI bus (for src/mrd_w5500.h).
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+
+#include "sim.h"
+
+#include <vector>
+
+/*
+  W5500の共通レジスタ, 8ソケットのレジスタと2KBずつの送受信バッファを持ち, SPIのフレーム
+  [アドレス2byte][制御1byte(BSB, RWB, OM)][データ...] を解釈する. UDPモードのソケットだけを扱い,
+  OPENでホストのUDPソケットを開き, SENDでホストに送り, Sn_RX_RSRを読んだ時に届いたパケットを
+  受信バッファに [IP4 ポート2 長さ2][データ] で入れる. SEND_OKは100Mbpsでの送出時間の後に立つ.
+  CSピンは MRD_SIM_W5500_CS (既定5). フレームのSPI時間は送信/受信/受信なしに分けて集計する.
+  MRD_SIM_W5500_RSR_TEAR=1 では, Sn_RX_RSRの上位バイトを読んだ後にパケットが届いた場合を再現し,
+  上位バイトは届く前, 下位バイトは届いた後の値を返す(実機で2回一致するまで読む必要がある理由).
+*/
+#define SIM_W5500_BUF 2048
+
+namespace
+{
+  enum
+  {
+    Sn_MR = 0x00,
+    Sn_CR = 0x01,
+    Sn_IR = 0x02,
+    Sn_SR = 0x03,
+    Sn_PORT = 0x04,
+    Sn_DIPR = 0x0C,
+    Sn_DPORT = 0x10,
+    Sn_RXBUF_SIZE = 0x1E,
+    Sn_TXBUF_SIZE = 0x1F,
+    Sn_TX_FSR = 0x20,
+    Sn_TX_RD = 0x22,
+    Sn_TX_WR = 0x24,
+    Sn_RX_RSR = 0x26,
+    Sn_RX_RD = 0x28,
+    Sn_RX_WR = 0x2A,
+  };
+
+  struct SimSocket
+  {
+    uint8_t reg[0x30];
+    uint8_t tx[SIM_W5500_BUF];
+    uint8_t rx[SIM_W5500_BUF];
+    int host = -1;
+    bool send_pending = false;
+    uint64_t send_done_us = 0;
+
+    uint16_t get16(int a) const { return (uint16_t)((reg[a] << 8) | reg[a + 1]); }
+    void set16(int a, uint16_t v)
+    {
+      reg[a] = v >> 8;
+      reg[a + 1] = v & 0xFF;
+    }
+  };
+
+  class SimW5500 : public sim::SpiDevice
+  {
+  public:
+    SimW5500()
+    {
+      memset(common, 0, sizeof(common));
+      common[0x39] = 0x04; // VERSIONR
+      for (int s = 0; s < 8; s++)
+      {
+        memset(sock[s].reg, 0, sizeof(sock[s].reg));
+        sock[s].reg[Sn_RXBUF_SIZE] = SIM_W5500_BUF / 1024;
+        sock[s].reg[Sn_TXBUF_SIZE] = SIM_W5500_BUF / 1024;
+        sock[s].set16(Sn_TX_FSR, SIM_W5500_BUF);
+      }
+      sim::spi_attach((uint8_t)sim::env_long("MRD_SIM_W5500_CS", 5), this);
+      tear = sim::env_long("MRD_SIM_W5500_RSR_TEAR", 0) != 0;
+    }
+
+    void select() override
+    {
+      pos = 0;
+      kind = -1;
+      packet = false;
+      closed = false;
+    }
+
+    uint8_t transfer(uint8_t mosi) override
+    {
+      uint8_t miso = 0;
+      if (pos == 0)
+      {
+        addr = (uint16_t)(mosi << 8);
+      }
+      else if (pos == 1)
+      {
+        addr |= mosi;
+      }
+      else if (pos == 2)
+      {
+        ctl = mosi;
+      }
+      else
+      {
+        miso = access(mosi);
+        addr++;
+      }
+      pos++;
+      return miso;
+    }
+
+    void deselect(uint64_t frame_ns) override
+    {
+      if ((kind >= 0) and !closed)
+      {
+        sim::net_spi(kind, 1, frame_ns, packet or (kind == 2)); // 受信なしはフレームごとに数える
+      }
+    }
+
+  private:
+    uint8_t common[0x40];
+    SimSocket sock[8];
+    int pos = 0;
+    uint16_t addr = 0;
+    uint8_t ctl = 0;
+    int kind = -1;       // このフレームの集計先 (0:送信, 1:受信, 2:受信なし)
+    bool packet = false; // このフレームでパケットの送信/受信が終わった
+    bool closed = false; // 開いていないソケットへのアクセス(初期化, クロック調整の試験)は集計しない
+    bool tear = false;   // Sn_RX_RSRを読む途中でパケットが届く
+
+    void classify(int k)
+    {
+      if ((kind < 0) or (kind == 2))
+      {
+        kind = k;
+      }
+    }
+
+    uint8_t access(uint8_t mosi)
+    {
+      int block = ctl >> 3;
+      bool write = (ctl & 0x04) != 0;
+      if (block == 0) // 共通レジスタ
+      {
+        closed = true;
+        if (addr >= sizeof(common))
+        {
+          return 0;
+        }
+        if (write and (addr != 0x39))
+        {
+          common[addr] = mosi;
+        }
+        return common[addr];
+      }
+      SimSocket &s = sock[(block >> 2) & 7];
+      closed = closed or (s.host < 0);
+      switch (block & 3)
+      {
+      case 1:
+        return write ? reg_write(s, mosi) : reg_read(s);
+      case 2:
+        classify(0);
+        if (write)
+        {
+          s.tx[addr % SIM_W5500_BUF] = mosi; // バッファの端で折り返す
+        }
+        return s.tx[addr % SIM_W5500_BUF];
+      case 3:
+        classify(1);
+        return s.rx[addr % SIM_W5500_BUF];
+      }
+      return 0;
+    }
+
+    uint8_t reg_read(SimSocket &s)
+    {
+      if (addr >= sizeof(s.reg))
+      {
+        return 0;
+      }
+      switch (addr)
+      {
+      case Sn_CR:
+      case Sn_IR:
+        classify(0);
+        if (s.send_pending and (sim::now_us() >= s.send_done_us))
+        {
+          s.send_pending = false;
+          s.reg[Sn_IR] |= 0x10; // SEND_OK
+        }
+        break;
+      case Sn_TX_FSR:
+      case Sn_TX_RD:
+        classify(0);
+        break;
+      case Sn_RX_RSR:
+      {
+        uint8_t before = s.reg[Sn_RX_RSR];
+        fill(s);
+        classify(s.get16(Sn_RX_RSR) ? 1 : 2);
+        if (tear)
+        {
+          return before; // 下位バイトは届いた後の値になる
+        }
+        break;
+      }
+      case Sn_RX_RD:
+        classify(1);
+        break;
+      }
+      return s.reg[addr];
+    }
+
+    uint8_t reg_write(SimSocket &s, uint8_t v)
+    {
+      if (addr >= sizeof(s.reg))
+      {
+        return 0;
+      }
+      switch (addr)
+      {
+      case Sn_CR:
+        command(s, v);
+        return 0;
+      case Sn_IR:
+        s.reg[Sn_IR] &= ~v; // 1を書いたビットを消す
+        return 0;
+      case Sn_SR:
+      case Sn_TX_FSR:
+      case Sn_TX_FSR + 1:
+      case Sn_TX_RD:
+      case Sn_TX_RD + 1:
+      case Sn_RX_RSR:
+      case Sn_RX_RSR + 1:
+      case Sn_RX_WR:
+      case Sn_RX_WR + 1:
+        return 0; // 読み出し専用
+      case Sn_DIPR:
+      case Sn_DIPR + 1:
+      case Sn_DIPR + 2:
+      case Sn_DIPR + 3:
+      case Sn_DPORT:
+      case Sn_DPORT + 1:
+      case Sn_TX_WR:
+      case Sn_TX_WR + 1:
+        classify(0);
+        break;
+      case Sn_RX_RD:
+      case Sn_RX_RD + 1:
+        classify(1);
+        break;
+      }
+      s.reg[addr] = v;
+      return 0;
+    }
+
+    void command(SimSocket &s, uint8_t cmd)
+    {
+      switch (cmd)
+      {
+      case 0x01: // OPEN
+        sim::net_close(s.host);
+        s.host = -1;
+        s.reg[Sn_SR] = 0;
+        if ((s.reg[Sn_MR] & 0x0F) == 0x02) // UDP
+        {
+          s.host = sim::net_open(s.get16(Sn_PORT));
+          s.reg[Sn_SR] = 0x22; // SOCK_UDP
+        }
+        s.set16(Sn_TX_RD, 0);
+        s.set16(Sn_TX_WR, 0);
+        s.set16(Sn_TX_FSR, SIM_W5500_BUF);
+        s.set16(Sn_RX_RD, 0);
+        s.set16(Sn_RX_WR, 0);
+        s.set16(Sn_RX_RSR, 0);
+        s.send_pending = false;
+        break;
+      case 0x10: // CLOSE
+        sim::net_close(s.host);
+        s.host = -1;
+        s.reg[Sn_SR] = 0;
+        break;
+      case 0x20: // SEND
+      {
+        classify(0);
+        packet = true;
+        uint16_t rd = s.get16(Sn_TX_RD);
+        uint16_t len = (uint16_t)(s.get16(Sn_TX_WR) - rd);
+        std::vector<uint8_t> data(len);
+        for (uint16_t i = 0; i < len; i++)
+        {
+          data[i] = s.tx[(uint16_t)(rd + i) % SIM_W5500_BUF];
+        }
+        sim::net_send(s.host, s.get16(Sn_DPORT), data.data(), len);
+        s.set16(Sn_TX_RD, s.get16(Sn_TX_WR));
+        s.send_pending = true;
+        s.send_done_us = sim::now_us() + 2 + (uint64_t)(len + 42) * 8 / 100; // 100Mbpsでの送出
+        break;
+      }
+      case 0x40: // RECV
+        classify(1);
+        packet = true;
+        s.set16(Sn_RX_RSR, (uint16_t)(s.get16(Sn_RX_WR) - s.get16(Sn_RX_RD)));
+        break;
+      }
+    }
+
+    // 届いているパケットを空きがある限り受信バッファに入れる
+    void fill(SimSocket &s)
+    {
+      static uint8_t buf[1500];
+      while ((s.host >= 0) and (SIM_W5500_BUF - s.get16(Sn_RX_RSR) >= 8 + (int)sizeof(buf)))
+      {
+        uint32_t ip = 0;
+        uint16_t port = 0;
+        int n = sim::net_recv(s.host, buf, sizeof(buf), &ip, &port);
+        if (n <= 0)
+        {
+          break;
+        }
+        uint8_t hdr[8] = {(uint8_t)ip, (uint8_t)(ip >> 8), (uint8_t)(ip >> 16), (uint8_t)(ip >> 24),
+                          (uint8_t)(port >> 8), (uint8_t)port, (uint8_t)(n >> 8), (uint8_t)n};
+        uint16_t wr = s.get16(Sn_RX_WR);
+        for (int i = 0; i < 8 + n; i++)
+        {
+          s.rx[(uint16_t)(wr + i) % SIM_W5500_BUF] = (i < 8) ? hdr[i] : buf[i - 8];
+        }
+        s.set16(Sn_RX_WR, (uint16_t)(wr + 8 + n));
+        s.set16(Sn_RX_RSR, (uint16_t)(s.get16(Sn_RX_RSR) + 8 + n));
+      }
+    }
+  };
+
+  SimW5500 w5500;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_wiimote.cpp
+ * @brief   Wiimote stand-in.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <ESP32Wiimote.h>
+
+#include <cstdlib>
+
+namespace
+{
+  bool scripted(uint32_t *buttons)
+  {
+    const char *s = getenv("MRD_SIM_WIIMOTE_BUTTONS");
+    if (s == NULL)
+    {
+      return false;
+    }
+    *buttons = (uint32_t)strtoul(s, NULL, 0);
+    return true;
+  }
+}
+
+bool ESP32Wiimote::getSnapshot(WiimoteSnapshot *snapshot)
+{
+  uint32_t buttons;
+  if (!scripted(&buttons))
+  {
+    return false;
+  }
+  snapshot->buttonState = (ButtonState)buttons;
+  snapshot->accelState = getAccelState();
+  snapshot->nunchukState = getNunchukState();
+  snapshot->reports = 1;
+  return true;
+}
+
+int ESP32Wiimote::available(void)
+{
+  uint32_t buttons;
+  return scripted(&buttons) ? 1 : 0;
+}
+
+ButtonState ESP32Wiimote::getButtonState(void)
+{
+  uint32_t buttons;
+  return scripted(&buttons) ? (ButtonState)buttons : NO_BUTTON;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/sim/sim_wire.cpp
+ * @brief   I2C bus stand-in routing Wire transactions to the attached devices.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "sim.h"
+
+#include <map>
+
+TwoWire Wire;
+
+namespace
+{
+  std::map<uint8_t, sim::I2cDevice *> &devices()
+  {
+    static std::map<uint8_t, sim::I2cDevice *> map;
+    return map;
+  }
+
+  sim::I2cDevice *device(uint16_t address)
+  {
+    auto it = devices().find((uint8_t)address);
+    return (it == devices().end()) ? NULL : it->second;
+  }
+
+  // アドレスを含めたbytesバイトのバス時間 (ACKを含め1バイト9クロック)
+  void charge(int bytes, uint32_t hz)
+  {
+    sim::busy_ns((uint64_t)bytes * 9 * 1000000000ULL / (hz ? hz : 100000));
+  }
+}
+
+namespace sim
+{
+  void i2c_attach(uint8_t address, I2cDevice *dev)
+  {
+    devices()[address] = dev;
+  }
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency)
+{
+  (void)sda;
+  (void)scl;
+  hz = frequency ? frequency : 100000;
+  return true;
+}
+
+void TwoWire::beginTransmission(uint16_t address)
+{
+  tx_addr = address;
+  tx_len = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (tx_len >= (int)sizeof(tx_buf))
+  {
+    return 0;
+  }
+  tx_buf[tx_len++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len)
+{
+  size_t n = 0;
+  while ((n < len) and write(data[n]))
+  {
+    n++;
+  }
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(bool send_stop)
+{
+  (void)send_stop;
+  sim::I2cDevice *dev = device(tx_addr);
+  if ((dev == NULL) or !dev->write(tx_buf, tx_len))
+  {
+    charge(1, hz);
+    return 2; // アドレスにNACK
+  }
+  charge(1 + tx_len, hz);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint16_t address, uint8_t len, bool send_stop)
+{
+  (void)send_stop;
+  rx_len = 0;
+  rx_pos = 0;
+  sim::I2cDevice *dev = device(address);
+  if (len > sizeof(rx_buf))
+  {
+    len = sizeof(rx_buf);
+  }
+  if (dev)
+  {
+    rx_len = dev->read(rx_buf, len);
+  }
+  charge(1 + rx_len, hz);
+  return (uint8_t)rx_len;
+}
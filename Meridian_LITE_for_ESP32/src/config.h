@@ -91,7 +91,10 @@
 
 /* Meridimの基本設定 */
 #define MSG_SIZE 90       // Meridim配列の長さ設定（デフォルトは90）
-#define FRAME_DURATION 10 // 1フレームあたりの単位時間（単位ms）
+#define FRAME_DURATION_US 10000 // 1フレームあたりの単位時間（単位us, 1000〜20000. 10000で100Hz, 4000で250Hz）
+#if (FRAME_DURATION_US < 1000) || (FRAME_DURATION_US > 20000)
+#error "FRAME_DURATION_US must be 1000-20000"
+#endif
 
 /* 各種ハードウェアのマウント有無 */
 #define MOUNT_ESP32 1        // ESPの搭載 (0:なし-SPI通信およびUDP通信を実施しない, 1:あり)
@@ -115,6 +118,30 @@
 #define MONITOR_FLOW 0      // シリアルモニタでフローを表示（0:OFF, 1:ON）
 #define MONITOR_SEQ 0       // シリアルモニタでシーケンス番号チェックを表示（0:OFF, 1:ON）
 #define MONITOR_SERVO_ERR 0 // シリアルモニタでサーボエラーを表示（0:OFF, 1:ON）
+#define MONITOR_IMU_FUSION 0 // シリアルモニタでMPUのフュージョン処理サイクル数を表示（0:OFF, 1:ON）
+#define MONITOR_RECORDER 0   // シリアルモニタでフライトレコーダーの統計を表示（0:OFF, 1:ON）
+#define MONITOR_SPI 0        // シリアルモニタでSPIバス(W5500とSDカード)の使用率を表示（0:OFF, 1:ON）
+
+/* フライトレコーダー(SDカードに全フレームの送受信Meridimを記録. MOUNT_SD 1 が必要) */
+#define SD_RECORDER 0                  // フライトレコーダーの使用 (0:OFF, 1:ON)
+#define SD_RECORDER_FILE "/flight.mrd" // 記録ファイル名
+#define SD_RECORDER_BLOCKS 2048        // 記録ファイルのブロック数 (1ブロック4KB=11フレーム, 2048で8MB/約225秒@100Hz)
+#define SD_RECORDER_CORE 0             // 書き込みタスクを割り当てるコア
+
+/* リプレイモード(記録ファイルのMeridimをUDP受信の代わりに使う. UDP送信は通常通り行う) */
+#define REPLAY_MODE 0                 // 0:OFF(UDP受信), 1:記録時のタイミングで再生, 2:最速で再生(サーボ処理のベンチマーク用)
+#define REPLAY_FS 0                   // 記録ファイルの場所 0:SDカード(MOUNT_SD 1 が必要), 1:SPIFFS
+#define REPLAY_FILE "/flight.mrd"     // 再生するファイル名 (フライトレコーダーと同時に使う場合は別名にすること)
+#define REPLAY_LOOP 1                 // 最後まで再生したら先頭に戻る (0:停止, 1:繰り返し)
+#define MONITOR_REPLAY 0              // シリアルモニタでリプレイの統計を表示（0:OFF, 1:ON）
+
+/* モーションアセット(フラッシュのmotion領域に置いたモーションを再生. 形式は mrd_motion.h, 領域は partitions_meridian.csv) */
+#define MOTION_ASSET 0                    // モーションアセットの使用 (0:OFF, 1:ON). アップロード中はフラッシュの消去で4KBごとにフレームが数十ms止まる
+#define MOTION_ASSET_LABEL "motion"       // モーションアセットのパーティション名
+#define MOTION_PLAY_INDEX MRD_USERDATA_80 // MCMD_MOTION_PLAYで再生するモーション番号を入れるMeridimの位置
+#define MONITOR_MOTION 0                  // シリアルモニタでモーションの再生とアップロードの状況を表示（0:OFF, 1:ON）
+// ボタンの組み合わせ(PS系ボタン配列)とモーション番号の対応. ボードに接続したジョイパッド(MOUNT_JOYPAD)でi番目の組み合わせを押し始めるとi番のモーションを再生 (0:割り当てなし)
+constexpr unsigned short MOTION_PAD_BUTTONS[] = {0x1400, 0x2400, 0x4400, 0x8400}; // L1+△, L1+○, L1+×, L1+□
 
 /* Wifiアクセスポイントの設定(SSID,パスワード等は別途keys.hで指定) */
 #define UDP_TIMEOUT 4 // UDPの待受タイムアウト（単位ms,推奨値0）
@@ -125,39 +152,86 @@
 /* リモコンの設定(ESP32自身のBluetoothMACアドレスは別途keys.hで指定) */
 #define BT_PAIR_MAX_DEVICES 20     // BT接続デバイスの記憶可能数
 #define BT_REMOVE_BONDED_DEVICES 0 // 0でバインドデバイス情報表示, 1でバインドデバイス情報クリア(BTリモコンがペアリング接続できない時に使用)
+#define WIIMOTE_TASK_CORE 0        // Wiiリモコンの受信処理タスクを動かすコア(BTコントローラと同じ0を推奨)
+#define WIIMOTE_TASK_PRIORITY 5    // Wiiリモコンの受信処理タスクの優先度
 // リモコン受信ボタンデータの変換テーブル
 constexpr unsigned short PAD_WIIMOTE_SOLO[16] = {0x1000, 0x0080, 0x0000, 0x0010, 0x0200, 0x0400, 0x0100, 0x0800, 0x0000, 0x0000, 0x0000, 0x0000, 0x0008, 0x0001, 0x0002, 0x0004};
 constexpr unsigned short PAD_WIIMOTE_ORIG[16] = {0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x0000, 0x0000, 0x0000, 0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0000, 0x0000, 0x0080};
+constexpr unsigned short PAD_KRR5FH_SOLO[16] = {0x0000, 0x0000, 0x0000, 0x0000, 0x0001, 0x0004, 0x0002, 0x0008, 0x0400, 0x1000, 0x0200, 0x0800, 0x0010, 0x0040, 0x0020, 0x0100};
+// ※各テーブルの i 番目はPS系ボタン配列の i ビット目を立てる元ボタンのマスク. mrd_pad_remap.h でコンパイル時に256要素x2の変換表を生成する
 
 // PC接続関連設定
 #define SERIAL_PC_BPS 115200 // PCとのシリアル速度（モニタリング表示用）
+#define SERIAL_LINK 0              // PCとのMeridimの送受信 (0:UDP(W5500), 1:USBシリアル(W5500が無い場合). 形式は mrd_cobs.h)
+#define SERIAL_LINK_BPS 2000000    // SERIAL_LINK 1 の時のシリアル速度 (USBシリアル変換ICの上限以下. CP2102Nなら3000000まで)
+#define SERIAL_LINK_RX_BUFFER 2048 // SERIAL_LINK 1 の時のUARTの受信バッファのバイト数(バッチパケットが入る大きさ)
 
 // SPI設定
 #define SPI_SPEED 6000000 // SPI通信の速度（6000000kHz推奨）
+#define W5500_BURST 0     // UDPのW5500アクセス (0:Ethernet2ライブラリ, 1:可変長フレームでまとめて転送 mrd_w5500.h, 実機で確認してから使う)
+#define SPI_TUNE 0             // 起動時にW5500のSPIクロックを調整 (0:SPI_SPEED固定, 1:SPI_SPEEDからSPI_SPEED_MAXまで上げて検証, W5500_BURST 1 のみ. 実機で確認してから使う)
+#define SPI_SPEED_MAX 33333333 // 調整で試すSPIクロックの上限(W5500の保証する33.3MHz以下にする)
+#define SPI_TUNE_MARGIN 1      // 検証を通った最も速いクロックから下げる段数
 
 /* UDP通信のオンオフ */
 #define UDP_RESEIVE 1 // PCからのデータ受信（0:OFF, 1:ON, 通常は1）
 #define UDP_SEND 1    // PCへのデータ送信（0:OFF, 1:ON, 通常は1）
+#define PEER_LEARN 0  // 送信先 (0:keys.hのWIFI_SEND_IP, 1:最後に正しいMeridimを送ってきたPCのIPアドレス, 2:そのIPアドレスと送信元ポート)
+
+/* UDP送信の頻度 (制御周期とは独立に設定) */
+#define UDP_SEND_DIVISOR 1 // Meridim全体(180byte)を何フレームに1回送るか (1:毎フレーム, 例:250Hz制御で5なら50Hz)
+#define UDP_SEND_FAST 0    // Meridim全体を送らないフレームで高速項目のみの短いパケットをUDP_SEND_FAST_PORTに送る (0:OFF, 1:ON)
+constexpr unsigned char UDP_FAST_FIELDS[] = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 88}; // 高速項目として送るMeridimの位置 (IMU/AHRS, エラーフラグ)
+#define MONITOR_UDP_SEND 0 // シリアルモニタでUDP送信の統計を表示（0:OFF, 1:ON）
+
+/* バッチ受信 (1つのUDPパケットで数フレーム先までのMeridimを受け取り, 受信キューから1フレームずつ予定通りに取り出す. 形式は mrd_jitter.h) */
+#define UDP_BATCH_RECEIVE 1 // バッチ形式のパケットを受け付ける (0:OFF, 1:ON). 通常のMeridimはこれまで通り受信する
+#define UDP_BATCH_DELAY 4   // 最初のフレームを受けてから再生を始めるまでのフレーム数 (吸収できるネットワークの揺らぎ)
+#define UDP_BATCH_DEPTH 32  // 受信キューに入れる先読みの上限フレーム数 (最大64)
+#define MONITOR_JITTER 0    // シリアルモニタでバッチ受信の統計を表示（0:OFF, 1:ON）
+
+/* 差分Meridim送信 (PCがMCMD_DELTA_ONを送った場合のみ. 形式は mrd_delta.h) */
+#define UDP_DELTA_KEY_INTERVAL 100          // キーフレーム(Meridim全体)を送る間隔(送信回数)
+#define UDP_DELTA_ACK_INDEX MRD_USERDATA_87 // PCが保持しているキーフレームの番号を入れるMeridimの位置 (購読のパラメータ[80]-[86]の外)
+
+/* 購読者への配信 (PCがMCMD_SUBSCRIBEで登録した最大4つの宛先に, 購読者ごとの頻度と項目で送る. 形式は mrd_fanout.h) */
+#define UDP_SUBSCRIBERS 1                // 購読の登録を受け付ける (0:OFF, 1:ON)
+#define SUB_PARAM_INDEX MRD_USERDATA_80  // MCMD_SUBSCRIBE/MCMD_UNSUBSCRIBEのパラメータ(7語, [87]はUDP_DELTA_ACK_INDEXなので含まない)を入れるMeridimの位置
+#define MONITOR_SUBS 0                   // シリアルモニタで購読者ごとの送信統計を表示（0:OFF, 1:ON）
 
 // I2C設定, I2Cセンサ関連設定
 #define I2C_SPEED 400000   // I2Cの速度（400kHz推奨）
-#define IMUAHRS_POLLING 10 // IMU/AHRSのセンサの読み取り間隔(ms)
+#define IMUAHRS_POLLING_US 10000 // IMU/AHRS(BNO055)のセンサの読み取り間隔(us)
 #define IMUAHRS_STOCK 4    // MPUで移動平均を取る際の元にする時系列データの個数
+#define IMUAHRS_FUSION_HZ 500    // MPU系センサのサンプリングおよびフュージョン更新の周波数(Hz, 1000の約数)
+#define IMUAHRS_FUSION_KP 131072 // MPU系フュージョンの比例ゲイン(Q16, 65536で1.0)
+#define IMUAHRS_FUSION_KI 0      // MPU系フュージョンの積分ゲイン(Q16, 65536で1.0)
 
 // サーボ関連設定
 #define ICS_BAUDRATE 1250000    // ICSサーボの通信速度1.25M
 #define ICS_TIMEOUT 2           // ICS返信待ちのタイムアウト時間
 #define SERVO_LOST_ERROR_WAIT 4 // 連続何フレームサーボ信号をロストしたら異常とするか
+#define MOTION_INTERP_PROFILE 3 // Meridim[MRD_MOTION_FRAMES]で補間する際の既定の形 (1:直線, 2:3次, 3:最小躍度)
+#define MONITOR_TRAJ 0          // シリアルモニタで軌道セグメントの統計を表示（0:OFF, 1:ON）
 
 // JOYPAD関連設定
-#define JOYPAD_POLLING 4    // 上記JOYPADのデータを読みに行くフレーム間隔 (※KRC-5FHでは4推奨,Bluetooth系は10推奨)
+#define JOYPAD_POLLING_US 40000 // 上記JOYPADのデータを読みに行く間隔(us) (※KRC-5FHでは40000推奨,Bluetooth系は100000推奨)
 #define JOYPAD_REFRESH 1    // JOYPADの受信ボタンデータをこのデバイスで0リセットするか、リセットせず論理加算するか （0:overide, 1:reflesh, 通常は1）
 #define JOYPAD_GENERALIZE 1 // ジョイパッドの入力値をPS系に一般化する
+#define KRR_BUS_BUDGET_US 600 // KRC-5FHの受信に必要なR系統の空き時間(us). フレーム残り時間がこれ未満なら次フレームに回す
 
 /* 固定値, マスターコマンド定義 */
 #define MCMD_UPDATE_YAW_CENTER 10002    // センサの推定ヨー軸を現在値センターとしてリセット
 #define MCMD_ENTER_TRIM_MODE 10003      // トリムモードに入る（全サーボオンで垂直に気おつけ姿勢で立つ）
 #define MCMD_CLEAR_SERVO_ERROR_ID 10004 // 通信エラーのサーボのIDをクリア(MSG_ERR_l)
+#define MCMD_BENCH 10010                // フレーム処理の各工程のベンチマークを実行し, 結果をJSONでシリアルに出力
+#define MCMD_DELTA_ON 10011             // UDP送信を差分Meridimに切り替える
+#define MCMD_DELTA_OFF 10012            // UDP送信を通常のMeridimに戻す
+#define MCMD_TRAJ_SEGMENT 10013         // 軌道セグメント(各軸の区間終点の角度・角速度, 開始時刻, 長さ. 形式は mrd_traj.h)
+#define MCMD_MOTION_PLAY 10014          // モーションアセットの再生 (番号はMeridim[MOTION_PLAY_INDEX])
+#define MCMD_MOTION_STOP 10015          // モーションアセットの再生を止める
+#define MCMD_SUBSCRIBE 10016            // 購読者の登録 (パラメータはMeridim[SUB_PARAM_INDEX]から. 形式は mrd_fanout.h)
+#define MCMD_UNSUBSCRIBE 10017          // 購読者の削除
 
 /* ピンアサイン */
 #define ERR_LED 25           // LED用 処理が時間内に収まっていない場合に点灯
@@ -166,6 +240,7 @@ constexpr unsigned short PAD_WIIMOTE_ORIG[16] = {0x0100, 0x0200, 0x0400, 0x0800,
 #define SERVO_NUM_L 11       // L系統につないだサーボの数
 #define SERVO_NUM_R 11       // R系統につないだサーボの数
 #define PIN_CHIPSELECT_SD 15 // SDカード用のCSピン
+#define PIN_CHIPSELECT_W5500 5 // W5500用のCSピン(W5500_BURST 1 の時に使用)
 
 //-------------------------------------------------------------------------
 //---- サ ー ボ 設 定  -----------------------------------------------------
@@ -4,6 +4,7 @@
 #define WIFI_SEND_IP "192.168.7.18" // 送り先のPCのIPアドレス（PCのIPアドレスを調べておく）
 #define UDP_SEND_PORT 22222         // 送り先のポート番号
 #define UDP_RESV_PORT 22224         // このESP32のポート番号
+#define UDP_SEND_FAST_PORT 22226    // 高速項目パケットの送り先のポート番号 (UDP_SEND_FAST 1 の時のみ)
 
 /* ESP32のIPアドレスを固定する場合は下記の5項目を設定 */
 #define FIXED_IP_ADDR "192. 168. 1. xx"    // ESP32のIPアドレスを固定する場合のESPのIPアドレス -- 2024/01/14 使用しない
@@ -62,6 +62,22 @@
 
 /* ヘッダファイルの読み込み */
 #include "main.h"
+#include "mrd_bench.h"
+#include "mrd_delta.h"
+#include "mrd_fanout.h"
+#include "mrd_fusion.h"
+#include "mrd_interp.h"
+#include "mrd_jitter.h"
+#include "mrd_link.h"
+#include "mrd_pad_remap.h"
+#include "mrd_peer.h"
+#include "mrd_asset.h"
+#include "mrd_recorder.h"
+#include "mrd_replay.h"
+#include "mrd_spi.h"
+#include "mrd_telemetry.h"
+#include "mrd_traj.h"
+#include "mrd_w5500.h"
 
 /* ライブラリ導入 */
 #include <Arduino.h>
@@ -70,19 +86,23 @@ MERIDIANFLOW::Meridian mrd;     // ライブラリのクラスを mrdという
 //#include <WiFi.h>               // WiFi通信用ライブラリ      -- 2024/01/14 コメントアウト WIFIから有線LANへ
 //#include <WiFiUdp.h>            // UDP通信用ライブラリ       -- 2024/01/14 コメントアウト WIFIから有線LANへ
 //WiFiUDP udp;                    // wifi設定                  -- 2024/01/14 コメントアウト WIFIから有線LANへ
-//#include <IcsHardSerialClass.h> // KONDOサーボのライブラリ    -- 2024/01/06 コメントアウト KONDOからROBOTISへ
+#include <IcsHardSerialClass.h> // KONDOサーボのライブラリ    -- KRC-5FH(KRR-5FH)の受信にのみ使用
 #include <Wire.h>               // I2C通信用ライブラリ
 #include <Adafruit_BNO055.h>    // 9軸センサBNO055用のライブラリ
 #include <ESP32Wiimote.h>       // Wiiコントローラーのライブラリ
 ESP32Wiimote wiimote;           // Wiiコントローラー設定
 #include <SPI.h>                // SPIのライブラリ
 #include <SD.h>                 // SDカード用のライブラリ
+#include <SPIFFS.h>             // フラッシュのファイルシステム(リプレイ用)
 
 #include <Dynamixel2Arduino.h>  // Dynamixelのライブラリ -- 2024/01/06 追加
+#include <driver/uart.h>        // R系統のUARTの形式の切り替え(KRC-5FHの受信)
 #include <Ethernet2.h>          // 有線LANの追加(SPI接続) -- 2024/01/14 追加
                                 // MeridianのSPIがSPI3との接続のため、w5500.cppとw5500.hも一部修正(begin関数とCSピンの定義について)
 #include <EthernetUDP2.h>       // 有線LANの追加(SPI接続) -- 2024/01/14 追加
-EthernetUDP udp;                // 有線LANの追加(SPI接続) -- 2024/01/14 追加
+#include <type_traits>
+typedef std::conditional<(W5500_BURST != 0), MrdW5500Udp, EthernetUDP>::type MrdUdp; // W5500へのアクセス方法
+MrdUdp udp;                     // 有線LANの追加(SPI接続) -- 2024/01/14 追加
 
 // 自局MACアドレスと自局IPアドレス (有線LAN)----------------------------------
 // 現時点では、key.hのFIXED_IP_ADDRよりこちらが優先されてしまう。
@@ -99,7 +119,9 @@ IPAddress ip(192, 168, 7, 107);
 //                   DYNAMIXEL関連 
 //---------------------------------------------------
 
-#define DEBUG_SERIAL Serial
+MrdMutePrint debug_mute;                                            // SERIAL_LINK ではMeridimの枠を壊さないよう表示しない
+Print &debug_serial = SERIAL_LINK ? (Print &)debug_mute : (Print &)Serial; // Dynamixelの動作表示の出力先
+#define DEBUG_SERIAL debug_serial
 #define DXL_SERIAL_L Serial1
 #define DXL_SERIAL_R Serial2
 const uint8_t DXL_DIR_PIN_L = 33; // DYNAMIXEL Shield DIR PIN
@@ -150,7 +172,7 @@ int dx_result;
 
 /* ICSサーボのインスタンス設定 */
 // IcsHardSerialClass krs_L(&Serial1, PIN_EN_L, ICS_BAUDRATE, ICS_TIMEOUT); // サーボL系統UARTの設定（TX27,RX32,EN33）
-// IcsHardSerialClass krs_R(&Serial2, PIN_EN_R, ICS_BAUDRATE, ICS_TIMEOUT); // サーボR系統UARTの設定（TX17,RX16,EN4）
+IcsHardSerialClass krs_R(&Serial2, PIN_EN_R, ICS_BAUDRATE, ICS_TIMEOUT); // R系統UARTのICS設定（KRR-5FHの受信時のみ切り替えて使用）
 
 /* Meridim配列設定 */
 const int MSG_BUFF = MSG_SIZE * 2;     // Meridim配列のバイト長
@@ -172,22 +194,40 @@ UnionData r_udp_meridim = {0}; // UDP受信用共用体のインスタンスを
 /* システム用変数 */
 TaskHandle_t thp[4];                                           // マルチスレッドのタスクハンドル格納用
 File myFile;                                                   // SDカード用
+MrdSpiArbiter spi_bus;                                         // SPIバス(W5500とSDカード)の調停
+MrdRecorder recorder;                                          // SDカードのフライトレコーダー
+MrdReplay replay;                                              // 記録ファイルの再生
+MrdTelemetry telemetry;                                        // UDP送信の頻度の管理
+MrdPeer peer;                                                  // UDPの送信先(PC)
+MrdFanout fanout;                                              // 購読者への配信
+MrdLinkUdp<MrdUdp> udp_link(udp, peer, spi_bus);               // UDPでのPCとの送受信
+MrdSerialLink serial_link;                                     // シリアルでのPCとの送受信(SERIAL_LINK 1)
+MrdLink *pc_link = &udp_link;                                  // PCとの送受信に使う方
+IPAddress udp_rsvd_ip;                                         // 最後に受信したMeridimの送信元
+MrdDeltaEncoder delta_enc;                                     // 差分Meridimのエンコーダ
+bool udp_delta_mode = false;                                   // 差分Meridimで送信中か
+MrdJitterBuffer jitter;                                        // バッチ受信の受信キュー
+MrdInterp interp;                                              // 受信した姿勢へのキーフレーム補間
+MrdTraj traj;                                                  // 軌道セグメントのキュー
+bool traj_mode = false;                                        // 軌道セグメントでサーボを動かしているか
+short servo_pose[30] = {0};                                    // 今フレームの目標姿勢(degree x 100, L0-L14, R0-R14の順)
+MrdAssetStore asset;                                           // フラッシュのモーションアセット領域
+MrdMotionPlayer motion_player;                                 // モーションアセットの再生
 int servo_num_max = max(MOUNT_SERVO_NUM_L, MOUNT_SERVO_NUM_R); // サーボ送受信のループ処理数（L系R系で多い方）
 
 /* フラグ関連変数 */
 bool udp_rsvd_flag = 0; // UDPの受信終了フラグ
 
 /* タイマー管理用の変数 */
-long frame_ms = FRAME_DURATION;  // 1フレームあたりの単位時間(ms)
-long mrd_t_mil = (long)millis(); // フレーム管理時計の時刻 Meridian Time.
-long now_t_mil = (long)millis(); // 現在時刻をミリ秒で取得
-long now_t_mic = (long)micros(); // 現在時刻をマイクロ秒で取得
+long frame_us = FRAME_DURATION_US;               // 1フレームあたりの単位時間(us)
+unsigned long mrd_t_mic = (unsigned long)micros(); // フレーム管理時計の時刻(us) Meridian Time. 比較は差分で行う(オーバーフロー対策)
+unsigned long now_t_mic = (unsigned long)micros(); // 現在時刻をマイクロ秒で取得
 int frame_count = 0;             // サイン計算用の変数
 int frame_count_diff = 2;        // サインカーブ動作などのフレームカウントをいくつずつ進めるか
 int frame_count_max = 360000;    // フレームカウントの最大値
-int joypad_polling_count = 0;    // JOYPADのデータを読みに行くためのフレームカウント
+unsigned long joypad_poll_t_mic = 0; // 最後にJOYPADのデータを読みに行った時刻(us)
 int mrd_seq_s_increment = 0;     // フレーム毎に0-59999をカウントし、送信
-int mrd_seq_r_expect = 0;        // フレーム毎に0-59999をカウントし、受信値と比較
+int mrd_seq_r_expect = 0;        // 受信毎に0-59999をカウントし、受信値と比較
 
 /* エラーカウント用 */
 int err_pc_esp = 0; // ESP32の受信エラー（PCからのUDP）
@@ -218,12 +258,46 @@ int pad_stick_V = 0;
 int pad_R2_val = 0;
 int pad_L2_val = 0;
 
+/* KRC-5FH(KRR-5FH)用の変数 R系統のサーボ通信後の空き時間に受信する */
+unsigned short krr_button = 0;         // 最新のボタンデータ
+int krr_analog[4] = {0};               // 最新のアナログデータ(PA1-PA4)
+bool krr_rsvd_flag = false;            // 一度でも受信できたか
+unsigned long krr_bus_us_last = 0;     // 直近のKRR受信でR系統を占有した時間(us)
+unsigned long krr_bus_us_max = 0;      // KRR受信でR系統を占有した最大時間(us)
+unsigned long krr_bus_deferred = 0;    // フレームの空き時間が足りず次フレームに回した回数
+unsigned long krr_bus_err = 0;         // KRRからの受信失敗回数
+
 /* センサー(BNO055)用の変数*/
 Adafruit_BNO055 bno = Adafruit_BNO055(55, 0x28, &Wire);
-float bno055_read[16];        // bno055のデータの一時保存
+float imuahrs_read[16];       // IMU/AHRSのデータの一時保存(Meridim[2]-[14]と同じ並び)
 float imuahrs_yaw_origin = 0; // ヨー軸の原点セット用
 float imuahrs_yaw_source = 0; // ヨー軸のソースデータ保持用
 
+/* センサー(MPU6050/MPU9250)用の設定と変数 */
+#define MPU_ADDR 0x68             // MPU6050/MPU9250のI2Cアドレス
+#define MPU_REG_SMPLRT_DIV 0x19   // サンプリングレート分周
+#define MPU_REG_CONFIG 0x1A       // DLPF設定
+#define MPU_REG_GYRO_CONFIG 0x1B  // ジャイロのレンジ設定
+#define MPU_REG_ACCEL_CONFIG 0x1C // 加速度のレンジ設定
+#define MPU_REG_FIFO_EN 0x23      // FIFOに積むデータの選択
+#define MPU_REG_INT_STATUS 0x3A   // 割り込みステータス(bit4:FIFOオーバーフロー)
+#define MPU_REG_GYRO_XOUT_H 0x43  // ジャイロ値の先頭
+#define MPU_REG_TEMP_OUT_H 0x41   // 温度値
+#define MPU_REG_USER_CTRL 0x6A    // FIFOの有効化とリセット
+#define MPU_REG_PWR_MGMT_1 0x6B   // 電源管理
+#define MPU_REG_FIFO_COUNTH 0x72  // FIFO内のバイト数
+#define MPU_REG_FIFO_R_W 0x74     // FIFO読み出し
+#define MPU_REG_WHO_AM_I 0x75     // デバイスID
+#define MPU_FIFO_SAMPLE_LEN 12    // FIFO 1サンプルのバイト数(加速度6+ジャイロ6)
+#define MPU_FIFO_BURST 10         // 1回のI2Cバースト読み出しで取得するサンプル数(Wireのバッファ128byte以内)
+#define MPU_ACC_LSB_PER_G 4096    // +-8g設定時の感度
+#define MPU_GYRO_LSB_PER_DPS 16.4 // +-2000dps設定時の感度
+MrdFusion mpu_fusion;                 // MPU用センサフュージョン
+uint8_t mpu_who_am_i = 0;             // 検出したMPUのWHO_AM_I (温度の換算式の選択に使う)
+uint32_t imu_fusion_cycles_last = 0;  // 直近の1回のフュージョン更新にかかったCPUサイクル数
+uint32_t imu_fusion_cycles_max = 0;   // フュージョン更新の最大CPUサイクル数
+uint32_t imu_fusion_update_count = 0; // フュージョン更新の累計回数
+
 /* 各サーボのマウントありなし */
 int idl_mount[15] = {IDL_MT0, IDL_MT1, IDL_MT2, IDL_MT3, IDL_MT4, IDL_MT5, IDL_MT6, IDL_MT7, IDL_MT8, IDL_MT9, IDL_MT10, IDL_MT11, IDL_MT12, IDL_MT13, IDL_MT14}; // L系統
 int idr_mount[15] = {IDR_MT0, IDR_MT1, IDR_MT2, IDR_MT3, IDR_MT4, IDR_MT5, IDR_MT6, IDR_MT7, IDR_MT8, IDR_MT9, IDR_MT10, IDR_MT11, IDR_MT12, IDR_MT13, IDR_MT14}; // R系統
@@ -270,15 +344,22 @@ void setup()
   /* ピンモードの設定 */
   pinMode(ERR_LED, OUTPUT); // エラー通知用LED
 
-  /* PC用シリアルの設定 */
-  Serial.begin(SERIAL_PC_BPS);
+  /* PC用シリアルの設定 (SERIAL_LINK 1 ではMeridimの送受信にも使う) */
+  if (SERIAL_LINK)
+  {
+    Serial.setRxBufferSize(SERIAL_LINK_RX_BUFFER); // begin()より前に設定する
+  }
+  Serial.begin(SERIAL_LINK ? SERIAL_LINK_BPS : SERIAL_PC_BPS);
+
+  /* SPIバスの調停(UDPとSDカードで共有, UDPを優先) */
+  spi_bus.begin();
 
   /* サーボモーター用シリアルの設定 */
   // krs_L.begin();
   // krs_R.begin();
 
   // Dynamixelの設定
-  dxl_R.begin(1000000);
+  uart_r_begin(MOUNT_JOYPAD);
   dxl_R.setPortProtocolVersion(DXL_PROTOCOL_VERSION);
   dxl_L.begin(1000000);
   dxl_L.setPortProtocolVersion(DXL_PROTOCOL_VERSION);
@@ -286,7 +367,7 @@ void setup()
   delay(200);
 
   /* 起動メッセージ1 */
-  mrd.print_esp_hello_start(VERSION, String(SERIAL_PC_BPS), WIFI_AP_SSID);
+  mrd.print_esp_hello_start(VERSION, String(SERIAL_LINK ? SERIAL_LINK_BPS : SERIAL_PC_BPS), WIFI_AP_SSID);
 
   /* WiFiの初期化と開始 */
   // init_wifi(WIFI_AP_SSID, WIFI_AP_PASS);
@@ -295,14 +376,35 @@ void setup()
   //   delay(1); // 接続が完了するまでループで待つ
   // }
 
-  Ethernet.begin(mac, ip);
+  if (SERIAL_LINK) // W5500を使わずシリアルでPCと送受信する
+  {
+    serial_link.begin(&Serial, MSG_BUFF);
+    pc_link = &serial_link;
+    Serial.print("Meridim over Serial: ");
+    Serial.print(SERIAL_LINK_BPS);
+    Serial.println(" bps");
+  }
+  else
+  {
+    Ethernet.begin(mac, ip);
 
-  /* 起動メッセージ2 */
-  //mrd.print_esp_hello_ip(WIFI_SEND_IP, WiFi.localIP().toString(), FIXED_IP_ADDR, MODE_FIXED_IP);
-  mrd.print_esp_hello_ip(WIFI_SEND_IP, Ethernet.localIP().toString(), FIXED_IP_ADDR, MODE_FIXED_IP);
+    /* UDP通信の開始(W5500_BURST 1 ではSPIクロックの調整を含む) */
+    uint32_t udp_spi_hz = init_udp(udp);
+    if (!peer.begin(WIFI_SEND_IP, UDP_SEND_PORT, UDP_SEND_FAST_PORT, PEER_LEARN)) // 送信先は起動時に1回だけ解釈する
+    {
+      Serial.println("WIFI_SEND_IP is not an IPv4 address.");
+    }
 
-  /* UDP通信の開始 */
-  udp.begin(UDP_RESV_PORT);
+    /* 起動メッセージ2 */
+    //mrd.print_esp_hello_ip(WIFI_SEND_IP, WiFi.localIP().toString(), FIXED_IP_ADDR, MODE_FIXED_IP);
+    mrd.print_esp_hello_ip(WIFI_SEND_IP, Ethernet.localIP().toString(), FIXED_IP_ADDR, MODE_FIXED_IP);
+    if (udp_spi_hz > 0)
+    {
+      Serial.print("W5500 SPI clock: ");
+      Serial.print(udp_spi_hz);
+      Serial.println(" Hz");
+    }
+  }
 
   /* Bluetoothリモコン関連の処理 */
   bt_settings();
@@ -320,15 +422,48 @@ void setup()
     Serial.println("Core1 thread for bno055 start.");
     delay(10); // センサー用スレッド
   }
+  else if ((MOUNT_IMUAHRS == 1) or (MOUNT_IMUAHRS == 2))
+  {
+    xTaskCreatePinnedToCore(Core1_mpu_r, "Core1_mpu_r", 4096, NULL, 10, &thp[0], 1);
+    Serial.println("Core1 thread for MPU fusion start.");
+    delay(10); // センサー用スレッド
+  }
 
   /* SDカードの初期設定とチェック */
   check_sd();
 
+  /* フライトレコーダーの開始 */
+  if (MOUNT_SD and SD_RECORDER)
+  {
+    Serial.print("Flight recorder ");
+    Serial.print(SD_RECORDER_FILE);
+    if (recorder.begin(SD, SD_RECORDER_FILE, SD_RECORDER_BLOCKS, &spi_bus, SD_RECORDER_CORE))
+    {
+      Serial.println(" start.");
+    }
+    else
+    {
+      Serial.println(" failed.");
+    }
+  }
+
+  /* リプレイの開始 */
+  if (REPLAY_MODE != 0)
+  {
+    init_replay();
+  }
+
+  /* モーションアセット領域の確認 */
+  if (MOTION_ASSET)
+  {
+    init_motion_asset();
+  }
+
   /* マウントされたサーボIDの表示 */
   mrd.print_servo_mounts(idl_mount, idr_mount, id3_mount);
 
   /* JOYPADの認識 */
-  mrd.print_controlpad(MOUNT_JOYPAD, JOYPAD_POLLING);
+  mrd.print_controlpad(MOUNT_JOYPAD, JOYPAD_POLLING_US / FRAME_DURATION_US); // 表示はフレーム数換算
 
   /* Bluetoothの初期化 */
   uint8_t bt_mac[6];
@@ -340,10 +475,14 @@ void setup()
   delay(1000);
 
   /* タイマーの調整と開始のシリアル表示 */
-  mrd_t_mil += (long)millis() + 10;                                   // 周期管理用のMeridianTimeをリセット
+  mrd_t_mic = (unsigned long)micros() + frame_us;                     // 周期管理用のMeridianTimeをリセット
   Serial.println("-) Meridian -LITE- system on ESP32 now flows. (-"); //
 
   /* UDP開始用のダミーデータの生成 */
+  telemetry.begin(UDP_SEND_DIVISOR, UDP_SEND_FAST);
+  fanout.begin();
+  jitter.begin(UDP_BATCH_DELAY, UDP_BATCH_DEPTH);
+  interp.begin(MOTION_INTERP_PROFILE);
   if (UDP_SEND) // 設定でUDPの送信を行うかどうか決定
   {
     s_udp_meridim.sval[MSG_CKSM] = mrd.cksm_val(s_udp_meridim.sval, MSG_SIZE);
@@ -393,43 +532,23 @@ void loop()
 
   //////// < 1 > U D P 受 信 ///////////////////////////////////////////////////////
   // @ [1-1] UDP受信の実行 もしデータパケットが来ていれば受信する
-  if (UDP_RESEIVE) // UDPの受信を行うかどうか
-  {
-    receiveUDP(); // UDPを受信
-    if (udp_rsvd_flag)
-    {
-      mrd.monitor_check_flow("[Rsvd]", MONITOR_FLOW); // デバグ用フロー表示
-      udp_rsvd_flag = 0;
-    }
-  }
+  bool rsvd_new = meridim_receive(); // このフレームで新しいMeridimを受信したか
   // 　→ ここでr_udp_meridim.sval に受信したMeridim配列が入っている状態。
 
-  // @ [1-2] チェックサムを確認
-  if (mrd.cksm_rslt(r_udp_meridim.sval, MSG_SIZE)) // Check sum OK!
+  // @ [1-2] チェックサムを確認し, [1-3] UDP受信配列から UDP送信配列にデータを転写, [1-4] エラーフラグ14番を更新
+  if (meridim_accept()) // Check sum OK!
   {
-    mrd.monitor_check_flow("[CSok]", MONITOR_FLOW); // デバグ用フロー表示
-
-    // @ [1-3] UDP受信配列から UDP送信配列にデータを転写
-    memcpy(s_udp_meridim.bval, r_udp_meridim.bval, MSG_SIZE * 2);
-
-    // @ [1-4] エラーフラグ14番(ESP32のPCからのUDP受信エラー検出)をオフ
-    s_udp_meridim.bval[MSG_ERR_u] &= B10111111;
-
-    //
-    mrd.monitor_check_flow("[1]", MONITOR_FLOW); // デバグ用フロー表示
-
     //////// < 2 > リ モ コ ン 受 信 ///////////////////////////////////////////////////
     // @ [2-1] コントロールパッド受信値の転記
     if (MOUNT_JOYPAD != 0)
     {
-      pad_array.ui64val[0] = joypad_read(MOUNT_JOYPAD, pad_array.ui64val[0], JOYPAD_POLLING, JOYPAD_REFRESH);
-      s_udp_meridim.usval[MRD_CONTROL_BUTTONS] = pad_array.usval[0];
-      if (MONITOR_JOYPAD)
-      {
-        monitor_joypad(pad_array.usval);
-      }
-      //
-      mrd.monitor_check_flow("[2]", MONITOR_FLOW); // デバグ用フロー表示
+      joypad_to_meridim(MOUNT_JOYPAD);
+    }
+
+    // @ [2-2] ボタンの組み合わせでモーションアセットを再生 (ボードに接続したジョイパッドのみ. PCが転送したボタンデータでは再生しない)
+    if (MOTION_ASSET and (MOUNT_JOYPAD != 0))
+    {
+      motion_pad_trigger(pad_array.usval[0]);
     }
 
     //////// < 3 > 受 信 コ マ ン ド に 基 づ く 制 御 処 理 /////////////////////////////
@@ -447,168 +566,15 @@ void loop()
 
     //////// < 5 > サ ー ボ 動 作 の 実 行 /////////////////////////////////////////////
     // @ [5-1] UDPから受信したサーボ位置をサーボ配列に書き込む
-    for (int i = 0; i < servo_num_max; i++)
-    {
-      idl_tgt_past[i] = idl_tgt[i];                       // 前回のdegreeをキープ
-      idr_tgt_past[i] = idr_tgt[i];                       // 前回のdegreeをキープ
-      idl_tgt[i] = s_udp_meridim.sval[i * 2 + 21] * 0.01; // 受信したdegreeを格納
-      idr_tgt[i] = s_udp_meridim.sval[i * 2 + 51] * 0.01; // 受信したdegreeを格納
-    }
+    //         Meridim[MRD_MOTION_FRAMES]が1以上なら, 受信した姿勢をキーフレームとしてそのフレーム数をかけて補間する
+    //         マスターコマンドがMCMD_TRAJ_SEGMENTなら軌道セグメントをキューに入れ, 毎フレーム評価した姿勢にする
+    //         モーションアセットの再生中はそちらを優先し, 終わったらその姿勢から受信した姿勢に向かう
+    servo_pose_update(rsvd_new);
 
     // @ [5-2] サーボ受信値の処理
     if (!ESP32_STDALONE)
     {
-      if (s_udp_meridim.sval[MRD_MASTER] != 0)
-      {
-        for (int i = 0; i < servo_num_max; i++) // ICS_L系統の処理
-        {                                       // 接続したサーボの数だけ繰り返す。最大は15
-          if (idl_mount[i])
-          {
-            if (s_udp_meridim.sval[(i * 2) + 20] == 1) // 受信配列のサーボコマンドが1ならPos指定
-            {
-              //k = krs_L.setPos(i, mrd.Deg2Krs(idl_tgt[i], idl_trim[i], idl_cw[i])); ★★★★★★★★★★★★★★★★★★★★★★
-
-              DEBUG_SERIAL.print("Sending :");
-              DEBUG_SERIAL.println(i);
-
-              // Turn on torque
-              if(dxl_L.write(i, TORQUE_ENABLE_ADDR, (uint8_t*)&turn_on, TORQUE_ENABLE_ADDR_LEN, TIMEOUT))
-                DEBUG_SERIAL.println("Torque on");
-              else
-                DEBUG_SERIAL.println("Error: Torque on failed");
-
-              goalPosition1 = Deg2Dxl(idl_tgt[i]);
-              dxl_L.write(i, GOAL_POSITION_ADDR, (uint8_t*)&goalPosition1, GOAL_POSITION_ADDR_LEN, TIMEOUT);
-              dxl_L.read(i, PRESENT_POSITION_ADDR, PRESENT_POSITION_ADDR_LEN, (uint8_t*)&presentPosition1, sizeof(presentPosition1), TIMEOUT);
-              k = presentPosition1;
-
-
-              if (k == -1) // サーボからの返信信号を受け取れなかった時は前回の数値のままにする
-              {
-                //k = mrd.Deg2Krs(idl_tgt_past[i], idl_trim[i], idl_cw[i]);
-                k = Deg2Dxl(idl_tgt_past[i]);
-
-                idl_err[i]++;
-                if (idl_err[i] >= SERVO_LOST_ERROR_WAIT)
-                {
-                  s_udp_meridim.bval[MSG_ERR_l] = char(i); // Meridim[MSG_ERR] エラーを出したサーボID（0をID[L00]として[L99]まで）
-                  mrd.monitor_servo_error("L", i, MONITOR_SERVO_ERR);
-                }
-              }
-              else
-              {
-                idl_err[i] = 0;
-              }
-            }
-            else // 1以外ならとりあえずサーボを脱力し位置を取得。手持ちの最大は15
-            {
-              //k = krs_L.setFree(i); // サーボからの返信信号を受け取れていれば値を更新★★★★★★★★★★★★★★★★★★★★★
-              
-              // Turn off torque
-              if(dxl_L.write(i, TORQUE_ENABLE_ADDR, (uint8_t*)&turn_off, TORQUE_ENABLE_ADDR_LEN, TIMEOUT))
-                DEBUG_SERIAL.println("Torque on");
-              else
-                DEBUG_SERIAL.println("Error: Torque on failed");
-
-              dxl_L.read(i, PRESENT_POSITION_ADDR, PRESENT_POSITION_ADDR_LEN, (uint8_t*)&presentPosition1, sizeof(presentPosition1), TIMEOUT);
-              k = presentPosition1;
-
-              if (k == -1)          // サーボからの返信信号を受け取れなかった時は前回の数値のままにする
-              {
-                //k = mrd.Deg2Krs(idl_tgt_past[i], idl_trim[i], idl_cw[i]);
-                k = Deg2Dxl(idl_tgt_past[i]);
-                
-                idl_err[i]++;
-                if (idl_err[i] >= SERVO_LOST_ERROR_WAIT)
-                {
-                  s_udp_meridim.bval[MSG_ERR_l] = char(i); // Meridim[MSG_ERR] エラーを出したサーボID（0をID[L00]として[L99]まで）
-                  mrd.monitor_servo_error("L", i, MONITOR_SERVO_ERR);
-                }
-              }
-              else
-              {
-                idl_err[i] = 0;
-              }
-            }
-            //idl_tgt[i] = mrd.Krs2Deg(k, idl_trim[i], idl_cw[i]);
-            idl_tgt[i] = Dxl2Deg(k);
-          }
-          delayMicroseconds(1);
-
-          if (idr_mount[i])
-          {
-            if (s_udp_meridim.sval[(i * 2) + 50] == 1) // 受信配列のサーボコマンドが1ならPos指定
-            {
-              //k = krs_R.setPos(i, mrd.Deg2Krs(idr_tgt[i], idr_trim[i], idr_cw[i]));★★★★★★★★★★★★★★★
-
-              // Turn on torque
-              if(dxl_R.write(i, TORQUE_ENABLE_ADDR, (uint8_t*)&turn_on, TORQUE_ENABLE_ADDR_LEN, TIMEOUT))
-                DEBUG_SERIAL.println("Torque on");
-              else
-                DEBUG_SERIAL.println("Error: Torque on failed");
-
-              //goalPosition1 = s_DXL_servo_pos_R[i];
-              goalPosition1 = Deg2Dxl(idl_tgt[i]);
-              dxl_R.write(i, GOAL_POSITION_ADDR, (uint8_t*)&goalPosition1, GOAL_POSITION_ADDR_LEN, TIMEOUT);
-              dxl_R.read(i, PRESENT_POSITION_ADDR, PRESENT_POSITION_ADDR_LEN, (uint8_t*)&presentPosition1, sizeof(presentPosition1), TIMEOUT);
-              k = presentPosition1;
-
-              if (k == -1) // サーボからの返信信号を受け取れなかった時は前回の数値のままにする
-              {
-                //k = mrd.Deg2Krs(idr_tgt_past[i], idr_trim[i], idr_cw[i]);
-                k = Deg2Dxl(idl_tgt_past[i]);
-                idr_err[i]++;
-                if (idr_err[i] >= SERVO_LOST_ERROR_WAIT)
-                {
-                  s_udp_meridim.bval[MSG_ERR_l] = char(i + 100); // Meridim[MSG_ERR] エラーを出したサーボID（100をID[R00]として[R99]まで）
-                  mrd.monitor_servo_error("R", i + 100, MONITOR_SERVO_ERR);
-                }
-              }
-              else
-              {
-                idr_err[i] = 0;
-              }
-            }
-            else // 1以外ならとりあえずサーボを脱力し位置を取得
-            {
-              //k = krs_R.setFree(i);★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★
-
-              // Turn off torque
-              if(dxl_R.write(i, TORQUE_ENABLE_ADDR, (uint8_t*)&turn_off, TORQUE_ENABLE_ADDR_LEN, TIMEOUT))
-                DEBUG_SERIAL.println("Torque on");
-              else
-                DEBUG_SERIAL.println("Error: Torque on failed");
-
-              dxl_R.read(i, PRESENT_POSITION_ADDR, PRESENT_POSITION_ADDR_LEN, (uint8_t*)&presentPosition1, sizeof(presentPosition1), TIMEOUT);
-              k = presentPosition1;
-
-
-              if (k == -1) // サーボからの返信信号を受け取れなかった時は前回の数値のままにする
-              {
-                //k = mrd.Deg2Krs(idr_tgt_past[i], idr_trim[i], idr_cw[i]);
-                k = Deg2Dxl(idr_tgt_past[i]);
-                
-                idr_err[i]++;
-                if (idr_err[i] >= SERVO_LOST_ERROR_WAIT)
-                {
-                  s_udp_meridim.bval[MSG_ERR_l] = char(i + 100); // Meridim[MSG_ERR] エラーを出したサーボID（100をID[R00]として[R99]まで）
-                  mrd.monitor_servo_error("R", i + 100, MONITOR_SERVO_ERR);
-                }
-              }
-              else
-              {
-                idr_err[i] = 0;
-              }
-            }
-            //idr_tgt[i] = mrd.Krs2Deg(k, idr_trim[i], idr_cw[i]);
-            idl_tgt[i] = Dxl2Deg(k);
-          }
-          delayMicroseconds(1);
-        }
-
-        //
-        mrd.monitor_check_flow("[5]", MONITOR_FLOW); // デバグ用フロー表示
-      }
+      servo_bus_exchange();
     }
     else
     {
@@ -617,43 +583,35 @@ void loop()
       //
     }
   }
-  else // Check sum NG
-  {
-    err_pc_esp++;
-    s_udp_meridim.bval[MSG_ERR_u] |= B01000000;     // エラーフラグ14番(ESP32のPCからのUDP受信エラー検出)をオン
-    mrd.monitor_check_flow("[csNG]", MONITOR_FLOW); // デバグ用フロー表示
-  }
+
+  // @ [5-3] R系統のサーボ通信が終わった後の空き時間でKRC-5FHを読む
+  krr_poll_bus_slot(MOUNT_JOYPAD);
 
   //////// < 6 > サ ー ボ 受 信 値 の 処 理 //////////////////////////////////////////
   // @[6-1] サーボIDごとにの現在位置もしくは計算結果を配列に格納
-  for (int i = 0; i < 15; i++)
-  {
-    // s_udp_meridim.sval[i * 2 + 20] = 0;                              // 仮にここでは各サーボのコマンドを脱力&ポジション指示(0)に設定
-    s_udp_meridim.sval[i * 2 + 21] = mrd.float2HfShort(idl_tgt[i]); // 仮にここでは最新のサーボ角度degreeを格納
-  }
-  for (int i = 0; i < 15; i++)
-  {
-    // s_udp_meridim.sval[i * 2 + 50] = 0;                              // 仮にここでは各サーボのコマンドを脱力&ポジション指示(0)に設定
-    s_udp_meridim.sval[i * 2 + 51] = mrd.float2HfShort(idr_tgt[i]); // 仮にここでは最新のサーボ角度degreeを格納
-  }
+  servo_to_meridim();
 
   //
   mrd.monitor_check_flow("[6]", MONITOR_FLOW); // デバグ用フロー表示
 
   //////// < 7 > エ ラ ー リ ポ ー ト の 作 成 ///////////////////////////////////////
   // @[7-1] シーケンス番号チェック
-  mrd_seq_r_expect = mrd.seq_predict_num(mrd_seq_r_expect);                                // シーケンス番号予想値の生成
-  monitor_seq_num(mrd_seq_r_expect, int(s_udp_meridim.usval[MRD_SEQENTIAL]), MONITOR_SEQ); // シーケンス番号の表示
-
-  if (mrd.seq_compare_nums(mrd_seq_r_expect, int(s_udp_meridim.usval[MRD_SEQENTIAL])))
+  //        新しく受信したフレームでのみ予想値を進める. フレーム周期がPCの送信周期より短い場合も誤検出しない
+  if (rsvd_new)
   {
-    s_udp_meridim.bval[MSG_ERR_u] &= B11111011; // [MSG_ERR] 9番ビット[Teensy受信のスキップ検出]をサゲる.
-  }
-  else // 受信シーケンシャルカウンタの値が予想と違ったら
-  {
-    mrd_seq_r_expect = int(s_udp_meridim.usval[MRD_SEQENTIAL]); // 現在の受信値を予想結果としてキープ
-    s_udp_meridim.bval[MSG_ERR_u] |= B00000100;                 // Meridim[MSG_ERR] 9番ビット[Teensy受信のスキップ検出]をアゲる.
-    // err_tsy_skip++;
+    mrd_seq_r_expect = mrd.seq_predict_num(mrd_seq_r_expect);                                // シーケンス番号予想値の生成
+    monitor_seq_num(mrd_seq_r_expect, int(s_udp_meridim.usval[MRD_SEQENTIAL]), MONITOR_SEQ); // シーケンス番号の表示
+
+    if (mrd.seq_compare_nums(mrd_seq_r_expect, int(s_udp_meridim.usval[MRD_SEQENTIAL])))
+    {
+      s_udp_meridim.bval[MSG_ERR_u] &= B11111011; // [MSG_ERR] 9番ビット[Teensy受信のスキップ検出]をサゲる.
+    }
+    else // 受信シーケンシャルカウンタの値が予想と違ったら
+    {
+      mrd_seq_r_expect = int(s_udp_meridim.usval[MRD_SEQENTIAL]); // 現在の受信値を予想結果としてキープ
+      s_udp_meridim.bval[MSG_ERR_u] |= B00000100;                 // Meridim[MSG_ERR] 9番ビット[Teensy受信のスキップ検出]をアゲる.
+      // err_tsy_skip++;
+    }
   }
 
   //
@@ -661,11 +619,11 @@ void loop()
 
   //////// < 8 > フ レ ー ム 終 端 処 理 ////////////////////////////////////////////
   // @ [8-1] この時点で１フレーム内に処理が収まっていない時の処理
-  now_t_mil = (long)millis(); // 現在時刻を更新
-  if (now_t_mil > mrd_t_mil)
-  {                               // 現在時刻がフレーム管理時計を超えていたらアラートを出す
-    Serial.print("[ERR] delay:"); // シリアルに遅延msを表示
-    Serial.println(now_t_mil - mrd_t_mil);
+  now_t_mic = (unsigned long)micros(); // 現在時刻を更新
+  if ((REPLAY_MODE != 2) and ((long)(now_t_mic - mrd_t_mic) > 0))
+  {                                   // 現在時刻がフレーム管理時計を超えていたらアラートを出す
+    Serial.print("[ERR] delay us:"); // シリアルに遅延usを表示
+    Serial.println((long)(now_t_mic - mrd_t_mic));
     digitalWrite(ERR_LED, HIGH); // 処理落ちが発生していたらLEDを点灯
   }
   else
@@ -674,20 +632,31 @@ void loop()
   }
 
   // @ [8-2] この時点で時間が余っていたら時間消化。時間がオーバーしていたらこの処理を自然と飛ばす。
-  now_t_mil = (long)millis();
-  now_t_mic = (long)micros(); // 現在時刻を取得
-  while ((mrd_t_mil - now_t_mil) >= 1)
+  //         1ms(1tick)より長く残っている間はdelayで他のタスクに譲り, 残りはマイクロ秒単位で待つ。
+  //         最速リプレイ時は待たずに次のフレームへ進む。
+  //         待つ間にシリアルの送信キューをUARTに移す(SERIAL_LINK 1)。
+  now_t_mic = (unsigned long)micros(); // 現在時刻を取得
+  while ((REPLAY_MODE != 2) and ((long)(mrd_t_mic - now_t_mic) > 1000))
   {
+    pc_link->poll();
     delay(1);
-    now_t_mil = (long)millis();
+    now_t_mic = (unsigned long)micros();
   }
-  while (now_t_mic < mrd_t_mil * 1000)
+  while ((REPLAY_MODE != 2) and ((long)(mrd_t_mic - now_t_mic) > 0))
   {
-    now_t_mic = (long)micros(); // 現在時刻を取得
+    pc_link->poll();
+    now_t_mic = (unsigned long)micros(); // 現在時刻を取得
   }
 
   // @ [8-3] フレーム管理時計mercのカウントアップ
-  mrd_t_mil = mrd_t_mil + frame_ms;             // フレーム管理時計を1フレーム分進める
+  if (REPLAY_MODE == 2)
+  {
+    mrd_t_mic = now_t_mic; // 最速リプレイ時はフレーム管理時計を現在時刻に合わせる
+  }
+  else
+  {
+    mrd_t_mic = mrd_t_mic + frame_us; // フレーム管理時計を1フレーム分進める
+  }
   frame_count = frame_count + frame_count_diff; // サインカーブ動作用のフレームカウントをいくつずつ進めるかをここで設定。
 
   //
@@ -695,33 +664,60 @@ void loop()
 
   //////// < 9 > U D P 送 信 信 号 作 成 ////////////////////////////////////////////
   // @ [9-1] センサーからの値を送信用に格納
-  if (MOUNT_IMUAHRS == 3)
+  if (MOUNT_IMUAHRS != 0)
   {
-    for (int i = 0; i < 15; i++)
-    {
-      s_udp_meridim.sval[i] = mrd.float2HfShort(bno055_read[i]); // DMP_ROLL推定値
-    }
+    imu_to_meridim();
   }
 
-  // @ [9-2] フレームスキップ検出用のカウントをカウントアップして送信用に格納
-  mrd_seq_s_increment = mrd.seq_increase_num(mrd_seq_s_increment);
-  s_udp_meridim.usval[1] = mrd_seq_s_increment;
-
+  // @ [9-2] 今フレームの送信内容を決め, Meridim全体を送るフレームではフレームスキップ検出用のカウントをカウントアップして格納
   // @ [9-3] チェックサムを計算して格納
-  s_udp_meridim.sval[MSG_CKSM] = mrd.cksm_val(s_udp_meridim.sval, MSG_SIZE);
+  int tx_kind = meridim_seal();
 
   //
   mrd.monitor_check_flow("[9]", MONITOR_FLOW); // デバグ用フロー表示
 
   //////// < 10 > U D P 送 信 //////////////////////////////////////////////////////
-  // @ [10-1] UDP送信を実行
+  // @ [10-1] UDP送信を実行 (UDP_SEND_DIVISORフレームに1回Meridim全体, その他のフレームは高速項目のみ)
   if (UDP_SEND) // 設定でUDPの送信を行うかどうか決定
   {
-    sendUDP();
+    if (tx_kind == MRD_TX_FULL)
+    {
+      sendUDP();
+    }
+    else if (tx_kind == MRD_TX_FAST)
+    {
+      sendUDP_fast();
+    }
+    if (MONITOR_UDP_SEND)
+    {
+      monitor_udp_send();
+    }
+    if (UDP_SUBSCRIBERS and !SERIAL_LINK) // 購読者には購読者ごとの頻度で送る(UDPのみ)
+    {
+      sendUDP_subscribers();
+      if (MONITOR_SUBS)
+      {
+        monitor_subs();
+      }
+    }
 
     //
     mrd.monitor_check_flow("[10]\n", MONITOR_FLOW); // デバグ用フロー表示
   }
+
+  // @ [10-2] フライトレコーダーに送受信データを記録(バッファへのコピーのみ)
+  if (recorder.is_ready())
+  {
+    recorder.append((uint32_t)micros(), r_udp_meridim.bval, s_udp_meridim.bval);
+    if (MONITOR_RECORDER)
+    {
+      monitor_recorder();
+    }
+  }
+  if (MONITOR_SPI)
+  {
+    monitor_spi();
+  }
   // delayMicroseconds(1);
 }
 
@@ -729,280 +725,1102 @@ void loop()
 //---- 関 数 各 種  -----------------------------------------------------------------------------------------------
 //================================================================================================================
 
-// void init_wifi(const char *wifi_ap_ssid, const char *wifi_ap_pass)
-// {
-//   WiFi.disconnect(true, true); // WiFi接続をリセット
-//   delay(100);
-//   WiFi.begin(wifi_ap_ssid, wifi_ap_pass); // Wifiに接続
-//   while (WiFi.status() != WL_CONNECTED)
-//   {            // https://www.arduino.cc/en/Reference/WiFiStatus 戻り値一覧
-//     delay(50); // 接続が完了するまでループで待つ
-//   }
-// }
+// ■ フレームの工程 -------------------------------------------------------------------
+//   loop()の各工程. run_bench()も同じ関数を呼んで計測する
 
-void receiveUDP()
+// [1-1] 受信データをr_udp_meridimに入れる. 新しいMeridimを受信したらtrue
+bool meridim_receive()
 {
-  if (udp.parsePacket() >= MSG_BUFF) // データの受信バッファ確認
+  bool rsvd_new = false;
+  if (REPLAY_MODE != 0) // リプレイモードでは記録ファイルから受信データを作る
   {
-    udp.read(r_udp_meridim.bval, MSG_BUFF); // データの受信
-    udp_rsvd_flag = true;                   // 受信完了フラグを上げる
+    replay_receive();
   }
-  // delay(1);
-}
-
-void sendUDP()
-{
-  udp.beginPacket(WIFI_SEND_IP, UDP_SEND_PORT); // UDPパケットの開始
-  udp.write(s_udp_meridim.bval, MSG_BUFF);
-  udp.endPacket(); // UDPパケットの終了
-}
-
-void check_sd()
-{
-  if (MOUNT_SD)
+  else if (UDP_RESEIVE) // UDPの受信を行うかどうか
   {
-    Serial.print("SD card check...");
-    delay(100);
-    if (!SD.begin(PIN_CHIPSELECT_SD))
-    {
-      Serial.println(" initialization FALIED!");
-      delay(500);
-    }
-    else
-    {
-      Serial.println(" OK.");
-    }
-
-    if (CHECK_SD_RW)
+    receiveUDP(); // UDPを受信
+    if (jitter.active()) // バッチ受信中は今フレームの再生予定のMeridimを受信データとして取り出す
     {
-      // open the file.
-      myFile = SD.open("/tmp.txt", FILE_WRITE);
-      delayMicroseconds(2); // SPI安定化検証用
-
-      // if the file opened okay, write to it:
-      if (myFile)
+      if (jitter.pop(r_udp_meridim.sval))
       {
-        Serial.print("SD card r/w check...");
-        // SD書き込みテスト用のランダムな4桁の数字を生成
-        randomSeed(long(analogRead(A0))); // 未接続ピンのノイズを利用
-        int randNumber = random(1000, 9999);
-
-        Serial.print(" write code ");
-        Serial.print(randNumber);
-        myFile.println(randNumber);
-        delayMicroseconds(2); // SPI安定化検証用
-        // close the file:
-        myFile.close();
-        Serial.print(" and");
-        delayMicroseconds(10); // SPI安定化検証用
-        // re-open the file for reading:
-        myFile = SD.open("/tmp.txt");
-        if (myFile)
-        {
-          Serial.print(" read code ");
-          while (myFile.available())
-          {
-            Serial.write(myFile.read());
-          }
-          // close the file:
-          myFile.close();
-        }
-        SD.remove("/tmp.txt");
-        delay(10);
+        udp_rsvd_flag = true;
       }
-      else
+      if (MONITOR_JITTER)
       {
-        // if the file didn't open, print an error:
-        Serial.println("Could not open SD test file.");
+        monitor_jitter();
       }
     }
   }
-  else
+  if (udp_rsvd_flag)
   {
-    Serial.println("No SD reader/writer mounted.");
+    mrd.monitor_check_flow("[Rsvd]", MONITOR_FLOW); // デバグ用フロー表示
+    udp_rsvd_flag = 0;
+    rsvd_new = true;
   }
+  return rsvd_new;
 }
 
-void bt_settings()
+// [1-2]-[1-4] チェックサムを確認し, OKならUDP受信配列をUDP送信配列に転写する
+bool meridim_accept()
 {
-  /* Wiiコントローラの接続開始 */
-  if ((MOUNT_JOYPAD == 5) or (MOUNT_JOYPAD == 6))
+  if (mrd.cksm_rslt(r_udp_meridim.sval, MSG_SIZE)) // Check sum OK!
   {
-    Serial.println("Try to connect Wiimote...");
-    wiimote.init();
+    mrd.monitor_check_flow("[CSok]", MONITOR_FLOW); // デバグ用フロー表示
+
+    // @ [1-3] UDP受信配列から UDP送信配列にデータを転写
+    memcpy(s_udp_meridim.bval, r_udp_meridim.bval, MSG_SIZE * 2);
+
+    // @ [1-4] エラーフラグ14番(ESP32のPCからのUDP受信エラー検出)をオフ
+    s_udp_meridim.bval[MSG_ERR_u] &= B10111111;
+
+    //
+    mrd.monitor_check_flow("[1]", MONITOR_FLOW); // デバグ用フロー表示
+    return true;
   }
+  // Check sum NG
+  err_pc_esp++;
+  s_udp_meridim.bval[MSG_ERR_u] |= B01000000;     // エラーフラグ14番(ESP32のPCからのUDP受信エラー検出)をオン
+  mrd.monitor_check_flow("[csNG]", MONITOR_FLOW); // デバグ用フロー表示
+  return false;
 }
 
-uint64_t joypad_read(int mount_joypad, uint64_t pre_val, int polling, bool joypad_reflesh)
-{
-  // if (mount_joypad == 2)
-  // { // KRR5FH(KRC-5FH)をICS_R系に接続している場合
-  //   joypad_polling_count++;
-  //   if (joypad_polling_count >= polling)
-  //   {
-  //     static bool isFirstCall = true; // 初回の呼び出しフラグ
-  //     if (isFirstCall)
-  //     {
-  //       Serial.println("KRC-5FH successfully connected. ");
-  //       isFirstCall = false; // 初回の呼び出しフラグをオフにする
-  //     }
-  //     unsigned short buttonData;
-  //     unsigned short pad_btn_tmp = 0;
-
-  //     // buttonData = krs_R.getKrrButton(); ★★★★★★★★★★★★★★★★★★★★★★★
-  //     delayMicroseconds(2);
-  //     if (buttonData != KRR_BUTTON_FALSE) // ボタンデータが受信できていたら
-  //     {
-  //       int button_1 = buttonData;
-
-  //       if (JOYPAD_GENERALIZE)
-  //       {
-
-  //         if ((button_1 & 15) == 15)
-  //         { // 左側十字ボタン全部押しなら start押下とみなす
-  //           pad_btn_tmp += 1;
-  //         }
-  //         else
-  //         {
-  //           // 左側の十字ボタン
-  //           pad_btn_tmp += (button_1 & 1) * 16 + ((button_1 & 2) >> 1) * 64 + ((button_1 & 4) >> 2) * 32 + ((button_1 & 8) >> 3) * 128;
-  //         }
-  //         if ((button_1 & 368) == 368)
-  //           pad_btn_tmp += 8; // 右側十字ボタン全部押しなら select押下とみなす
-  //         else
-  //         {
-  //           // 右側十字ボタン
-  //           pad_btn_tmp += ((button_1 & 16) >> 4) * 4096 + ((button_1 & 32) >> 5) * 16384 + ((button_1 & 64) >> 6) * 8192 + ((button_1 & 256) >> 8) * 32768;
-  //         }
-  //         // L1,L2,R1,R2
-  //         pad_btn_tmp += ((button_1 & 2048) >> 11) * 2048 + ((button_1 & 4096) >> 12) * 512 + ((button_1 & 512) >> 9) * 1024 + ((button_1 & 1024) >> 10) * 256;
-  //       }
-  //       else
-  //       {
-  //         pad_btn_tmp = button_1;
-  //       }
-  //     }
-  //     /* 共用体用の64ビットの上位16ビット部をボタンデータとして書き換える */
-  //     uint64_t updated_val;
-  //     if (joypad_reflesh)
-  //     {
-  //       updated_val = (pre_val & 0xFFFFFFFFFFFF0000) | (static_cast<uint64_t>(pad_btn_tmp)); // 上位16ビット index[0]
-  //     }
-  //     else
-  //     {
-  //       updated_val = (pre_val) | (static_cast<uint64_t>(pad_btn_tmp));
-  //     }
-  //     // updated_val = (updated_val & 0x0000FFFFFFFFFFFF) | (static_cast<uint64_t>(pad_btn_tmp) << 48); // 下位16ビット index[3]
-  //     // updated_val = (updated_val & 0xFFFF0000FFFFFFFF) | (static_cast<uint64_t>(pad_btn_tmp) << 32); // 上位33-48ビット index[2]
-  //     // updated_val = (updated_val & 0xFFFFFFFF0000FFFF) | (static_cast<uint64_t>(pad_btn_tmp) << 16); // 上位17-32ビット index[1]
-  //     joypad_polling_count = 0;
-  //     return updated_val;
-  //   }
-  //   else
-  //   {
-  //     return pre_val;
-  //   }
-  // }
-  // else if (mount_joypad == 5) // wiimote_yoko
-  // {
-  //   uint64_t updated_val = 0;
-  //   if (joypad_reflesh)
-  //   {
-  //     updated_val = (pre_val & 0xFFFFFFFFFFFF0000) | (static_cast<uint64_t>(pad_wiimote_receive())); // 上位16ビット index[0]
-  //   }
-  //   else
-  //   {
-  //     updated_val = (pre_val) | (static_cast<uint64_t>(pad_wiimote_receive()));
-  //   }
-  //   joypad_polling_count = 0;
-  //   return updated_val;
-  // }
-  // else
-  // {
-  //   return pre_val;
-  // }
-  return 0;
+// [2-1] コントロールパッドの受信値をUDP送信配列に転記する
+void joypad_to_meridim(int mount_joypad)
+{
+  pad_array.ui64val[0] = joypad_read(mount_joypad, pad_array.ui64val[0], JOYPAD_REFRESH);
+  s_udp_meridim.usval[MRD_CONTROL_BUTTONS] = pad_array.usval[0];
+  if (mount_joypad == 2) // KRC-5FHはアナログ値も転記
+  {
+    s_udp_meridim.usval[MRD_CONTROL_STICK_L] = pad_array.usval[1];
+    s_udp_meridim.usval[MRD_CONTROL_STICK_R] = pad_array.usval[2];
+  }
+  if (MONITOR_JOYPAD)
+  {
+    monitor_joypad(pad_array.usval);
+  }
+  //
+  mrd.monitor_check_flow("[2]", MONITOR_FLOW); // デバグ用フロー表示
 }
 
-uint16_t pad_wiimote_receive()
+// [5-1] 受信した姿勢(補間, 軌道セグメント, モーション再生)から今フレームのサーボ目標角度を決める
+void servo_pose_update(bool rsvd_new)
 {
-  wiimote.task();
-  if (wiimote.available() > 0)
+  if (rsvd_new)
   {
-    static bool isFirstCall = true; // 初回の呼び出しフラグ
-    if (isFirstCall)
+    if (s_udp_meridim.sval[MRD_MASTER] == MCMD_TRAJ_SEGMENT)
     {
-      Serial.println("Wiimote successfully connected. ");
-      isFirstCall = false; // 初回の呼び出しフラグをオフにする
+      if (!traj_mode) // 今の姿勢から軌道を始める
+      {
+        traj.begin(frame_us, servo_pose);
+        traj_mode = true;
+      }
+      traj.push_meridim(s_udp_meridim.sval);
     }
-    uint16_t button = wiimote.getButtonState();
-    pad_btn = 0;
-    for (int i = 0; i < 16; i++)
+    else
     {
-      uint16_t mask = 1 << i;
-      if ((JOYPAD_GENERALIZE && (PAD_WIIMOTE_SOLO[i] & button)) || (!JOYPAD_GENERALIZE && (PAD_WIIMOTE_ORIG[i] & button)))
+      if (traj_mode) // 軌道の最後の姿勢から補間を続ける
       {
-        pad_btn |= mask;
+        interp.set_pose(servo_pose, 30);
+        traj_mode = false;
       }
+      short key_pose[30];
+      for (int i = 0; i < 15; i++)
+      {
+        key_pose[i] = s_udp_meridim.sval[i * 2 + 21];
+        key_pose[i + 15] = s_udp_meridim.sval[i * 2 + 51];
+      }
+      interp.set_key(key_pose, 30, s_udp_meridim.sval[MRD_MOTION_FRAMES]);
     }
-    return pad_btn;
   }
-  else
+  if (motion_player.playing())
   {
-    return pad_btn;
+    if (!motion_player.step(servo_pose))
+    {
+      interp.set_pose(servo_pose, 30);
+      traj_mode = false;
+    }
+    for (int i = 0; i < 15; i++) // モーションは全サーボ位置指定として扱う
+    {
+      s_udp_meridim.sval[i * 2 + 20] = 1;
+      s_udp_meridim.sval[i * 2 + 50] = 1;
+    }
   }
-  if (MOUNT_JOYPAD == 6)
+  else if (traj_mode)
   {
-    Serial.println("Wiimote + Nunchuk not available now. "); //
-  }
-}
-
-void init_imuahrs(int mount_imuahrs)
-{
-  if (mount_imuahrs == 3)
-    if (!bno.begin())
+    traj.step(servo_pose);
+    for (int i = 0; i < 15; i++) // セグメントのMeridimはサーボの欄に終点が入っているので, 全サーボ位置指定として扱う
     {
-      Serial.println("No BNO055 detected ... Check your wiring or I2C ADDR!");
+      s_udp_meridim.sval[i * 2 + 20] = 1;
+      s_udp_meridim.sval[i * 2 + 50] = 1;
     }
-    else
+    if (MONITOR_TRAJ)
     {
-      Serial.println("BNO055 mounted and started.");
-      delay(50);
-      bno.setExtCrystalUse(false);
-      delay(10);
+      monitor_traj();
     }
+  }
   else
   {
-    Serial.println("No IMU/AHRS sensor mounted.");
+    interp.step(servo_pose);
   }
-}
-
-void Core1_bno055_r(void *args)
+  if (MOTION_ASSET and MONITOR_MOTION)
+  {
+    monitor_motion();
+  }
+  for (int i = 0; i < servo_num_max; i++)
+  {
+    idl_tgt_past[i] = idl_tgt[i];           // 前回のdegreeをキープ
+    idr_tgt_past[i] = idr_tgt[i];           // 前回のdegreeをキープ
+    idl_tgt[i] = servo_pose[i] * 0.01;      // 今フレームの目標degreeを格納
+    idr_tgt[i] = servo_pose[i + 15] * 0.01; // 今フレームの目標degreeを格納
+  }
+}
+
+// [5-2] マウントしたサーボに目標角度を送り, 現在位置を読む
+void servo_bus_exchange()
+{
+  if (s_udp_meridim.sval[MRD_MASTER] != 0)
+  {
+    for (int i = 0; i < servo_num_max; i++) // ICS_L系統の処理
+    {                                       // 接続したサーボの数だけ繰り返す。最大は15
+      if (idl_mount[i])
+      {
+        if (s_udp_meridim.sval[(i * 2) + 20] == 1) // 受信配列のサーボコマンドが1ならPos指定
+        {
+          //k = krs_L.setPos(i, mrd.Deg2Krs(idl_tgt[i], idl_trim[i], idl_cw[i])); ★★★★★★★★★★★★★★★★★★★★★★
+
+          DEBUG_SERIAL.print("Sending :");
+          DEBUG_SERIAL.println(i);
+
+          // Turn on torque
+          if(dxl_L.write(i, TORQUE_ENABLE_ADDR, (uint8_t*)&turn_on, TORQUE_ENABLE_ADDR_LEN, TIMEOUT))
+            DEBUG_SERIAL.println("Torque on");
+          else
+            DEBUG_SERIAL.println("Error: Torque on failed");
+
+          goalPosition1 = Deg2Dxl(idl_tgt[i]);
+          dxl_L.write(i, GOAL_POSITION_ADDR, (uint8_t*)&goalPosition1, GOAL_POSITION_ADDR_LEN, TIMEOUT);
+          dxl_L.read(i, PRESENT_POSITION_ADDR, PRESENT_POSITION_ADDR_LEN, (uint8_t*)&presentPosition1, sizeof(presentPosition1), TIMEOUT);
+          k = presentPosition1;
+
+
+          if (k == -1) // サーボからの返信信号を受け取れなかった時は前回の数値のままにする
+          {
+            //k = mrd.Deg2Krs(idl_tgt_past[i], idl_trim[i], idl_cw[i]);
+            k = Deg2Dxl(idl_tgt_past[i]);
+
+            idl_err[i]++;
+            if (idl_err[i] >= SERVO_LOST_ERROR_WAIT)
+            {
+              s_udp_meridim.bval[MSG_ERR_l] = char(i); // Meridim[MSG_ERR] エラーを出したサーボID（0をID[L00]として[L99]まで）
+              mrd.monitor_servo_error("L", i, MONITOR_SERVO_ERR);
+            }
+          }
+          else
+          {
+            idl_err[i] = 0;
+          }
+        }
+        else // 1以外ならとりあえずサーボを脱力し位置を取得。手持ちの最大は15
+        {
+          //k = krs_L.setFree(i); // サーボからの返信信号を受け取れていれば値を更新★★★★★★★★★★★★★★★★★★★★★
+
+          // Turn off torque
+          if(dxl_L.write(i, TORQUE_ENABLE_ADDR, (uint8_t*)&turn_off, TORQUE_ENABLE_ADDR_LEN, TIMEOUT))
+            DEBUG_SERIAL.println("Torque on");
+          else
+            DEBUG_SERIAL.println("Error: Torque on failed");
+
+          dxl_L.read(i, PRESENT_POSITION_ADDR, PRESENT_POSITION_ADDR_LEN, (uint8_t*)&presentPosition1, sizeof(presentPosition1), TIMEOUT);
+          k = presentPosition1;
+
+          if (k == -1)          // サーボからの返信信号を受け取れなかった時は前回の数値のままにする
+          {
+            //k = mrd.Deg2Krs(idl_tgt_past[i], idl_trim[i], idl_cw[i]);
+            k = Deg2Dxl(idl_tgt_past[i]);
+
+            idl_err[i]++;
+            if (idl_err[i] >= SERVO_LOST_ERROR_WAIT)
+            {
+              s_udp_meridim.bval[MSG_ERR_l] = char(i); // Meridim[MSG_ERR] エラーを出したサーボID（0をID[L00]として[L99]まで）
+              mrd.monitor_servo_error("L", i, MONITOR_SERVO_ERR);
+            }
+          }
+          else
+          {
+            idl_err[i] = 0;
+          }
+        }
+        //idl_tgt[i] = mrd.Krs2Deg(k, idl_trim[i], idl_cw[i]);
+        idl_tgt[i] = Dxl2Deg(k);
+      }
+      delayMicroseconds(1);
+
+      if (idr_mount[i])
+      {
+        if (s_udp_meridim.sval[(i * 2) + 50] == 1) // 受信配列のサーボコマンドが1ならPos指定
+        {
+          //k = krs_R.setPos(i, mrd.Deg2Krs(idr_tgt[i], idr_trim[i], idr_cw[i]));★★★★★★★★★★★★★★★
+
+          // Turn on torque
+          if(dxl_R.write(i, TORQUE_ENABLE_ADDR, (uint8_t*)&turn_on, TORQUE_ENABLE_ADDR_LEN, TIMEOUT))
+            DEBUG_SERIAL.println("Torque on");
+          else
+            DEBUG_SERIAL.println("Error: Torque on failed");
+
+          //goalPosition1 = s_DXL_servo_pos_R[i];
+          goalPosition1 = Deg2Dxl(idl_tgt[i]);
+          dxl_R.write(i, GOAL_POSITION_ADDR, (uint8_t*)&goalPosition1, GOAL_POSITION_ADDR_LEN, TIMEOUT);
+          dxl_R.read(i, PRESENT_POSITION_ADDR, PRESENT_POSITION_ADDR_LEN, (uint8_t*)&presentPosition1, sizeof(presentPosition1), TIMEOUT);
+          k = presentPosition1;
+
+          if (k == -1) // サーボからの返信信号を受け取れなかった時は前回の数値のままにする
+          {
+            //k = mrd.Deg2Krs(idr_tgt_past[i], idr_trim[i], idr_cw[i]);
+            k = Deg2Dxl(idl_tgt_past[i]);
+            idr_err[i]++;
+            if (idr_err[i] >= SERVO_LOST_ERROR_WAIT)
+            {
+              s_udp_meridim.bval[MSG_ERR_l] = char(i + 100); // Meridim[MSG_ERR] エラーを出したサーボID（100をID[R00]として[R99]まで）
+              mrd.monitor_servo_error("R", i + 100, MONITOR_SERVO_ERR);
+            }
+          }
+          else
+          {
+            idr_err[i] = 0;
+          }
+        }
+        else // 1以外ならとりあえずサーボを脱力し位置を取得
+        {
+          //k = krs_R.setFree(i);★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★★
+
+          // Turn off torque
+          if(dxl_R.write(i, TORQUE_ENABLE_ADDR, (uint8_t*)&turn_off, TORQUE_ENABLE_ADDR_LEN, TIMEOUT))
+            DEBUG_SERIAL.println("Torque on");
+          else
+            DEBUG_SERIAL.println("Error: Torque on failed");
+
+          dxl_R.read(i, PRESENT_POSITION_ADDR, PRESENT_POSITION_ADDR_LEN, (uint8_t*)&presentPosition1, sizeof(presentPosition1), TIMEOUT);
+          k = presentPosition1;
+
+
+          if (k == -1) // サーボからの返信信号を受け取れなかった時は前回の数値のままにする
+          {
+            //k = mrd.Deg2Krs(idr_tgt_past[i], idr_trim[i], idr_cw[i]);
+            k = Deg2Dxl(idr_tgt_past[i]);
+
+            idr_err[i]++;
+            if (idr_err[i] >= SERVO_LOST_ERROR_WAIT)
+            {
+              s_udp_meridim.bval[MSG_ERR_l] = char(i + 100); // Meridim[MSG_ERR] エラーを出したサーボID（100をID[R00]として[R99]まで）
+              mrd.monitor_servo_error("R", i + 100, MONITOR_SERVO_ERR);
+            }
+          }
+          else
+          {
+            idr_err[i] = 0;
+          }
+        }
+        //idr_tgt[i] = mrd.Krs2Deg(k, idr_trim[i], idr_cw[i]);
+        idl_tgt[i] = Dxl2Deg(k);
+      }
+      delayMicroseconds(1);
+    }
+
+    //
+    mrd.monitor_check_flow("[5]", MONITOR_FLOW); // デバグ用フロー表示
+  }
+}
+
+// [6-1] サーボの角度をUDP送信配列に格納する
+void servo_to_meridim()
+{
+  for (int i = 0; i < 15; i++)
+  {
+    // s_udp_meridim.sval[i * 2 + 20] = 0;                              // 仮にここでは各サーボのコマンドを脱力&ポジション指示(0)に設定
+    s_udp_meridim.sval[i * 2 + 21] = mrd.float2HfShort(idl_tgt[i]); // 仮にここでは最新のサーボ角度degreeを格納
+  }
+  for (int i = 0; i < 15; i++)
+  {
+    // s_udp_meridim.sval[i * 2 + 50] = 0;                              // 仮にここでは各サーボのコマンドを脱力&ポジション指示(0)に設定
+    s_udp_meridim.sval[i * 2 + 51] = mrd.float2HfShort(idr_tgt[i]); // 仮にここでは最新のサーボ角度degreeを格納
+  }
+}
+
+// [9-1] IMU/AHRSの値をUDP送信配列に格納する
+void imu_to_meridim()
+{
+  for (int i = MRD_ACC_X; i <= MRD_DIR_YAW; i++)
+  {
+    s_udp_meridim.sval[i] = mrd.float2HfShort(imuahrs_read[i]); // 加速度, ジャイロ, 磁気, 温度, 方向推定値
+  }
+}
+
+// [9-2], [9-3] 今フレームの送信内容を決め, シーケンス番号とチェックサムで閉じる. 送信内容(MRD_TX_*)を返す
+int meridim_seal()
+{
+  // @ [9-2] 今フレームの送信内容を決め, Meridim全体を送るフレームではフレームスキップ検出用のカウントをカウントアップして格納
+  int tx_kind = telemetry.next_frame();
+  if (tx_kind == MRD_TX_FULL)
+  {
+    mrd_seq_s_increment = mrd.seq_increase_num(mrd_seq_s_increment);
+    s_udp_meridim.usval[1] = mrd_seq_s_increment;
+  }
+
+  // @ [9-3] チェックサムを計算して格納
+  s_udp_meridim.sval[MSG_CKSM] = mrd.cksm_val(s_udp_meridim.sval, MSG_SIZE);
+  return tx_kind;
+}
+
+// UDPソケットの開始(Ethernet2ライブラリ). SPIクロックはライブラリの設定
+uint32_t init_udp(EthernetUDP &u)
+{
+  u.begin(UDP_RESV_PORT);
+  return 0;
+}
+
+// UDPソケットの開始(W5500に直接アクセス). SPI_TUNE 1 では使えるうちで速いSPIクロックを選ぶ
+uint32_t init_udp(MrdW5500Udp &u)
+{
+  uint32_t hz = SPI_SPEED;
+  if (SPI_TUNE)
+  {
+    spi_bus.acquire(MRD_SPI_DEV_NET);
+    hz = u.tune_clock(PIN_CHIPSELECT_W5500, SPI_SPEED, SPI_SPEED_MAX, SPI_TUNE_MARGIN);
+    spi_bus.release(MRD_SPI_DEV_NET);
+    if (hz == 0)
+    {
+      Serial.println("W5500 SPI check failed, using SPI_SPEED.");
+      hz = SPI_SPEED;
+    }
+  }
+  spi_bus.acquire(MRD_SPI_DEV_NET);
+  bool ok = u.begin(UDP_RESV_PORT, PIN_CHIPSELECT_W5500, hz);
+  spi_bus.release(MRD_SPI_DEV_NET);
+  if (!ok)
+  {
+    Serial.println("W5500 UDP socket open failed.");
+  }
+  return hz;
+}
+
+// void init_wifi(const char *wifi_ap_ssid, const char *wifi_ap_pass)
+// {
+//   WiFi.disconnect(true, true); // WiFi接続をリセット
+//   delay(100);
+//   WiFi.begin(wifi_ap_ssid, wifi_ap_pass); // Wifiに接続
+//   while (WiFi.status() != WL_CONNECTED)
+//   {            // https://www.arduino.cc/en/Reference/WiFiStatus 戻り値一覧
+//     delay(50); // 接続が完了するまでループで待つ
+//   }
+// }
+
+void receiveUDP()
+{
+  static_assert(MRD_UPLOAD_MAX_BYTES <= MRD_BATCH_MAX_BYTES, "upload packet must fit the receive buffer");
+  static_assert(MRD_BATCH_MAX_BYTES <= MRD_LINK_MAX_PACKET, "batch packet must fit the link");
+  static short rx_buf[MRD_BATCH_MAX_BYTES / 2];
+  int len = pc_link->receive((uint8_t *)rx_buf, sizeof(rx_buf)); // UDPかシリアルで1パケット受信する(UDPはSDカードとSPIバスを共有)
+  if (len <= 0)
+  {
+    return;
+  }
+  bool by_udp = (pc_link == &udp_link); // 送信元の学習と購読の登録はUDPのみ
+  if (len == MSG_BUFF)
+  {
+    memcpy(r_udp_meridim.bval, rx_buf, MSG_BUFF);
+    udp_rsvd_flag = true; // 受信完了フラグを上げる
+    if (by_udp)
+    {
+      udp_rsvd_ip = udp_link.remote_ip(); // 購読の登録でIPアドレスを省略した時の宛先
+    }
+    if (by_udp and (PEER_LEARN != MRD_PEER_FIXED) and mrd.cksm_rslt(r_udp_meridim.sval, MSG_SIZE))
+    {
+      peer_learn(udp_link.remote_ip(), udp_link.remote_port()); // 正しいMeridimを送ってきたPCに返信する
+    }
+    return;
+  }
+  // Meridim以外の長さはバッチパケットかアップロードのパケット
+  MrdUploadAck ack;
+  if (MOTION_ASSET and asset.upload((uint8_t *)rx_buf, len, &ack)) // モーションアセットのアップロード
+  {
+    if (!asset.motions().is_ready()) // 領域の割り当てを外したので再生中のモーションを止める
+    {
+      stop_motion();
+    }
+    pc_link->send(MRD_LINK_MAIN, (uint8_t *)&ack, sizeof(ack)); // 応答をすぐに返す
+    mrd_t_mic = (unsigned long)micros() + frame_us;          // 消去で止まった分(erase_us_max)は取り戻さず, フレーム管理時計を現在時刻に合わせる
+  }
+  else if (UDP_BATCH_RECEIVE and (len > MSG_BUFF))
+  {
+    if ((jitter.push_batch(rx_buf, len) > 0) and by_udp and (PEER_LEARN != MRD_PEER_FIXED)) // 受信キューに入れ, 再生予定のフレームで取り出す
+    {
+      peer_learn(udp_link.remote_ip(), udp_link.remote_port());
+    }
+  }
+  // delay(1);
+}
+
+void peer_learn(IPAddress ip, uint16_t port)
+{
+  if (peer.learn(ip, port)) // 送信先が変わった時だけ表示する
+  {
+    Serial.print("Peer: ");
+    Serial.print(peer.ip().toString());
+    Serial.print(":");
+    Serial.println(peer.port());
+  }
+}
+
+void sendUDP()
+{
+  static uint8_t delta_buf[MRD_DELTA_MAX];
+  const uint8_t *buf = s_udp_meridim.bval;
+  int len = MSG_BUFF;
+  if (udp_delta_mode) // PCから要求があれば差分Meridimにする
+  {
+    len = delta_enc.encode(s_udp_meridim.sval, s_udp_meridim.usval[MRD_SEQENTIAL], delta_buf);
+    buf = delta_buf;
+  }
+  pc_link->send(MRD_LINK_MAIN, buf, len); // UDPかシリアルで送信
+  telemetry.sent(MRD_TX_FULL, len, millis());
+}
+
+void sendUDP_fast()
+{
+  static short fast_buf[MRD_FAST_MAX_FIELDS + 3];
+  int len = telemetry.pack_fast(fast_buf, s_udp_meridim.sval, UDP_FAST_FIELDS, sizeof(UDP_FAST_FIELDS));
+  pc_link->send(MRD_LINK_FAST, (uint8_t *)fast_buf, len); // UDPかシリアルで送信
+  telemetry.sent(MRD_TX_FAST, len, millis());
+}
+
+void sendUDP_subscribers()
+{
+  int n = fanout.plan(s_udp_meridim.sval); // パケットはここで1回だけ作る
+  if (n == 0)
+  {
+    return;
+  }
+  // PCへの送信([10-1]の先頭)の後にまとめて送る. W5500の宛先レジスタの書き込みはフレームあたりn+1回
+  for (int i = 0; i < n; i++)
+  {
+    const MrdSubSend &p = fanout.packet(i);
+    fanout.sent(i, udp_link.send_to(p.ip, p.port, p.buf, p.len)); // SDカードとSPIバスを共有(優先)
+  }
+}
+
+void monitor_subs()
+{
+  static unsigned long t_last = millis();
+  static uint32_t bytes_last[MRD_SUB_MAX] = {0};
+  unsigned long now = millis();
+  if (now - t_last < 1000) // 1秒ごとに表示
+  {
+    return;
+  }
+  uint32_t dt = now - t_last;
+  t_last = now;
+  Serial.print("[Subs]");
+  for (int i = 0; i < MRD_SUB_MAX; i++)
+  {
+    if (!fanout.active(i))
+    {
+      continue;
+    }
+    MrdSubStats st = fanout.stats(i);
+    Serial.print(" ");
+    Serial.print(i);
+    Serial.print(":");
+    Serial.print(fanout.port(i));
+    Serial.print(" pkt:");
+    Serial.print(st.packets);
+    Serial.print(" B/s:");
+    Serial.print((uint32_t)((uint64_t)(st.bytes - bytes_last[i]) * 1000 / dt));
+    Serial.print(" drop:");
+    Serial.print(st.drops);
+    bytes_last[i] = st.bytes;
+  }
+  Serial.println();
+}
+
+void monitor_udp_send()
+{
+  static unsigned long t_last = millis();
+  unsigned long now = millis();
+  if (now - t_last < 1000) // 1秒ごとに表示
+  {
+    return;
+  }
+  t_last = now;
+  MrdTxStats st = telemetry.stats();
+  Serial.print("[UDP] full/s:");
+  Serial.print(st.full_per_sec);
+  Serial.print(" fast/s:");
+  Serial.print(st.fast_per_sec);
+  Serial.print(" B/s:");
+  Serial.print(st.bytes_per_sec);
+  Serial.print(" total B:");
+  Serial.print(st.bytes);
+  if (udp_delta_mode)
+  {
+    Serial.print(" delta key:");
+    Serial.print(delta_enc.keyframes());
+    Serial.print(" resync:");
+    Serial.print(delta_enc.resyncs());
+  }
+  Serial.println();
+}
+
+void monitor_jitter()
+{
+  static unsigned long t_last = millis();
+  unsigned long now = millis();
+  if (now - t_last < 1000) // 1秒ごとに表示
+  {
+    return;
+  }
+  t_last = now;
+  MrdJitterStats st = jitter.stats();
+  Serial.print("[Batch] played:");
+  Serial.print(st.played);
+  Serial.print(" underrun:");
+  Serial.print(st.underruns);
+  Serial.print(" late:");
+  Serial.print(st.late);
+  Serial.print(" overrun:");
+  Serial.print(st.overruns);
+  Serial.print(" bad:");
+  Serial.print(st.bad);
+  Serial.print(" depth:");
+  Serial.print(st.depth);
+  Serial.print(" (");
+  Serial.print(st.depth_min);
+  Serial.print("-");
+  Serial.print(st.depth_max);
+  Serial.println(")");
+}
+
+void monitor_traj()
+{
+  static unsigned long t_last = millis();
+  unsigned long now = millis();
+  if (now - t_last < 1000) // 1秒ごとに表示
+  {
+    return;
+  }
+  t_last = now;
+  MrdTrajStats st = traj.stats();
+  Serial.print("[Traj] segments:");
+  Serial.print(st.segments);
+  Serial.print(" queued:");
+  Serial.print(st.queued);
+  Serial.print(" late:");
+  Serial.print(st.late);
+  Serial.print(" overflow:");
+  Serial.print(st.overflows);
+  Serial.print(" dup:");
+  Serial.print(st.duplicates);
+  Serial.print(" idle:");
+  Serial.println(st.idle);
+}
+
+void monitor_recorder()
+{
+  static int count = 0;
+  if (++count < 100) // 100フレームごとに表示
+  {
+    return;
+  }
+  count = 0;
+  MrdRecStats st = recorder.stats();
+  Serial.print("rec:");
+  Serial.print(st.records);
+  Serial.print(" drop:");
+  Serial.print(st.dropped);
+  Serial.print(" blk:");
+  Serial.print(st.blocks_written);
+  Serial.print(" err:");
+  Serial.print(st.write_errors);
+  Serial.print(" B/s:");
+  Serial.print(st.bytes_per_sec);
+  Serial.print(" wr_us_max:");
+  Serial.print(st.write_us_max);
+  Serial.print(" pend_max:");
+  Serial.println(st.pending_high_water);
+}
+
+void monitor_spi()
+{
+  static unsigned long t_last = millis();
+  static uint32_t busy_last[MRD_SPI_DEVS] = {0};
+  unsigned long now = millis();
+  if (now - t_last < 1000) // 1秒ごとに表示
+  {
+    return;
+  }
+  const char *names[MRD_SPI_DEVS] = {"net", "sd"};
+  for (int i = 0; i < MRD_SPI_DEVS; i++)
+  {
+    MrdSpiStats st = spi_bus.stats(i);
+    Serial.print(i == 0 ? "spi " : " ");
+    Serial.print(names[i]);
+    Serial.print(":");
+    Serial.print((st.busy_us - busy_last[i]) / (float)((now - t_last) * 10), 1); // バスの使用率(%)
+    Serial.print("% n:");
+    Serial.print(st.grants);
+    Serial.print(" hold_max:");
+    Serial.print(st.hold_us_max);
+    Serial.print(" wait_max:");
+    Serial.print(st.wait_us_max);
+    busy_last[i] = st.busy_us;
+  }
+  Serial.print(" yield:");
+  Serial.println(spi_bus.stats(MRD_SPI_DEV_SD).yields);
+  t_last = now;
+}
+
+void init_replay()
+{
+  Serial.print("Replay ");
+  Serial.print(REPLAY_FILE);
+  bool ok = false;
+  if (REPLAY_FS == 1)
+  {
+    ok = SPIFFS.begin() and replay.begin(SPIFFS, REPLAY_FILE, (REPLAY_MODE == 1), REPLAY_LOOP, NULL, 1);
+  }
+  else if (MOUNT_SD)
+  {
+    ok = replay.begin(SD, REPLAY_FILE, (REPLAY_MODE == 1), REPLAY_LOOP, &spi_bus, 1);
+  }
+  if (ok)
+  {
+    Serial.print(" start. blocks:");
+    Serial.println(replay.stats().blocks_total);
+  }
+  else
+  {
+    Serial.println(" failed.");
+  }
+}
+
+void init_motion_asset()
+{
+  motion_player.begin(MOTION_INTERP_PROFILE);
+  Serial.print("Motion asset ");
+  Serial.print(MOTION_ASSET_LABEL);
+  if (!asset.begin(MOTION_ASSET_LABEL))
+  {
+    Serial.println(" partition not found.");
+    return;
+  }
+  Serial.print(" motions:");
+  Serial.print(asset.motions().count());
+  Serial.print(" bytes:");
+  Serial.print(asset.motions().bytes());
+  Serial.print("/");
+  Serial.println(asset.size());
+}
+
+bool start_motion(int index)
+{
+  return motion_player.start(asset.motions(), index, servo_pose); // アップロード中は領域が割り当てられていないので再生しない
+}
+
+void stop_motion()
+{
+  if (motion_player.playing()) // 止めた姿勢から受信した姿勢に向かう
+  {
+    motion_player.stop();
+    interp.set_pose(servo_pose, 30);
+    traj_mode = false;
+  }
+}
+
+void motion_pad_trigger(uint16_t buttons)
+{
+  static uint16_t pre_buttons = 0;
+  for (int i = 0; i < (int)(sizeof(MOTION_PAD_BUTTONS) / sizeof(MOTION_PAD_BUTTONS[0])); i++)
+  {
+    uint16_t mask = MOTION_PAD_BUTTONS[i];
+    if ((mask != 0) and ((buttons & mask) == mask) and ((pre_buttons & mask) != mask)) // 組み合わせがそろった瞬間のみ
+    {
+      start_motion(i);
+    }
+  }
+  pre_buttons = buttons;
+}
+
+void monitor_motion()
+{
+  static unsigned long t_last = millis();
+  unsigned long now = millis();
+  if (now - t_last < 1000) // 1秒ごとに表示
+  {
+    return;
+  }
+  t_last = now;
+  MrdAssetStats st = asset.stats();
+  Serial.print("[Motion] playing:");
+  Serial.print(motion_player.current());
+  Serial.print(" motions:");
+  Serial.print(asset.motions().count());
+  Serial.print(" uploads:");
+  Serial.print(st.uploads);
+  Serial.print(" chunks:");
+  Serial.print(st.chunks);
+  Serial.print(" resent:");
+  Serial.print(st.resent);
+  Serial.print(" err:");
+  Serial.print(st.errors);
+  Serial.print(" erase_us_max:");
+  Serial.print(st.erase_us_max);
+  Serial.print(" write_us_max:");
+  Serial.println(st.write_us_max);
+}
+
+void replay_receive()
+{
+  if (replay.next((uint32_t)micros(), r_udp_meridim.bval))
+  {
+    mrd.monitor_check_flow("[Rply]", MONITOR_FLOW); // デバグ用フロー表示
+    udp_rsvd_flag = true;                           // 受信完了フラグを上げる
+  }
+  if (MONITOR_REPLAY)
+  {
+    static unsigned long frames_last = 0;
+    static unsigned long t_last = millis();
+    unsigned long now = millis();
+    if (now - t_last >= 1000) // 1秒ごとに表示
+    {
+      MrdReplayStats st = replay.stats();
+      Serial.print("replay fps:");
+      Serial.print((st.frames - frames_last) * 1000 / (now - t_last));
+      Serial.print(" frames:");
+      Serial.print(st.frames);
+      Serial.print(" underrun:");
+      Serial.print(st.underruns);
+      Serial.print(" loops:");
+      Serial.print(st.loops);
+      Serial.print(" err:");
+      Serial.print(st.read_errors);
+      Serial.print(" rd_us_max:");
+      Serial.println(st.read_us_max);
+      frames_last = st.frames;
+      t_last = now;
+    }
+  }
+}
+
+void check_sd()
+{
+  if (MOUNT_SD)
+  {
+    Serial.print("SD card check...");
+    delay(100);
+    if (!SD.begin(PIN_CHIPSELECT_SD))
+    {
+      Serial.println(" initialization FALIED!");
+      delay(500);
+    }
+    else
+    {
+      Serial.println(" OK.");
+    }
+
+    if (CHECK_SD_RW)
+    {
+      // open the file.
+      myFile = SD.open("/tmp.txt", FILE_WRITE);
+      delayMicroseconds(2); // SPI安定化検証用
+
+      // if the file opened okay, write to it:
+      if (myFile)
+      {
+        Serial.print("SD card r/w check...");
+        // SD書き込みテスト用のランダムな4桁の数字を生成
+        randomSeed(long(analogRead(A0))); // 未接続ピンのノイズを利用
+        int randNumber = random(1000, 9999);
+
+        Serial.print(" write code ");
+        Serial.print(randNumber);
+        myFile.println(randNumber);
+        delayMicroseconds(2); // SPI安定化検証用
+        // close the file:
+        myFile.close();
+        Serial.print(" and");
+        delayMicroseconds(10); // SPI安定化検証用
+        // re-open the file for reading:
+        myFile = SD.open("/tmp.txt");
+        if (myFile)
+        {
+          Serial.print(" read code ");
+          while (myFile.available())
+          {
+            Serial.write(myFile.read());
+          }
+          // close the file:
+          myFile.close();
+        }
+        SD.remove("/tmp.txt");
+        delay(10);
+      }
+      else
+      {
+        // if the file didn't open, print an error:
+        Serial.println("Could not open SD test file.");
+      }
+    }
+  }
+  else
+  {
+    Serial.println("No SD reader/writer mounted.");
+  }
+}
+
+void bt_settings()
+{
+  /* Wiiコントローラの接続開始 */
+  if ((MOUNT_JOYPAD == 5) or (MOUNT_JOYPAD == 6))
+  {
+    Serial.println("Try to connect Wiimote...");
+    wiimote.init();
+    if (!wiimote.startTask(WIIMOTE_TASK_CORE, WIIMOTE_TASK_PRIORITY)) // HCIキューの処理は専用タスクで行う
+    {
+      Serial.println("Wiimote service task could not start.");
+    }
+  }
+}
+
+uint64_t joypad_read(int mount_joypad, uint64_t pre_val, bool joypad_reflesh)
+{
+  if (mount_joypad == 2)
+  { // KRR5FH(KRC-5FH)をICS_R系に接続している場合. 受信自体はkrr_poll_bus_slot()が行う
+    if (!krr_rsvd_flag)
+    {
+      return pre_val;
+    }
+    uint16_t pad_btn_tmp = krr_button;
+    if (JOYPAD_GENERALIZE)
+    {
+      pad_btn_tmp = pad_krr_generalize(krr_button);
+    }
+
+    /* 共用体用の64ビットの下位16ビット部をボタンデータ, 残りをアナログデータとして書き換える */
+    uint64_t analog_val = (static_cast<uint64_t>(krr_analog[0] & 0xFF) << 16) | (static_cast<uint64_t>(krr_analog[1] & 0xFF) << 24) | (static_cast<uint64_t>(krr_analog[2] & 0xFF) << 32) | (static_cast<uint64_t>(krr_analog[3] & 0xFF) << 40);
+    uint64_t updated_val;
+    if (joypad_reflesh)
+    {
+      updated_val = (pre_val & 0xFFFF000000000000) | analog_val | (static_cast<uint64_t>(pad_btn_tmp)); // index[0]-[2]
+    }
+    else
+    {
+      updated_val = (pre_val) | analog_val | (static_cast<uint64_t>(pad_btn_tmp));
+    }
+    return updated_val;
+  }
+  else if (mount_joypad == 5) // wiimote_yoko
+  {
+    uint64_t updated_val = 0;
+    if (joypad_reflesh)
+    {
+      updated_val = (pre_val & 0xFFFFFFFFFFFF0000) | (static_cast<uint64_t>(pad_wiimote_receive())); // 上位16ビット index[0]
+    }
+    else
+    {
+      updated_val = (pre_val) | (static_cast<uint64_t>(pad_wiimote_receive()));
+    }
+    joypad_poll_t_mic = (unsigned long)micros();
+    return updated_val;
+  }
+  else
+  {
+    return pre_val;
+  }
+}
+
+void uart_r_begin(int mount_joypad)
+{
+  if (mount_joypad == 2) // KRC-5FHはR系統のUARTをICSの設定(タイムアウト, ENピン)で一度だけ開き, 以降は形式だけを切り替える
+  {
+    krs_R.begin();
+  }
+  dxl_R.begin(1000000);
+}
+
+// R系統のUARTの形式をICS(1.25Mbps 8E1)とDynamixel(1Mbps 8N1)で切り替える.
+// begin()はUARTのドライバを作り直すため, ボーレートとパリティだけを書き換える
+void uart_r_select_ics(bool ics)
+{
+  DXL_SERIAL_R.updateBaudRate(ics ? ICS_BAUDRATE : 1000000);
+  uart_set_parity(UART_NUM_2, ics ? UART_PARITY_EVEN : UART_PARITY_DISABLE);
+}
+
+void krr_poll_bus_slot(int mount_joypad)
+{
+  if (mount_joypad != 2)
+  {
+    return;
+  }
+  if ((unsigned long)micros() - joypad_poll_t_mic < JOYPAD_POLLING_US)
+  {
+    return;
+  }
+
+  /* フレームの残り時間が足りなければサーボの周期を優先し, 次のフレームに回す */
+  long slack_us = (long)(mrd_t_mic - (unsigned long)micros());
+  if (slack_us < KRR_BUS_BUDGET_US)
+  {
+    krr_bus_deferred++;
+    return;
+  }
+
+  unsigned long t0 = micros();
+  uart_r_select_ics(true); // R系統のUARTをICS(8E1)に切り替え
+  unsigned short button;
+  int analog[4];
+  bool ok = krs_R.getKrrAllData(&button, analog); // ボタンとアナログを1回のやりとりで取得
+  uart_r_select_ics(false);                       // R系統のUARTをDynamixelに戻す
+  krr_bus_us_last = micros() - t0;
+  if (krr_bus_us_last > krr_bus_us_max)
+  {
+    krr_bus_us_max = krr_bus_us_last;
+  }
+  joypad_poll_t_mic = t0;
+
+  if (ok and (button != KRR_BUTTON_FALSE))
+  {
+    if (!krr_rsvd_flag)
+    {
+      Serial.println("KRC-5FH successfully connected. ");
+    }
+    krr_button = button;
+    for (int i = 0; i < 4; i++)
+    {
+      krr_analog[i] = analog[i];
+    }
+    krr_rsvd_flag = true;
+  }
+  else
+  {
+    krr_bus_err++;
+  }
+
+  if (MONITOR_JOYPAD)
+  {
+    Serial.print("[KRR] bus us:");
+    Serial.print(krr_bus_us_last);
+    Serial.print(" max:");
+    Serial.print(krr_bus_us_max);
+    Serial.print(" deferred:");
+    Serial.print(krr_bus_deferred);
+    Serial.print(" err:");
+    Serial.println(krr_bus_err);
+  }
+}
+
+uint16_t pad_wiimote_receive()
+{
+  static uint32_t last_reports = 0; // 前回読み出した時点の受信レポート数
+  WiimoteSnapshot snapshot;         // 受信タスクが公開した最新状態(BTスタックには触れない)
+  if (wiimote.getSnapshot(&snapshot) and (snapshot.reports != last_reports))
+  {
+    if (last_reports == 0)
+    {
+      Serial.println("Wiimote successfully connected. ");
+    }
+    last_reports = snapshot.reports;
+    uint16_t button = snapshot.buttonState;
+    if (JOYPAD_GENERALIZE)
+    {
+      pad_btn = PadRemap<PAD_WIIMOTE_SOLO>::apply(button); // 変換表でPS系のボタン配列に変換
+    }
+    else
+    {
+      pad_btn = PadRemap<PAD_WIIMOTE_ORIG>::apply(button);
+    }
+    return pad_btn;
+  }
+  else
+  {
+    return pad_btn;
+  }
+  if (MOUNT_JOYPAD == 6)
+  {
+    Serial.println("Wiimote + Nunchuk not available now. "); //
+  }
+}
+
+uint16_t pad_krr_generalize(uint16_t krr_btn)
+{
+  uint16_t btn = PadRemap<PAD_KRR5FH_SOLO>::apply(krr_btn); // 変換表でPS系のボタン配列に変換
+  if ((krr_btn & 15) == 15)
+  { // 左側十字ボタン全部押しなら start押下とみなす
+    btn = (btn & ~0x00F0) | 0x0001;
+  }
+  if ((krr_btn & 368) == 368)
+  { // 右側十字ボタン全部押しなら select押下とみなす
+    btn = (btn & ~0xF000) | 0x0008;
+  }
+  return btn;
+}
+
+void init_imuahrs(int mount_imuahrs)
+{
+  if ((mount_imuahrs == 1) or (mount_imuahrs == 2))
+  {
+    if (!init_mpu())
+    {
+      Serial.println("No MPU6050/MPU9250 detected ... Check your wiring or I2C ADDR!");
+    }
+    else
+    {
+      Serial.println("MPU6050/MPU9250 mounted and started.");
+    }
+  }
+  else if (mount_imuahrs == 3)
+    if (!bno.begin())
+    {
+      Serial.println("No BNO055 detected ... Check your wiring or I2C ADDR!");
+    }
+    else
+    {
+      Serial.println("BNO055 mounted and started.");
+      delay(50);
+      bno.setExtCrystalUse(false);
+      delay(10);
+    }
+  else
+  {
+    Serial.println("No IMU/AHRS sensor mounted.");
+  }
+}
+
+void Core1_bno055_r(void *args)
 {
+  unsigned long next_t_mic = (unsigned long)micros(); // 次の読み取り開始時刻(us)
   while (1)
   {
     /* 加速度センサ値の取得と表示 - VECTOR_ACCELEROMETER - m/s^2 */
     imu::Vector<3> accelermetor = bno.getVector(Adafruit_BNO055::VECTOR_ACCELEROMETER);
-    bno055_read[0] = (float)accelermetor.x();
-    bno055_read[1] = (float)accelermetor.y();
-    bno055_read[2] = (float)accelermetor.z();
+    imuahrs_read[2] = (float)accelermetor.x();
+    imuahrs_read[3] = (float)accelermetor.y();
+    imuahrs_read[4] = (float)accelermetor.z();
 
     /* ジャイロセンサ値の取得 - VECTOR_GYROSCOPE - rad/s */
     imu::Vector<3> gyroscope = bno.getVector(Adafruit_BNO055::VECTOR_GYROSCOPE);
-    bno055_read[3] = gyroscope.x();
-    bno055_read[4] = gyroscope.y();
-    bno055_read[5] = gyroscope.z();
+    imuahrs_read[5] = gyroscope.x();
+    imuahrs_read[6] = gyroscope.y();
+    imuahrs_read[7] = gyroscope.z();
 
     /* 磁力センサ値の取得と表示  - VECTOR_MAGNETOMETER - uT */
     imu::Vector<3> magnetmetor = bno.getVector(Adafruit_BNO055::VECTOR_MAGNETOMETER);
-    bno055_read[6] = magnetmetor.x();
-    bno055_read[7] = magnetmetor.y();
-    bno055_read[8] = magnetmetor.z();
+    imuahrs_read[8] = magnetmetor.x();
+    imuahrs_read[9] = magnetmetor.y();
+    imuahrs_read[10] = magnetmetor.z();
 
     /* センサフュージョンによる方向推定値の取得と表示 - VECTOR_EULER - degrees */
     imu::Vector<3> euler = bno.getVector(Adafruit_BNO055::VECTOR_EULER);
-    bno055_read[12] = euler.y();                          // DMP_ROLL推定値
-    bno055_read[13] = euler.z();                          // DMP_PITCH推定値
+    imuahrs_read[12] = euler.y();                         // DMP_ROLL推定値
+    imuahrs_read[13] = euler.z();                         // DMP_PITCH推定値
     imuahrs_yaw_source = euler.x();                       // ヨー軸のソースデータ保持
     float yaw_tmp = euler.x() - 180 - imuahrs_yaw_origin; // DMP_YAW推定値
     if (yaw_tmp >= 180)
@@ -1013,7 +1831,7 @@ void Core1_bno055_r(void *args)
     {
       yaw_tmp = yaw_tmp + 360;
     }
-    bno055_read[14] = yaw_tmp; // DMP_YAW推定値
+    imuahrs_read[14] = yaw_tmp; // DMP_YAW推定値
 
     /*
       // センサフュージョンの方向推定値のクオータニオン
@@ -1033,7 +1851,220 @@ void Core1_bno055_r(void *args)
     Serial.print(", Ac"); Serial.print(accel, DEC);
     Serial.print(", Mg"); Serial.println(mag, DEC);
     */
-    delay(IMUAHRS_POLLING);
+
+    /* 読み取り開始時刻をIMUAHRS_POLLING_US間隔に揃える. tick(1ms)単位の端数は次の周期で取り戻す */
+    next_t_mic += IMUAHRS_POLLING_US;
+    long wait_us = (long)(next_t_mic - (unsigned long)micros());
+    if (wait_us < 0)
+    {
+      next_t_mic = (unsigned long)micros(); // 読み取りが周期を超えた場合は位相を取り直す
+      wait_us = 0;
+    }
+    vTaskDelay(max((TickType_t)1, (TickType_t)(wait_us / (1000L * portTICK_PERIOD_MS))));
+  }
+}
+
+void mpu_write_reg(uint8_t reg, uint8_t val)
+{
+  Wire.beginTransmission(MPU_ADDR);
+  Wire.write(reg);
+  Wire.write(val);
+  Wire.endTransmission();
+}
+
+int mpu_read_regs(uint8_t reg, uint8_t *buf, int len)
+{
+  Wire.beginTransmission(MPU_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0)
+  {
+    return 0;
+  }
+  int rcvd = Wire.requestFrom((uint16_t)MPU_ADDR, (uint8_t)len);
+  for (int i = 0; i < rcvd; i++)
+  {
+    buf[i] = Wire.read();
+  }
+  return rcvd;
+}
+
+bool init_mpu()
+{
+  uint8_t who = 0;
+  if (mpu_read_regs(MPU_REG_WHO_AM_I, &who, 1) != 1)
+  {
+    return false;
+  }
+  if ((who != 0x68) and (who != 0x71) and (who != 0x73)) // MPU6050, MPU9250, MPU9255
+  {
+    return false;
+  }
+  mpu_who_am_i = who;
+
+  mpu_write_reg(MPU_REG_PWR_MGMT_1, 0x80); // デバイスリセット
+  delay(100);
+  mpu_write_reg(MPU_REG_PWR_MGMT_1, 0x01);                            // スリープ解除, クロックをジャイロXのPLLに
+  mpu_write_reg(MPU_REG_CONFIG, 0x03);                                // DLPF 44Hz, 内部サンプリング1kHz
+  mpu_write_reg(MPU_REG_SMPLRT_DIV, (1000 / IMUAHRS_FUSION_HZ) - 1); // サンプリングレートの設定
+  mpu_write_reg(MPU_REG_GYRO_CONFIG, 0x18);                           // ジャイロ+-2000dps
+  mpu_write_reg(MPU_REG_ACCEL_CONFIG, 0x10);                          // 加速度+-8g
+  delay(50);
+
+  /* 静止状態でのジャイロのオフセットを取得 */
+  int32_t gyro_bias[3] = {0, 0, 0};
+  const int bias_samples = 200;
+  for (int n = 0; n < bias_samples; n++)
+  {
+    uint8_t raw[6];
+    mpu_read_regs(MPU_REG_GYRO_XOUT_H, raw, 6);
+    for (int i = 0; i < 3; i++)
+    {
+      gyro_bias[i] += (int16_t)((raw[i * 2] << 8) | raw[i * 2 + 1]);
+    }
+    delay(2);
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    gyro_bias[i] /= bias_samples;
+  }
+
+  mpu_fusion.begin(IMUAHRS_FUSION_HZ, IMUAHRS_FUSION_KP, IMUAHRS_FUSION_KI, MPU_GYRO_LSB_PER_DPS);
+  mpu_fusion.set_gyro_bias(gyro_bias);
+
+  /* FIFOに加速度とジャイロを積む設定 */
+  mpu_write_reg(MPU_REG_USER_CTRL, 0x04); // FIFOリセット
+  mpu_write_reg(MPU_REG_FIFO_EN, 0x78);   // 加速度XYZ, ジャイロXYZ
+  mpu_write_reg(MPU_REG_USER_CTRL, 0x40); // FIFO有効
+  return true;
+}
+
+int mpu_fifo_fuse(int16_t acc[3], int16_t gyro[3], uint64_t *cycles_sum)
+{
+  /* FIFOがオーバーフローしていたらリセットして読み直す */
+  uint8_t reg[2];
+  if ((mpu_read_regs(MPU_REG_INT_STATUS, reg, 1) == 1) and (reg[0] & 0x10))
+  {
+    mpu_write_reg(MPU_REG_USER_CTRL, 0x44);
+    return -1;
+  }
+  if (mpu_read_regs(MPU_REG_FIFO_COUNTH, reg, 2) != 2)
+  {
+    return -1;
+  }
+  int samples = ((reg[0] << 8) | reg[1]) / MPU_FIFO_SAMPLE_LEN;
+
+  /* FIFOを最大MPU_FIFO_BURSTサンプルずつバースト読み出ししてフュージョンを更新 */
+  uint8_t fifo_buf[MPU_FIFO_SAMPLE_LEN * MPU_FIFO_BURST];
+  int fused = 0;
+  while (samples > 0)
+  {
+    int burst = min(samples, MPU_FIFO_BURST);
+    int len = burst * MPU_FIFO_SAMPLE_LEN;
+    if (mpu_read_regs(MPU_REG_FIFO_R_W, fifo_buf, len) != len)
+    {
+      break;
+    }
+    for (int n = 0; n < burst; n++)
+    {
+      uint8_t *p = &fifo_buf[n * MPU_FIFO_SAMPLE_LEN];
+      for (int i = 0; i < 3; i++)
+      {
+        acc[i] = (int16_t)((p[i * 2] << 8) | p[i * 2 + 1]);
+        gyro[i] = (int16_t)((p[i * 2 + 6] << 8) | p[i * 2 + 7]);
+      }
+      uint32_t t0 = ESP.getCycleCount();
+      mpu_fusion.update(acc, gyro);
+      imu_fusion_cycles_last = ESP.getCycleCount() - t0;
+      if (imu_fusion_cycles_last > imu_fusion_cycles_max)
+      {
+        imu_fusion_cycles_max = imu_fusion_cycles_last;
+      }
+      *cycles_sum += imu_fusion_cycles_last;
+      imu_fusion_update_count++;
+      fused++;
+    }
+    samples -= burst;
+  }
+  return fused;
+}
+
+float mpu_temp_c(int16_t raw, uint8_t who)
+{
+  if (who == 0x68) // MPU6050
+  {
+    return raw / 340.0f + 36.53f;
+  }
+  return raw / 333.87f + 21.0f; // MPU9250, MPU9255 (RoomTemp_Offset 21℃)
+}
+
+void Core1_mpu_r(void *args)
+{
+  const float acc_scale = 9.80665f / MPU_ACC_LSB_PER_G; // 生値 → m/s^2
+  const float gyro_scale = 1.0f / MPU_GYRO_LSB_PER_DPS; // 生値 → deg/s (BNO055の既定単位に合わせる)
+  const TickType_t period = max((TickType_t)1, (TickType_t)pdMS_TO_TICKS(2)); // FIFOの読み出し周期
+  int16_t acc[3] = {0, 0, 0};
+  int16_t gyro[3] = {0, 0, 0};
+  uint64_t cycles_sum = 0;
+  uint32_t monitor_count = 0;
+  int temp_count = 0;
+  TickType_t last_wake = xTaskGetTickCount();
+
+  while (1)
+  {
+    vTaskDelayUntil(&last_wake, period);
+
+    int fused = mpu_fifo_fuse(acc, gyro, &cycles_sum);
+    if (fused < 0)
+    {
+      continue;
+    }
+    monitor_count += fused;
+
+    /* BNO055と同じ並びで結果を格納 */
+    for (int i = 0; i < 3; i++)
+    {
+      imuahrs_read[i + 2] = acc[i] * acc_scale;   // 加速度 m/s^2
+      imuahrs_read[i + 5] = gyro[i] * gyro_scale; // ジャイロ deg/s
+      imuahrs_read[i + 8] = 0;                    // 磁気コンパスは未使用
+    }
+    if (++temp_count >= 100) // 温度は低頻度で取得
+    {
+      temp_count = 0;
+      uint8_t t[2];
+      if (mpu_read_regs(MPU_REG_TEMP_OUT_H, t, 2) == 2)
+      {
+        imuahrs_read[11] = mpu_temp_c((int16_t)((t[0] << 8) | t[1]), mpu_who_am_i);
+      }
+    }
+
+    float roll, pitch, yaw;
+    mpu_fusion.euler(&roll, &pitch, &yaw);
+    imuahrs_read[12] = roll;  // DMP_ROLL推定値
+    imuahrs_read[13] = pitch; // DMP_PITCH推定値
+    imuahrs_yaw_source = yaw; // ヨー軸のソースデータ保持
+    float yaw_tmp = yaw - imuahrs_yaw_origin;
+    if (yaw_tmp >= 180)
+    {
+      yaw_tmp = yaw_tmp - 360;
+    }
+    else if (yaw_tmp < -180)
+    {
+      yaw_tmp = yaw_tmp + 360;
+    }
+    imuahrs_read[14] = yaw_tmp; // DMP_YAW推定値
+
+    /* 1秒ごとにフュージョン処理のサイクル数を表示 */
+    if (MONITOR_IMU_FUSION and (monitor_count >= IMUAHRS_FUSION_HZ))
+    {
+      Serial.print("[IMU] updates/s:");
+      Serial.print(monitor_count);
+      Serial.print(" cycles avg:");
+      Serial.print((uint32_t)(cycles_sum / monitor_count));
+      Serial.print(" max:");
+      Serial.println(imu_fusion_cycles_max);
+      cycles_sum = 0;
+      monitor_count = 0;
+    }
   }
 }
 
@@ -1088,6 +2119,68 @@ void execute_MasterCommand()
   {
     s_udp_meridim.bval[MSG_ERR_l] = 0;
   }
+
+  // コマンド[10010]: フレーム処理のベンチマーク（コマンドを受信し始めた最初のフレームのみ実行）
+  static short pre_master = 0;
+  if ((s_udp_meridim.sval[MRD_MASTER] == MCMD_BENCH) and (pre_master != MCMD_BENCH))
+  {
+    run_bench();
+    mrd_t_mic = (unsigned long)micros() + frame_us; // ベンチマークで止まった分はフレーム管理時計を現在時刻に合わせる
+  }
+
+  // コマンド[10011]/[10012]: 差分Meridim送信の開始/終了（開始はコマンドを受信し始めた最初のフレームのみ）
+  if ((s_udp_meridim.sval[MRD_MASTER] == MCMD_DELTA_ON) and (pre_master != MCMD_DELTA_ON))
+  {
+    delta_enc.begin(UDP_DELTA_KEY_INTERVAL);
+    udp_delta_mode = true;
+  }
+  if (s_udp_meridim.sval[MRD_MASTER] == MCMD_DELTA_OFF)
+  {
+    udp_delta_mode = false;
+  }
+  if (udp_delta_mode) // PCが保持しているキーフレームの番号を受け取る
+  {
+    delta_enc.set_ack(s_udp_meridim.usval[UDP_DELTA_ACK_INDEX]);
+  }
+
+  // コマンド[10014]/[10015]: モーションアセットの再生/停止（再生はコマンドを受信し始めた最初のフレームのみ）
+  if (MOTION_ASSET and (s_udp_meridim.sval[MRD_MASTER] == MCMD_MOTION_PLAY) and (pre_master != MCMD_MOTION_PLAY))
+  {
+    start_motion(s_udp_meridim.sval[MOTION_PLAY_INDEX]);
+  }
+  if (s_udp_meridim.sval[MRD_MASTER] == MCMD_MOTION_STOP)
+  {
+    stop_motion();
+  }
+
+  // コマンド[10016]/[10017]: 購読者の登録/削除（コマンドを受信し始めた最初のフレームのみ）
+  static_assert((UDP_DELTA_ACK_INDEX < SUB_PARAM_INDEX) or (UDP_DELTA_ACK_INDEX >= SUB_PARAM_INDEX + MRD_SUB_PARAMS), "delta ack must not overlap the subscribe parameters");
+  if (UDP_SUBSCRIBERS and (s_udp_meridim.sval[MRD_MASTER] == MCMD_SUBSCRIBE) and (pre_master != MCMD_SUBSCRIBE))
+  {
+    int slot = fanout.subscribe(&s_udp_meridim.sval[SUB_PARAM_INDEX], udp_rsvd_ip);
+    Serial.print("Subscribe ");
+    if (slot < 0)
+    {
+      Serial.println("rejected (table full or bad parameters).");
+    }
+    else
+    {
+      Serial.print(slot);
+      Serial.print(": ");
+      Serial.print(fanout.ip(slot).toString());
+      Serial.print(":");
+      Serial.print(fanout.port(slot));
+      Serial.print(" 1/");
+      Serial.print(fanout.divisor(slot));
+      Serial.print(" fields:");
+      Serial.println(fanout.fields(slot));
+    }
+  }
+  if (UDP_SUBSCRIBERS and (s_udp_meridim.sval[MRD_MASTER] == MCMD_UNSUBSCRIBE) and (pre_master != MCMD_UNSUBSCRIBE))
+  {
+    fanout.unsubscribe(&s_udp_meridim.sval[SUB_PARAM_INDEX], udp_rsvd_ip);
+  }
+  pre_master = s_udp_meridim.sval[MRD_MASTER];
 }
 
 void servo_all_off()
@@ -1123,9 +2216,10 @@ void servo_all_off()
 
 void setyawcenter()
 {
-  if (MOUNT_IMUAHRS == 1) // MPU6050
+  if ((MOUNT_IMUAHRS == 1) or (MOUNT_IMUAHRS == 2)) // MPU6050, MPU9250
   {
-    Serial.println("MPU6050 driver is not implemented in this version.");
+    imuahrs_yaw_origin = imuahrs_yaw_source;
+    s_udp_meridim.sval[0] = MSG_SIZE;
   }
   else if (MOUNT_IMUAHRS == 3) // BNO055
   {
@@ -1133,3 +2227,312 @@ void setyawcenter()
     s_udp_meridim.sval[0] = MSG_SIZE;
   }
 }
+
+//================================================================================================================
+//---- Benchmark -------------------------------------------------------------------------------------------------
+//================================================================================================================
+
+/* ベンチマーク. 工程の関数は動作中の配列・状態を使うため, 計測の前に保存して終わったら戻す */
+struct BenchSaved
+{
+  UnionData r;
+  UnionData s;
+  UnionPad pad;
+  unsigned short krr_button;
+  int krr_analog[4];
+  bool krr_rsvd_flag;
+  int err_pc_esp;
+  int mrd_seq_s_increment;
+  MrdTelemetry telemetry;
+  MrdInterp interp;
+  MrdTraj traj;
+  MrdMotionPlayer motion_player;
+  bool traj_mode;
+  short servo_pose[30];
+  int servo_num_max;
+  int idl_mount[15];
+  int idr_mount[15];
+  float idl_tgt[15];
+  float idr_tgt[15];
+  float idl_tgt_past[15];
+  float idr_tgt_past[15];
+  int idl_err[15];
+  int idr_err[15];
+};
+BenchSaved bench_saved;
+uint8_t bench_packet[MSG_BUFF]; // UDPで受信したパケット
+int bench_servos = 0;           // 計測中の構成のサーボ数
+int bench_seq = 0;              // リモコン値を変えるためのカウンタ
+
+static void bench_save()
+{
+  BenchSaved &b = bench_saved;
+  b.r = r_udp_meridim;
+  b.s = s_udp_meridim;
+  b.pad = pad_array;
+  b.krr_button = krr_button;
+  memcpy(b.krr_analog, krr_analog, sizeof(krr_analog));
+  b.krr_rsvd_flag = krr_rsvd_flag;
+  b.err_pc_esp = err_pc_esp;
+  b.mrd_seq_s_increment = mrd_seq_s_increment;
+  b.telemetry = telemetry;
+  b.interp = interp;
+  b.traj = traj;
+  b.motion_player = motion_player;
+  b.traj_mode = traj_mode;
+  memcpy(b.servo_pose, servo_pose, sizeof(servo_pose));
+  b.servo_num_max = servo_num_max;
+  memcpy(b.idl_mount, idl_mount, sizeof(idl_mount));
+  memcpy(b.idr_mount, idr_mount, sizeof(idr_mount));
+  memcpy(b.idl_tgt, idl_tgt, sizeof(idl_tgt));
+  memcpy(b.idr_tgt, idr_tgt, sizeof(idr_tgt));
+  memcpy(b.idl_tgt_past, idl_tgt_past, sizeof(idl_tgt_past));
+  memcpy(b.idr_tgt_past, idr_tgt_past, sizeof(idr_tgt_past));
+  memcpy(b.idl_err, idl_err, sizeof(idl_err));
+  memcpy(b.idr_err, idr_err, sizeof(idr_err));
+}
+
+static void bench_restore()
+{
+  const BenchSaved &b = bench_saved;
+  r_udp_meridim = b.r;
+  s_udp_meridim = b.s;
+  pad_array = b.pad;
+  krr_button = b.krr_button;
+  memcpy(krr_analog, b.krr_analog, sizeof(krr_analog));
+  krr_rsvd_flag = b.krr_rsvd_flag;
+  err_pc_esp = b.err_pc_esp;
+  mrd_seq_s_increment = b.mrd_seq_s_increment;
+  telemetry = b.telemetry;
+  interp = b.interp;
+  traj = b.traj;
+  motion_player = b.motion_player;
+  traj_mode = b.traj_mode;
+  memcpy(servo_pose, b.servo_pose, sizeof(servo_pose));
+  servo_num_max = b.servo_num_max;
+  memcpy(idl_mount, b.idl_mount, sizeof(idl_mount));
+  memcpy(idr_mount, b.idr_mount, sizeof(idr_mount));
+  memcpy(idl_tgt, b.idl_tgt, sizeof(idl_tgt));
+  memcpy(idr_tgt, b.idr_tgt, sizeof(idr_tgt));
+  memcpy(idl_tgt_past, b.idl_tgt_past, sizeof(idl_tgt_past));
+  memcpy(idr_tgt_past, b.idr_tgt_past, sizeof(idr_tgt_past));
+  memcpy(idl_err, b.idl_err, sizeof(idl_err));
+  memcpy(idr_err, b.idr_err, sizeof(idr_err));
+}
+
+// 設定でマウントしたサーボのうち, L系統とR系統から交互にn個だけを残す. 残せた数を返す
+static int bench_mount(int n)
+{
+  int kept = 0;
+  for (int i = 0; i < 15; i++)
+  {
+    idl_mount[i] = 0;
+    idr_mount[i] = 0;
+  }
+  for (int i = 0; (i < 15) and (kept < n); i++)
+  {
+    if (bench_saved.idl_mount[i] and (i < bench_saved.servo_num_max))
+    {
+      idl_mount[i] = bench_saved.idl_mount[i];
+      kept++;
+    }
+    if (bench_saved.idr_mount[i] and (i < bench_saved.servo_num_max) and (kept < n))
+    {
+      idr_mount[i] = bench_saved.idr_mount[i];
+      kept++;
+    }
+  }
+  return kept;
+}
+
+// [1-2]: チェックサムの計算
+static void bench_checksum()
+{
+  s_udp_meridim.sval[MSG_CKSM] = mrd.cksm_val(s_udp_meridim.sval, MSG_SIZE);
+}
+
+// [1-2]-[1-4]: 受信パケットのチェックサム確認と送信配列への転写
+static void bench_udp_parse()
+{
+  memcpy(r_udp_meridim.bval, bench_packet, MSG_BUFF);
+  meridim_accept();
+}
+
+// [2-1]: KRC-5FHの値のPS系への変換とMeridimへの転記
+static void bench_joypad_merge()
+{
+  krr_button = (unsigned short)(bench_seq & 0x1FF);
+  krr_analog[0] = bench_seq & 0xFF;
+  krr_analog[1] = 0x40;
+  krr_analog[2] = 0x80;
+  krr_analog[3] = 0xC0;
+  krr_rsvd_flag = true;
+  bench_seq++;
+  joypad_to_meridim(2);
+}
+
+// [5-1]: 受信した姿勢をキーフレームにして今フレームの目標角度を決める(30軸の最小躍度補間)
+static void bench_pose_update()
+{
+  servo_pose_update(true);
+}
+
+// [5-1]: キーフレーム補間(最小躍度, 50フレームの区間を繰り返す)
+MrdInterp bench_interp_eng;
+short bench_pose[30];
+static void bench_interp()
+{
+  static int bench_interp_servos = -1;
+  if ((!bench_interp_eng.moving()) or (bench_servos != bench_interp_servos))
+  {
+    for (int j = 0; j < 30; j++)
+    {
+      bench_pose[j] = (short)((bench_pose[j] == 0) ? j * 300 - 4500 : 0); // 2つの姿勢を交互に目標にする
+    }
+    bench_interp_eng.set_key(bench_pose, bench_servos, (MRD_INTERP_MINJERK << 12) | 50);
+    bench_interp_servos = bench_servos;
+  }
+  bench_interp_eng.step(bench_pose);
+}
+
+// [5-1]: 軌道セグメントの評価(30軸の3次曲線, 区間が無くなれば次を入れる)
+MrdTraj bench_traj_q;
+static void bench_traj()
+{
+  static short end_pos[30];
+  static short end_vel[30];
+  static short pose[30];
+  static uint16_t start = 0;
+  if (bench_traj_q.stats().queued == 0)
+  {
+    for (int j = 0; j < 30; j++)
+    {
+      end_pos[j] = (short)((end_pos[j] == 0) ? j * 300 - 4500 : 0);
+      end_vel[j] = (short)(j * 10);
+    }
+    bench_traj_q.push(end_pos, end_vel, start, 20);
+    start += 20;
+  }
+  bench_traj_q.step(pose);
+}
+
+// [5-2]: サーボとの送受信(bench_mount()で残したサーボ). 計測前の目標姿勢とサーボコマンドをそのまま送る.
+// 送受信で目標角度は読んだ現在位置に置き換わり, 前の工程も目標角度を動かすため, 呼ぶたびに戻す
+static void bench_servo_bus()
+{
+  for (int i = 0; i < 15; i++)
+  {
+    idl_tgt[i] = bench_saved.servo_pose[i] * 0.01;
+    idr_tgt[i] = bench_saved.servo_pose[i + 15] * 0.01;
+    idl_tgt_past[i] = idl_tgt[i];
+    idr_tgt_past[i] = idr_tgt[i];
+    s_udp_meridim.sval[i * 2 + 20] = bench_saved.s.sval[i * 2 + 20];
+    s_udp_meridim.sval[i * 2 + 50] = bench_saved.s.sval[i * 2 + 50];
+  }
+  servo_bus_exchange();
+}
+
+// [9-1]: IMU/AHRSの値を送信配列に格納
+static void bench_imu_copy()
+{
+  imu_to_meridim();
+}
+
+// [6-1], [9-2], [9-3]: サーボ角度を格納し, シーケンス番号とチェックサムで閉じる
+static void bench_meridim_pack()
+{
+  servo_to_meridim();
+  meridim_seal();
+}
+
+bool run_bench()
+{
+  bench_save();
+
+  /* それらしい値で受信パケットを作る. 全サーボ位置指定, 50フレームの最小躍度補間.
+     姿勢は今の目標姿勢にして, 目標姿勢の更新がサーボを動かす値を作らないようにする */
+  UnionData pkt;
+  for (int i = 0; i < MSG_SIZE; i++)
+  {
+    pkt.sval[i] = (short)(i * 37 - 1500);
+  }
+  pkt.sval[MRD_MASTER] = 90;
+  pkt.sval[MRD_MOTION_FRAMES] = (MRD_INTERP_MINJERK << 12) | 50;
+  for (int i = 0; i < 15; i++)
+  {
+    pkt.sval[i * 2 + 20] = 1;
+    pkt.sval[i * 2 + 50] = 1;
+    pkt.sval[i * 2 + 21] = servo_pose[i];
+    pkt.sval[i * 2 + 51] = servo_pose[i + 15];
+  }
+  pkt.sval[MSG_CKSM] = mrd.cksm_val(pkt.sval, MSG_SIZE);
+  memcpy(bench_packet, pkt.bval, MSG_BUFF);
+  memcpy(r_udp_meridim.bval, bench_packet, MSG_BUFF);
+  meridim_accept();
+  bench_interp_eng.begin(MRD_INTERP_MINJERK);
+  bench_traj_q.begin(frame_us, bench_pose);
+  traj_mode = false;
+  motion_player.stop();
+
+  /* 工程ごとの許容時間(ns)の目安. ESP32 240MHzでの見積もりに余裕を持たせた値. 超えたら性能の劣化とみなす
+     servo_busはサーボとのUART通信を含む(1Mbps, リターンディレイ0で1個あたり約0.8ms)ため, 1回ずつ計測する.
+     計測の間はフレームの処理が止まる(servo_busだけで構成ごとに 計測回数 x サーボ数 x 約0.8ms) */
+  const struct
+  {
+    const char *name;
+    MrdBenchFunc fn;
+    bool per_servo;      // サーボ数ごとに計測する工程か
+    uint32_t base_ns;    // サーボ数によらない許容時間
+    uint32_t servo_ns;   // サーボ1個あたりの許容時間
+    int iterations;      // 1回の計測で繰り返す呼び出し数
+  } stages[] = {
+      {"checksum", bench_checksum, false, 4000, 0, MRD_BENCH_ITERATIONS},
+      {"udp_parse", bench_udp_parse, false, 8000, 0, MRD_BENCH_ITERATIONS},
+      {"joypad_merge", bench_joypad_merge, false, 2000, 0, MRD_BENCH_ITERATIONS},
+      {"pose_update", bench_pose_update, false, 16000, 0, MRD_BENCH_ITERATIONS},
+      {"interp", bench_interp, true, 1000, 200, MRD_BENCH_ITERATIONS},
+      {"traj_eval", bench_traj, false, 8000, 0, MRD_BENCH_ITERATIONS},
+      {"servo_bus", bench_servo_bus, true, 40000, 1000000, 1},
+      {"imu_copy", bench_imu_copy, false, 6000, 0, MRD_BENCH_ITERATIONS},
+      {"meridim_pack", bench_meridim_pack, false, 20000, 0, MRD_BENCH_ITERATIONS},
+  };
+  const int configs[] = {0, 11, 22, 30};
+  const size_t num_configs = sizeof(configs) / sizeof(configs[0]);
+  const int mounted = bench_mount(30); // 設定でマウントしたサーボの数
+  bool mounted_listed = false;
+  for (size_t c = 0; c < num_configs; c++)
+  {
+    mounted_listed = mounted_listed or (configs[c] == mounted);
+  }
+
+  MrdBench bench;
+  bench.begin(Serial, VERSION);
+  for (size_t c = 0; c <= num_configs; c++)
+  {
+    bool extra = (c == num_configs); // 最後にservo_busをマウントした全サーボで計測する(configsに無い数の場合)
+    if (extra and mounted_listed)
+    {
+      break;
+    }
+    bench_servos = extra ? mounted : configs[c];
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++)
+    {
+      bool bus = (stages[i].fn == bench_servo_bus);
+      if ((!stages[i].per_servo) and (c > 0))
+      {
+        continue; // サーボ数によらない工程は1回だけ計測する
+      }
+      if ((extra and !bus) or (bus and (bench_servos > mounted)))
+      {
+        continue; // サーボとの送受信はマウントしたサーボの数まで
+      }
+      if (bus)
+      {
+        bench_mount(bench_servos);
+      }
+      bench.stage(stages[i].name, bench_servos, stages[i].fn, stages[i].base_ns + stages[i].servo_ns * bench_servos, stages[i].iterations);
+    }
+  }
+  bench_restore();
+  return bench.end();
+}
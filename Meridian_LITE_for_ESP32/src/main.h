@@ -4,6 +4,10 @@
 #include <cstdint>
 #include <string>
 
+class EthernetUDP;
+class IPAddress;
+class MrdW5500Udp;
+
 /**
  * @brief Initialize wifi.
  *
@@ -12,6 +16,69 @@
  */
 void init_wifi(const char *wifi_ap_ssid, const char *wifi_ap_pass);
 
+/**
+ * @brief Open the UDP socket on UDP_RESV_PORT (W5500_BURST selects the type of udp).
+ *        With MrdW5500Udp and SPI_TUNE 1 the SPI clock is tuned first.
+ *
+ * @return SPI clock of the W5500, 0 if it is set by the Ethernet2 library.
+ */
+uint32_t init_udp(EthernetUDP &u);
+uint32_t init_udp(MrdW5500Udp &u);
+
+/**
+ * @brief Frame stage [1-1]: receive the Meridim of this frame into r_udp_meridim
+ *        (replay file, or UDP with the batch receive queue).
+ *
+ * @return true if a new Meridim was received in this frame.
+ */
+bool meridim_receive();
+
+/**
+ * @brief Frame stages [1-2]-[1-4]: check the checksum of r_udp_meridim and copy it to s_udp_meridim.
+ *        Sets the receive error flag and counts the error if the checksum is wrong.
+ *
+ * @return true if the checksum is correct.
+ */
+bool meridim_accept();
+
+/**
+ * @brief Frame stage [2-1]: write the joypad values to s_udp_meridim.
+ *
+ * @param mount_joypad Gamepad type (2:KRC-5FH also writes the analog sticks).
+ */
+void joypad_to_meridim(int mount_joypad);
+
+/**
+ * @brief Frame stage [5-1]: take the received pose (keyframe interpolation, trajectory segments,
+ *        motion asset playback) and set the servo targets of this frame.
+ *
+ * @param rsvd_new true if a new Meridim was received in this frame.
+ */
+void servo_pose_update(bool rsvd_new);
+
+/**
+ * @brief Frame stage [5-2]: send the targets to the mounted servos and read their positions.
+ */
+void servo_bus_exchange();
+
+/**
+ * @brief Frame stage [6-1]: write the servo angles to s_udp_meridim.
+ */
+void servo_to_meridim();
+
+/**
+ * @brief Frame stage [9-1]: write the IMU/AHRS values to s_udp_meridim.
+ */
+void imu_to_meridim();
+
+/**
+ * @brief Frame stages [9-2], [9-3]: choose what to send in this frame, count up the sequence number
+ *        for a full Meridim and close s_udp_meridim with the checksum.
+ *
+ * @return MRD_TX_FULL, MRD_TX_FAST or MRD_TX_NONE.
+ */
+int meridim_seal();
+
 /**
  * @brief Receive meridim data from UDP.
  *        Received data keep on r_udp_meridim.
@@ -19,12 +86,115 @@ void init_wifi(const char *wifi_ap_ssid, const char *wifi_ap_pass);
  */
 void receiveUDP();
 
+/**
+ * @brief Make the sender of a valid packet the UDP destination (PEER_LEARN 1/2).
+ *        Prints the new destination when it changes.
+ */
+void peer_learn(IPAddress ip, uint16_t port);
+
 /**
  * @brief Send meridim data to UDP.
  *
  */
 void sendUDP();
 
+/**
+ * @brief Send the compact packet of UDP_FAST_FIELDS to UDP_SEND_FAST_PORT.
+ *
+ */
+void sendUDP_fast();
+
+/**
+ * @brief Send the packets of the subscribers due in this frame (MCMD_SUBSCRIBE).
+ *        Call after the peer's packet so the W5500 destination is rewritten once per subscriber
+ *        and once back to the peer per frame (MrdLinkUdp::send_to()).
+ *
+ */
+void sendUDP_subscribers();
+
+/**
+ * @brief Print the packets, byte rate and drops of each subscriber every second.
+ *
+ */
+void monitor_subs();
+
+/**
+ * @brief Print the UDP send rates every second.
+ *
+ */
+void monitor_udp_send();
+
+/**
+ * @brief Print the batch receive queue statistics every second.
+ *
+ */
+void monitor_jitter();
+
+/**
+ * @brief Print the trajectory segment queue statistics every second.
+ *
+ */
+void monitor_traj();
+
+/**
+ * @brief Print the flight recorder statistics every 100 frames.
+ *
+ */
+void monitor_recorder();
+
+/**
+ * @brief Print the SPI bus occupancy and the longest wait of each device every second.
+ *
+ */
+void monitor_spi();
+
+/**
+ * @brief Open the replay file on SD or SPIFFS according to REPLAY_FS.
+ *
+ */
+void init_replay();
+
+/**
+ * @brief Find the motion asset partition and map its motion image.
+ *
+ */
+void init_motion_asset();
+
+/**
+ * @brief Start playing a motion of the asset partition from the current pose.
+ *
+ * @param[in] index Motion number.
+ * @return true Started (false if there is no such motion or an upload is in progress).
+ */
+bool start_motion(int index);
+
+/**
+ * @brief Stop the motion being played; the pose continues from where it stopped.
+ *
+ */
+void stop_motion();
+
+/**
+ * @brief Start the motion assigned in MOTION_PAD_BUTTONS when its button combination is pressed.
+ *        Called with the locally mounted joypad only, never with buttons forwarded by the PC.
+ *
+ * @param[in] buttons Button word of the local joypad (PS layout).
+ */
+void motion_pad_trigger(uint16_t buttons);
+
+/**
+ * @brief Print the motion playback and upload statistics every second.
+ *
+ */
+void monitor_motion();
+
+/**
+ * @brief Receive meridim data from the replay file instead of UDP.
+ *        A frame is copied to r_udp_meridim only when it is due.
+ *
+ */
+void replay_receive();
+
 /**
  * @brief Check SD card read and write.
  *
@@ -42,12 +212,36 @@ void bt_settings();
  *
  * @param mount_joypad  Gamepad type (currently 2:KRC-5FH and 5:wiimote are available).
  * @param pre_val Previous received value (8 bytes, assuming union data).
- * @param polling Frame count for inquiry frequency.
  * @param joypad_reflesh 1:To reset the JOYPAD's received button data to 0 with this device
  *                       0:perform logical addition without resetting .(usually 1)
  * @return uint64_t
  */
-uint64_t joypad_read(int mount_joypad, uint64_t pre_val, int polling, bool joypad_reflesh);
+uint64_t joypad_read(int mount_joypad, uint64_t pre_val, bool joypad_reflesh);
+
+/**
+ * @brief Open the R servo UART once for Dynamixel (1Mbps, 8N1).
+ *        With KRC-5FH it is first opened with the ICS settings, later polls only switch the format.
+ *
+ * @param mount_joypad Gamepad type (2:KRC-5FH).
+ */
+void uart_r_begin(int mount_joypad);
+
+/**
+ * @brief Switch the format of the R servo UART between ICS (KRR-5FH) and Dynamixel.
+ *        Only the baud rate and parity are changed; the UART is not initialized again.
+ *
+ * @param ics true for ICS (ICS_BAUDRATE, 8E1), false for Dynamixel (1Mbps, 8N1).
+ */
+void uart_r_select_ics(bool ics);
+
+/**
+ * @brief Poll KRC-5FH (KRR-5FH) in the idle time of the R servo bus after the servo batch.
+ *        Runs every JOYPAD_POLLING_US microseconds only if KRR_BUS_BUDGET_US is left in the frame,
+ *        switches the bus to ICS for one getKrrAllData exchange and records the bus time.
+ *
+ * @param mount_joypad Gamepad type (does nothing unless 2:KRC-5FH).
+ */
+void krr_poll_bus_slot(int mount_joypad);
 
 /**
  * @brief Receive input values from the wiimote
@@ -55,22 +249,85 @@ uint64_t joypad_read(int mount_joypad, uint64_t pre_val, int polling, bool joypa
  */
 uint16_t pad_wiimote_receive();
 
+/**
+ * @brief Convert KRC-5FH button data to the PS2/3 gamepad button layout.
+ *        Pressing all four buttons of the left (right) cross is reported as start (select).
+ *
+ * @param[in] uint16_t Button data received from KRR-5FH.
+ * @return uint16_t Button data in the PS2/3 layout.
+ */
+uint16_t pad_krr_generalize(uint16_t krr_btn);
+
 /**
  * @brief Initialize sensors.
  *
  * @param[in] int Number of mounted imuahrs.
  *            0:off, 1:MPU6050(GY-521), 2:MPU9250(GY-6050/GY-9250) 3:BNO055
- *            Currently only 3:bno055 is available.
+ *            1 and 2 use the accelerometer and gyro only (no magnetometer).
  */
 void init_imuahrs(int mount_imuahrs);
 
 /**
- * @brief Read the data in bno055 and write it to bno055_read[].
+ * @brief Read the data in bno055 and write it to imuahrs_read[] every IMUAHRS_POLLING_US.
  *
  * @param[in] void *args Pointer used by the system for thread processing.
  */
 void Core1_bno055_r(void *args);
 
+/**
+ * @brief Write one register of MPU6050/MPU9250.
+ *
+ * @param[in] uint8_t Register address.
+ * @param[in] uint8_t Value to write.
+ */
+void mpu_write_reg(uint8_t reg, uint8_t val);
+
+/**
+ * @brief Burst read registers of MPU6050/MPU9250.
+ *
+ * @param[in] uint8_t First register address.
+ * @param[out] uint8_t* Buffer to store the data.
+ * @param[in] int Number of bytes to read.
+ * @return int Number of bytes actually read.
+ */
+int mpu_read_regs(uint8_t reg, uint8_t *buf, int len);
+
+/**
+ * @brief Reset MPU6050/MPU9250, calibrate the gyro bias and start the FIFO.
+ *
+ * @return true if the sensor is detected.
+ */
+bool init_mpu();
+
+/**
+ * @brief Read all samples in the MPU FIFO and run the fixed-point fusion for each.
+ *        Resets the FIFO instead if it has overflowed.
+ *
+ * @param[out] acc Raw accelerometer x,y,z of the last sample.
+ * @param[out] gyro Raw gyro x,y,z of the last sample.
+ * @param[in,out] cycles_sum CPU cycles of the fusion updates are added here.
+ * @return Number of samples fused, -1 if the FIFO was reset or could not be read.
+ */
+int mpu_fifo_fuse(int16_t acc[3], int16_t gyro[3], uint64_t *cycles_sum);
+
+/**
+ * @brief Convert the raw TEMP_OUT value to degrees Celsius.
+ *        MPU6050 (WHO_AM_I 0x68) and MPU9250/MPU9255 (0x71/0x73) use different formulas.
+ *
+ * @param[in] raw TEMP_OUT_H/L as a signed value.
+ * @param[in] who WHO_AM_I of the sensor.
+ * @return Temperature (degree Celsius).
+ */
+float mpu_temp_c(int16_t raw, uint8_t who);
+
+/**
+ * @brief Drain the MPU FIFO, run the fixed-point fusion for every sample
+ *        at IMUAHRS_FUSION_HZ and write the result to imuahrs_read[].
+ *
+ * @param[in] void *args Pointer used by the system for thread processing.
+ */
+void Core1_mpu_r(void *args);
+
 /**
  * @brief Show data of joypad's input on serial monitor.
  *
@@ -102,8 +359,21 @@ void servo_all_off();
  * @brief Resetting the origin of the yaw axis.
  *        Use MOUNT_IMUAHRS for device model detection.
  *        0:none, 1:MPU6050(GY-521), 2:MPU9250(GY-6050/GY-9250) 3:BNO055
- *        Now only 3:BNO055 is available
  */
 void setyawcenter();
 
+/**
+ * @brief Benchmark the frame loop stages with the same functions loop() calls (checksum, UDP parse,
+ *        joypad merge, pose update, interpolation, trajectory, servo bus, IMU copy, Meridim pack)
+ *        and print the result to Serial as one line of JSON. Triggered by MCMD_BENCH.
+ *        The synthetic packet carries the current target pose, and the servo bus stage talks to
+ *        the mounted servos only (0/11/22/30 of them and all mounted), resending the target pose
+ *        and servo commands saved before the run, so the servos do not move.
+ *        The frame loop is blocked while it runs, the servo bus stage alone for about
+ *        0.8 ms per servo and call. The frame state is restored afterwards.
+ *
+ * @return true if every stage is within its budget.
+ */
+bool run_bench();
+
 #endif
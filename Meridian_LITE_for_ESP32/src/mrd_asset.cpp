@@ -0,0 +1,177 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_asset.cpp
+ * @brief   Motion asset partition: memory-mapped motion image and its UDP upload.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_asset.h"
+
+bool MrdAssetStore::begin(const char *label)
+{
+  unmap();
+  part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)MRD_ASSET_SUBTYPE, label);
+  if (part == NULL)
+  {
+    return false;
+  }
+  uploading = false;
+  map();
+  return true;
+}
+
+bool MrdAssetStore::map()
+{
+  if (esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &base, &handle) != ESP_OK)
+  {
+    base = NULL;
+    return false;
+  }
+  if (!store.attach((const uint8_t *)base, part->size)) // 空の領域や書きかけのイメージは使わない
+  {
+    unmap();
+    return false;
+  }
+  return true;
+}
+
+void MrdAssetStore::unmap()
+{
+  store.detach();
+  if (base != NULL)
+  {
+    spi_flash_munmap(handle);
+    base = NULL;
+  }
+}
+
+int32_t MrdAssetStore::write_chunk(const uint8_t *data, uint32_t len)
+{
+  /* 書き込む範囲のセクタを必要になった分だけ消去する(全体を先に消すとBEGINで数秒止まるため) */
+  while (erased < received + len)
+  {
+    uint32_t t0 = micros();
+    if (esp_partition_erase_range(part, erased, MRD_ASSET_SECTOR) != ESP_OK)
+    {
+      return MRD_UPLOAD_ERR_FLASH;
+    }
+    uint32_t dt = micros() - t0;
+    st.erase_us_max = max(st.erase_us_max, dt);
+    erased += MRD_ASSET_SECTOR;
+  }
+  uint32_t t0 = micros();
+  if (esp_partition_write(part, received, data, len) != ESP_OK)
+  {
+    return MRD_UPLOAD_ERR_FLASH;
+  }
+  uint32_t dt = micros() - t0;
+  st.write_us_max = max(st.write_us_max, dt);
+  received += len;
+  st.chunks++;
+  return MRD_UPLOAD_OK;
+}
+
+bool MrdAssetStore::upload(const uint8_t *pkt, int len, MrdUploadAck *ack)
+{
+  if ((len < (int)sizeof(MrdUploadPacket)) or (((const MrdUploadPacket *)pkt)->magic != MRD_UPLOAD_MAGIC))
+  {
+    return false;
+  }
+  MrdUploadPacket h;
+  memcpy(&h, pkt, sizeof(h));
+  int32_t status = MRD_UPLOAD_OK;
+
+  if (part == NULL)
+  {
+    status = MRD_UPLOAD_ERR_STATE;
+  }
+  else if (h.op == MRD_UPLOAD_BEGIN)
+  {
+    if ((h.value < sizeof(MrdMotionImage)) or (h.value > part->size))
+    {
+      status = MRD_UPLOAD_ERR_SIZE;
+    }
+    else
+    {
+      unmap(); // 書き換える間は古いイメージを読まない
+      uploading = true;
+      expect = h.value;
+      received = 0;
+      erased = 0;
+    }
+  }
+  else if ((h.op == MRD_UPLOAD_COMMIT) and !uploading and store.is_ready() and (h.value == commit_crc))
+  {
+    st.resent++; // 確認済み(ackが失われて送り直された)
+  }
+  else if (!uploading)
+  {
+    status = MRD_UPLOAD_ERR_STATE;
+  }
+  else if (h.op == MRD_UPLOAD_DATA)
+  {
+    uint32_t n = h.value;
+    if ((n == 0) or (n > MRD_UPLOAD_CHUNK) or ((int)(sizeof(h) + n) > len) or (h.offset + n > expect))
+    {
+      status = MRD_UPLOAD_ERR_SIZE;
+    }
+    else if (h.offset + n <= received) // 書き込み済み(ackが失われて送り直された)
+    {
+      st.resent++;
+    }
+    else if (h.offset != received)
+    {
+      status = MRD_UPLOAD_ERR_ORDER;
+    }
+    else
+    {
+      status = write_chunk(pkt + sizeof(h), n);
+    }
+  }
+  else if (h.op == MRD_UPLOAD_COMMIT)
+  {
+    if (received != expect)
+    {
+      status = MRD_UPLOAD_ERR_ORDER;
+    }
+    else
+    {
+      /* 割り当て直してフラッシュから読み戻した内容でCRCと形式を確認する */
+      uploading = false;
+      if (esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &base, &handle) != ESP_OK)
+      {
+        base = NULL;
+        status = MRD_UPLOAD_ERR_FLASH;
+      }
+      else if (mrd_motion_crc32(0, (const uint8_t *)base, expect) != h.value)
+      {
+        unmap();
+        status = MRD_UPLOAD_ERR_CRC;
+      }
+      else if (!store.attach((const uint8_t *)base, part->size))
+      {
+        unmap();
+        status = MRD_UPLOAD_ERR_IMAGE;
+      }
+      else
+      {
+        commit_crc = h.value;
+        st.uploads++;
+      }
+    }
+  }
+  else
+  {
+    status = MRD_UPLOAD_ERR_STATE;
+  }
+
+  if (status != MRD_UPLOAD_OK)
+  {
+    st.errors++;
+  }
+  ack->magic = MRD_UPLOAD_MAGIC;
+  ack->op = h.op;
+  ack->offset = received;
+  ack->status = status;
+  return true;
+}
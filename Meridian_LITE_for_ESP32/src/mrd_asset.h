@@ -0,0 +1,85 @@
+#ifndef __MERIDIAN_ASSET__
+#define __MERIDIAN_ASSET__
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#include "mrd_motion.h"
+
+/*
+  モーションアセット領域 (partitions_meridian.csv の data パーティション)
+  領域の先頭にモーションイメージ(mrd_motion.h)を置き, esp_partition_mmap でフラッシュをそのままアドレス空間に割り当てて読む.
+  UDPでのアップロード中は割り当てを外し, COMMITで内容を確認してから割り当て直す.
+*/
+#define MRD_ASSET_SUBTYPE 0x40 // パーティションのサブタイプ (data, 0x40-0xFEは利用者定義)
+#define MRD_ASSET_SECTOR 4096  // フラッシュの消去単位
+
+/* 統計 */
+typedef struct
+{
+  uint32_t uploads;      // 完了したアップロード数
+  uint32_t chunks;       // 書き込んだDATAパケット数
+  uint32_t resent;       // 受け付け済みで届いたパケット数(ackが届かず送り直された)
+  uint32_t errors;       // エラーで応答したパケット数
+  uint32_t erase_us_max; // 1セクタの消去にかかった最大時間(us)
+  uint32_t write_us_max; // 1パケットの書き込みにかかった最大時間(us)
+} MrdAssetStats;
+
+/**
+ * @brief Motion asset partition: memory-mapped motion image and its UDP upload.
+ */
+class MrdAssetStore
+{
+public:
+  /**
+   * @brief Find the partition, map it and attach the image if one is valid.
+   *
+   * @param[in] label Partition label.
+   * @return true if the partition exists (even when it holds no valid image yet).
+   */
+  bool begin(const char *label);
+
+  /**
+   * @brief Handle one upload packet (mrd_motion.h).
+   *
+   * @param[in] pkt Packet.
+   * @param[in] len Packet length.
+   * @param[out] ack Answer to send back.
+   * @return true if pkt is an upload packet (ack is valid).
+   */
+  bool upload(const uint8_t *pkt, int len, MrdUploadAck *ack);
+
+  /**
+   * @brief The motions of the mapped image.
+   */
+  const MrdMotionStore &motions() const { return store; }
+
+  /**
+   * @brief An upload is in progress (playback unavailable).
+   */
+  bool is_uploading() const { return uploading; }
+
+  bool is_ready() const { return part != NULL; }
+
+  uint32_t size() const { return part ? part->size : 0; }
+
+  MrdAssetStats stats() const { return st; }
+
+private:
+  bool map();
+  void unmap();
+  int32_t write_chunk(const uint8_t *data, uint32_t len);
+
+  const esp_partition_t *part = NULL;
+  spi_flash_mmap_handle_t handle;
+  const void *base = NULL;
+  MrdMotionStore store;
+  bool uploading = false;
+  uint32_t expect = 0;     // アップロード中のイメージの長さ
+  uint32_t received = 0;   // 書き込み済みの長さ
+  uint32_t erased = 0;     // 消去済みの長さ(セクタ単位)
+  uint32_t commit_crc = 0; // 最後にCOMMITしたイメージのCRC32
+  MrdAssetStats st = {0, 0, 0, 0, 0, 0};
+};
+
+#endif
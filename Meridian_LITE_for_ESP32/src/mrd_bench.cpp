@@ -0,0 +1,68 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_bench.cpp
+ * @brief   Micro benchmark harness for the frame loop stages.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_bench.h"
+
+void MrdBench::begin(Print &p, const char *version)
+{
+  out = &p;
+  first = true;
+  all_ok = true;
+  cpu_mhz = ESP.getCpuFreqMHz();
+  if (cpu_mhz == 0)
+  {
+    cpu_mhz = 240;
+  }
+  char buf[160];
+  snprintf(buf, sizeof(buf), "{\"bench\":\"frame\",\"version\":\"%s\",\"cpu_mhz\":%u,\"rounds\":%d,\"iterations\":%d,\"results\":[",
+           version, (unsigned)cpu_mhz, MRD_BENCH_ROUNDS, MRD_BENCH_ITERATIONS);
+  report = buf;
+}
+
+bool MrdBench::stage(const char *name, int servos, MrdBenchFunc fn, uint32_t budget_ns, int iterations)
+{
+  fn(); // キャッシュを温める
+
+  uint32_t best = UINT32_MAX;
+  uint64_t total = 0;
+  for (int r = 0; r < MRD_BENCH_ROUNDS; r++)
+  {
+    uint32_t c0 = ESP.getCycleCount();
+    for (int i = 0; i < iterations; i++)
+    {
+      fn();
+    }
+    uint32_t dc = ESP.getCycleCount() - c0;
+    total += dc;
+    if (dc < best)
+    {
+      best = dc;
+    }
+  }
+
+  uint32_t cycles = best / iterations;
+  uint32_t ns = (uint32_t)((uint64_t)best * 1000 / cpu_mhz / iterations);
+  uint32_t avg_ns = (uint32_t)(total * 1000 / cpu_mhz / (MRD_BENCH_ROUNDS * iterations));
+  bool ok = (budget_ns == 0) or (ns <= budget_ns);
+  all_ok = all_ok and ok;
+
+  char buf[200];
+  snprintf(buf, sizeof(buf), "%s{\"stage\":\"%s\",\"servos\":%d,\"iterations\":%d,\"cycles\":%u,\"ns\":%u,\"avg_ns\":%u,\"budget_ns\":%u,\"ok\":%s}",
+           first ? "" : ",", name, servos, iterations, (unsigned)cycles, (unsigned)ns, (unsigned)avg_ns, (unsigned)budget_ns,
+           ok ? "true" : "false");
+  report += buf;
+  first = false;
+  return ok;
+}
+
+bool MrdBench::end()
+{
+  report += all_ok ? "],\"ok\":true}" : "],\"ok\":false}";
+  out->println(report); // 工程の中の表示(サーボの動作表示など)が混ざらないよう, まとめて出力する
+  report = "";
+  return all_ok;
+}
@@ -0,0 +1,63 @@
+#ifndef __MERIDIAN_BENCH__
+#define __MERIDIAN_BENCH__
+
+#include <Arduino.h>
+
+#define MRD_BENCH_ROUNDS 8        // 1ステージあたりの計測回数(最小値を採用)
+#define MRD_BENCH_ITERATIONS 100  // 1回の計測で繰り返す呼び出し数(既定)
+
+/**
+ * @brief One stage of the frame pipeline. The caller sets up the configuration before stage().
+ */
+typedef void (*MrdBenchFunc)();
+
+/**
+ * @brief Micro benchmark harness for the frame loop stages.
+ *        Each stage is called MRD_BENCH_ITERATIONS times per round and the fastest of
+ *        MRD_BENCH_ROUNDS rounds is reported, so interrupts and task switches do not
+ *        inflate the result. Results are written as one line of JSON by end()
+ *        (so output of the stages themselves does not break it up):
+ *
+ *   {"bench":"frame","version":"...","cpu_mhz":240,"rounds":8,"iterations":100,
+ *    "results":[{"stage":"checksum","servos":0,"cycles":410,"ns":1708,"avg_ns":1750,"budget_ns":4000,"ok":true},...],
+ *    "ok":true}
+ */
+class MrdBench
+{
+public:
+  /**
+   * @brief Start a report.
+   *
+   * @param[in] out Output (Serial on target, stdout in the simulation).
+   * @param[in] version Firmware version string written to the report.
+   */
+  void begin(Print &out, const char *version);
+
+  /**
+   * @brief Measure one stage and write its result.
+   *
+   * @param[in] name Stage name.
+   * @param[in] servos Number of servos of the configuration (written to the report).
+   * @param[in] fn Stage to measure.
+   * @param[in] budget_ns Regression threshold per call (ns), 0 for none.
+   * @param[in] iterations Calls per round (fewer for stages that wait on a bus).
+   * @return true if the stage is within budget.
+   */
+  bool stage(const char *name, int servos, MrdBenchFunc fn, uint32_t budget_ns, int iterations = MRD_BENCH_ITERATIONS);
+
+  /**
+   * @brief Close the report.
+   *
+   * @return true if every stage was within budget.
+   */
+  bool end();
+
+private:
+  Print *out = NULL;
+  String report; // end()まで出力をためる
+  bool first = true;
+  bool all_ok = true;
+  uint32_t cpu_mhz = 240;
+};
+
+#endif
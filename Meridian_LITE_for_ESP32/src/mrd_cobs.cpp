@@ -0,0 +1,147 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_cobs.cpp
+ * @brief   COBS framing with CRC-16 for the serial Meridim link.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_cobs.h"
+
+namespace
+{
+  // 4bitずつのCRC-16/CCITTの表 (256項目の表の1/16の大きさで, 1byteあたり2回引く)
+  const uint16_t crc16_nibble[16] = {0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+                                     0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+
+  // COBSの1byteを出力する. code は今のブロックのコードバイトの位置
+  inline void cobs_put(uint8_t *out, int &o, int &code, uint8_t b)
+  {
+    if (b == 0)
+    {
+      out[code] = (uint8_t)(o - code);
+      code = o++;
+      return;
+    }
+    out[o++] = b;
+    if (o - code == 0xFF) // 254byteの0を含まないブロックは0x00なしで閉じる
+    {
+      out[code] = 0xFF;
+      code = o++;
+    }
+  }
+}
+
+uint16_t mrd_crc16(const uint8_t *data, int len, uint16_t crc)
+{
+  for (int i = 0; i < len; i++)
+  {
+    crc = (uint16_t)((crc << 4) ^ crc16_nibble[(crc >> 12) ^ (data[i] >> 4)]);
+    crc = (uint16_t)((crc << 4) ^ crc16_nibble[(crc >> 12) ^ (data[i] & 0x0F)]);
+  }
+  return crc;
+}
+
+int mrd_cobs_encode(uint8_t channel, const uint8_t *packet, int len, uint8_t *out)
+{
+  uint16_t crc = mrd_crc16(packet, len, mrd_crc16(&channel, 1));
+  int o = 0;
+  out[o++] = 0x00;
+  int code = o++;
+  cobs_put(out, o, code, channel);
+  for (int i = 0; i < len; i++)
+  {
+    cobs_put(out, o, code, packet[i]);
+  }
+  cobs_put(out, o, code, (uint8_t)(crc & 0xFF));
+  cobs_put(out, o, code, (uint8_t)(crc >> 8));
+  out[code] = (uint8_t)(o - code);
+  out[o++] = 0x00;
+  return o;
+}
+
+void MrdCobsDecoder::begin(uint8_t *buf, int cap)
+{
+  this->buf = buf;
+  this->cap = cap;
+  n_frames = 0;
+  n_crc = 0;
+  n_overflow = 0;
+  n_noise = 0;
+  reset();
+}
+
+void MrdCobsDecoder::reset()
+{
+  len = 0;
+  seg = 0;
+  remain = 0;
+  zero = false;
+  full = false;
+  over = false;
+}
+
+int MrdCobsDecoder::feed(uint8_t b)
+{
+  if (b == 0x00)
+  {
+    int n = finish();
+    reset();
+    return n;
+  }
+  seg++;
+  if (remain == 0) // コードバイト. 前のブロックが254byte未満なら間に0x00があった
+  {
+    if (zero)
+    {
+      if (len < cap)
+      {
+        buf[len++] = 0x00;
+      }
+      else
+      {
+        over = true;
+      }
+    }
+    remain = b - 1;
+    full = (b == 0xFF);
+    zero = (remain == 0) and !full;
+    return 0;
+  }
+  if (len < cap)
+  {
+    buf[len++] = b;
+  }
+  else
+  {
+    over = true;
+  }
+  remain--;
+  zero = (remain == 0) and !full;
+  return 0;
+}
+
+int MrdCobsDecoder::finish()
+{
+  if (seg == 0) // 区切りが続いた
+  {
+    return 0;
+  }
+  if ((remain != 0) or (len < MRD_COBS_OVERHEAD)) // ブロックの途中で終わった: パケットではない
+  {
+    n_noise += seg;
+    return 0;
+  }
+  if (over)
+  {
+    n_overflow++;
+    return 0;
+  }
+  uint16_t crc = (uint16_t)(buf[len - 2] | (buf[len - 1] << 8));
+  if (mrd_crc16(buf, len - 2) != crc)
+  {
+    n_crc++;
+    return 0;
+  }
+  n_frames++;
+  return len - MRD_COBS_OVERHEAD;
+}
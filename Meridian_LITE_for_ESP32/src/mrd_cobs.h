@@ -0,0 +1,79 @@
+#ifndef __MERIDIAN_COBS__
+#define __MERIDIAN_COBS__
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+  シリアルでのパケットの枠組み (SERIAL_LINK, PC側は tools/mrd_probe の --serial)
+  0x00 | COBS( チャンネル1byte | パケット | CRC-16 2byte ) | 0x00
+  COBSで0x00を含まない列にし, 0x00を区切りに使う. 先頭の0x00は, 前に混ざった文字(シリアルモニタの
+  表示など)をパケットから切り離すため. CRC-16はCCITT(多項式0x1021, 初期値0xFFFF)で,
+  チャンネルとパケットにかけてリトルエンディアンで付ける.
+  受信側は区切りまでの列を1つずつ検査し, COBSとして壊れた列(文字など)とCRCが合わない列を捨てる.
+*/
+#define MRD_COBS_OVERHEAD 3                                              // チャンネルとCRC
+#define MRD_COBS_FRAME_MAX(len) ((len) + MRD_COBS_OVERHEAD + ((len) + MRD_COBS_OVERHEAD) / 254 + 3) // 符号化後の最大長
+
+/**
+ * @brief CRC-16/CCITT-FALSE, continued from crc.
+ */
+uint16_t mrd_crc16(const uint8_t *data, int len, uint16_t crc = 0xFFFF);
+
+/**
+ * @brief Frame one packet.
+ *
+ * @param[out] out At least MRD_COBS_FRAME_MAX(len) bytes.
+ * @return int Bytes written to out.
+ */
+int mrd_cobs_encode(uint8_t channel, const uint8_t *packet, int len, uint8_t *out);
+
+/**
+ * @brief Byte-at-a-time decoder of the framed packets.
+ */
+class MrdCobsDecoder
+{
+public:
+  /**
+   * @brief Set the work buffer (packet + MRD_COBS_OVERHEAD bytes). Longer frames are dropped.
+   */
+  void begin(uint8_t *buf, int cap);
+
+  /**
+   * @brief Take one received byte.
+   *
+   * @return int Length of the packet completed by this byte (see packet()), 0 if none.
+   *             Empty packets are counted but not reported.
+   */
+  int feed(uint8_t b);
+
+  /**
+   * @brief Channel and bytes of the packet just completed. Valid until the next feed().
+   */
+  uint8_t channel() const { return buf[0]; }
+  const uint8_t *packet() const { return buf + 1; }
+
+  uint32_t frames() const { return n_frames; }       // 正しく受信したパケット数
+  uint32_t crc_errors() const { return n_crc; }      // CRCが合わず捨てたパケット数
+  uint32_t overflows() const { return n_overflow; }  // 長すぎて捨てたパケット数
+  uint32_t noise_bytes() const { return n_noise; }   // COBSとして壊れていて捨てたバイト数(文字など)
+
+private:
+  int finish();
+  void reset();
+
+  uint8_t *buf = NULL;
+  int cap = 0;
+  int len = 0;         // 復号したバイト数
+  int seg = 0;         // 区切りからのバイト数
+  int remain = 0;      // 今のブロックの残りのバイト数(0:次はコードバイト)
+  bool zero = false;   // 次のブロックの前に0x00を入れる
+  bool full = false;   // 今のブロックは0x00で終わらない254byteのブロック
+  bool over = false;   // この列はバッファに入らなかった
+  uint32_t n_frames = 0;
+  uint32_t n_crc = 0;
+  uint32_t n_overflow = 0;
+  uint32_t n_noise = 0;
+};
+
+#endif
@@ -0,0 +1,232 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_delta.cpp
+ * @brief   Delta-encoded Meridim wire format.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_delta.h"
+
+#include <cstring>
+
+//================================================================================================================
+//  共通
+//================================================================================================================
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+  p[0] = (uint8_t)(v & 0xFF);
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static int put_header(uint8_t *out, uint16_t seq, uint16_t key_seq, uint8_t flags)
+{
+  put_u16(out, MRD_DELTA_MAGIC);
+  put_u16(out + 2, seq);
+  put_u16(out + 4, key_seq);
+  out[6] = flags;
+  out[7] = 0;
+  return MRD_DELTA_HEADER;
+}
+
+static int put_raw(uint8_t *out, const short *meridim)
+{
+  for (int i = 0; i < MRD_DELTA_WORDS; i++)
+  {
+    put_u16(out + i * 2, (uint16_t)meridim[i]);
+  }
+  return MRD_DELTA_WORDS * 2;
+}
+
+//================================================================================================================
+//  エンコーダ
+//================================================================================================================
+
+void MrdDeltaEncoder::begin(int a_interval)
+{
+  interval = (a_interval < 1) ? 1 : a_interval;
+  key_valid = false;
+  pending_valid = false;
+  since_key = interval; // 最初のフレームでキーフレームを送る
+  key_count = 0;
+  resync_count = 0;
+}
+
+void MrdDeltaEncoder::set_ack(uint16_t ack)
+{
+  if (ack == MRD_DELTA_NO_KEY)
+  {
+    // PCがキーフレームを持っていない. 送信中のキーフレームが無ければすぐに送り直す
+    if (key_valid)
+    {
+      key_valid = false;
+      resync_count++;
+    }
+    if (!pending_valid)
+    {
+      since_key = interval;
+    }
+    return;
+  }
+  if (pending_valid and ack == pending_seq)
+  {
+    memcpy(key, pending, sizeof(key));
+    key_seq = pending_seq;
+    key_valid = true;
+    pending_valid = false;
+  }
+  // それ以外(key_seqと同じ, または遅れて届いた古いack)は何もしない
+}
+
+int MrdDeltaEncoder::encode(const short *meridim, uint16_t seq, uint8_t *out)
+{
+  // @ [1] キーフレームの送信
+  if (since_key >= interval)
+  {
+    since_key = 1;
+    memcpy(pending, meridim, sizeof(pending));
+    pending_seq = seq;
+    pending_valid = true;
+    key_count++;
+    int len = put_header(out, seq, seq, MRD_DELTA_FLAG_KEY | MRD_DELTA_FLAG_RAW);
+    return len + put_raw(out + len, meridim);
+  }
+  since_key++;
+
+  // @ [2] ackされたキーフレームが無ければ全体フレーム
+  if (!key_valid)
+  {
+    int len = put_header(out, seq, seq, MRD_DELTA_FLAG_RAW);
+    return len + put_raw(out + len, meridim);
+  }
+
+  // @ [3] 差分フレーム
+  int len = put_header(out, seq, key_seq, 0);
+  uint8_t *bitmap = out + len;
+  memset(bitmap, 0, MRD_DELTA_BITMAP);
+  len += MRD_DELTA_BITMAP;
+  for (int i = 0; i < MRD_DELTA_WORDS; i++)
+  {
+    int32_t d = (int32_t)meridim[i] - (int32_t)key[i];
+    if (d == 0)
+    {
+      continue;
+    }
+    bitmap[i >> 3] |= (uint8_t)(1 << (i & 7));
+    uint32_t z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31); // zigzag
+    while (z >= 0x80)
+    {
+      out[len++] = (uint8_t)(z | 0x80);
+      z >>= 7;
+    }
+    out[len++] = (uint8_t)z;
+  }
+
+  // 差分の方が大きくなる場合は全体フレームに切り替える
+  if (len > MRD_DELTA_RAW_LEN)
+  {
+    len = put_header(out, seq, key_seq, MRD_DELTA_FLAG_RAW);
+    len += put_raw(out + len, meridim);
+  }
+  return len;
+}
+
+//================================================================================================================
+//  デコーダ
+//================================================================================================================
+
+void MrdDeltaDecoder::begin()
+{
+  have[0] = false;
+  have[1] = false;
+  last = 0;
+  lost = false;
+}
+
+int MrdDeltaDecoder::decode(const uint8_t *in, int len, short *meridim)
+{
+  if (len < MRD_DELTA_HEADER or get_u16(in) != MRD_DELTA_MAGIC)
+  {
+    return -1;
+  }
+  uint16_t seq = get_u16(in + 2);
+  uint16_t key_seq = get_u16(in + 4);
+  uint8_t flags = in[6];
+  const uint8_t *p = in + MRD_DELTA_HEADER;
+  const uint8_t *end = in + len;
+
+  // 全体フレーム
+  if (flags & MRD_DELTA_FLAG_RAW)
+  {
+    if (len < MRD_DELTA_RAW_LEN)
+    {
+      return -1;
+    }
+    for (int i = 0; i < MRD_DELTA_WORDS; i++)
+    {
+      meridim[i] = (short)get_u16(p + i * 2);
+    }
+    if (flags & MRD_DELTA_FLAG_KEY)
+    {
+      last ^= 1;
+      memcpy(key[last], meridim, sizeof(key[last]));
+      seq_of[last] = seq;
+      have[last] = true;
+      lost = false;
+    }
+    return seq;
+  }
+
+  // 差分フレーム
+  int slot = -1;
+  for (int k = 0; k < 2; k++)
+  {
+    if (have[k] and seq_of[k] == key_seq)
+    {
+      slot = k;
+    }
+  }
+  if (slot < 0)
+  {
+    lost = true;
+    return -1;
+  }
+  if (end - p < MRD_DELTA_BITMAP)
+  {
+    return -1;
+  }
+  const uint8_t *bitmap = p;
+  p += MRD_DELTA_BITMAP;
+  for (int i = 0; i < MRD_DELTA_WORDS; i++)
+  {
+    if (!(bitmap[i >> 3] & (1 << (i & 7))))
+    {
+      meridim[i] = key[slot][i];
+      continue;
+    }
+    uint32_t z = 0;
+    int shift = 0;
+    while (true)
+    {
+      if (p >= end or shift > 28)
+      {
+        return -1;
+      }
+      uint8_t b = *p++;
+      z |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+      if (!(b & 0x80))
+      {
+        break;
+      }
+    }
+    int32_t d = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    meridim[i] = (short)(key[slot][i] + d);
+  }
+  return seq;
+}
@@ -0,0 +1,112 @@
+#ifndef __MERIDIAN_DELTA__
+#define __MERIDIAN_DELTA__
+
+#include <cstdint>
+
+/*
+  差分Meridimの形式 (リトルエンディアン)
+  [0]-[1]   MRD_DELTA_MAGIC
+  [2]-[3]   フレームの通し番号(seq)
+  [4]-[5]   基準にしたキーフレームの通し番号(key_seq)
+  [6]       フラグ bit0:キーフレームとして保持する bit1:Meridim全体をそのまま格納
+  [7]       予約
+  全体フレーム: [8]- Meridim全体(MRD_DELTA_WORDS*2 byte)
+  差分フレーム: [8]-[19] 変化した項目のビットマップ(90bit, 項目iはバイトi/8のビットi%8)
+               [20]-    変化した項目ごとに (値 - キーフレームの値) をzigzag変換したvarint
+  PCは保持しているキーフレームのkey_seqをMeridimの所定の位置に入れて返す(ack).
+  ackされたキーフレームだけを差分の基準にするため, パケットが欠けても復号できる.
+  ackが届くまでの間はキーフレーム扱いしない全体フレームを送る.
+*/
+#define MRD_DELTA_MAGIC 0x444D                       // "MD"
+#define MRD_DELTA_WORDS 90                           // Meridim90の要素数
+#define MRD_DELTA_HEADER 8                           // ヘッダのバイト数
+#define MRD_DELTA_BITMAP ((MRD_DELTA_WORDS + 7) / 8) // ビットマップのバイト数
+#define MRD_DELTA_RAW_LEN (MRD_DELTA_HEADER + MRD_DELTA_WORDS * 2) // 全体フレームの長さ
+#define MRD_DELTA_MAX (MRD_DELTA_HEADER + MRD_DELTA_BITMAP + MRD_DELTA_WORDS * 3) // 送信バッファに必要な長さ
+#define MRD_DELTA_NO_KEY 0xFFFF                      // ackにこの値が来たらキーフレームを持っていない(再同期要求)
+#define MRD_DELTA_FLAG_KEY 0x01
+#define MRD_DELTA_FLAG_RAW 0x02
+
+/**
+ * @brief Encoder of the delta Meridim wire format (board side).
+ *        Deltas are taken against the last keyframe acknowledged by the PC.
+ *        A new keyframe is sent every `interval` frames and whenever the PC reports
+ *        a keyframe the encoder does not know (resync).
+ */
+class MrdDeltaEncoder
+{
+public:
+  /**
+   * @brief Reset the encoder. The next frame is a keyframe.
+   *
+   * @param[in] interval Frames between keyframes.
+   */
+  void begin(int interval);
+
+  /**
+   * @brief Take the keyframe sequence number reported by the PC.
+   *
+   * @param[in] ack key_seq held by the PC, or MRD_DELTA_NO_KEY.
+   */
+  void set_ack(uint16_t ack);
+
+  /**
+   * @brief Encode one Meridim.
+   *
+   * @param[in] meridim Meridim (MRD_DELTA_WORDS shorts).
+   * @param[in] seq Frame sequence number.
+   * @param[out] out Packet buffer (MRD_DELTA_MAX bytes).
+   * @return int Packet length (never more than MRD_DELTA_RAW_LEN).
+   */
+  int encode(const short *meridim, uint16_t seq, uint8_t *out);
+
+  uint32_t keyframes() const { return key_count; }
+  uint32_t resyncs() const { return resync_count; }
+
+private:
+  short key[MRD_DELTA_WORDS];     // ackされたキーフレーム
+  short pending[MRD_DELTA_WORDS]; // 送信済みでack待ちのキーフレーム
+  uint16_t key_seq = 0;
+  uint16_t pending_seq = 0;
+  bool key_valid = false;
+  bool pending_valid = false;
+  int interval = 50;
+  int since_key = 0;              // 最後にキーフレームを送ってからのフレーム数
+  uint32_t key_count = 0;
+  uint32_t resync_count = 0;
+};
+
+/**
+ * @brief Decoder of the delta Meridim wire format (PC side and host tools).
+ *        Keeps the last two keyframes so deltas sent before an ack arrived still decode.
+ */
+class MrdDeltaDecoder
+{
+public:
+  void begin();
+
+  /**
+   * @brief Decode one packet.
+   *
+   * @param[in] in Packet.
+   * @param[in] len Packet length.
+   * @param[out] meridim Decoded Meridim (MRD_DELTA_WORDS shorts).
+   * @return int Frame sequence number, or -1 if the packet is broken or its keyframe is unknown.
+   */
+  int decode(const uint8_t *in, int len, short *meridim);
+
+  /**
+   * @brief key_seq to report back to the board.
+   *        MRD_DELTA_NO_KEY before the first keyframe and after a delta could not be decoded.
+   */
+  uint16_t ack() const { return (have[last] and !lost) ? seq_of[last] : (uint16_t)MRD_DELTA_NO_KEY; }
+
+private:
+  short key[2][MRD_DELTA_WORDS];
+  uint16_t seq_of[2] = {0, 0};
+  bool have[2] = {false, false};
+  int last = 0;      // 最新のキーフレームのスロット
+  bool lost = false; // 基準のキーフレームが見つからなかった(次のキーフレームまで再同期を要求)
+};
+
+#endif
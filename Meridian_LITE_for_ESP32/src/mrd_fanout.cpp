@@ -0,0 +1,197 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_fanout.cpp
+ * @brief   Meridim fan-out to registered subscribers.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_fanout.h"
+
+void MrdFanout::begin()
+{
+  for (int s = 0; s < MRD_SUB_MAX; s++)
+  {
+    subs[s].divisor = 0;
+  }
+  frame_seq = 0;
+}
+
+IPAddress MrdFanout::param_ip(const short *params, IPAddress sender)
+{
+  uint16_t ab = (uint16_t)params[0];
+  uint16_t cd = (uint16_t)params[1];
+  if ((ab == 0) and (cd == 0))
+  {
+    return sender;
+  }
+  return IPAddress(ab & 0xFF, ab >> 8, cd & 0xFF, cd >> 8);
+}
+
+int MrdFanout::find(IPAddress ip, uint16_t port) const
+{
+  for (int s = 0; s < MRD_SUB_MAX; s++)
+  {
+    if ((subs[s].divisor > 0) and (subs[s].ip == ip) and (subs[s].port == port))
+    {
+      return s;
+    }
+  }
+  return -1;
+}
+
+int MrdFanout::subscribe(const short *params, IPAddress sender)
+{
+  IPAddress ip = param_ip(params, sender);
+  uint16_t port = (uint16_t)params[2];
+  int divisor = params[3];
+  if ((port == 0) or (divisor < 1))
+  {
+    return -1;
+  }
+
+  /* 項目の範囲をビットマスクにする */
+  uint32_t mask[3] = {0, 0, 0};
+  int num = 0;
+  bool ranged = false;
+  for (int r = 0; r < MRD_SUB_RANGES; r++)
+  {
+    uint16_t w = (uint16_t)params[4 + r];
+    int first = w & 0xFF;
+    int count = w >> 8;
+    ranged = ranged or (w != 0);
+    for (int i = first; (i < first + count) and (i < MRD_SUB_MAX_FIELDS); i++)
+    {
+      if (!(mask[i / 32] & (1UL << (i % 32))))
+      {
+        mask[i / 32] |= 1UL << (i % 32);
+        num++;
+      }
+    }
+  }
+  if (ranged and (num == 0)) // 範囲が全てMeridimの外
+  {
+    return -1;
+  }
+
+  int slot = find(ip, port);
+  bool fresh = (slot < 0);
+  for (int s = 0; (slot < 0) and (s < MRD_SUB_MAX); s++)
+  {
+    if (subs[s].divisor == 0)
+    {
+      slot = s;
+    }
+  }
+  if (slot < 0)
+  {
+    return -1;
+  }
+  Sub &u = subs[slot];
+  u.ip = ip;
+  u.port = port;
+  u.divisor = divisor;
+  u.phase = 0;
+  memcpy(u.mask, mask, sizeof(mask));
+  u.num = num;
+  if (fresh)
+  {
+    u.st = {0, 0, 0};
+  }
+  return slot;
+}
+
+bool MrdFanout::unsubscribe(const short *params, IPAddress sender)
+{
+  int slot = find(param_ip(params, sender), (uint16_t)params[2]);
+  if (slot < 0)
+  {
+    return false;
+  }
+  subs[slot].divisor = 0;
+  return true;
+}
+
+int MrdFanout::plan(const short *meridim)
+{
+  int n = 0;
+  for (int s = 0; s < MRD_SUB_MAX; s++)
+  {
+    Sub &u = subs[s];
+    if (u.divisor == 0)
+    {
+      continue;
+    }
+    if (u.phase > 0)
+    {
+      u.phase--;
+      continue;
+    }
+    u.phase = u.divisor - 1;
+
+    MrdSubSend &d = due[n];
+    d.ip = u.ip;
+    d.port = u.port;
+    if (u.num == 0) // Meridim全体は送信用のMeridimをそのまま送る
+    {
+      d.buf = (const uint8_t *)meridim;
+      d.len = MRD_SUB_MAX_FIELDS * 2;
+    }
+    else
+    {
+      int shared = -1; // このフレームで同じ項目のパケットを作った購読者
+      for (int k = 0; (shared < 0) and (k < n); k++)
+      {
+        const Sub &v = subs[due_slot[k]];
+        if ((v.num == u.num) and (memcmp(v.mask, u.mask, sizeof(u.mask)) == 0))
+        {
+          shared = k;
+        }
+      }
+      if (shared >= 0)
+      {
+        d.buf = due[shared].buf;
+        d.len = due[shared].len;
+      }
+      else
+      {
+        short *out = pkt[s];
+        int k = 2;
+        out[0] = (short)MRD_FAST_MAGIC;
+        out[1] = (short)frame_seq;
+        for (int i = 0; i < MRD_SUB_MAX_FIELDS; i++)
+        {
+          if (u.mask[i / 32] & (1UL << (i % 32)))
+          {
+            out[k++] = meridim[i];
+          }
+        }
+        int sum = 0;
+        for (int i = 0; i < k; i++)
+        {
+          sum += out[i];
+        }
+        out[k] = (short)~sum;
+        d.buf = (const uint8_t *)out;
+        d.len = (k + 1) * 2;
+      }
+    }
+    due_slot[n] = s;
+    n++;
+  }
+  frame_seq = (frame_seq >= 59999) ? 0 : frame_seq + 1;
+  return n;
+}
+
+void MrdFanout::sent(int i, bool ok)
+{
+  MrdSubStats &st = subs[due_slot[i]].st;
+  if (ok)
+  {
+    st.packets++;
+    st.bytes += due[i].len;
+  }
+  else
+  {
+    st.drops++;
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef __MERIDIAN_FANOUT__
+#define __MERIDIAN_FANOUT__
+
+#include <Arduino.h>
+
+#include "mrd_telemetry.h"
+
+/*
+  購読者(PC上の複数のアプリ)へのMeridimの配信
+  購読はPCがマスターコマンド MCMD_SUBSCRIBE で登録する. パラメータは SUB_PARAM_INDEX からの7語
+  [0]-[1]  購読者のIPアドレス (a | b<<8, c | d<<8). 0.0.0.0ならコマンドを送ってきたPC
+  [2]      購読者のポート
+  [3]      何フレームに1回送るか (1以上)
+  [4]-[6]  送る項目の範囲 (下位8bit:先頭のMeridimの位置, 上位8bit:個数). 3つとも0ならMeridim全体
+  次の語(Meridim[87])は差分Meridimのack(UDP_DELTA_ACK_INDEX)で, 差分モードでは毎フレーム入るためパラメータにしない.
+  同じIPアドレスとポートの登録は上書き, MCMD_UNSUBSCRIBE([0]-[2]のみ使用)で削除する.
+
+  範囲を指定した購読者には高速項目パケット(mrd_telemetry.h)と同じ形式で, 範囲に含まれる項目を
+  Meridimの位置の順に送る. [1]の通し番号は配信のフレーム番号で, 全購読者で共通.
+  パケットはフレームごとに1回だけ作り, 同じ項目の購読者では同じバッファを送る(Meridim全体は送信用のMeridimをそのまま送る).
+  マルチキャストは使わない(W5500は受信と同じソケットをマルチキャストモードで開けないため).
+*/
+#define MRD_SUB_MAX 4         // 購読者の最大数
+#define MRD_SUB_RANGES 3      // 項目の範囲の最大数
+#define MRD_SUB_PARAMS 7      // マスターコマンドのパラメータの語数
+#define MRD_SUB_MAX_FIELDS 90 // 範囲指定で送る項目の最大数(Meridim90の全項目)
+
+/* 購読者ごとの送信統計 */
+typedef struct
+{
+  uint32_t packets; // 送信数
+  uint32_t bytes;   // 送信バイト数
+  uint32_t drops;   // W5500に渡せなかった数
+} MrdSubStats;
+
+/* 1フレームで送る1パケット */
+typedef struct
+{
+  IPAddress ip;
+  uint16_t port;
+  const uint8_t *buf;
+  int len;
+} MrdSubSend;
+
+/**
+ * @brief Table of subscribers that get the Meridim at their own rate and field selection.
+ *        Each distinct packet is built once per frame and shared by all subscribers that use it.
+ *        Only plans and counts; the sending itself stays with the caller.
+ */
+class MrdFanout
+{
+public:
+  /**
+   * @brief Clear the table.
+   */
+  void begin();
+
+  /**
+   * @brief Add or update a subscriber from the MCMD_SUBSCRIBE parameters.
+   *
+   * @param[in] params MRD_SUB_PARAMS words from SUB_PARAM_INDEX.
+   * @param[in] sender Sender of the command, used when the address in params is 0.0.0.0.
+   * @return int Slot, or -1 if the table is full or the parameters are invalid.
+   */
+  int subscribe(const short *params, IPAddress sender);
+
+  /**
+   * @brief Remove a subscriber (MCMD_UNSUBSCRIBE).
+   *
+   * @return true if it was registered.
+   */
+  bool unsubscribe(const short *params, IPAddress sender);
+
+  /**
+   * @brief Advance one control frame and build the packets due in it.
+   *
+   * @param[in] meridim Meridim to send (MRD_SUB_MAX_FIELDS shorts, checksum set).
+   * @return int Number of packets to send (see packet()).
+   */
+  int plan(const short *meridim);
+
+  /**
+   * @brief i-th packet of the frame (0 <= i < plan()).
+   */
+  const MrdSubSend &packet(int i) const { return due[i]; }
+
+  /**
+   * @brief Count the i-th packet of the frame.
+   *
+   * @param[in] ok false if it was not handed to the W5500.
+   */
+  void sent(int i, bool ok);
+
+  bool active(int slot) const { return subs[slot].divisor > 0; }
+  IPAddress ip(int slot) const { return subs[slot].ip; }
+  uint16_t port(int slot) const { return subs[slot].port; }
+  int divisor(int slot) const { return subs[slot].divisor; }
+  int fields(int slot) const { return subs[slot].num; }
+  MrdSubStats stats(int slot) const { return subs[slot].st; }
+
+private:
+  struct Sub
+  {
+    IPAddress ip;
+    uint16_t port;
+    int divisor;      // 0:空き
+    int phase;        // 次の送信までのフレーム数
+    uint32_t mask[3]; // 送る項目 (Meridimの位置ごとに1bit). 全て0ならMeridim全体
+    int num;          // 送る項目の数 (0:Meridim全体)
+    MrdSubStats st;
+  };
+
+  int find(IPAddress ip, uint16_t port) const;
+  static IPAddress param_ip(const short *params, IPAddress sender);
+
+  Sub subs[MRD_SUB_MAX];
+  MrdSubSend due[MRD_SUB_MAX];
+  int due_slot[MRD_SUB_MAX];                       // due[i]の購読者
+  short pkt[MRD_SUB_MAX][MRD_SUB_MAX_FIELDS + 3]; // 範囲指定のパケット(購読者ごとの置き場所, 同じ項目なら共有)
+  uint16_t frame_seq = 0;                         // 配信のフレーム番号(0-59999)
+};
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_fusion.cpp
+ * @brief   Fixed-point Mahony AHRS filter for MPU6050/MPU9250.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_fusion.h"
+
+#include <cmath>
+
+#define Q30_ONE (1L << 30)
+
+// 64bit整数の平方根（ビット単位の二分法）
+static uint32_t isqrt64(uint64_t x)
+{
+  uint64_t res = 0;
+  uint64_t bit = 1ULL << 62;
+  while (bit > x)
+  {
+    bit >>= 2;
+  }
+  while (bit != 0)
+  {
+    if (x >= res + bit)
+    {
+      x -= res + bit;
+      res = (res >> 1) + bit;
+    }
+    else
+    {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)res;
+}
+
+// Q30同士の乗算
+static inline int32_t mul_q30(int32_t a, int32_t b)
+{
+  return (int32_t)(((int64_t)a * b) >> 30);
+}
+
+void MrdFusion::begin(int sample_hz, int32_t kp_q16, int32_t ki_q16, float gyro_lsb_per_dps)
+{
+  q[0] = Q30_ONE;
+  q[1] = 0;
+  q[2] = 0;
+  q[3] = 0;
+  for (int i = 0; i < 3; i++)
+  {
+    integral[i] = 0;
+    bias[i] = 0;
+  }
+  kp = kp_q16;
+  ki_dt = (int32_t)(((int64_t)ki_q16 << 14) / sample_hz);           // Q16→Q30 に dt を掛ける
+  half_dt = (int32_t)(Q30_ONE / (2 * sample_hz));                      // dt/2 (Q30)
+  gyro_to_rad = (int32_t)(M_PI / 180.0 / gyro_lsb_per_dps * (1L << 24) + 0.5); // 生値→rad/s(Q24)
+}
+
+void MrdFusion::set_gyro_bias(const int32_t gyro_bias[3])
+{
+  for (int i = 0; i < 3; i++)
+  {
+    bias[i] = gyro_bias[i];
+  }
+}
+
+void MrdFusion::update(const int16_t acc[3], const int16_t gyro[3])
+{
+  // ジャイロ値をrad/s(Q24)へ変換
+  int32_t gx = (gyro[0] - bias[0]) * gyro_to_rad;
+  int32_t gy = (gyro[1] - bias[1]) * gyro_to_rad;
+  int32_t gz = (gyro[2] - bias[2]) * gyro_to_rad;
+
+  // 加速度が得られている場合のみ重力方向で補正する
+  int64_t a2 = (int64_t)acc[0] * acc[0] + (int64_t)acc[1] * acc[1] + (int64_t)acc[2] * acc[2];
+  if (a2 > 0)
+  {
+    // 加速度を単位ベクトル化 (Q30)
+    uint32_t an = isqrt64((uint64_t)a2);
+    int32_t ax = (int32_t)(((int64_t)acc[0] << 30) / an);
+    int32_t ay = (int32_t)(((int64_t)acc[1] << 30) / an);
+    int32_t az = (int32_t)(((int64_t)acc[2] << 30) / an);
+
+    // 現在の姿勢から推定される重力方向 (Q30)
+    int32_t vx = 2 * (mul_q30(q[1], q[3]) - mul_q30(q[0], q[2]));
+    int32_t vy = 2 * (mul_q30(q[0], q[1]) + mul_q30(q[2], q[3]));
+    int32_t vz = mul_q30(q[0], q[0]) - mul_q30(q[1], q[1]) - mul_q30(q[2], q[2]) + mul_q30(q[3], q[3]);
+
+    // 計測値と推定値の外積を誤差とする (Q30)
+    int32_t ex = (int32_t)(((int64_t)ay * vz - (int64_t)az * vy) >> 30);
+    int32_t ey = (int32_t)(((int64_t)az * vx - (int64_t)ax * vz) >> 30);
+    int32_t ez = (int32_t)(((int64_t)ax * vy - (int64_t)ay * vx) >> 30);
+
+    // 積分補正 Q30*Q30→Q24
+    if (ki_dt > 0)
+    {
+      integral[0] += (int32_t)(((int64_t)ex * ki_dt) >> 36);
+      integral[1] += (int32_t)(((int64_t)ey * ki_dt) >> 36);
+      integral[2] += (int32_t)(((int64_t)ez * ki_dt) >> 36);
+      gx += integral[0];
+      gy += integral[1];
+      gz += integral[2];
+    }
+
+    // 比例補正 Q30*Q16→Q24
+    gx += (int32_t)(((int64_t)ex * kp) >> 22);
+    gy += (int32_t)(((int64_t)ey * kp) >> 22);
+    gz += (int32_t)(((int64_t)ez * kp) >> 22);
+  }
+
+  // 角速度*dt/2 (Q24*Q30→Q30)
+  int32_t hx = (int32_t)(((int64_t)gx * half_dt) >> 24);
+  int32_t hy = (int32_t)(((int64_t)gy * half_dt) >> 24);
+  int32_t hz = (int32_t)(((int64_t)gz * half_dt) >> 24);
+
+  // クオータニオンの積分
+  int32_t qa = q[0];
+  int32_t qb = q[1];
+  int32_t qc = q[2];
+  int32_t qd = q[3];
+  q[0] += (int32_t)((-(int64_t)qb * hx - (int64_t)qc * hy - (int64_t)qd * hz) >> 30);
+  q[1] += (int32_t)(((int64_t)qa * hx + (int64_t)qc * hz - (int64_t)qd * hy) >> 30);
+  q[2] += (int32_t)(((int64_t)qa * hy - (int64_t)qb * hz + (int64_t)qd * hx) >> 30);
+  q[3] += (int32_t)(((int64_t)qa * hz + (int64_t)qb * hy - (int64_t)qc * hx) >> 30);
+
+  // 正規化
+  uint64_t n2 = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    n2 += (uint64_t)((int64_t)q[i] * q[i]);
+  }
+  uint32_t qn = isqrt64(n2);
+  if (qn > 0)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      q[i] = (int32_t)(((int64_t)q[i] << 30) / qn);
+    }
+  }
+}
+
+void MrdFusion::euler(float *roll, float *pitch, float *yaw) const
+{
+  const float k = 1.0f / Q30_ONE;
+  float w = q[0] * k;
+  float x = q[1] * k;
+  float y = q[2] * k;
+  float z = q[3] * k;
+
+  float sinp = 2.0f * (w * y - z * x);
+  if (sinp > 1.0f)
+  {
+    sinp = 1.0f;
+  }
+  else if (sinp < -1.0f)
+  {
+    sinp = -1.0f;
+  }
+
+  const float r2d = 180.0f / (float)M_PI;
+  *roll = atan2f(2.0f * (w * x + y * z), 1.0f - 2.0f * (x * x + y * y)) * r2d;
+  *pitch = asinf(sinp) * r2d;
+  *yaw = atan2f(2.0f * (w * z + x * y), 1.0f - 2.0f * (y * y + z * z)) * r2d;
+}
@@ -0,0 +1,63 @@
+#ifndef __MERIDIAN_FUSION__
+#define __MERIDIAN_FUSION__
+
+#include <cstdint>
+
+/**
+ * @brief Fixed-point Mahony AHRS filter for raw 6-axis IMUs (MPU6050/MPU9250).
+ *        The attitude quaternion is held in Q30, gyro rates in rad/s Q24.
+ *        Only integer arithmetic is used in update(); float is used in euler() only.
+ */
+class MrdFusion
+{
+public:
+  /**
+   * @brief Reset the filter.
+   *
+   * @param[in] sample_hz Update rate of update() (Hz).
+   * @param[in] kp_q16 Proportional gain in Q16 (65536 = 1.0).
+   * @param[in] ki_q16 Integral gain in Q16 (65536 = 1.0).
+   * @param[in] gyro_lsb_per_dps Sensitivity of the raw gyro value (16.4 for +-2000dps).
+   */
+  void begin(int sample_hz, int32_t kp_q16, int32_t ki_q16, float gyro_lsb_per_dps);
+
+  /**
+   * @brief Set the raw gyro offset to be subtracted before fusion.
+   *
+   * @param[in] bias Raw gyro bias x,y,z.
+   */
+  void set_gyro_bias(const int32_t bias[3]);
+
+  /**
+   * @brief Run one filter step with raw sensor values.
+   *
+   * @param[in] acc Raw accelerometer x,y,z (any scale).
+   * @param[in] gyro Raw gyro x,y,z (scale given by begin()).
+   */
+  void update(const int16_t acc[3], const int16_t gyro[3]);
+
+  /**
+   * @brief Get the estimated attitude.
+   *
+   * @param[out] roll  Roll (degree, -180 to 180).
+   * @param[out] pitch Pitch (degree, -90 to 90).
+   * @param[out] yaw   Yaw (degree, -180 to 180).
+   */
+  void euler(float *roll, float *pitch, float *yaw) const;
+
+  /**
+   * @brief Get the attitude quaternion w,x,y,z in Q30.
+   */
+  const int32_t *quat() const { return q; }
+
+private:
+  int32_t q[4];           // 姿勢クオータニオン w,x,y,z (Q30)
+  int32_t integral[3];    // 積分補正項 (rad/s Q24)
+  int32_t bias[3];        // ジャイロの生値オフセット
+  int32_t kp;             // 比例ゲイン (Q16)
+  int32_t ki_dt;          // 積分ゲイン*dt (Q30)
+  int32_t half_dt;        // dt/2 (Q30)
+  int32_t gyro_to_rad;    // ジャイロ生値からrad/s(Q24)への変換係数
+};
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_interp.cpp
+ * @brief   Keyframe interpolation of the servo targets in fixed point.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_interp.h"
+
+#include <cstring>
+
+int32_t mrd_interp_shape(int profile, int32_t t)
+{
+  if (t <= 0)
+  {
+    return 0;
+  }
+  if (t >= 65536)
+  {
+    return 65536;
+  }
+  int64_t t2 = (int64_t)t * t; // Q32
+  switch (profile)
+  {
+  case MRD_INTERP_CUBIC: // (3 - 2t)t^2
+    return (int32_t)((t2 * ((3 << 16) - 2 * (int64_t)t) + (1LL << 31)) >> 32);
+  case MRD_INTERP_MINJERK: // (10 - 15t + 6t^2)t^3
+  {
+    int64_t t3 = ((t2 >> 8) * t + (1LL << 15)) >> 16;             // Q24
+    int64_t p = (10LL << 32) - 15 * ((int64_t)t << 16) + 6 * t2; // Q32
+    return (int32_t)((t3 * (p >> 8) + (1LL << 31)) >> 32);
+  }
+  default: // 直線
+    return t;
+  }
+}
+
+void MrdInterp::begin(int a_profile)
+{
+  profile_default = ((a_profile >= MRD_INTERP_LINEAR) and (a_profile <= MRD_INTERP_MINJERK)) ? a_profile : MRD_INTERP_MINJERK;
+  profile = profile_default;
+  memset(cur, 0, sizeof(cur));
+  num = 0;
+  frames = 0;
+  k = 0;
+}
+
+void MrdInterp::set_key(const short *target, int a_num, short motion)
+{
+  num = (a_num < 0) ? 0 : (a_num > MRD_INTERP_MAX_AXES) ? MRD_INTERP_MAX_AXES : a_num;
+  int sel = (motion >> 12) & 0x3;
+  profile = (sel == MRD_INTERP_DEFAULT) ? profile_default : sel;
+  frames = motion & 0x0FFF;
+  k = 0;
+  memcpy(start, cur, sizeof(short) * num); // 補間途中でも今の位置から次のキーフレームに向かう
+  memcpy(goal, target, sizeof(short) * num);
+}
+
+void MrdInterp::set_pose(const short *pose, int a_num)
+{
+  set_key(pose, a_num, 0);
+  memcpy(cur, goal, sizeof(short) * num);
+}
+
+void MrdInterp::step(short *out)
+{
+  if (k >= frames) // 区間の終わり(またはフレーム数0)は目標値そのもの
+  {
+    memcpy(cur, goal, sizeof(short) * num);
+  }
+  else
+  {
+    k++;
+    int64_t s;
+    int q;
+    if (profile == MRD_INTERP_LINEAR) // 直線はQ32で直接求める(Q16の進み具合の丸めで誤差を増やさない)
+    {
+      s = ((int64_t)k << 32) / frames;
+      q = 32;
+    }
+    else
+    {
+      s = mrd_interp_shape(profile, (int32_t)((((int64_t)k << 16) + frames / 2) / frames));
+      q = 16;
+    }
+    for (int i = 0; i < num; i++)
+    {
+      int64_t d = (int32_t)goal[i] - (int32_t)start[i];
+      cur[i] = (short)(start[i] + (int32_t)((d * s + (1LL << (q - 1))) >> q));
+    }
+  }
+  memcpy(out, cur, sizeof(short) * num);
+}
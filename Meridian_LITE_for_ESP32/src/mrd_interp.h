@@ -0,0 +1,82 @@
+#ifndef __MERIDIAN_INTERP__
+#define __MERIDIAN_INTERP__
+
+#include <cstdint>
+
+/*
+  Meridim[MRD_MOTION_FRAMES] の意味
+  bit0-11   受信した姿勢に到達するまでのフレーム数 (0:補間せずすぐに目標値にする)
+  bit12-13  補間の形 (0:既定値, 1:直線, 2:3次, 3:最小躍度)
+*/
+#define MRD_INTERP_DEFAULT 0 // 既定値(begin()で指定した形)
+#define MRD_INTERP_LINEAR 1  // 直線(等速)
+#define MRD_INTERP_CUBIC 2   // 3次(始点と終点で速度0)
+#define MRD_INTERP_MINJERK 3 // 最小躍度(始点と終点で速度, 加速度0)
+#define MRD_INTERP_MAX_AXES 30 // 補間する軸の最大数(L系統15+R系統15)
+
+/**
+ * @brief Evaluate an interpolation profile.
+ *
+ * @param[in] profile MRD_INTERP_LINEAR, MRD_INTERP_CUBIC or MRD_INTERP_MINJERK.
+ * @param[in] t Progress in Q16 (0-65536).
+ * @return int32_t Position along the segment in Q16 (0-65536).
+ */
+int32_t mrd_interp_shape(int profile, int32_t t);
+
+/**
+ * @brief Keyframe interpolation of the servo targets in fixed point.
+ *        Each received pose becomes a keyframe reached from the current interpolated
+ *        pose over the number of frames given in Meridim[MRD_MOTION_FRAMES].
+ *        Values are in Meridim units (degree x 100).
+ */
+class MrdInterp
+{
+public:
+  /**
+   * @brief Reset the engine.
+   *
+   * @param[in] profile Profile used when a keyframe does not select one.
+   */
+  void begin(int profile);
+
+  /**
+   * @brief Start a new segment toward a keyframe.
+   *
+   * @param[in] target Keyframe pose (num values).
+   * @param[in] num Number of axes (up to MRD_INTERP_MAX_AXES).
+   * @param[in] motion Meridim[MRD_MOTION_FRAMES] (frames and profile).
+   */
+  void set_key(const short *target, int num, short motion);
+
+  /**
+   * @brief Jump to a pose without interpolation (when another source drove the servos).
+   *
+   * @param[in] pose Pose (num values).
+   * @param[in] num Number of axes (up to MRD_INTERP_MAX_AXES).
+   */
+  void set_pose(const short *pose, int num);
+
+  /**
+   * @brief Advance one control frame.
+   *
+   * @param[out] out Interpolated pose (num values).
+   */
+  void step(short *out);
+
+  /**
+   * @brief A segment is still in progress.
+   */
+  bool moving() const { return k < frames; }
+
+private:
+  short start[MRD_INTERP_MAX_AXES];
+  short goal[MRD_INTERP_MAX_AXES];
+  short cur[MRD_INTERP_MAX_AXES];
+  int num = 0;
+  int profile_default = MRD_INTERP_MINJERK;
+  int profile = MRD_INTERP_MINJERK; // 現在の区間の形
+  int frames = 0;                   // 現在の区間のフレーム数
+  int k = 0;                        // 現在の区間で進んだフレーム数
+};
+
+#endif
@@ -0,0 +1,174 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_jitter.cpp
+ * @brief   Timed receive queue (jitter buffer) for batched PC frames.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_jitter.h"
+
+#include <cstring>
+
+void MrdJitterBuffer::begin(int a_delay, int a_depth)
+{
+  delay = (a_delay < 0) ? 0 : a_delay;
+  depth = (a_depth < 1) ? 1 : (a_depth > MRD_JITTER_SLOTS) ? MRD_JITTER_SLOTS : a_depth;
+  memset(slot_valid, 0, sizeof(slot_valid));
+  started = false;
+  wait = 0;
+  play = 0;
+  newest = 0;
+  missing = 0;
+  st = {0, 0, 0, 0, 0, 0, 0, 0, 0, MRD_JITTER_SLOTS, 0};
+}
+
+int MrdJitterBuffer::push_batch(const short *pkt, int bytes)
+{
+  int words = bytes / 2;
+  if ((words < 2) or ((uint16_t)pkt[0] != MRD_BATCH_MAGIC))
+  {
+    return -1;
+  }
+  int n = pkt[1];
+  if ((n < 1) or (n > MRD_BATCH_MAX_FRAMES) or (words < 2 + n * (1 + MRD_BATCH_WORDS)))
+  {
+    st.bad++;
+    return 0;
+  }
+  st.batches++;
+
+  bool good[MRD_BATCH_MAX_FRAMES];
+  bool first = !started;
+  uint16_t earliest = 0;
+  for (int i = 0; i < n; i++)
+  {
+    const short *m = pkt + 2 + n + i * MRD_BATCH_WORDS;
+    int sum = 0;
+    for (int j = 0; j < MRD_BATCH_WORDS - 1; j++)
+    {
+      sum += m[j];
+    }
+    good[i] = (m[MRD_BATCH_WORDS - 1] == (short)~sum); // Meridimと同じチェックサム
+    if (!good[i])
+    {
+      st.bad++;
+      continue;
+    }
+    uint16_t frame = (uint16_t)pkt[2 + i];
+    if (first or ((int16_t)(frame - earliest) < 0))
+    {
+      earliest = frame;
+      first = false;
+    }
+  }
+  if (!started and !first) // バッチの中の順番によらず, 最も前のフレームから再生する
+  {
+    start(earliest);
+  }
+
+  int queued = 0;
+  for (int i = 0; i < n; i++)
+  {
+    if (good[i] and push((uint16_t)pkt[2 + i], pkt + 2 + n + i * MRD_BATCH_WORDS))
+    {
+      queued++;
+    }
+  }
+  return queued;
+}
+
+void MrdJitterBuffer::start(uint16_t frame)
+{
+  started = true;
+  play = frame;
+  newest = frame;
+  wait = delay;
+  missing = 0;
+}
+
+bool MrdJitterBuffer::push(uint16_t frame, const short *meridim)
+{
+  if (!started) // 最初のフレームを基準に再生の時刻を決める
+  {
+    start(frame);
+  }
+
+  int ahead = (int16_t)(frame - play);
+  if (ahead < 0)
+  {
+    st.late++;
+    return false;
+  }
+  if (ahead >= depth)
+  {
+    st.overruns++;
+    return false;
+  }
+
+  int idx = frame & (MRD_JITTER_SLOTS - 1);
+  memcpy(slot_data[idx], meridim, sizeof(slot_data[idx]));
+  slot_frame[idx] = frame;
+  slot_valid[idx] = true;
+  if ((int16_t)(frame - newest) > 0)
+  {
+    newest = frame;
+  }
+  st.queued++;
+  st.depth = lead();
+  if (st.depth > st.depth_max)
+  {
+    st.depth_max = st.depth;
+  }
+  return true;
+}
+
+bool MrdJitterBuffer::pop(short *meridim)
+{
+  if (!started)
+  {
+    return false;
+  }
+  if (wait > 0) // 再生開始の遅延中
+  {
+    wait--;
+    return false;
+  }
+
+  int idx = play & (MRD_JITTER_SLOTS - 1);
+  bool hit = slot_valid[idx] and (slot_frame[idx] == play);
+  if (hit)
+  {
+    memcpy(meridim, slot_data[idx], sizeof(slot_data[idx]));
+    slot_valid[idx] = false;
+    st.played++;
+    missing = 0;
+  }
+  else
+  {
+    st.underruns++;
+    missing++;
+  }
+  play++;
+
+  st.depth = lead();
+  if (st.depth < st.depth_min)
+  {
+    st.depth_min = st.depth;
+  }
+
+  // キューの長さ分フレームが来なければストリームが終わったとみなし, 次のバッチから再生し直す
+  if (missing >= depth)
+  {
+    st.underruns -= missing; // 途切れた後の分はアンダーランに数えない
+    st.restarts++;
+    started = false;
+    memset(slot_valid, 0, sizeof(slot_valid));
+  }
+  return hit;
+}
+
+int MrdJitterBuffer::lead() const
+{
+  int n = (int16_t)(newest - play) + 1;
+  return (n < 0) ? 0 : n;
+}
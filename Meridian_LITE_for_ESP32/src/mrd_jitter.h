@@ -0,0 +1,102 @@
+#ifndef __MERIDIAN_JITTER__
+#define __MERIDIAN_JITTER__
+
+#include <cstdint>
+
+/*
+  バッチ受信パケットの形式 (short配列, リトルエンディアン)
+  [0]         MRD_BATCH_MAGIC
+  [1]         フレーム数 n (1-MRD_BATCH_MAX_FRAMES)
+  [2]-[n+1]   各フレームの再生フレーム番号(0-65535で一周. PC側のモーションの通し番号)
+  [n+2]-      Meridim90 x n (それぞれ通常のMeridimと同じチェックサム付き)
+  最初に受け取ったバッチの最も前のフレーム番号を基準に, delayフレーム後から1フレームずつ順に再生する.
+*/
+#define MRD_BATCH_MAGIC 0x424D                                    // "MB"
+#define MRD_BATCH_WORDS 90                                        // Meridim90の要素数
+#define MRD_BATCH_MAX_FRAMES 8                                    // 1パケットのフレーム数の上限 (1500byteに収まる数)
+#define MRD_BATCH_MAX_BYTES ((2 + MRD_BATCH_MAX_FRAMES * (1 + MRD_BATCH_WORDS)) * 2) // バッチパケットの最大長
+#define MRD_JITTER_SLOTS 64                                       // 受信キューの容量(2のべき乗)
+
+/* 受信キューの統計 */
+typedef struct
+{
+  uint32_t batches;   // 受け付けたバッチパケット数
+  uint32_t bad;       // 形式やチェックサムが不正で捨てたフレーム数
+  uint32_t queued;    // キューに入れたフレーム数
+  uint32_t played;    // 予定通りに取り出したフレーム数
+  uint32_t underruns; // 再生時刻にフレームが届いていなかった回数
+  uint32_t late;      // 再生時刻を過ぎてから届き捨てたフレーム数
+  uint32_t overruns;  // 先の時刻すぎてキューに入らず捨てたフレーム数
+  uint32_t restarts;  // 受信が途切れて再生を止めた回数(次のバッチから再生し直す)
+  int depth;          // 現在キューにある先読みフレーム数
+  int depth_min;      // 再生中の先読みフレーム数の最小値
+  int depth_max;      // 先読みフレーム数の最大値
+} MrdJitterStats;
+
+/**
+ * @brief Timed receive queue (jitter buffer) for batched PC frames.
+ *        Frames are stored by their target frame number and popped exactly one per
+ *        control frame, so network jitter shorter than the playout delay never reaches the servos.
+ */
+class MrdJitterBuffer
+{
+public:
+  /**
+   * @brief Reset the queue.
+   *
+   * @param[in] delay Control frames between the first received frame and its playout.
+   * @param[in] depth Largest lead (frames ahead of playout) accepted, up to MRD_JITTER_SLOTS.
+   */
+  void begin(int delay, int depth);
+
+  /**
+   * @brief Store the frames of one batch packet.
+   *
+   * @param[in] pkt Packet.
+   * @param[in] bytes Packet length.
+   * @return int Number of frames queued, or -1 if the packet is not a batch packet.
+   */
+  int push_batch(const short *pkt, int bytes);
+
+  /**
+   * @brief Store one frame.
+   *
+   * @param[in] frame Target frame number.
+   * @param[in] meridim Meridim (MRD_BATCH_WORDS shorts).
+   * @return true Queued.
+   */
+  bool push(uint16_t frame, const short *meridim);
+
+  /**
+   * @brief Advance one control frame and take the frame scheduled for it.
+   *
+   * @param[out] meridim Meridim of this frame (unchanged if none).
+   * @return true A frame was popped.
+   */
+  bool pop(short *meridim);
+
+  /**
+   * @brief A batch stream is being played (or waiting for its playout delay).
+   */
+  bool active() const { return started; }
+
+  MrdJitterStats stats() const { return st; }
+
+private:
+  void start(uint16_t frame);
+  int lead() const;
+
+  short slot_data[MRD_JITTER_SLOTS][MRD_BATCH_WORDS];
+  uint16_t slot_frame[MRD_JITTER_SLOTS];
+  bool slot_valid[MRD_JITTER_SLOTS];
+  int delay = 0;
+  int depth = MRD_JITTER_SLOTS;
+  bool started = false;
+  int wait = 0;           // 再生開始までの残りフレーム数
+  uint16_t play = 0;      // 次に再生するフレーム番号
+  uint16_t newest = 0;    // キューに入れた最も先のフレーム番号
+  int missing = 0;        // 連続して再生フレームが無かった回数
+  MrdJitterStats st = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+};
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_link.cpp
+ * @brief   Serial Meridim link to the PC (COBS framing, non-blocking send queue).
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_link.h"
+
+void MrdSerialLink::begin(HardwareSerial *port, int latest_len)
+{
+  this->port = port;
+  latest = latest_len;
+  q_head = 0;
+  q_tail = 0;
+  n_tx = 0;
+  n_drop = 0;
+  pend = 0;
+  n_superseded = 0;
+  dec.begin(rx_buf, sizeof(rx_buf));
+}
+
+int MrdSerialLink::receive(uint8_t *buf, int cap)
+{
+  poll(); // 受信のついでに送信も進める
+  int got = 0;
+  int len = pend;
+  pend = 0;
+  int avail = port->available();
+  while (true)
+  {
+    if (len > 0) // MAINチャンネルのパケットが1つ揃った
+    {
+      if (got == 0)
+      {
+        got = len;
+        memcpy(buf, dec.packet(), min(len, cap));
+        if (len != latest) // Meridim以外は1つずつ返す
+        {
+          break;
+        }
+      }
+      else if (len == latest) // 新しいMeridimで置き換える
+      {
+        memcpy(buf, dec.packet(), min(len, cap));
+        n_superseded++;
+      }
+      else // 持っているMeridimを先に返し, このパケットは次回に返す
+      {
+        pend = len;
+        break;
+      }
+    }
+    if (avail-- <= 0) // 今UARTの受信バッファにある分だけ読む(待たない)
+    {
+      break;
+    }
+    int c = port->read();
+    if (c < 0)
+    {
+      break;
+    }
+    len = dec.feed((uint8_t)c);
+    if (dec.channel() != MRD_LINK_MAIN)
+    {
+      len = 0;
+    }
+  }
+  return min(got, cap);
+}
+
+bool MrdSerialLink::send(int channel, const uint8_t *buf, int len)
+{
+  int need = MRD_COBS_FRAME_MAX(len);
+  if (q_tail + need > MRD_LINK_TX_QUEUE) // 末尾に入らなければ未送信分を先頭に詰める
+  {
+    memmove(q, q + q_head, q_tail - q_head);
+    q_tail -= q_head;
+    q_head = 0;
+  }
+  if (q_tail + need > MRD_LINK_TX_QUEUE)
+  {
+    n_drop++;
+    return false;
+  }
+  q_tail += mrd_cobs_encode((uint8_t)channel, buf, len, q + q_tail);
+  n_tx++;
+  poll();
+  return true;
+}
+
+void MrdSerialLink::poll()
+{
+  int n = min(port->availableForWrite(), q_tail - q_head); // UARTのFIFOの空きの分だけ書く(FIFOが一杯の時に待たないため)
+  if (n <= 0)
+  {
+    return;
+  }
+  port->write(q + q_head, n);
+  q_head += n;
+  if (q_head == q_tail)
+  {
+    q_head = 0;
+    q_tail = 0;
+  }
+}
@@ -0,0 +1,171 @@
+#ifndef __MERIDIAN_LINK__
+#define __MERIDIAN_LINK__
+
+#include <Arduino.h>
+
+#include "mrd_cobs.h"
+#include "mrd_peer.h"
+#include "mrd_spi.h"
+
+/*
+  PCとのMeridimの送受信 (config.h の SERIAL_LINK で選ぶ)
+  UDP(W5500)でもシリアルでも, PCからのパケット1つを受け取り, PCへのパケットをチャンネルを付けて送る.
+  チャンネルはUDPでは宛先のポート, シリアルでは枠の先頭の1byte(mrd_cobs.h).
+  UDP専用の機能(送信先の学習, 購読者への配信)は MrdLinkUdp を直接使う.
+*/
+#define MRD_LINK_MAIN 0 // Meridim, 差分Meridim, アップロードの応答 (UDP_SEND_PORT)
+#define MRD_LINK_FAST 1 // 高速項目パケット (UDP_SEND_FAST_PORT)
+
+#define MRD_LINK_MAX_PACKET 1472 // 1パケットの最大長(Ethernetの1フレームに入るUDPのデータ長)
+#define MRD_LINK_TX_QUEUE 1024   // シリアルの送信キューのバイト数(Meridim 5つ分)
+
+/**
+ * @brief Packet link to the PC, implemented over UDP and over the serial port.
+ */
+class MrdLink
+{
+public:
+  virtual ~MrdLink() {}
+
+  /**
+   * @brief Take one packet from the PC.
+   *
+   * @param[out] buf Packet, truncated to cap bytes.
+   * @return int Bytes stored in buf, 0 if none arrived.
+   */
+  virtual int receive(uint8_t *buf, int cap) = 0;
+
+  /**
+   * @brief Send one packet to the PC.
+   *
+   * @param[in] channel MRD_LINK_MAIN or MRD_LINK_FAST.
+   * @return false if it was not handed to the hardware (dropped).
+   */
+  virtual bool send(int channel, const uint8_t *buf, int len) = 0;
+
+  /**
+   * @brief Move queued bytes to the hardware without blocking. Call whenever there is time.
+   */
+  virtual void poll() {}
+};
+
+/**
+ * @brief UDP link on EthernetUDP or MrdW5500Udp, through the SPI bus arbiter.
+ *        Packets go to the MrdPeer destination; the sender of the last packet is kept.
+ */
+template <class U>
+class MrdLinkUdp : public MrdLink
+{
+public:
+  MrdLinkUdp(U &udp, MrdPeer &peer, MrdSpiArbiter &bus) : udp(udp), peer(peer), bus(bus) {}
+
+  int receive(uint8_t *buf, int cap) override
+  {
+    bus.acquire(MRD_SPI_DEV_NET); // SDカードとSPIバスを共有(優先)
+    int len = udp.parsePacket();
+    int n = (len > 0) ? udp.read(buf, (size_t)min(len, cap)) : 0;
+    if (len > 0)
+    {
+      from_ip = udp.remoteIP();
+      from_port = udp.remotePort();
+    }
+    bus.release(MRD_SPI_DEV_NET);
+    return (n > 0) ? n : 0;
+  }
+
+  bool send(int channel, const uint8_t *buf, int len) override
+  {
+    bus.acquire(MRD_SPI_DEV_NET);
+    bool ok = udp.beginPacket(peer.ip(), (channel == MRD_LINK_FAST) ? peer.fast_port() : peer.port()) and
+              (udp.write(buf, len) == (size_t)len) and udp.endPacket();
+    bus.release(MRD_SPI_DEV_NET);
+    return ok;
+  }
+
+  /**
+   * @brief Send one packet to a destination other than the peer (subscribers).
+   *        MrdW5500Udp only rewrites Sn_DIPR/Sn_DPORT when the destination changes, so send
+   *        all of a frame's extra packets together after the peer's packet: with k of them the
+   *        frame costs k+1 destination writes (one 9 byte SPI frame each, the +1 being the
+   *        return to the peer in the next frame) instead of two per packet.
+   *
+   * @return false if it was not handed to the hardware (dropped).
+   */
+  bool send_to(IPAddress ip, uint16_t port, const uint8_t *buf, int len)
+  {
+    bus.acquire(MRD_SPI_DEV_NET);
+    bool ok = udp.beginPacket(ip, port) and (udp.write(buf, len) == (size_t)len) and udp.endPacket();
+    bus.release(MRD_SPI_DEV_NET);
+    return ok;
+  }
+
+  IPAddress remote_ip() const { return from_ip; }      // 最後に受信したパケットの送信元
+  uint16_t remote_port() const { return from_port; }
+
+private:
+  U &udp;
+  MrdPeer &peer;
+  MrdSpiArbiter &bus;
+  IPAddress from_ip;
+  uint16_t from_port = 0;
+};
+
+/**
+ * @brief Serial link with COBS framing and CRC-16 (mrd_cobs.h).
+ *        Sending only queues the framed packet; poll() moves as many bytes as the UART FIFO
+ *        has room for, so the frame loop never waits for the UART. Receiving decodes the bytes
+ *        already in the UART receive buffer: a packet of the latest_len length (Meridim) is replaced
+ *        by a newer one of the same length, so a PC sending faster than the frame rate does not
+ *        build up a queue; packets of other lengths (upload, batch) are returned one by one in order.
+ */
+class MrdSerialLink : public MrdLink
+{
+public:
+  /**
+   * @brief Use a port that is already started (Serial.begin()).
+   *
+   * @param[in] latest_len Length of the packets where only the newest one counts (MSG_BUFF).
+   */
+  void begin(HardwareSerial *port, int latest_len);
+
+  int receive(uint8_t *buf, int cap) override;
+
+  /**
+   * @return false if the packet does not fit in the send queue (dropped, counted).
+   */
+  bool send(int channel, const uint8_t *buf, int len) override;
+
+  void poll() override;
+
+  uint32_t tx_frames() const { return n_tx; }        // 送信キューに入れたパケット数
+  uint32_t tx_drops() const { return n_drop; }       // 送信キューに入らず捨てたパケット数
+  int tx_queued() const { return q_tail - q_head; }  // 送信キューに残っているバイト数
+  uint32_t rx_superseded() const { return n_superseded; } // 新しいパケットで置き換えて捨てたパケット数
+  const MrdCobsDecoder &rx() const { return dec; }   // 受信の統計
+
+private:
+  HardwareSerial *port = NULL;
+  uint8_t q[MRD_LINK_TX_QUEUE]; // 送信キュー. [q_head, q_tail) が未送信
+  int q_head = 0;
+  int q_tail = 0;
+  uint32_t n_tx = 0;
+  uint32_t n_drop = 0;
+  int latest = 0;
+  int pend = 0; // 前回の受信で復号したが返せなかったパケットの長さ(dec に残っている)
+  uint32_t n_superseded = 0;
+  MrdCobsDecoder dec;
+  uint8_t rx_buf[MRD_LINK_MAX_PACKET + MRD_COBS_OVERHEAD];
+};
+
+/**
+ * @brief Print that discards everything. Stands in for the debug output that shares the port
+ *        with MrdSerialLink, since text written between the bytes of a frame breaks the frame.
+ */
+class MrdMutePrint : public Print
+{
+public:
+  size_t write(uint8_t c) override { return 1; }
+  size_t write(const uint8_t *buf, size_t len) override { return len; }
+};
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_motion.cpp
+ * @brief   Motion asset image: format check, lookup and playback.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_motion.h"
+
+#include <cstring>
+
+uint32_t mrd_motion_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+  // 4bitずつの表引き(表は64バイトで済み, フラッシュ上の数百KBでも十分速い)
+  static const uint32_t table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++)
+  {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+bool MrdMotionStore::attach(const uint8_t *a_base, uint32_t size)
+{
+  detach();
+  if ((a_base == NULL) or (size < sizeof(MrdMotionImage)))
+  {
+    return false;
+  }
+  const MrdMotionImage *h = (const MrdMotionImage *)a_base;
+  if ((h->magic != MRD_MOTION_MAGIC) or (h->version != MRD_MOTION_VERSION) or (h->bytes > size) or
+      (h->bytes < sizeof(MrdMotionImage) + (uint32_t)h->count * sizeof(MrdMotionEntry)))
+  {
+    return false;
+  }
+  if (mrd_motion_crc32(0, a_base + sizeof(MrdMotionImage), h->bytes - sizeof(MrdMotionImage)) != h->crc)
+  {
+    return false;
+  }
+
+  /* 目次と各モーションが範囲内に収まっているか */
+  const MrdMotionEntry *dir = (const MrdMotionEntry *)(a_base + sizeof(MrdMotionImage));
+  for (int i = 0; i < h->count; i++)
+  {
+    const MrdMotionEntry &e = dir[i];
+    if ((e.offset % 4 != 0) or (e.offset > h->bytes) or (e.bytes > h->bytes - e.offset) or (e.bytes < sizeof(MrdMotionHeader)))
+    {
+      return false;
+    }
+    const MrdMotionHeader *m = (const MrdMotionHeader *)(a_base + e.offset);
+    if ((m->axes < 1) or (m->axes > MRD_INTERP_MAX_AXES) or (m->keys < 1) or (m->stride < MRD_MOTION_KEY_BYTES(m->axes)) or
+        (m->stride % 4 != 0) or (sizeof(MrdMotionHeader) + (uint32_t)m->keys * m->stride > e.bytes))
+    {
+      return false;
+    }
+  }
+  base = a_base;
+  img = h;
+  return true;
+}
+
+void MrdMotionStore::detach()
+{
+  base = NULL;
+  img = NULL;
+}
+
+const MrdMotionEntry *MrdMotionStore::entry(int index) const
+{
+  if (!img or (index < 0) or (index >= img->count))
+  {
+    return NULL;
+  }
+  return (const MrdMotionEntry *)(base + sizeof(MrdMotionImage)) + index;
+}
+
+const MrdMotionHeader *MrdMotionStore::motion(int index) const
+{
+  const MrdMotionEntry *e = entry(index);
+  return e ? (const MrdMotionHeader *)(base + e->offset) : NULL;
+}
+
+int MrdMotionStore::find(const char *name) const
+{
+  for (int i = 0; i < count(); i++)
+  {
+    if (strncmp(entry(i)->name, name, MRD_MOTION_NAME_LEN) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void MrdMotionPlayer::begin(int profile)
+{
+  interp.begin(profile);
+  mot = NULL;
+  index = -1;
+}
+
+bool MrdMotionPlayer::start(const MrdMotionStore &store, int a_index, const short *pose)
+{
+  mot = store.motion(a_index);
+  if (!mot)
+  {
+    return false;
+  }
+  index = a_index;
+  key = 0;
+  hold = 0;
+  interp.set_pose(pose, MRD_INTERP_MAX_AXES); // 今の姿勢から最初のキーフレームに向かう
+  return next_key();
+}
+
+bool MrdMotionPlayer::next_key()
+{
+  if (key >= mot->keys)
+  {
+    if (!(mot->flags & MRD_MOTION_LOOP))
+    {
+      return false;
+    }
+    key = 0;
+  }
+  const uint8_t *k = (const uint8_t *)(mot + 1) + key * mot->stride;
+  const uint16_t *word = (const uint16_t *)k;
+  interp.set_key((const short *)(k + 4), mot->axes, (short)word[0]); // キーフレームはイメージから直接読む
+  hold = word[1];
+  key++;
+  return true;
+}
+
+bool MrdMotionPlayer::step(short *pose)
+{
+  if (!mot)
+  {
+    return false;
+  }
+  if (!interp.moving())
+  {
+    if (hold > 0)
+    {
+      hold--;
+    }
+    else if (!next_key()) // 最後のキーフレームで止まって終了
+    {
+      mot = NULL;
+      return false;
+    }
+  }
+  interp.step(pose);
+  return true;
+}
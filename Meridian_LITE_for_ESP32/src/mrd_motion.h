@@ -0,0 +1,195 @@
+#ifndef __MERIDIAN_MOTION__
+#define __MERIDIAN_MOTION__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mrd_interp.h"
+
+/*
+  モーションアセットのイメージ (tools/mrd_motion_pack で作成し, フラッシュのmotion領域に書き込む)
+  [MrdMotionImage]           イメージ全体のヘッダ
+  [MrdMotionEntry] x count   モーションの目次
+  モーション本体 x count        それぞれ4バイト境界から始まる
+    [MrdMotionHeader]
+    キーフレーム x keys         1つあたり stride バイト(4の倍数)
+      uint16 motion            到達までのフレーム数と補間の形 (Meridim[MRD_MOTION_FRAMES]と同じ, mrd_interp.h)
+      uint16 hold              到達後にその姿勢で止まるフレーム数
+      int16  pos[axes]         角度 (degree x 100, L0-L14, R0-R14の順)
+  値はすべてリトルエンディアン. イメージはフラッシュからそのまま読むため, 再生時にRAMへのコピーは不要.
+*/
+#define MRD_MOTION_MAGIC 0x4144524D // "MRDA"
+#define MRD_MOTION_VERSION 1
+#define MRD_MOTION_NAME_LEN 16
+#define MRD_MOTION_LOOP 0x0001 // 最後のキーフレームの後に最初のキーフレームに戻る
+#define MRD_MOTION_KEY_BYTES(axes) ((4 + (axes) * 2 + 3) & ~3)
+
+/*
+  アップロードのパケット (PC→ボードのUDP受信ポート. ヘッダの後にデータが続く)
+  BEGIN   value=イメージの長さ. 領域を書き込み待ちにし, 再生中のモーションは止める
+  DATA    offset=書き込み位置, value=データ長. 前回までに受け付けた長さの位置から順に送る
+  COMMIT  value=イメージ全体のCRC32. 内容を確認して再生に使えるようにする
+  ボードはパケットごとにMrdUploadAckを送信先ポートへ返す. 応答が無ければ同じパケットを送り直す.
+*/
+#define MRD_UPLOAD_MAGIC 0x554D // "MU"
+#define MRD_UPLOAD_BEGIN 1
+#define MRD_UPLOAD_DATA 2
+#define MRD_UPLOAD_COMMIT 3
+#define MRD_UPLOAD_CHUNK 1024                          // 1パケットのデータの上限
+#define MRD_UPLOAD_MAX_BYTES (12 + MRD_UPLOAD_CHUNK) // パケットの最大長
+
+/* アップロードの応答の status */
+#define MRD_UPLOAD_OK 0
+#define MRD_UPLOAD_ERR_SIZE -1   // 領域に入らない, またはパケット長が不正
+#define MRD_UPLOAD_ERR_ORDER -2  // 書き込み位置が飛んだ (ackのoffsetから送り直す)
+#define MRD_UPLOAD_ERR_FLASH -3  // フラッシュの消去/書き込みに失敗
+#define MRD_UPLOAD_ERR_CRC -4    // COMMITのCRC32が一致しない
+#define MRD_UPLOAD_ERR_STATE -5  // BEGIN前のDATA/COMMIT
+#define MRD_UPLOAD_ERR_IMAGE -6  // 書き込んだイメージの形式が不正
+
+typedef struct
+{
+  uint32_t magic;   // MRD_MOTION_MAGIC
+  uint16_t version; // MRD_MOTION_VERSION
+  uint16_t count;   // モーション数
+  uint32_t bytes;   // イメージ全体の長さ(ヘッダを含む)
+  uint32_t crc;     // ヘッダより後ろのCRC32
+} MrdMotionImage;
+
+typedef struct
+{
+  char name[MRD_MOTION_NAME_LEN]; // モーション名(NUL終端)
+  uint32_t offset;                // イメージ先頭からのモーション本体の位置
+  uint32_t bytes;                 // モーション本体の長さ
+} MrdMotionEntry;
+
+typedef struct
+{
+  uint16_t axes;   // 1キーフレームの軸数 (1-MRD_INTERP_MAX_AXES)
+  uint16_t keys;   // キーフレーム数
+  uint16_t flags;  // MRD_MOTION_LOOP
+  uint16_t stride; // 1キーフレームのバイト数
+} MrdMotionHeader;
+
+typedef struct
+{
+  uint16_t magic;  // MRD_UPLOAD_MAGIC
+  uint16_t op;     // MRD_UPLOAD_BEGIN/DATA/COMMIT
+  uint32_t offset; // DATAの書き込み位置
+  uint32_t value;  // BEGIN:イメージの長さ, DATA:データ長, COMMIT:CRC32
+} MrdUploadPacket;
+
+typedef struct
+{
+  uint16_t magic;  // MRD_UPLOAD_MAGIC
+  uint16_t op;     // 応答したパケットのop
+  uint32_t offset; // 受け付けた長さ(次のDATAの位置)
+  int32_t status;  // MRD_UPLOAD_OK または MRD_UPLOAD_ERR_*
+} MrdUploadAck;
+
+/**
+ * @brief CRC-32 (IEEE 802.3), continuing from crc (start with 0).
+ */
+uint32_t mrd_motion_crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Read-only view of a motion image in place (flash mapping or a host buffer).
+ *        attach() checks the whole image once, so lookups and playback trust it afterwards.
+ */
+class MrdMotionStore
+{
+public:
+  /**
+   * @brief Check and attach an image.
+   *
+   * @param[in] base Start of the image.
+   * @param[in] size Bytes available at base (the partition size).
+   * @return true The image is valid.
+   */
+  bool attach(const uint8_t *base, uint32_t size);
+
+  void detach();
+
+  bool is_ready() const { return img != NULL; }
+
+  /**
+   * @brief Number of motions (0 if no valid image).
+   */
+  int count() const { return img ? img->count : 0; }
+
+  /**
+   * @brief Bytes used by the image (0 if no valid image).
+   */
+  uint32_t bytes() const { return img ? img->bytes : 0; }
+
+  /**
+   * @brief Directory entry of motion `index`, or NULL.
+   */
+  const MrdMotionEntry *entry(int index) const;
+
+  /**
+   * @brief Motion `index`, or NULL. Keyframes follow the header.
+   */
+  const MrdMotionHeader *motion(int index) const;
+
+  /**
+   * @brief Index of the motion named `name`, or -1.
+   */
+  int find(const char *name) const;
+
+private:
+  const uint8_t *base = NULL;
+  const MrdMotionImage *img = NULL;
+};
+
+/**
+ * @brief Plays one motion of a store through MrdInterp, reading the keyframes where they are.
+ */
+class MrdMotionPlayer
+{
+public:
+  /**
+   * @brief Reset the player.
+   *
+   * @param[in] profile Profile used when a keyframe does not select one (MRD_INTERP_*).
+   */
+  void begin(int profile);
+
+  /**
+   * @brief Start a motion from the current pose.
+   *
+   * @param[in] store Motion store.
+   * @param[in] index Motion number.
+   * @param[in] pose Current pose (MRD_INTERP_MAX_AXES values, degree x 100).
+   * @return true Started.
+   */
+  bool start(const MrdMotionStore &store, int index, const short *pose);
+
+  void stop() { mot = NULL; }
+
+  /**
+   * @brief Advance one control frame.
+   *
+   * @param[in,out] pose Pose, the axes of the motion are overwritten.
+   * @return true Still playing (false once the last keyframe was reached and held).
+   */
+  bool step(short *pose);
+
+  bool playing() const { return mot != NULL; }
+
+  /**
+   * @brief Number of the motion being played, or -1.
+   */
+  int current() const { return mot ? index : -1; }
+
+private:
+  bool next_key();
+
+  MrdInterp interp;
+  const MrdMotionHeader *mot = NULL;
+  int index = -1;
+  int key = 0;  // 次に向かうキーフレーム
+  int hold = 0; // 到達後に止まる残りフレーム数
+};
+
+#endif
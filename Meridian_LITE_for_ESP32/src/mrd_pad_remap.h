@@ -0,0 +1,74 @@
+#ifndef __MERIDIAN_PAD_REMAP__
+#define __MERIDIAN_PAD_REMAP__
+
+#include <cstdint>
+
+/**
+ * @brief Compile-time button remap tables for joypads.
+ *
+ * A pad registers its mapping as a 16-entry array in the same layout as
+ * PAD_WIIMOTE_SOLO: entry i is the mask of native buttons that set bit i
+ * of the PS-style Meridim button word.
+ * PadRemap<MAP>::apply() then converts a native word with two table loads and an OR,
+ * which gives the same result as testing the 16 entries one by one.
+ *
+ *   uint16_t btn = PadRemap<PAD_WIIMOTE_SOLO>::apply(native);
+ */
+
+// 0..N-1 の整数列 (C++11用)
+template <int... I>
+struct PadIndexSeq
+{
+};
+template <int N, int... I>
+struct PadMakeSeq : PadMakeSeq<N - 1, N - 1, I...>
+{
+};
+template <int... I>
+struct PadMakeSeq<0, I...>
+{
+  typedef PadIndexSeq<I...> type;
+};
+
+/**
+ * @brief Remap one native button word bit by bit (reference implementation).
+ *
+ * @param[in] map Mapping table, map[i] is the native mask for output bit i.
+ * @param[in] in Native button word.
+ * @param[in] i First output bit to evaluate (call with 0).
+ * @return uint16_t Remapped button word.
+ */
+constexpr uint16_t pad_remap_bits(const unsigned short (&map)[16], uint16_t in, int i)
+{
+  return (i >= 16) ? 0 : (uint16_t)((((map[i] & in) != 0) ? (1 << i) : 0) | pad_remap_bits(map, in, i + 1));
+}
+
+template <const unsigned short (&MAP)[16], typename SEQ>
+struct PadRemapTable;
+
+template <const unsigned short (&MAP)[16], int... I>
+struct PadRemapTable<MAP, PadIndexSeq<I...>>
+{
+  static constexpr uint16_t lo[256] = {pad_remap_bits(MAP, (uint16_t)I, 0)...};        // 下位8ビット用
+  static constexpr uint16_t hi[256] = {pad_remap_bits(MAP, (uint16_t)(I << 8), 0)...}; // 上位8ビット用
+};
+template <const unsigned short (&MAP)[16], int... I>
+constexpr uint16_t PadRemapTable<MAP, PadIndexSeq<I...>>::lo[256];
+template <const unsigned short (&MAP)[16], int... I>
+constexpr uint16_t PadRemapTable<MAP, PadIndexSeq<I...>>::hi[256];
+
+template <const unsigned short (&MAP)[16]>
+struct PadRemap : PadRemapTable<MAP, typename PadMakeSeq<256>::type>
+{
+  typedef PadRemapTable<MAP, typename PadMakeSeq<256>::type> table;
+
+  /**
+   * @brief Remap a native button word to the PS-style Meridim layout.
+   */
+  static inline uint16_t apply(uint16_t in)
+  {
+    return table::lo[in & 0xFF] | table::hi[in >> 8];
+  }
+};
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_peer.cpp
+ * @brief   Destination session of the UDP packets to the PC.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_peer.h"
+
+bool MrdPeer::begin(const char *host, uint16_t port, uint16_t fast_port, int m)
+{
+  mode = m;
+  dport = port;
+  fport = fast_port;
+  addr = IPAddress(0, 0, 0, 0);
+  return addr.fromString(host);
+}
+
+bool MrdPeer::learn(IPAddress ip, uint16_t port)
+{
+  if (mode == MRD_PEER_FIXED)
+  {
+    return false;
+  }
+  uint16_t p = (mode == MRD_PEER_LEARN_ALL) ? port : dport;
+  if ((ip == addr) and (p == dport))
+  {
+    return false;
+  }
+  addr = ip;
+  dport = p;
+  return true;
+}
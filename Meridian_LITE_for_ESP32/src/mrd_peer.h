@@ -0,0 +1,52 @@
+#ifndef __MERIDIAN_PEER__
+#define __MERIDIAN_PEER__
+
+#include <Arduino.h>
+
+/*
+  UDPの送信先(PC)のセッション
+  keys.hのWIFI_SEND_IPは起動時に1回だけ解釈し, 送信ではIPAddressで宛先を渡す.
+  学習モードでは, 正しいMeridim(またはバッチパケット)を送ってきたPCを次の送信先にする.
+  W5500_BURST 1 のドライバはSn_DIPR/Sn_DPORTを宛先が変わった時だけ書く.
+*/
+#define MRD_PEER_FIXED 0     // keys.hの送信先に送る
+#define MRD_PEER_LEARN_IP 1  // 最後に正しく受信したPCのIPアドレスに送る(ポートはkeys.hのもの)
+#define MRD_PEER_LEARN_ALL 2 // 最後に正しく受信したPCのIPアドレスと送信元ポートに送る(高速項目のポートはkeys.hのもの)
+
+/**
+ * @brief Destination of the UDP packets to the PC, resolved once and optionally learned
+ *        from the sender of the last valid Meridim.
+ */
+class MrdPeer
+{
+public:
+  /**
+   * @brief Set the configured destination.
+   *
+   * @param[in] host Dotted decimal address (WIFI_SEND_IP).
+   * @param[in] port Port of the Meridim and acknowledgements (UDP_SEND_PORT).
+   * @param[in] fast_port Port of the fast field packets (UDP_SEND_FAST_PORT).
+   * @param[in] mode MRD_PEER_FIXED, MRD_PEER_LEARN_IP or MRD_PEER_LEARN_ALL.
+   * @return false if host is not an IPv4 address (the destination is then 0.0.0.0 until learned).
+   */
+  bool begin(const char *host, uint16_t port, uint16_t fast_port, int mode);
+
+  /**
+   * @brief Note the sender of a valid packet. Ignored in MRD_PEER_FIXED.
+   *
+   * @return true if the destination changed.
+   */
+  bool learn(IPAddress ip, uint16_t port);
+
+  IPAddress ip() const { return addr; }
+  uint16_t port() const { return dport; }
+  uint16_t fast_port() const { return fport; }
+
+private:
+  int mode = MRD_PEER_FIXED;
+  IPAddress addr;
+  uint16_t dport = 0;
+  uint16_t fport = 0;
+};
+
+#endif
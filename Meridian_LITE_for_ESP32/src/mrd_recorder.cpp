@@ -0,0 +1,239 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_recorder.cpp
+ * @brief   SD flight recorder for Meridim frames.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_recorder.h"
+
+#define MRD_REC_HEADER_INTERVAL 16 // ファイルヘッダを更新するブロック間隔
+
+bool MrdRecorder::begin(fs::FS &fs, const char *path, uint32_t blocks, MrdSpiArbiter *spi_bus, int core)
+{
+  spi = spi_bus;
+  capacity = blocks;
+  next_block = 0;
+  block_seq = 0;
+  const size_t file_bytes = MRD_REC_SECTOR + (size_t)capacity * MRD_REC_BLOCK_BYTES;
+
+  /* 同じ容量で確保済みのファイルがあれば再利用し, 最新ブロックの次から書く */
+  bool reuse = false;
+  if (fs.exists(path))
+  {
+    file = fs.open(path, "r+");
+    MrdRecFileHeader hdr;
+    if (file and (file.size() == file_bytes) and (file.read((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr)) and (hdr.magic == MRD_REC_FILE_MAGIC) and (hdr.block_bytes == MRD_REC_BLOCK_BYTES) and (hdr.capacity == capacity))
+    {
+      reuse = true;
+      for (uint32_t i = 0; i < capacity; i++)
+      {
+        uint32_t head[2];
+        file.seek(MRD_REC_SECTOR + i * MRD_REC_BLOCK_BYTES);
+        if ((file.read((uint8_t *)head, sizeof(head)) == sizeof(head)) and (head[0] == MRD_REC_BLOCK_MAGIC) and (head[1] > block_seq))
+        {
+          block_seq = head[1];
+          next_block = (i + 1) % capacity;
+        }
+      }
+    }
+    else if (file)
+    {
+      file.close();
+    }
+  }
+
+  /* 新規作成時はゼロ埋めで全容量を確保する(書き込み中のFAT更新を避けるため) */
+  if (!reuse)
+  {
+    file = fs.open(path, FILE_WRITE);
+    if (!file)
+    {
+      return false;
+    }
+    memset(&buf[0], 0, sizeof(MrdRecBlock));
+    MrdRecFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = MRD_REC_FILE_MAGIC;
+    hdr.block_bytes = MRD_REC_BLOCK_BYTES;
+    hdr.capacity = capacity;
+    file.write((uint8_t *)&hdr, sizeof(hdr));
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+      if (file.write((uint8_t *)&buf[0], sizeof(MrdRecBlock)) != sizeof(MrdRecBlock))
+      {
+        file.close();
+        return false;
+      }
+    }
+    file.close();
+    file = fs.open(path, "r+");
+    if (!file)
+    {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < MRD_REC_BUFFERS; i++)
+  {
+    buf[i].count = 0;
+    pending[i] = false;
+  }
+  fill_idx = 0;
+  write_idx = 0;
+  window_start_ms = millis();
+  ready = true;
+  if (xTaskCreatePinnedToCore(writer_task, "mrd_rec", 4096, this, 1, &task, core) != pdPASS)
+  {
+    ready = false;
+  }
+  return ready;
+}
+
+void MrdRecorder::append(uint32_t t_us, const uint8_t *r_meridim, const uint8_t *s_meridim)
+{
+  if (!ready)
+  {
+    return;
+  }
+  if (pending[fill_idx]) // 書き込みが追いついていない
+  {
+    st.dropped++;
+    return;
+  }
+  MrdRecBlock *b = &buf[fill_idx];
+  MrdRecRecord *rec = &b->records[b->count];
+  rec->t_us = t_us;
+  memcpy(rec->r_meridim, r_meridim, MRD_REC_MSG_BYTES);
+  memcpy(rec->s_meridim, s_meridim, MRD_REC_MSG_BYTES);
+  b->count++;
+  st.records++;
+  if (b->count >= MRD_REC_RECORDS_PER_BLOCK)
+  {
+    submit(fill_idx);
+  }
+}
+
+void MrdRecorder::flush()
+{
+  if (ready and !pending[fill_idx] and (buf[fill_idx].count > 0))
+  {
+    submit(fill_idx);
+  }
+}
+
+void MrdRecorder::submit(int idx)
+{
+  pending[idx] = true;
+  uint32_t n = 0;
+  for (int i = 0; i < MRD_REC_BUFFERS; i++)
+  {
+    n += pending[i] ? 1 : 0;
+  }
+  if (n > st.pending_high_water)
+  {
+    st.pending_high_water = n;
+  }
+  fill_idx = (idx + 1) % MRD_REC_BUFFERS;
+  xTaskNotifyGive(task);
+}
+
+bool MrdRecorder::write_at(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+  /* 1セクタずつSPIバスを確保し, 他のデバイスの待ち時間を1セクタ分に抑える */
+  bool ok = true;
+  for (uint32_t done = 0; ok and (done < len); done += MRD_REC_SECTOR)
+  {
+    uint32_t chunk = min((uint32_t)MRD_REC_SECTOR, len - done);
+    if (spi)
+    {
+      spi->acquire(MRD_SPI_DEV_SD);
+    }
+    if (done == 0)
+    {
+      ok = file.seek(offset);
+    }
+    ok = ok and (file.write(data + done, chunk) == chunk);
+    if (spi)
+    {
+      spi->release(MRD_SPI_DEV_SD);
+    }
+  }
+  return ok;
+}
+
+bool MrdRecorder::write_header()
+{
+  MrdRecFileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = MRD_REC_FILE_MAGIC;
+  hdr.block_bytes = MRD_REC_BLOCK_BYTES;
+  hdr.capacity = capacity;
+  hdr.next_block = next_block;
+  hdr.block_seq = block_seq;
+  bool ok = write_at(0, (const uint8_t *)&hdr, sizeof(hdr));
+  if (spi)
+  {
+    spi->acquire(MRD_SPI_DEV_SD);
+  }
+  file.flush();
+  if (spi)
+  {
+    spi->release(MRD_SPI_DEV_SD);
+  }
+  return ok;
+}
+
+void MrdRecorder::write_block(int idx)
+{
+  MrdRecBlock *b = &buf[idx];
+  b->magic = MRD_REC_BLOCK_MAGIC;
+  b->block_seq = ++block_seq;
+  b->record_size = MRD_REC_RECORD_BYTES;
+  b->reserved = 0;
+
+  uint32_t t0 = micros();
+  if (!write_at(MRD_REC_SECTOR + next_block * MRD_REC_BLOCK_BYTES, (const uint8_t *)b, sizeof(MrdRecBlock)))
+  {
+    st.write_errors++;
+  }
+  uint32_t dt = micros() - t0;
+  if (dt > st.write_us_max)
+  {
+    st.write_us_max = dt;
+  }
+
+  next_block = (next_block + 1) % capacity;
+  st.blocks_written++;
+  window_bytes += sizeof(MrdRecBlock);
+  if ((st.blocks_written % MRD_REC_HEADER_INTERVAL) == 0)
+  {
+    write_header();
+  }
+
+  b->count = 0;
+  pending[idx] = false;
+}
+
+void MrdRecorder::writer_task(void *arg)
+{
+  MrdRecorder *self = (MrdRecorder *)arg;
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    while (self->pending[self->write_idx])
+    {
+      self->write_block(self->write_idx);
+      self->write_idx = (self->write_idx + 1) % MRD_REC_BUFFERS;
+    }
+
+    /* 1秒ごとにスループットを更新 */
+    uint32_t now_ms = millis();
+    if (now_ms - self->window_start_ms >= 1000)
+    {
+      self->st.bytes_per_sec = (uint32_t)((uint64_t)self->window_bytes * 1000 / (now_ms - self->window_start_ms));
+      self->window_bytes = 0;
+      self->window_start_ms = now_ms;
+    }
+  }
+}
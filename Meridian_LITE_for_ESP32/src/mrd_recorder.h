@@ -0,0 +1,133 @@
+#ifndef __MERIDIAN_RECORDER__
+#define __MERIDIAN_RECORDER__
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "mrd_spi.h"
+
+/*
+  フライトレコーダーのファイル形式 (リトルエンディアン)
+  [sector 0]        MrdRecFileHeader (512byte)
+  [sector 1 -]      MrdRecBlock (4096byte = 8sector) x capacity. 末尾まで書いたら先頭のブロックに戻る(リング)
+  各ブロックには MRD_REC_RECORDS_PER_BLOCK 個のフレームが入り, block_seq が最大のブロックが最新.
+*/
+#define MRD_REC_SECTOR 512
+#define MRD_REC_BLOCK_BYTES 4096                                 // 書き込み単位 (8セクタ)
+#define MRD_REC_MSG_BYTES 180                                    // Meridim90のバイト数
+#define MRD_REC_FILE_MAGIC 0x3143524D                            // "MRC1"
+#define MRD_REC_BLOCK_MAGIC 0x4B4C424D                           // "MBLK"
+#define MRD_REC_BUFFERS 2                                        // ダブルバッファ
+#define MRD_REC_RECORD_BYTES (4 + MRD_REC_MSG_BYTES * 2 + 4)     // 1フレーム分の記録のバイト数
+#define MRD_REC_RECORDS_PER_BLOCK ((MRD_REC_BLOCK_BYTES - 16) / MRD_REC_RECORD_BYTES)
+
+/* 1フレーム分の記録 */
+typedef struct
+{
+  uint32_t t_us;                        // フレームの時刻(us)
+  uint8_t r_meridim[MRD_REC_MSG_BYTES]; // 受信したMeridim
+  uint8_t s_meridim[MRD_REC_MSG_BYTES]; // 送信したMeridim
+  uint8_t reserved[4];
+} MrdRecRecord;
+
+/* ブロック(書き込み単位) */
+typedef struct
+{
+  uint32_t magic;     // MRD_REC_BLOCK_MAGIC
+  uint32_t block_seq; // 書き込み通し番号(1から)
+  uint16_t count;     // 有効なレコード数
+  uint16_t record_size;
+  uint32_t reserved;
+  MrdRecRecord records[MRD_REC_RECORDS_PER_BLOCK];
+  uint8_t pad[MRD_REC_BLOCK_BYTES - 16 - MRD_REC_RECORD_BYTES * MRD_REC_RECORDS_PER_BLOCK];
+} MrdRecBlock;
+
+/* ファイルヘッダ(セクタ0) */
+typedef struct
+{
+  uint32_t magic;       // MRD_REC_FILE_MAGIC
+  uint32_t block_bytes; // MRD_REC_BLOCK_BYTES
+  uint32_t capacity;    // ブロック数
+  uint32_t next_block;  // 次に書き込むブロック番号(目安, 定期更新)
+  uint32_t block_seq;   // 最後に書き込んだ通し番号(目安, 定期更新)
+  uint8_t pad[MRD_REC_SECTOR - 20];
+} MrdRecFileHeader;
+
+/* 統計 */
+typedef struct
+{
+  uint32_t records;            // 記録したフレーム数
+  uint32_t dropped;            // バッファが空かず捨てたフレーム数
+  uint32_t blocks_written;     // 書き込んだブロック数
+  uint32_t write_errors;       // 書き込み失敗回数
+  uint32_t bytes_per_sec;      // 直近1秒の書き込みスループット
+  uint32_t write_us_max;       // 1ブロックの書き込みにかかった最大時間(us)
+  uint32_t pending_high_water; // 書き込み待ちバッファ数の最大値
+} MrdRecStats;
+
+/**
+ * @brief SD flight recorder.
+ *        append() only copies the frame into a RAM buffer; full buffers are written
+ *        to a preallocated ring file by a writer task, so SD latency never reaches the frame loop.
+ */
+class MrdRecorder
+{
+public:
+  /**
+   * @brief Open (and preallocate if needed) the ring file and start the writer task.
+   *
+   * @param[in] fs File system (SD or a stand-in).
+   * @param[in] path File path.
+   * @param[in] capacity Number of blocks in the ring.
+   * @param[in] spi_bus SPI bus arbiter shared with the W5500, may be NULL.
+   * @param[in] core Core to pin the writer task to.
+   * @return true if the file is ready.
+   */
+  bool begin(fs::FS &fs, const char *path, uint32_t capacity, MrdSpiArbiter *spi_bus, int core);
+
+  /**
+   * @brief Queue one frame. Never blocks.
+   *
+   * @param[in] t_us Frame time (us).
+   * @param[in] r_meridim Received Meridim (MRD_REC_MSG_BYTES).
+   * @param[in] s_meridim Sent Meridim (MRD_REC_MSG_BYTES).
+   */
+  void append(uint32_t t_us, const uint8_t *r_meridim, const uint8_t *s_meridim);
+
+  /**
+   * @brief Write out the partially filled buffer and update the file header.
+   */
+  void flush();
+
+  /**
+   * @brief Get the statistics.
+   */
+  MrdRecStats stats() const { return st; }
+
+  bool is_ready() const { return ready; }
+
+private:
+  File file;
+  MrdSpiArbiter *spi;
+  TaskHandle_t task;
+  bool ready = false;
+
+  MrdRecBlock buf[MRD_REC_BUFFERS];
+  volatile bool pending[MRD_REC_BUFFERS]; // 書き込み待ち
+  int fill_idx = 0;                       // 記録中のバッファ
+  int write_idx = 0;                      // 次に書き込むバッファ
+  uint32_t capacity = 0;
+  uint32_t next_block = 0;
+  uint32_t block_seq = 0;
+  MrdRecStats st = {0, 0, 0, 0, 0, 0, 0};
+  uint32_t window_bytes = 0;
+  uint32_t window_start_ms = 0;
+
+  bool write_at(uint32_t offset, const uint8_t *data, uint32_t len);
+  bool write_header();
+  void write_block(int idx);
+  void submit(int idx);
+  static void writer_task(void *arg);
+};
+
+#endif
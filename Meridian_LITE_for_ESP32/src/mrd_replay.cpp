@@ -0,0 +1,197 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_replay.cpp
+ * @brief   Playback of flight recorder files.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_replay.h"
+
+#define MRD_REPLAY_GAP_US 1000000 // 記録時刻がこれ以上飛んだら別の記録とみなし時刻の基準を取り直す
+
+bool MrdReplay::begin(fs::FS &fs, const char *path, bool realtime_mode, bool loop_mode, MrdSpiArbiter *spi_bus, int core)
+{
+  spi = spi_bus;
+  realtime = realtime_mode;
+  loop = loop_mode;
+
+  file = fs.open(path, "r");
+  if (!file)
+  {
+    return false;
+  }
+  MrdRecFileHeader hdr;
+  if ((file.read((uint8_t *)&hdr, sizeof(hdr)) != sizeof(hdr)) or (hdr.magic != MRD_REC_FILE_MAGIC) or (hdr.block_bytes != MRD_REC_BLOCK_BYTES) or (hdr.capacity == 0))
+  {
+    file.close();
+    return false;
+  }
+  capacity = hdr.capacity;
+
+  /* 通し番号が最大のブロックを探し, 有効なブロック数から最古のブロックを求める */
+  uint32_t seq_max = 0;
+  uint32_t newest = 0;
+  uint32_t valid = 0;
+  for (uint32_t i = 0; i < capacity; i++)
+  {
+    uint32_t head[2];
+    file.seek(MRD_REC_SECTOR + i * MRD_REC_BLOCK_BYTES);
+    if ((file.read((uint8_t *)head, sizeof(head)) == sizeof(head)) and (head[0] == MRD_REC_BLOCK_MAGIC))
+    {
+      valid++;
+      if (head[1] > seq_max)
+      {
+        seq_max = head[1];
+        newest = i;
+      }
+    }
+  }
+  if (valid == 0)
+  {
+    file.close();
+    return false;
+  }
+  first_block = (newest + 1 + capacity - valid) % capacity;
+  st.blocks_total = valid;
+
+  for (int i = 0; i < MRD_REPLAY_BUFFERS; i++)
+  {
+    filled[i] = false;
+  }
+  play_idx = 0;
+  play_rec = 0;
+  read_idx = 0;
+  read_count = 0;
+  read_good = 0;
+  eof = false;
+  finished = false;
+  anchored = false;
+  ready = true;
+  if (xTaskCreatePinnedToCore(reader_task, "mrd_replay", 4096, this, 1, &task, core) != pdPASS)
+  {
+    ready = false;
+  }
+  return ready;
+}
+
+bool MrdReplay::next(uint32_t now_us, uint8_t *r_meridim)
+{
+  if (!ready or finished)
+  {
+    return false;
+  }
+  if (!filled[play_idx])
+  {
+    if (eof)
+    {
+      finished = true;
+    }
+    else
+    {
+      st.underruns++; // 先読みが追いついていない
+    }
+    return false;
+  }
+
+  MrdRecBlock *b = &buf[play_idx];
+  const MrdRecRecord *rec = &b->records[play_rec];
+  if (realtime)
+  {
+    // 初回, 周回時, 記録の切れ目では時刻の基準を取り直す
+    uint32_t gap = rec->t_us - last_t_rec;
+    if (!anchored or (gap > MRD_REPLAY_GAP_US))
+    {
+      t_offset_us = now_us - rec->t_us;
+      anchored = true;
+    }
+    if ((int32_t)(now_us - (rec->t_us + t_offset_us)) < 0) // まだ再生時刻になっていない
+    {
+      return false;
+    }
+  }
+  memcpy(r_meridim, rec->r_meridim, MRD_REC_MSG_BYTES);
+  last_t_rec = rec->t_us;
+  st.frames++;
+
+  if (++play_rec >= b->count) // ブロックを使い切ったら読み込みタスクに返す
+  {
+    play_rec = 0;
+    filled[play_idx] = false;
+    play_idx = (play_idx + 1) % MRD_REPLAY_BUFFERS;
+    xTaskNotifyGive(task);
+  }
+  return true;
+}
+
+bool MrdReplay::read_at(uint32_t offset, uint8_t *data, uint32_t len)
+{
+  /* 1セクタずつSPIバスを確保し, 他のデバイスの待ち時間を1セクタ分に抑える */
+  bool ok = true;
+  for (uint32_t done = 0; ok and (done < len); done += MRD_REC_SECTOR)
+  {
+    uint32_t chunk = min((uint32_t)MRD_REC_SECTOR, len - done);
+    if (spi)
+    {
+      spi->acquire(MRD_SPI_DEV_SD);
+    }
+    if (done == 0)
+    {
+      ok = file.seek(offset);
+    }
+    ok = ok and (file.read(data + done, chunk) == chunk);
+    if (spi)
+    {
+      spi->release(MRD_SPI_DEV_SD);
+    }
+  }
+  return ok;
+}
+
+void MrdReplay::read_block(int idx)
+{
+  if (read_count >= st.blocks_total)
+  {
+    if (!loop or (read_good == 0)) // 1周して読めるブロックが無ければ繰り返さない
+    {
+      eof = true;
+      return;
+    }
+    read_count = 0;
+    read_good = 0;
+    st.loops++;
+  }
+  uint32_t block = (first_block + read_count) % capacity;
+  read_count++;
+
+  MrdRecBlock *b = &buf[idx];
+  uint32_t t0 = micros();
+  bool ok = read_at(MRD_REC_SECTOR + block * MRD_REC_BLOCK_BYTES, (uint8_t *)b, sizeof(MrdRecBlock));
+  uint32_t dt = micros() - t0;
+  if (dt > st.read_us_max)
+  {
+    st.read_us_max = dt;
+  }
+
+  // 壊れたブロックや空のブロックは飛ばす
+  if (!ok or (b->magic != MRD_REC_BLOCK_MAGIC) or (b->count == 0) or (b->count > MRD_REC_RECORDS_PER_BLOCK))
+  {
+    st.read_errors++;
+    return;
+  }
+  read_good++;
+  filled[idx] = true;
+  read_idx = (idx + 1) % MRD_REPLAY_BUFFERS;
+}
+
+void MrdReplay::reader_task(void *arg)
+{
+  MrdReplay *self = (MrdReplay *)arg;
+  while (1)
+  {
+    while (!self->filled[self->read_idx] and !self->eof)
+    {
+      self->read_block(self->read_idx);
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef __MERIDIAN_REPLAY__
+#define __MERIDIAN_REPLAY__
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "mrd_recorder.h"
+
+#define MRD_REPLAY_BUFFERS 4 // 先読みするブロック数
+
+/* 統計 */
+typedef struct
+{
+  uint32_t frames;       // 再生したフレーム数
+  uint32_t underruns;    // 先読みが間に合わなかった回数
+  uint32_t loops;        // 先頭に戻って再生した回数
+  uint32_t read_errors;  // 読み込み失敗回数
+  uint32_t read_us_max;  // 1ブロックの読み込みにかかった最大時間(us)
+  uint32_t blocks_total; // ファイル中の有効ブロック数
+} MrdReplayStats;
+
+/**
+ * @brief Playback of a flight recorder file (see mrd_recorder.h).
+ *        A reader task keeps MRD_REPLAY_BUFFERS blocks read ahead, so next() never touches the file.
+ *        Works on any fs::FS (SD, SPIFFS or a stand-in).
+ */
+class MrdReplay
+{
+public:
+  /**
+   * @brief Open a recorder file, find the oldest block and start the reader task.
+   *
+   * @param[in] fs File system.
+   * @param[in] path File path.
+   * @param[in] realtime true: release frames at the recorded timing, false: as fast as possible.
+   * @param[in] loop true: restart from the oldest block at the end of the file.
+   * @param[in] spi_bus SPI bus arbiter shared with the W5500, may be NULL.
+   * @param[in] core Core to pin the reader task to.
+   * @return true if the file holds at least one block.
+   */
+  bool begin(fs::FS &fs, const char *path, bool realtime, bool loop, MrdSpiArbiter *spi_bus, int core);
+
+  /**
+   * @brief Get the next received Meridim if it is due. Never blocks.
+   *
+   * @param[in] now_us Current time (us).
+   * @param[out] r_meridim Destination (MRD_REC_MSG_BYTES).
+   * @return true if a frame was copied.
+   */
+  bool next(uint32_t now_us, uint8_t *r_meridim);
+
+  /**
+   * @brief Get the statistics.
+   */
+  MrdReplayStats stats() const { return st; }
+
+  bool is_ready() const { return ready; }
+
+  /**
+   * @brief true after the last frame has been played (loop == false), or when a whole pass
+   *        over the file found no readable block.
+   */
+  bool is_finished() const { return finished; }
+
+private:
+  File file;
+  MrdSpiArbiter *spi;
+  TaskHandle_t task;
+  bool ready = false;
+  bool finished = false;
+  bool realtime = true;
+  bool loop = true;
+
+  MrdRecBlock buf[MRD_REPLAY_BUFFERS];
+  volatile bool filled[MRD_REPLAY_BUFFERS]; // 読み込み済み
+  volatile bool eof = false;                // 最後のブロックまで読み込んだ
+  int play_idx = 0;                         // 再生中のバッファ
+  int play_rec = 0;                         // 再生中のレコード
+  int read_idx = 0;                         // 次に読み込むバッファ
+  uint32_t capacity = 0;
+  uint32_t first_block = 0;  // 最古のブロック
+  uint32_t read_count = 0;   // 今回の周回で読み込んだブロック数
+  uint32_t read_good = 0;    // 今回の周回で読めたブロック数
+  bool anchored = false;     // 時刻の基準を設定済み
+  uint32_t t_offset_us = 0;  // 記録時刻から現在時刻への換算値
+  uint32_t last_t_rec = 0;   // 直前に再生したフレームの記録時刻
+  MrdReplayStats st = {0, 0, 0, 0, 0, 0};
+
+  bool read_at(uint32_t offset, uint8_t *data, uint32_t len);
+  void read_block(int idx);
+  static void reader_task(void *arg);
+};
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_spi.cpp
+ * @brief   Priority arbiter of the shared SPI bus.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_spi.h"
+
+void MrdSpiArbiter::begin()
+{
+  bus = xSemaphoreCreateMutex();
+  gate = xSemaphoreCreateMutex();
+}
+
+void MrdSpiArbiter::acquire(int dev)
+{
+  uint32_t t0 = micros();
+  if (dev == MRD_SPI_DEV_NET)
+  {
+    xSemaphoreTake(gate, portMAX_DELAY); // 後から来たSDをゲートで止める
+    xSemaphoreTake(bus, portMAX_DELAY);  // 転送中のSDの1セクタが終わるのを待つ
+  }
+  else
+  {
+    if (xSemaphoreTake(gate, 0) != pdTRUE)
+    {
+      st[dev].yields++;
+      xSemaphoreTake(gate, portMAX_DELAY);
+    }
+    xSemaphoreTake(bus, portMAX_DELAY);
+    xSemaphoreGive(gate); // ゲートは通るだけ
+  }
+  held_since = micros();
+  uint32_t wait = held_since - t0;
+  if (wait > st[dev].wait_us_max)
+  {
+    st[dev].wait_us_max = wait;
+  }
+  st[dev].grants++;
+}
+
+void MrdSpiArbiter::release(int dev)
+{
+  uint32_t hold = micros() - held_since;
+  st[dev].busy_us += hold;
+  if (hold > st[dev].hold_us_max)
+  {
+    st[dev].hold_us_max = hold;
+  }
+  xSemaphoreGive(bus);
+  if (dev == MRD_SPI_DEV_NET)
+  {
+    xSemaphoreGive(gate);
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef __MERIDIAN_SPI__
+#define __MERIDIAN_SPI__
+
+#include <Arduino.h>
+
+/*
+  SPIバスの調停 (W5500とSDカードで共有)
+  各デバイスは1回の転送(UDPパケット1つ, SDの1セクタ)ごとにバスを確保して解放する.
+  ネットワーク(W5500)はゲートを閉じてからバスを待ち, SDはゲートを通ってからバスを取る.
+  ネットワークが待っている間SDはゲートで止まるので, Meridimの送受信がSDのために待つのは
+  最大でSD転送1回分(1セクタ)になる.
+*/
+#define MRD_SPI_DEV_NET 0 // W5500 (優先)
+#define MRD_SPI_DEV_SD 1  // SDカード
+#define MRD_SPI_DEVS 2
+
+/* デバイスごとのバス使用の統計 */
+typedef struct
+{
+  uint32_t grants;      // バスを確保した回数
+  uint32_t busy_us;     // バスを保持した時間の合計(us)
+  uint32_t hold_us_max; // 1回の保持時間の最大値(us)
+  uint32_t wait_us_max; // 確保までに待った時間の最大値(us)
+  uint32_t yields;      // 優先デバイスに順番を譲った回数(ゲートで止まった回数)
+} MrdSpiStats;
+
+/**
+ * @brief Priority arbiter of the shared SPI bus.
+ *        The network device is served before the SD card whenever both wait, so a Meridim
+ *        packet waits for at most one SD transfer. Collects per-device bus occupancy.
+ */
+class MrdSpiArbiter
+{
+public:
+  /**
+   * @brief Create the bus lock. Call once before any task uses the bus.
+   */
+  void begin();
+
+  /**
+   * @brief Take the bus for one transfer. Blocks.
+   *
+   * @param[in] dev MRD_SPI_DEV_NET or MRD_SPI_DEV_SD.
+   */
+  void acquire(int dev);
+
+  /**
+   * @brief Give the bus back.
+   *
+   * @param[in] dev Same device as acquire().
+   */
+  void release(int dev);
+
+  /**
+   * @brief Get the statistics of one device.
+   */
+  MrdSpiStats stats(int dev) const { return st[dev]; }
+
+private:
+  SemaphoreHandle_t bus = NULL;  // バス本体
+  SemaphoreHandle_t gate = NULL; // ネットワークが待っている間は閉じる
+  uint32_t held_since = 0;       // 現在の保持の開始時刻(us)
+  MrdSpiStats st[MRD_SPI_DEVS] = {};
+};
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_telemetry.cpp
+ * @brief   Multirate UDP output scheduler.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_telemetry.h"
+
+void MrdTelemetry::begin(int div, bool use_fast)
+{
+  divisor = (div < 1) ? 1 : div;
+  fast = use_fast;
+  phase = 0;
+  fast_seq = 0;
+  st = {0, 0, 0, 0, 0, 0};
+  window_start_ms = millis();
+  window_bytes = 0;
+  window_full = 0;
+  window_fast = 0;
+}
+
+int MrdTelemetry::next_frame()
+{
+  if (phase == 0)
+  {
+    phase = divisor - 1;
+    return MRD_TX_FULL;
+  }
+  phase--;
+  return fast ? MRD_TX_FAST : MRD_TX_NONE;
+}
+
+void MrdTelemetry::sent(int kind, uint32_t bytes, uint32_t now_ms)
+{
+  if (kind == MRD_TX_FULL)
+  {
+    st.full_packets++;
+    window_full++;
+  }
+  else if (kind == MRD_TX_FAST)
+  {
+    st.fast_packets++;
+    window_fast++;
+  }
+  st.bytes += bytes;
+  window_bytes += bytes;
+
+  // 1秒ごとに送信レートを更新
+  if (now_ms - window_start_ms >= 1000)
+  {
+    uint32_t dt = now_ms - window_start_ms;
+    st.bytes_per_sec = (uint32_t)((uint64_t)window_bytes * 1000 / dt);
+    st.full_per_sec = (uint32_t)((uint64_t)window_full * 1000 / dt);
+    st.fast_per_sec = (uint32_t)((uint64_t)window_fast * 1000 / dt);
+    window_start_ms = now_ms;
+    window_bytes = 0;
+    window_full = 0;
+    window_fast = 0;
+  }
+}
+
+int MrdTelemetry::pack_fast(short *out, const short *meridim, const unsigned char *fields, int num)
+{
+  if (num > MRD_FAST_MAX_FIELDS)
+  {
+    num = MRD_FAST_MAX_FIELDS;
+  }
+  out[0] = (short)MRD_FAST_MAGIC;
+  out[1] = (short)fast_seq;
+  fast_seq = (fast_seq >= 59999) ? 0 : fast_seq + 1;
+  for (int i = 0; i < num; i++)
+  {
+    out[i + 2] = meridim[fields[i]];
+  }
+
+  int sum = 0;
+  for (int i = 0; i < num + 2; i++)
+  {
+    sum += out[i];
+  }
+  out[num + 2] = (short)~sum;
+  return (num + 3) * 2;
+}
@@ -0,0 +1,90 @@
+#ifndef __MERIDIAN_TELEMETRY__
+#define __MERIDIAN_TELEMETRY__
+
+#include <Arduino.h>
+
+/*
+  高速項目パケットの形式 (short配列, リトルエンディアン)
+  [0]       MRD_FAST_MAGIC
+  [1]       送信通し番号(0-59999)
+  [2]-[n+1] Meridimから抜き出した n 個の項目(UDP_FAST_FIELDS の順)
+  [n+2]     チェックサム([0]-[n+1]の合計のビット反転. Meridimと同じ計算)
+*/
+#define MRD_FAST_MAGIC 0x464D     // "MF"
+#define MRD_FAST_MAX_FIELDS 32    // 高速項目の最大数
+
+/* 今フレームで送るもの */
+#define MRD_TX_NONE 0 // 送信なし
+#define MRD_TX_FULL 1 // Meridim全体
+#define MRD_TX_FAST 2 // 高速項目のみ
+
+/* 送信統計 */
+typedef struct
+{
+  uint32_t full_packets;   // Meridim全体の送信数
+  uint32_t fast_packets;   // 高速項目パケットの送信数
+  uint32_t bytes;          // 送信バイト数の累計
+  uint32_t bytes_per_sec;  // 直近1秒の送信バイト数
+  uint32_t full_per_sec;   // 直近1秒のMeridim全体の送信数
+  uint32_t fast_per_sec;   // 直近1秒の高速項目パケットの送信数
+} MrdTxStats;
+
+/**
+ * @brief Multirate UDP output scheduler.
+ *        The full Meridim goes out every `divisor` frames; on the frames in between
+ *        an optional compact packet carries only the selected fast fields.
+ *        Only decides and counts; the sending itself stays with the caller.
+ */
+class MrdTelemetry
+{
+public:
+  /**
+   * @brief Reset the schedule.
+   *
+   * @param[in] divisor Send the full Meridim every this many frames (1 = every frame).
+   * @param[in] fast Send the compact packet on the other frames.
+   */
+  void begin(int divisor, bool fast);
+
+  /**
+   * @brief Advance one control frame and get what to send in it.
+   *
+   * @return int MRD_TX_FULL, MRD_TX_FAST or MRD_TX_NONE.
+   */
+  int next_frame();
+
+  /**
+   * @brief Count a sent packet.
+   *
+   * @param[in] kind MRD_TX_FULL or MRD_TX_FAST.
+   * @param[in] bytes Payload size.
+   * @param[in] now_ms Current time (ms) for the 1 s rate window.
+   */
+  void sent(int kind, uint32_t bytes, uint32_t now_ms);
+
+  /**
+   * @brief Build the compact packet from a Meridim.
+   *
+   * @param[out] out Packet (MRD_FAST_MAX_FIELDS + 3 shorts).
+   * @param[in] meridim Source Meridim.
+   * @param[in] fields Meridim indexes to copy.
+   * @param[in] num Number of fields (up to MRD_FAST_MAX_FIELDS).
+   * @return int Packet size in bytes.
+   */
+  int pack_fast(short *out, const short *meridim, const unsigned char *fields, int num);
+
+  MrdTxStats stats() const { return st; }
+
+private:
+  int divisor = 1;
+  bool fast = false;
+  int phase = 0;            // 次のMeridim全体の送信までのフレーム数
+  int fast_seq = 0;         // 高速項目パケットの通し番号
+  MrdTxStats st = {0, 0, 0, 0, 0, 0};
+  uint32_t window_start_ms = 0;
+  uint32_t window_bytes = 0;
+  uint32_t window_full = 0;
+  uint32_t window_fast = 0;
+};
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_traj.cpp
+ * @brief   Queue of per-joint cubic trajectory segments.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_traj.h"
+
+#include <cstring>
+
+void MrdTraj::begin(long a_frame_us, const short *pose)
+{
+  frame_us = (a_frame_us > 0) ? a_frame_us : 10000;
+  memcpy(hold, pose, sizeof(hold));
+  for (int i = 0; i < MRD_TRAJ_AXES; i++)
+  {
+    tail_pos[i] = pose[i];
+    tail_vel[i] = 0;
+  }
+  head = 0;
+  count = 0;
+  running = false;
+  clock = 0;
+  tail_valid = false;
+  st = {0, 0, 0, 0, 0, 0};
+}
+
+bool MrdTraj::push(const short *end_pos, const short *end_vel, uint16_t start, int frames)
+{
+  if (frames < 1)
+  {
+    frames = 1;
+  }
+  if (frames > MRD_TRAJ_MAX_FRAMES)
+  {
+    frames = MRD_TRAJ_MAX_FRAMES;
+  }
+  if (tail_valid and (start == tail_start)) // 同じパケットが再送された
+  {
+    st.duplicates++;
+    return false;
+  }
+  if (count >= MRD_TRAJ_QUEUE)
+  {
+    st.overflows++;
+    return false;
+  }
+  tail_start = start;
+  tail_valid = true;
+
+  if (!running) // 最初の区間の開始時刻に時計を合わせる
+  {
+    running = true;
+    clock = start;
+  }
+  else if ((count == 0) and ((int16_t)(start - clock) < 0)) // 開始時刻に間に合わなかった区間は今から始める
+  {
+    start = clock;
+    st.late++;
+  }
+
+  // 始点(前の区間の終点)と終点の角度・角速度から3次エルミート曲線の係数を作る (Q8)
+  Segment &seg = q[(head + count) % MRD_TRAJ_QUEUE];
+  seg.start = start;
+  seg.frames = frames;
+  for (int i = 0; i < MRD_TRAJ_AXES; i++)
+  {
+    int64_t p0 = (int64_t)tail_pos[i] << 8;
+    int64_t p1 = (int64_t)end_pos[i] << 8;
+    int64_t v1 = ((int64_t)end_vel[i] * 10 * frame_us * 65536) / 1000000; // degree x 100 / frame (Q16)
+    int64_t tv0 = (tail_vel[i] * frames) >> 8;
+    int64_t tv1 = (v1 * frames) >> 8;
+    seg.c[i][0] = 2 * p0 + tv0 - 2 * p1 + tv1;
+    seg.c[i][1] = -3 * p0 - 2 * tv0 + 3 * p1 - tv1;
+    seg.c[i][2] = tv0;
+    seg.c[i][3] = p0;
+    tail_pos[i] = end_pos[i];
+    tail_vel[i] = v1;
+  }
+  count++;
+  st.segments++;
+  st.queued = count;
+  return true;
+}
+
+bool MrdTraj::push_meridim(const short *meridim)
+{
+  short pos[MRD_TRAJ_AXES];
+  short vel[MRD_TRAJ_AXES];
+  for (int i = 0; i < 15; i++)
+  {
+    pos[i] = meridim[20 + i * 2];
+    vel[i] = meridim[21 + i * 2];
+    pos[i + 15] = meridim[50 + i * 2];
+    vel[i + 15] = meridim[51 + i * 2];
+  }
+  return push(pos, vel, (uint16_t)meridim[80], meridim[81]);
+}
+
+void MrdTraj::step(short *pose)
+{
+  if (count == 0)
+  {
+    memcpy(pose, hold, sizeof(hold));
+    if (running)
+    {
+      st.idle++;
+      clock++;
+      for (int i = 0; i < MRD_TRAJ_AXES; i++) // 止まったので次の区間は速度0から始める
+      {
+        tail_vel[i] = 0;
+      }
+    }
+    return;
+  }
+
+  const Segment &seg = q[head];
+  int k = (int16_t)(clock - seg.start) + 1; // このフレームの終わりでの区間内の経過フレーム数
+  clock++;
+  if (k <= 0) // まだ開始時刻になっていない
+  {
+    memcpy(pose, hold, sizeof(hold));
+    st.idle++;
+    return;
+  }
+  if (k >= seg.frames) // 区間の終点
+  {
+    eval(seg, 65536, pose);
+    memcpy(hold, pose, sizeof(hold));
+    head = (head + 1) % MRD_TRAJ_QUEUE;
+    count--;
+    st.queued = count;
+    return;
+  }
+  eval(seg, (int32_t)(((int64_t)k << 16) / seg.frames), pose);
+}
+
+void MrdTraj::eval(const Segment &seg, int32_t s, short *pose) const
+{
+  for (int i = 0; i < MRD_TRAJ_AXES; i++)
+  {
+    int64_t acc = seg.c[i][0];
+    acc = ((acc * s) >> 16) + seg.c[i][1];
+    acc = ((acc * s) >> 16) + seg.c[i][2];
+    acc = ((acc * s) >> 16) + seg.c[i][3];
+    acc = (acc + 128) >> 8;
+    pose[i] = (short)((acc > 32767) ? 32767 : (acc < -32768) ? -32768 : acc);
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef __MERIDIAN_TRAJ__
+#define __MERIDIAN_TRAJ__
+
+#include <cstdint>
+
+/*
+  軌道セグメントのMeridim (マスターコマンド MCMD_TRAJ_SEGMENT)
+  [20+i*2] / [50+i*2]  L/R系統 i番サーボの区間終点の角度 (degree x 100)
+  [21+i*2] / [51+i*2]  L/R系統 i番サーボの区間終点の角速度 (degree/s x 10)
+  [80]                 区間の開始時刻 (PC側のフレーム番号, 0-65535で一周)
+  [81]                 区間の長さ (フレーム数, 1-4095)
+  区間の始点は1つ前の区間の終点(角度と角速度)で, 各軸を3次エルミート曲線で結ぶ.
+  受信したセグメントは小さなキューに入れ, 制御周期ごとに現在の区間を評価する.
+*/
+#define MRD_TRAJ_AXES 30       // 軸数(L系統15+R系統15)
+#define MRD_TRAJ_QUEUE 8       // キューに入る区間の数
+#define MRD_TRAJ_MAX_FRAMES 4095
+
+/* 軌道セグメントの統計 */
+typedef struct
+{
+  uint32_t segments;   // 受け付けた区間の数
+  uint32_t late;       // 開始時刻を過ぎて届き, 届いた時点から始めた区間の数
+  uint32_t overflows;  // キューが一杯で捨てた区間の数
+  uint32_t duplicates; // 同じ開始時刻で重複して届き捨てた区間の数
+  uint32_t idle;       // 次の区間が無く終点で止まっていたフレーム数
+  int queued;          // 現在キューにある区間の数
+} MrdTrajStats;
+
+/**
+ * @brief Queue of per-joint cubic segments evaluated every control frame.
+ *        Each segment ends at a position and velocity per joint; it starts where the
+ *        previous one ended, so the trajectory stays continuous in position and velocity.
+ *        Evaluation is in fixed point (Q16 time, degree x 100 positions).
+ */
+class MrdTraj
+{
+public:
+  /**
+   * @brief Reset the queue. The trajectory holds `pose` until the first segment.
+   *
+   * @param[in] frame_us Control frame period (us), to convert velocities.
+   * @param[in] pose Current pose (MRD_TRAJ_AXES values, degree x 100).
+   */
+  void begin(long frame_us, const short *pose);
+
+  /**
+   * @brief Queue one segment.
+   *
+   * @param[in] end_pos End position per joint (degree x 100).
+   * @param[in] end_vel End velocity per joint (degree/s x 10).
+   * @param[in] start Start time (PC frame number).
+   * @param[in] frames Duration (frames).
+   * @return true Queued.
+   */
+  bool push(const short *end_pos, const short *end_vel, uint16_t start, int frames);
+
+  /**
+   * @brief Queue the segment carried by a Meridim (layout above).
+   *
+   * @param[in] meridim Meridim90.
+   * @return true Queued.
+   */
+  bool push_meridim(const short *meridim);
+
+  /**
+   * @brief Advance one control frame and evaluate the trajectory.
+   *
+   * @param[out] pose Pose of this frame (MRD_TRAJ_AXES values, degree x 100).
+   */
+  void step(short *pose);
+
+  MrdTrajStats stats() const { return st; }
+
+private:
+  struct Segment
+  {
+    uint16_t start;
+    int frames;
+    int64_t c[MRD_TRAJ_AXES][4]; // p(s) = ((c0 s + c1) s + c2) s + c3, s は Q16, 係数はQ8 (速度の大きい長い区間は32ビットを超える)
+  };
+
+  void eval(const Segment &seg, int32_t s, short *pose) const;
+
+  Segment q[MRD_TRAJ_QUEUE];
+  int head = 0;
+  int count = 0;
+  bool running = false;            // 時刻が進んでいるか(最初の区間を受けて開始)
+  uint16_t clock = 0;              // 現在の時刻(PC側のフレーム番号)
+  long frame_us = 10000;
+  int32_t tail_pos[MRD_TRAJ_AXES]; // 最後に入れた区間の終点の角度 (degree x 100)
+  int64_t tail_vel[MRD_TRAJ_AXES]; // 最後に入れた区間の終点の角速度 (degree x 100 / frame, Q16)
+  uint16_t tail_start = 0;
+  bool tail_valid = false;
+  short hold[MRD_TRAJ_AXES];       // 区間が無いときの姿勢
+  MrdTrajStats st = {0, 0, 0, 0, 0, 0};
+};
+
+#endif
@@ -0,0 +1,384 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/src/mrd_w5500.cpp
+ * @brief   W5500 UDP socket with variable length data mode bursts.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_w5500.h"
+
+/* ソケット0のレジスタ (W5500データシート 4.2) */
+#define W5500_SOCK 0
+#define W5500_BSB_SREG (W5500_SOCK * 4 + 1) // ソケットレジスタのブロック
+#define W5500_BSB_TXBUF (W5500_SOCK * 4 + 2)
+#define W5500_BSB_RXBUF (W5500_SOCK * 4 + 3)
+#define W5500_RWB_WRITE 0x04
+#define W5500_BSB_COMMON 0
+#define W5500_BSB_TUNE_SREG (7 * 4 + 1) // クロック調整の試験に使うソケット7
+#define W5500_BSB_TUNE_TXBUF (7 * 4 + 2)
+#define W5500_VERSIONR 0x0039
+#define W5500_VERSION 0x04
+
+#define Sn_MR 0x0000
+#define Sn_CR 0x0001
+#define Sn_IR 0x0002
+#define Sn_SR 0x0003
+#define Sn_PORT 0x0004
+#define Sn_DIPR 0x000C
+#define Sn_TXBUF_SIZE 0x001F
+#define Sn_TX_WR 0x0024
+#define Sn_RX_RSR 0x0026
+#define Sn_RX_RD 0x0028
+
+#define Sn_MR_UDP 0x02
+#define Sn_CR_OPEN 0x01
+#define Sn_CR_CLOSE 0x10
+#define Sn_CR_SEND 0x20
+#define Sn_CR_RECV 0x40
+#define Sn_IR_SEND_OK 0x10
+#define Sn_IR_TIMEOUT 0x08
+#define SOCK_UDP 0x22
+
+#define W5500_CMD_TIMEOUT_US 2000 // コマンドの受付とSENDの完了(ARPを含む)を待つ上限
+
+/* SPIクロックの調整 */
+#define W5500_TUNE_APB_HZ 80000000 // ESP32のSPIクロックはAPB 80MHzの整数分の1で速い方の段が決まる
+#define W5500_SPEC_HZ 33333333     // W5500のデータシートで保証されるSPIクロックの上限
+#define W5500_TUNE_ROUNDS 4        // 1段あたりの試験回数
+#define W5500_TUNE_CONFIRM_ROUNDS 32 // 選んだクロックの確認の試験回数
+#define W5500_TUNE_BURST 256       // バッファ折り返し試験の長さ(byte)
+
+void MrdW5500Udp::frame_write(uint16_t addr, uint8_t block, uint8_t *buf, uint16_t len)
+{
+  buf[0] = addr >> 8;
+  buf[1] = addr & 0xFF;
+  buf[2] = (block << 3) | W5500_RWB_WRITE; // 可変長データモード
+  digitalWrite(cs, LOW);
+  SPI.writeBytes(buf, 3 + len);
+  digitalWrite(cs, HIGH);
+}
+
+void MrdW5500Udp::frame_read(uint16_t addr, uint8_t block, uint8_t *buf, uint16_t len)
+{
+  buf[0] = addr >> 8;
+  buf[1] = addr & 0xFF;
+  buf[2] = block << 3;
+  digitalWrite(cs, LOW);
+  SPI.transfer(buf, 3 + len); // 受信したデータで上書きされる. データは buf[3] から
+  digitalWrite(cs, HIGH);
+}
+
+uint8_t MrdW5500Udp::read8(uint16_t addr)
+{
+  uint8_t b[4];
+  frame_read(addr, W5500_BSB_SREG, b, 1);
+  return b[3];
+}
+
+uint16_t MrdW5500Udp::read16(uint16_t addr)
+{
+  uint8_t b[5];
+  frame_read(addr, W5500_BSB_SREG, b, 2);
+  return (uint16_t)((b[3] << 8) | b[4]);
+}
+
+uint16_t MrdW5500Udp::read16_stable(uint16_t addr)
+{
+  // 受信中にW5500が更新する途中の値を読むことがあるため, 2回続けて同じ値になるまで読む(データシートの手順, Ethernet2と同じ)
+  uint16_t v = read16(addr);
+  uint16_t prev;
+  do
+  {
+    prev = v;
+    v = read16(addr);
+  } while (v != prev);
+  return v;
+}
+
+void MrdW5500Udp::write8(uint16_t addr, uint8_t v)
+{
+  uint8_t b[4];
+  b[3] = v;
+  frame_write(addr, W5500_BSB_SREG, b, 1);
+}
+
+void MrdW5500Udp::write16(uint16_t addr, uint16_t v)
+{
+  uint8_t b[5];
+  b[3] = v >> 8;
+  b[4] = v & 0xFF;
+  frame_write(addr, W5500_BSB_SREG, b, 2);
+}
+
+bool MrdW5500Udp::wait_command()
+{
+  unsigned long t0 = micros();
+  while (read8(Sn_CR) != 0)
+  {
+    if ((unsigned long)(micros() - t0) > W5500_CMD_TIMEOUT_US)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MrdW5500Udp::begin(uint16_t port, uint8_t cs_pin, uint32_t spi_hz)
+{
+  cs = cs_pin;
+  settings = SPISettings(spi_hz, MSBFIRST, SPI_MODE0);
+  pinMode(cs, OUTPUT);
+  digitalWrite(cs, HIGH);
+
+  SPI.beginTransaction(settings);
+  write8(Sn_CR, Sn_CR_CLOSE);
+  wait_command();
+  write8(Sn_MR, Sn_MR_UDP);
+  write16(Sn_PORT, port);
+  write8(Sn_CR, Sn_CR_OPEN);
+  wait_command();
+  bool ok = (read8(Sn_SR) == SOCK_UDP);
+  tx_cap = min((uint16_t)(read8(Sn_TXBUF_SIZE) * 1024), (uint16_t)MRD_W5500_MAX_PACKET);
+  uint8_t b[3 + 6];
+  frame_read(Sn_TX_WR, W5500_BSB_SREG, b, 6); // Sn_TX_WR, Sn_RX_RSR, Sn_RX_RD
+  tx_wr = (uint16_t)((b[3] << 8) | b[4]);
+  rx_rd = (uint16_t)((b[7] << 8) | b[8]);
+  SPI.endTransaction();
+
+  sending = false;
+  memset(dest_reg, 0, sizeof(dest_reg));
+  rx_len = 0;
+  rx_pos = 0;
+  return ok;
+}
+
+bool MrdW5500Udp::verify_clock(uint32_t hz, int rounds)
+{
+  static uint32_t seed = 2463534242UL; // 試験パターンの乱数 (xorshift)
+  static uint8_t pattern[3 + W5500_TUNE_BURST];
+  static uint8_t back[3 + W5500_TUNE_BURST];
+  const uint8_t fixed[] = {0x00, 0xFF, 0x55, 0xAA, 0x01, 0x80, 0xFE, 0x7F};
+
+  settings = SPISettings(hz, MSBFIRST, SPI_MODE0);
+  SPI.beginTransaction(settings);
+  bool ok = true;
+  for (int r = 0; ok and (r < rounds); r++)
+  {
+    /* バージョンレジスタの読み出し */
+    uint8_t v[3 + 1];
+    frame_read(W5500_VERSIONR, W5500_BSB_COMMON, v, 1);
+    ok = (v[3] == W5500_VERSION);
+
+    /* レジスタの書き込みと読み出し(Sn_DIPRからSn_DPORTの6byte) */
+    for (int i = 0; ok and (i < (int)sizeof(fixed)); i++)
+    {
+      uint8_t w[3 + 6], b[3 + 6];
+      for (int k = 0; k < 6; k++)
+      {
+        w[3 + k] = fixed[(i + k) % sizeof(fixed)];
+      }
+      frame_write(Sn_DIPR, W5500_BSB_TUNE_SREG, w, 6);
+      frame_read(Sn_DIPR, W5500_BSB_TUNE_SREG, b, 6);
+      ok = (memcmp(w + 3, b + 3, 6) == 0);
+    }
+
+    /* 送信バッファへの書き込みと読み出し. 位置をずらして折り返しも通す */
+    for (int k = 0; k < W5500_TUNE_BURST; k++)
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      pattern[3 + k] = (uint8_t)seed;
+    }
+    uint16_t at = (uint16_t)(seed >> 8);
+    if (ok)
+    {
+      frame_write(at, W5500_BSB_TUNE_TXBUF, pattern, W5500_TUNE_BURST);
+      frame_read(at, W5500_BSB_TUNE_TXBUF, back, W5500_TUNE_BURST);
+      ok = (memcmp(pattern + 3, back + 3, W5500_TUNE_BURST) == 0);
+    }
+  }
+  uint8_t z[3 + 6] = {0};
+  frame_write(Sn_DIPR, W5500_BSB_TUNE_SREG, z, 6); // ソケット7のレジスタを戻す
+  SPI.endTransaction();
+  return ok;
+}
+
+uint32_t MrdW5500Udp::tune_clock(uint8_t cs_pin, uint32_t hz_min, uint32_t hz_max, int margin)
+{
+  cs = cs_pin;
+  pinMode(cs, OUTPUT);
+  digitalWrite(cs, HIGH);
+
+  /* 段: hz_min, その上の80MHz/nのクロック(遅い順) */
+  uint32_t steps[W5500_TUNE_APB_HZ / 1000000];
+  int n_steps = 0;
+  hz_max = min(hz_max, (uint32_t)W5500_SPEC_HZ); // 保証外のクロックは試さない
+  steps[n_steps++] = hz_min;
+  for (uint32_t div = W5500_TUNE_APB_HZ / hz_min; div >= 2; div--)
+  {
+    uint32_t hz = W5500_TUNE_APB_HZ / div;
+    if ((hz > hz_min) and (hz <= hz_max) and (n_steps < (int)(sizeof(steps) / sizeof(steps[0]))))
+    {
+      steps[n_steps++] = hz;
+    }
+  }
+
+  int best = -1;
+  for (int i = 0; i < n_steps; i++)
+  {
+    if (!verify_clock(steps[i], W5500_TUNE_ROUNDS))
+    {
+      break; // これより速いクロックは試さない
+    }
+    best = i;
+  }
+  if (best < 0)
+  {
+    return 0;
+  }
+
+  /* 余裕の段数だけ下げ, 長めの試験で確認する. 通らなければさらに下げる */
+  for (int i = max(best - margin, 0); i >= 0; i--)
+  {
+    if (verify_clock(steps[i], W5500_TUNE_CONFIRM_ROUNDS))
+    {
+      return steps[i];
+    }
+  }
+  return 0;
+}
+
+int MrdW5500Udp::beginPacket(IPAddress ip, uint16_t port)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    dest[i] = ip[i];
+  }
+  dest[4] = port >> 8;
+  dest[5] = port & 0xFF;
+  tx_len = 0;
+  return 1;
+}
+
+int MrdW5500Udp::beginPacket(const char *host, uint16_t port)
+{
+  IPAddress ip;
+  if (!ip.fromString(host))
+  {
+    tx_len = 0;
+    return 0;
+  }
+  return beginPacket(ip, port);
+}
+
+size_t MrdW5500Udp::write(const uint8_t *buf, size_t len)
+{
+  size_t n = min(len, (size_t)(tx_cap - tx_len));
+  memcpy(tx_stage + 3 + tx_len, buf, n);
+  tx_len += n;
+  return n;
+}
+
+int MrdW5500Udp::endPacket()
+{
+  if (tx_len <= 0)
+  {
+    return 0;
+  }
+  SPI.beginTransaction(settings);
+
+  /* 前回のSENDが終わるまで待つ(通常は前のフレームで終わっているので1回で済む). Sn_CRとSn_IRは隣り合う */
+  uint8_t st[3 + 2];
+  unsigned long t0 = micros();
+  while (true)
+  {
+    frame_read(Sn_CR, W5500_BSB_SREG, st, 2);
+    if ((st[3] == 0) and (!sending or (st[4] & (Sn_IR_SEND_OK | Sn_IR_TIMEOUT))))
+    {
+      break;
+    }
+    if ((unsigned long)(micros() - t0) > W5500_CMD_TIMEOUT_US)
+    {
+      SPI.endTransaction();
+      sending = false; // 完了が確認できなくても次のパケットでは待たない
+      return 0;
+    }
+  }
+
+  if (memcmp(dest, dest_reg, sizeof(dest)) != 0) // Sn_DIPRとSn_DPORTは連続している
+  {
+    uint8_t b[3 + 6];
+    memcpy(b + 3, dest, sizeof(dest));
+    frame_write(Sn_DIPR, W5500_BSB_SREG, b, sizeof(dest));
+    memcpy(dest_reg, dest, sizeof(dest));
+  }
+
+  frame_write(tx_wr, W5500_BSB_TXBUF, tx_stage, tx_len); // 送信バッファの端はW5500が折り返す
+  tx_wr += tx_len;
+  write16(Sn_TX_WR, tx_wr);
+
+  /* SENDの後に前回の完了フラグを消す(Sn_CRの次がSn_IR). 今回の完了はこのフレームの間には立たない */
+  uint8_t b[3 + 2];
+  b[3] = Sn_CR_SEND;
+  b[4] = sending ? (st[4] & (Sn_IR_SEND_OK | Sn_IR_TIMEOUT)) : 0;
+  frame_write(Sn_CR, W5500_BSB_SREG, b, 2);
+  SPI.endTransaction();
+  sending = true;
+  return 1;
+}
+
+int MrdW5500Udp::parsePacket()
+{
+  rx_len = 0;
+  rx_pos = 0;
+  SPI.beginTransaction(settings);
+  uint16_t rsr = read16_stable(Sn_RX_RSR);
+  if (rsr < 8)
+  {
+    SPI.endTransaction();
+    return 0;
+  }
+
+  /* ヘッダと前回と同じ長さのデータを1フレームで読む. 長かった場合のみ残りを読み足す */
+  uint16_t n = min(rsr, (uint16_t)(8 + min(rx_expect, (uint16_t)MRD_W5500_MAX_PACKET)));
+  frame_read(rx_rd, W5500_BSB_RXBUF, rx_stage, n);
+  uint16_t len = (uint16_t)((rx_stage[9] << 8) | rx_stage[10]);
+  if (8 + len > rsr) // ヘッダが壊れている. 受信バッファを捨てて読み直しに備える
+  {
+    rx_rd += rsr;
+    write16(Sn_RX_RD, rx_rd);
+    write8(Sn_CR, Sn_CR_RECV);
+    SPI.endTransaction();
+    return 0;
+  }
+  uint16_t keep = min(len, (uint16_t)MRD_W5500_MAX_PACKET);
+  if (8 + keep > n)
+  {
+    uint8_t *tail = rx_stage + n; // 読み足す部分の直前3byteをヘッダに使い, 後で戻す
+    uint8_t save[3];
+    memcpy(save, tail, 3);
+    frame_read(rx_rd + n, W5500_BSB_RXBUF, tail, 8 + keep - n);
+    memcpy(tail, save, 3);
+  }
+  rx_rd += 8 + len;
+  write16(Sn_RX_RD, rx_rd);
+  write8(Sn_CR, Sn_CR_RECV);
+  SPI.endTransaction();
+
+  rx_expect = len;
+  rx_len = keep;
+  return len;
+}
+
+int MrdW5500Udp::read(unsigned char *buf, size_t len)
+{
+  int n = min((int)len, rx_len - rx_pos);
+  if (n <= 0)
+  {
+    return -1;
+  }
+  memcpy(buf, rx_stage + 3 + 8 + rx_pos, n);
+  rx_pos += n;
+  return n;
+}
@@ -0,0 +1,119 @@
+#ifndef __MERIDIAN_W5500__
+#define __MERIDIAN_W5500__
+
+#include <Arduino.h>
+#include <SPI.h>
+
+/*
+  W5500のUDPソケットを直接扱うドライバ (EthernetUDPの代わり)
+  Ethernet2はレジスタやバッファを1バイトずつSPI転送し, 16bitレジスタの読み出しや完了待ちのたびに
+  フレームを分けるため, 180byteのMeridim1つに送信14回以上, 受信24回のSPIフレームを使う.
+  このドライバはW5500の可変長データモード(VDM)で, 連続したレジスタやバッファを1フレームにまとめて転送する.
+    送信: [前回のSENDの完了確認] [送信バッファへの書き込み] [Sn_TX_WR] [Sn_CR=SEND] の4フレーム
+          (宛先が変わった時のみ [Sn_DIPR/Sn_DPORT] を追加)
+    受信: [Sn_RX_RSR]x2 [ヘッダ+データ] [Sn_RX_RD] [Sn_CR=RECV] の5フレーム (受信が無ければ2フレーム)
+          (Sn_RX_RSRは更新途中の値を読むことがあるため, 2回続けて一致するまで読む)
+  パケット1つの転送は1回のSPIトランザクションで行う. チップの初期化(MAC, IP)はEthernet2のEthernet.begin()を使う.
+*/
+#define MRD_W5500_MAX_PACKET 1472 // UDPデータの最大長 (MTU 1500)
+
+/**
+ * @brief UDP socket of the W5500 driven with variable length data mode bursts.
+ *        Same calls as EthernetUDP for the parts main.cpp uses.
+ */
+class MrdW5500Udp
+{
+public:
+  /**
+   * @brief Open socket 0 of the W5500 as a UDP socket.
+   *
+   * @param[in] port Local port.
+   * @param[in] cs_pin CS pin of the W5500.
+   * @param[in] spi_hz SPI clock.
+   * @return true if the socket is open.
+   */
+  bool begin(uint16_t port, uint8_t cs_pin, uint32_t spi_hz);
+
+  /**
+   * @brief Find the SPI clock for begin(). Steps the clock up from hz_min through the ESP32's
+   *        80MHz/n clocks up to hz_max (at most the 33.3MHz of the datasheet) and checks each step with register write/readback patterns
+   *        and a socket buffer loopback. Stops at the first step that fails, goes margin steps
+   *        below the highest one that passed and checks it again with more rounds.
+   *        Call after Ethernet.begin(). Uses the registers and TX buffer of socket 7.
+   *
+   * @param[in] cs_pin CS pin of the W5500.
+   * @return Chosen clock, 0 if the W5500 does not answer correctly even at hz_min.
+   */
+  uint32_t tune_clock(uint8_t cs_pin, uint32_t hz_min, uint32_t hz_max, int margin);
+
+  /**
+   * @brief Start a packet to ip:port. The destination registers are only written when it changes.
+   */
+  int beginPacket(IPAddress ip, uint16_t port);
+
+  /**
+   * @brief Start a packet to a dotted decimal address (no DNS).
+   *
+   * @return 0 if host is not an IPv4 address.
+   */
+  int beginPacket(const char *host, uint16_t port);
+
+  /**
+   * @brief Append data to the packet (up to MRD_W5500_MAX_PACKET).
+   */
+  size_t write(const uint8_t *buf, size_t len);
+
+  /**
+   * @brief Send the packet.
+   *
+   * @return 1 if the packet was handed to the W5500.
+   */
+  int endPacket();
+
+  /**
+   * @brief Receive the next packet into the driver's buffer.
+   *
+   * @return Size of the packet, 0 if none.
+   */
+  int parsePacket();
+
+  /**
+   * @brief Copy data of the received packet.
+   *
+   * @return Number of bytes copied, -1 if nothing is left.
+   */
+  int read(unsigned char *buf, size_t len);
+  int read(char *buf, size_t len) { return read((unsigned char *)buf, len); }
+  int available() { return rx_len - rx_pos; }
+
+  IPAddress remoteIP() { return IPAddress(rx_stage[3], rx_stage[4], rx_stage[5], rx_stage[6]); }
+  uint16_t remotePort() { return (uint16_t)((rx_stage[7] << 8) | rx_stage[8]); }
+
+private:
+  void frame_write(uint16_t addr, uint8_t block, uint8_t *buf, uint16_t len); // buf[0..2]はヘッダ用
+  void frame_read(uint16_t addr, uint8_t block, uint8_t *buf, uint16_t len);  // buf[0..2]はヘッダ用
+  uint8_t read8(uint16_t addr);
+  uint16_t read16(uint16_t addr);
+  uint16_t read16_stable(uint16_t addr); // Sn_RX_RSR用. 2回続けて一致するまで読む
+  void write8(uint16_t addr, uint8_t v);
+  void write16(uint16_t addr, uint16_t v);
+  bool wait_command();
+  bool verify_clock(uint32_t hz, int rounds);
+
+  uint8_t cs = 5;
+  SPISettings settings;
+  uint16_t tx_wr = 0;             // 送信バッファの書き込み位置
+  uint16_t rx_rd = 0;             // 受信バッファの読み出し位置
+  uint16_t tx_cap = 0;            // 1パケットの上限(送信バッファの大きさとMRD_W5500_MAX_PACKETの小さい方)
+  bool sending = false;           // 完了を確認していないSENDがある
+  uint8_t dest[6] = {0};          // 宛先 (Sn_DIPR, Sn_DPORTと同じ並び)
+  uint8_t dest_reg[6] = {0};      // W5500に書き込み済みの宛先
+  uint16_t rx_expect = MRD_W5500_MAX_PACKET; // 前回の受信サイズ. ヘッダと一緒に読む長さに使う
+  int tx_len = 0;
+  int rx_len = 0;
+  int rx_pos = 0;
+  uint8_t tx_stage[3 + MRD_W5500_MAX_PACKET];     // [ヘッダ3byte][データ]
+  uint8_t rx_stage[3 + 8 + MRD_W5500_MAX_PACKET]; // [ヘッダ3byte][IP4 ポート2 長さ2][データ]
+};
+
+#endif
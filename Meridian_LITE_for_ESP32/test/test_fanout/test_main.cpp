@@ -0,0 +1,337 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_fanout/test_main.cpp
+ * @brief   Checks the subscriber fan-out (src/mrd_fanout.h): rate divisors, field mask packing,
+ *          shared packet buffers and unsubscribe, on the table itself and over UDP loopback
+ *          through the unmodified setup()/loop().
+ *
+ *   pio test -e native -f test_fanout
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config.h"
+#include "keys.h"
+#include "mrd_fanout.h"
+#include "sim.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// MCMD_SUBSCRIBE/MCMD_UNSUBSCRIBEのパラメータ (宛先は0.0.0.0 = コマンドの送信元)
+static void sub_params(short *p, uint16_t port, int divisor, uint16_t r0, uint16_t r1)
+{
+  memset(p, 0, MRD_SUB_PARAMS * sizeof(short));
+  p[2] = (short)port;
+  p[3] = (short)divisor;
+  p[4] = (short)r0;
+  p[5] = (short)r1;
+}
+
+static uint16_t range(int first, int count)
+{
+  return (uint16_t)(first | (count << 8));
+}
+
+static bool checksum_ok(const short *p, int words)
+{
+  int sum = 0;
+  for (int i = 0; i < words - 1; i++)
+  {
+    sum += p[i];
+  }
+  return p[words - 1] == (short)~sum;
+}
+
+// 購読者ごとの頻度: 登録したフレームから divisor フレームに1回
+void test_divisor(void)
+{
+  static MrdFanout fan;
+  fan.begin();
+  IPAddress pc(192, 168, 7, 18);
+  short p[MRD_SUB_PARAMS];
+  short meridim[MRD_SUB_MAX_FIELDS] = {0};
+  const int divisors[3] = {1, 2, 5};
+  for (int s = 0; s < 3; s++)
+  {
+    sub_params(p, (uint16_t)(30000 + s), divisors[s], 0, 0);
+    TEST_ASSERT_EQUAL_INT(s, fan.subscribe(p, pc));
+  }
+  int got[3] = {0, 0, 0};
+  for (int f = 0; f < 100; f++)
+  {
+    int n = fan.plan(meridim);
+    for (int i = 0; i < n; i++)
+    {
+      int s = fan.packet(i).port - 30000;
+      TEST_ASSERT_EQUAL_INT(0, f % divisors[s]);
+      TEST_ASSERT_TRUE(fan.packet(i).ip == pc);
+      got[s]++;
+      fan.sent(i, (s != 2)); // 3つ目はW5500に渡せなかったことにする
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(100, got[0]);
+  TEST_ASSERT_EQUAL_INT(50, got[1]);
+  TEST_ASSERT_EQUAL_INT(20, got[2]);
+  TEST_ASSERT_EQUAL_UINT32(100, fan.stats(0).packets);
+  TEST_ASSERT_EQUAL_UINT32(100 * MRD_SUB_MAX_FIELDS * 2, fan.stats(0).bytes);
+  TEST_ASSERT_EQUAL_UINT32(0, fan.stats(2).packets);
+  TEST_ASSERT_EQUAL_UINT32(20, fan.stats(2).drops);
+
+  // 0では登録できない
+  sub_params(p, 30009, 0, 0, 0);
+  TEST_ASSERT_EQUAL_INT(-1, fan.subscribe(p, pc));
+}
+
+// 範囲指定はMeridimの位置の順に詰め, 重なりは1回だけ. 同じ項目の購読者は同じバッファ,
+// Meridim全体の購読者は渡したMeridimそのもの
+void test_mask_packing_and_sharing(void)
+{
+  static MrdFanout fan;
+  fan.begin();
+  IPAddress pc(10, 0, 0, 2);
+  short p[MRD_SUB_PARAMS];
+  sub_params(p, 31000, 1, range(40, 4), range(2, 3)); // 40-43, 2-4
+  TEST_ASSERT_EQUAL_INT(0, fan.subscribe(p, pc));
+  TEST_ASSERT_EQUAL_INT(7, fan.fields(0));
+  sub_params(p, 31001, 1, range(2, 3), range(40, 4)); // 順番と重なりが違っても同じ項目
+  p[6] = (short)range(41, 2);
+  TEST_ASSERT_EQUAL_INT(1, fan.subscribe(p, pc));
+  TEST_ASSERT_EQUAL_INT(7, fan.fields(1));
+  sub_params(p, 31002, 1, range(88, 10), 0); // Meridimの外は切り捨てる
+  TEST_ASSERT_EQUAL_INT(2, fan.subscribe(p, pc));
+  TEST_ASSERT_EQUAL_INT(2, fan.fields(2));
+  sub_params(p, 31003, 1, 0, 0);
+  TEST_ASSERT_EQUAL_INT(3, fan.subscribe(p, pc));
+  TEST_ASSERT_EQUAL_INT(0, fan.fields(3));
+  sub_params(p, 31004, 1, 0, 0);
+  TEST_ASSERT_EQUAL_INT(-1, fan.subscribe(p, pc)); // 表が一杯
+  sub_params(p, 31004, 1, range(95, 3), 0);
+  TEST_ASSERT_EQUAL_INT(-1, fan.subscribe(p, pc)); // 範囲が全てMeridimの外
+
+  short meridim[MRD_SUB_MAX_FIELDS];
+  for (int i = 0; i < MRD_SUB_MAX_FIELDS; i++)
+  {
+    meridim[i] = (short)(1000 + i);
+  }
+  for (int f = 0; f < 3; f++)
+  {
+    TEST_ASSERT_EQUAL_INT(4, fan.plan(meridim));
+    const MrdSubSend &a = fan.packet(0);
+    const MrdSubSend &b = fan.packet(1);
+    const MrdSubSend &c = fan.packet(2);
+    const MrdSubSend &full = fan.packet(3);
+    TEST_ASSERT_TRUE(a.buf == b.buf); // 1回だけ作って共有
+    TEST_ASSERT_EQUAL_INT(a.len, b.len);
+    TEST_ASSERT_TRUE(a.buf != c.buf);
+    TEST_ASSERT_TRUE(full.buf == (const uint8_t *)meridim);
+    TEST_ASSERT_EQUAL_INT(MRD_SUB_MAX_FIELDS * 2, full.len);
+
+    const short *pa = (const short *)a.buf;
+    const short expect[7] = {1002, 1003, 1004, 1040, 1041, 1042, 1043};
+    TEST_ASSERT_EQUAL_INT((2 + 7 + 1) * 2, a.len);
+    TEST_ASSERT_EQUAL_HEX16(MRD_FAST_MAGIC, (uint16_t)pa[0]);
+    TEST_ASSERT_EQUAL_INT(f, pa[1]); // 配信のフレーム番号
+    TEST_ASSERT_EQUAL_INT16_ARRAY(expect, pa + 2, 7);
+    TEST_ASSERT_TRUE(checksum_ok(pa, 10));
+
+    const short *pc2 = (const short *)c.buf;
+    TEST_ASSERT_EQUAL_INT((2 + 2 + 1) * 2, c.len);
+    TEST_ASSERT_EQUAL_INT(1088, pc2[2]);
+    TEST_ASSERT_EQUAL_INT(1089, pc2[3]);
+    TEST_ASSERT_TRUE(checksum_ok(pc2, 5));
+  }
+}
+
+// 削除した購読者には送らず, 空いた枠は再利用できる. 同じ宛先の登録は上書きで統計は残る
+void test_unsubscribe_and_update(void)
+{
+  static MrdFanout fan;
+  fan.begin();
+  IPAddress pc(10, 0, 0, 3);
+  IPAddress other(10, 0, 0, 4);
+  short p[MRD_SUB_PARAMS];
+  short meridim[MRD_SUB_MAX_FIELDS] = {0};
+  sub_params(p, 32000, 1, 0, 0);
+  TEST_ASSERT_EQUAL_INT(0, fan.subscribe(p, pc));
+  sub_params(p, 32001, 1, 0, 0);
+  TEST_ASSERT_EQUAL_INT(1, fan.subscribe(p, pc));
+  TEST_ASSERT_EQUAL_INT(2, fan.plan(meridim));
+  fan.sent(0, true);
+  fan.sent(1, true);
+
+  sub_params(p, 32000, 3, range(0, 10), 0); // 上書き
+  TEST_ASSERT_EQUAL_INT(0, fan.subscribe(p, pc));
+  TEST_ASSERT_EQUAL_INT(3, fan.divisor(0));
+  TEST_ASSERT_EQUAL_INT(10, fan.fields(0));
+  TEST_ASSERT_EQUAL_UINT32(1, fan.stats(0).packets);
+
+  sub_params(p, 32001, 1, 0, 0);
+  TEST_ASSERT_FALSE(fan.unsubscribe(p, other)); // 別のPCの同じポートは別の購読者
+  TEST_ASSERT_TRUE(fan.unsubscribe(p, pc));
+  TEST_ASSERT_FALSE(fan.unsubscribe(p, pc));
+  TEST_ASSERT_FALSE(fan.active(1));
+  for (int f = 0; f < 6; f++)
+  {
+    int n = fan.plan(meridim);
+    for (int i = 0; i < n; i++)
+    {
+      TEST_ASSERT_EQUAL_UINT16(32000, fan.packet(i).port);
+    }
+  }
+  sub_params(p, 32002, 1, 0, 0);
+  TEST_ASSERT_EQUAL_INT(1, fan.subscribe(p, other)); // 空いた枠
+  TEST_ASSERT_EQUAL_UINT32(0, fan.stats(1).packets);
+}
+
+/* UDPのループバック: PCとしてMCMD_SUBSCRIBEを送り, 購読者のソケットで受ける */
+
+static int pc_sock = -1;
+
+static int udp_open(uint16_t *port)
+{
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  bind(sock, (sockaddr *)&addr, sizeof(addr));
+  socklen_t len = sizeof(addr);
+  getsockname(sock, (sockaddr *)&addr, &len);
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+  *port = ntohs(addr.sin_port);
+  return sock;
+}
+
+// マスターコマンドとパラメータだけのMeridimをボードに送り, そのフレームを回す
+static void pc_command(short master, const short *params)
+{
+  short m[90];
+  memset(m, 0, sizeof(m));
+  m[0] = master;
+  memcpy(&m[SUB_PARAM_INDEX], params, MRD_SUB_PARAMS * sizeof(short));
+  m[UDP_DELTA_ACK_INDEX] = (short)range(40, 10); // 差分モードのPCは毎フレームackを入れる. 購読のパラメータに読まれると範囲指定になる
+  int sum = 0;
+  for (int i = 0; i < 89; i++)
+  {
+    sum += m[i];
+  }
+  m[89] = (short)~sum;
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((uint16_t)(UDP_RESV_PORT + sim::env_long("MRD_SIM_UDP_PORT_OFFSET", 0)));
+  sendto(pc_sock, m, sizeof(m), 0, (sockaddr *)&addr, sizeof(addr));
+  loop();
+}
+
+// 受信したパケットを数える (lenが0以外なら長さとチェックサムも確かめる)
+static int drain(int sock, int len, int *bad)
+{
+  int n = 0;
+  short buf[128];
+  ssize_t r;
+  while ((r = recv(sock, buf, sizeof(buf), 0)) > 0)
+  {
+    if ((len and (r != len)) or !checksum_ok(buf, (int)r / 2))
+    {
+      (*bad)++;
+    }
+    n++;
+  }
+  return n;
+}
+
+void test_udp_loopback(void)
+{
+  uint16_t pc_port;
+  pc_sock = udp_open(&pc_port);
+  uint16_t port[3];
+  int sock[3];
+  for (int s = 0; s < 3; s++)
+  {
+    sock[s] = udp_open(&port[s]);
+  }
+  short p[3][MRD_SUB_PARAMS];
+  sub_params(p[0], port[0], 1, 0, 0);                   // Meridim全体, 毎フレーム
+  sub_params(p[1], port[1], 2, range(21, 16), 0);       // 16項目, 2フレームに1回
+  sub_params(p[2], port[2], 5, range(2, 12), range(80, 9)); // 21項目, 5フレームに1回
+  short none[MRD_SUB_PARAMS] = {0};
+  for (int s = 0; s < 3; s++)
+  {
+    pc_command(MCMD_SUBSCRIBE, p[s]);
+    pc_command(0, none); // コマンドは切り替わった時だけ効くので, 間に別のMeridimを挟む
+  }
+  int bad = 0;
+  for (int s = 0; s < 3; s++)
+  {
+    drain(sock[s], 0, &bad);
+  }
+
+  const int frames = 100;
+  for (int f = 0; f < frames; f++)
+  {
+    loop();
+  }
+  int n0 = drain(sock[0], 180, &bad);
+  int n1 = drain(sock[1], (2 + 16 + 1) * 2, &bad);
+  int n2 = drain(sock[2], (2 + 21 + 1) * 2, &bad);
+  printf("loopback packets full:%d 1/2:%d 1/5:%d bad:%d\n", n0, n1, n2, bad);
+  TEST_ASSERT_EQUAL_INT(0, bad);
+  TEST_ASSERT_EQUAL_INT(frames, n0);
+  TEST_ASSERT_EQUAL_INT(frames / 2, n1);
+  TEST_ASSERT_EQUAL_INT(frames / 5, n2);
+
+  pc_command(MCMD_UNSUBSCRIBE, p[1]);
+  for (int s = 0; s < 3; s++)
+  {
+    drain(sock[s], 0, &bad);
+  }
+  for (int f = 0; f < frames; f++)
+  {
+    loop();
+  }
+  TEST_ASSERT_EQUAL_INT(frames, drain(sock[0], 180, &bad));
+  TEST_ASSERT_EQUAL_INT(0, drain(sock[1], 0, &bad)); // 削除した購読者には届かない
+  TEST_ASSERT_EQUAL_INT(frames / 5, drain(sock[2], 0, &bad));
+  TEST_ASSERT_EQUAL_INT(0, bad);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  char offset[16];
+  snprintf(offset, sizeof(offset), "%d", 10000 + getpid() % 30000); // 同時に動く他のシミュレーションとポートをずらす
+  setenv("MRD_SIM_UDP_PORT_OFFSET", offset, 0);
+  sim::set_loop_thread();
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_divisor);
+  RUN_TEST(test_mask_packing_and_sharing);
+  RUN_TEST(test_unsubscribe_and_update);
+  RUN_TEST(test_udp_loopback);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
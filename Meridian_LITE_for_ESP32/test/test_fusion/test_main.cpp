@@ -0,0 +1,182 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_fusion/test_main.cpp
+ * @brief   Runs init_mpu() and the MPU FIFO fusion against the trace-driven MPU stand-in
+ *          and checks the attitude and the temperature against the trace.
+ *
+ *   pio test -e native -f test_fusion
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config.h"
+#include "main.h"
+#include "mrd_fusion.h"
+#include "sim.h"
+
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
+
+void setup();
+
+extern MrdFusion mpu_fusion;
+extern uint8_t mpu_who_am_i;
+
+#define TRACE_REST_MS 1500 // 先頭の静止区間(ジャイロのオフセット取得用)
+#define TRACE_END_MS 12000
+#define TRACE_TEMP_C 31.5
+
+static char trace_path[] = "/tmp/mrd_mpu_trace_XXXXXX";
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// トレースの真値 (ZYXオイラー角, deg)
+void truth(double t_ms, double *roll, double *pitch, double *yaw)
+{
+  double t = (t_ms < TRACE_REST_MS) ? 0 : (t_ms - TRACE_REST_MS) / 1000.0;
+  *roll = 30.0 * sin(2 * M_PI * 0.5 * t);
+  *pitch = 20.0 * sin(2 * M_PI * 0.3 * t);
+  *yaw = 30.0 * t; // 30deg/s で回り続ける
+}
+
+// 真値から加速度(重力のみ)と機体座標の角速度を作り, 1msごとの行で書く
+void write_trace(const char *path)
+{
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL)
+  {
+    return;
+  }
+  fprintf(fp, "# t_ms, acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z, temp\n");
+  const double d2r = M_PI / 180.0;
+  for (int ms = 0; ms <= TRACE_END_MS; ms++)
+  {
+    double r, p, y, r1, p1, y1;
+    truth(ms, &r, &p, &y);
+    truth(ms + 1, &r1, &p1, &y1);
+    double dr = (r1 - r) * 1000.0; // deg/s
+    double dp = (p1 - p) * 1000.0;
+    double dy = (y1 - y) * 1000.0;
+    double sr = sin(r * d2r), cr = cos(r * d2r), sp = sin(p * d2r), cp = cos(p * d2r);
+    double g = 9.80665;
+    fprintf(fp, "%d, %.6f, %.6f, %.6f, %.6f, %.6f, %.6f, %.2f\n", ms,
+            -g * sp, g * sr * cp, g * cr * cp,
+            dr - dy * sp, dp * cr + dy * sr * cp, -dp * sr + dy * cr * cp,
+            TRACE_TEMP_C);
+  }
+  fclose(fp);
+}
+
+double wrap180(double a)
+{
+  while (a >= 180)
+  {
+    a -= 360;
+  }
+  while (a < -180)
+  {
+    a += 360;
+  }
+  return a;
+}
+
+// WHO_AM_Iごとの換算式で, トレースの温度に戻る
+void test_temperature_follows_who_am_i(void)
+{
+  const char *whos[3] = {"0x68", "0x71", "0x73"};
+  for (int i = 0; i < 3; i++)
+  {
+    setenv("MRD_SIM_MPU", whos[i], 1);
+    TEST_ASSERT_TRUE(init_mpu());
+    TEST_ASSERT_EQUAL_HEX16(strtol(whos[i], NULL, 0), mpu_who_am_i);
+    uint8_t t[2];
+    TEST_ASSERT_EQUAL_INT(2, mpu_read_regs(0x41, t, 2));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, TRACE_TEMP_C, mpu_temp_c((int16_t)((t[0] << 8) | t[1]), mpu_who_am_i));
+  }
+}
+
+void test_no_sensor_is_not_detected(void)
+{
+  unsetenv("MRD_SIM_MPU");
+  TEST_ASSERT_FALSE(init_mpu());
+}
+
+// 揺れと回転のトレースを2ms周期で読み, 姿勢の誤差を確かめる (ヨーは地磁気なしでジャイロの積分のみ)
+void test_fusion_tracks_trace(void)
+{
+  setenv("MRD_SIM_MPU", "0x71", 1);
+  uint64_t t0_us = sim::now_us(); // デバイスリセットはこの直後 (WHO_AM_Iの読み出し1回分の後)
+  TEST_ASSERT_TRUE(init_mpu());
+  uint64_t fifo_us = sim::now_us(); // init_mpu()の最後でFIFOが有効になる
+
+  int16_t acc[3];
+  int16_t gyro[3];
+  uint64_t cycles_sum = 0;
+  double err_rp = 0;
+  double err_yaw = 0;
+  int fused = 0;
+  int checks = 0;
+  while (true)
+  {
+    delay(2);
+    int n = mpu_fifo_fuse(acc, gyro, &cycles_sum);
+    TEST_ASSERT_TRUE(n >= 0); // FIFOはあふれない
+    fused += n;
+    double t_ms = (sim::now_us() - t0_us) / 1000.0;
+    if (t_ms >= TRACE_END_MS - 10)
+    {
+      break;
+    }
+    if (t_ms < TRACE_REST_MS + 500) // 動き始めてからの比較
+    {
+      continue;
+    }
+    float roll, pitch, yaw;
+    mpu_fusion.euler(&roll, &pitch, &yaw);
+    double r, p, y;
+    truth(t_ms - 500.0 / IMUAHRS_FUSION_HZ, &r, &p, &y); // 最後に読んだサンプルは平均で半周期前
+    err_rp = fmax(err_rp, fmax(fabs(roll - r), fabs(pitch - p)));
+    err_yaw = fmax(err_yaw, fabs(wrap180(yaw - y)));
+    checks++;
+  }
+  printf("fused:%d checks:%d roll/pitch max err:%.3f deg yaw max err:%.3f deg\n", fused, checks, err_rp, err_yaw);
+  TEST_ASSERT_GREATER_THAN(1000, checks);
+  TEST_ASSERT_INT_WITHIN(2, (sim::now_us() - fifo_us) * IMUAHRS_FUSION_HZ / 1000000, fused); // サンプルを落とさない
+  TEST_ASSERT_LESS_THAN_FLOAT(2.0f, (float)err_rp);
+  TEST_ASSERT_LESS_THAN_FLOAT(3.0f, (float)err_yaw);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  int fd = mkstemp(trace_path);
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+  setenv("MRD_SIM_MPU_TRACE", trace_path, 1);
+  setenv("MRD_SIM_MPU_GYRO_BIAS", "12,-7,5", 1); // init_mpu()のオフセット取得で消える
+  sim::set_loop_thread();
+  setup();
+
+  write_trace(trace_path);
+  UNITY_BEGIN();
+  RUN_TEST(test_no_sensor_is_not_detected);
+  RUN_TEST(test_temperature_follows_who_am_i);
+  RUN_TEST(test_fusion_tracks_trace);
+  int rc = UNITY_END();
+  unlink(trace_path);
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
@@ -0,0 +1,242 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_hci_pool/test_main.cpp
+ * @brief   Checks the CAS bitmap slot pool behind the Wiimote HCI queues (lib/ESP32Wiimote/src/HciPool.h).
+ *
+ *   pio test -e native -f test_hci_pool
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <unity.h>
+
+#include "../../lib/ESP32Wiimote/src/HciPool.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+#define POOL_SLOTS 64 // ESP32Wiimote.cppと同じ (RX_QUEUE_SIZE + TX_QUEUE_SIZE)
+#define POOL_SLOT_SIZE (2 * sizeof(size_t) + 288)
+
+typedef HciPool<POOL_SLOTS, POOL_SLOT_SIZE> Pool;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// 全スロットを取り切ると以降はヒープに回り, 返すと全スロットがまた取れる
+void test_exhaustion_falls_back_to_heap(void)
+{
+  static Pool pool;
+  void *p[POOL_SLOTS];
+  int slot[POOL_SLOTS];
+  std::set<int> seen;
+  for (int i = 0; i < POOL_SLOTS; i++)
+  {
+    p[i] = pool.alloc(POOL_SLOT_SIZE, &slot[i]);
+    TEST_ASSERT_NOT_NULL(p[i]);
+    TEST_ASSERT_TRUE((slot[i] >= 0) and (slot[i] < POOL_SLOTS));
+    seen.insert(slot[i]);
+    memset(p[i], i, POOL_SLOT_SIZE); // スロット全体に書けて, 他のスロットを壊さない
+  }
+  TEST_ASSERT_EQUAL_INT(POOL_SLOTS, (int)seen.size());
+  for (int i = 0; i < POOL_SLOTS; i++)
+  {
+    TEST_ASSERT_EQUAL_UINT8(i, ((uint8_t *)p[i])[0]);
+    TEST_ASSERT_EQUAL_UINT8(i, ((uint8_t *)p[i])[POOL_SLOT_SIZE - 1]);
+  }
+
+  int heap_slot = 0;
+  void *h = pool.alloc(16, &heap_slot);
+  TEST_ASSERT_NOT_NULL(h);
+  TEST_ASSERT_EQUAL_INT(-1, heap_slot);
+  HciPoolStats st = pool.stats();
+  TEST_ASSERT_EQUAL_UINT32(POOL_SLOTS, st.allocs);
+  TEST_ASSERT_EQUAL_UINT32(1, st.exhausted);
+  TEST_ASSERT_EQUAL_UINT32(0, st.oversize);
+  TEST_ASSERT_EQUAL_UINT32(POOL_SLOTS, st.inUse);
+  TEST_ASSERT_EQUAL_UINT32(POOL_SLOTS, st.highWater);
+  pool.release(h, heap_slot);
+  TEST_ASSERT_EQUAL_UINT32(POOL_SLOTS, pool.stats().inUse); // ヒープ分は数えない
+
+  for (int i = 0; i < POOL_SLOTS; i++)
+  {
+    pool.release(p[i], slot[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, pool.stats().inUse);
+
+  // 全スロットが戻っている
+  seen.clear();
+  for (int i = 0; i < POOL_SLOTS; i++)
+  {
+    p[i] = pool.alloc(1, &slot[i]);
+    TEST_ASSERT_TRUE(slot[i] >= 0);
+    seen.insert(slot[i]);
+  }
+  TEST_ASSERT_EQUAL_INT(POOL_SLOTS, (int)seen.size());
+  for (int i = 0; i < POOL_SLOTS; i++)
+  {
+    pool.release(p[i], slot[i]);
+  }
+  st = pool.stats();
+  TEST_ASSERT_EQUAL_UINT32(2 * POOL_SLOTS, st.allocs);
+  TEST_ASSERT_EQUAL_UINT32(1, st.exhausted);
+  TEST_ASSERT_EQUAL_UINT32(0, st.inUse);
+  TEST_ASSERT_EQUAL_UINT32(POOL_SLOTS, st.highWater);
+}
+
+void test_oversize_goes_to_heap(void)
+{
+  static Pool pool;
+  int slot = 0;
+  void *p = pool.alloc(POOL_SLOT_SIZE + 1, &slot);
+  TEST_ASSERT_NOT_NULL(p);
+  TEST_ASSERT_EQUAL_INT(-1, slot);
+  memset(p, 0xA5, POOL_SLOT_SIZE + 1);
+  pool.release(p, slot);
+  HciPoolStats st = pool.stats();
+  TEST_ASSERT_EQUAL_UINT32(0, st.allocs);
+  TEST_ASSERT_EQUAL_UINT32(0, st.exhausted);
+  TEST_ASSERT_EQUAL_UINT32(1, st.oversize);
+  TEST_ASSERT_EQUAL_UINT32(0, st.inUse);
+}
+
+// 全スレッドがそろうまで待つ (std::barrierはC++20のため)
+class Barrier
+{
+public:
+  explicit Barrier(int n) : count(n), waiting(0), generation(0) {}
+
+  void wait()
+  {
+    int gen = generation.load();
+    if (waiting.fetch_add(1) + 1 == count)
+    {
+      waiting.store(0);
+      generation.fetch_add(1);
+      return;
+    }
+    while (generation.load() == gen)
+    {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  const int count;
+  std::atomic<int> waiting;
+  std::atomic<int> generation;
+};
+
+// BTコントローラのタスクとサービスタスクに見立てた複数スレッドで取り合う.
+// 同じスロットが同時に2か所へ渡らず, 統計が数え漏れしないことを確かめる
+void test_concurrent_take_and_give(void)
+{
+  static Pool pool;
+  const int threads = 4;
+  const int rounds = 5000;
+  const int hold = 24; // 4スレッドで96個を同時に持つので, 毎回スロットが尽きてヒープにも回る
+  Barrier held(threads);
+  std::atomic<int> owner[POOL_SLOTS];
+  for (int i = 0; i < POOL_SLOTS; i++)
+  {
+    owner[i].store(-1);
+  }
+  std::atomic<uint32_t> pool_takes(0);
+  std::atomic<uint32_t> heap_takes(0);
+  std::atomic<uint32_t> conflicts(0);
+  std::atomic<uint32_t> over_slots(0);
+
+  std::vector<std::thread> ts;
+  for (int t = 0; t < threads; t++)
+  {
+    ts.push_back(std::thread([&, t]() {
+      void *p[hold];
+      int slot[hold];
+      for (int r = 0; r < rounds; r++)
+      {
+        int n = hold;
+        for (int i = 0; i < n; i++)
+        {
+          p[i] = pool.alloc(64, &slot[i]);
+          if (slot[i] < 0)
+          {
+            heap_takes++;
+            continue;
+          }
+          pool_takes++;
+          int expected = -1;
+          if (!owner[slot[i]].compare_exchange_strong(expected, t))
+          {
+            conflicts++;
+          }
+          *(int *)p[i] = t;
+        }
+        held.wait(); // 全スレッドが取り終えてから返す
+        if (pool.stats().inUse > POOL_SLOTS)
+        {
+          over_slots++;
+        }
+        for (int i = 0; i < n; i++)
+        {
+          if (slot[i] >= 0)
+          {
+            if (*(int *)p[i] != t)
+            {
+              conflicts++;
+            }
+            owner[slot[i]].store(-1);
+          }
+          pool.release(p[i], slot[i]);
+        }
+      }
+    }));
+  }
+  for (size_t i = 0; i < ts.size(); i++)
+  {
+    ts[i].join();
+  }
+
+  HciPoolStats st = pool.stats();
+  printf("pool takes:%u heap takes:%u high water:%u\n", (unsigned)pool_takes.load(), (unsigned)heap_takes.load(), (unsigned)st.highWater);
+  TEST_ASSERT_EQUAL_UINT32(0, conflicts.load());
+  TEST_ASSERT_EQUAL_UINT32(0, over_slots.load());
+  TEST_ASSERT_EQUAL_UINT32(pool_takes.load(), st.allocs);
+  TEST_ASSERT_EQUAL_UINT32(heap_takes.load(), st.exhausted);
+  TEST_ASSERT_EQUAL_UINT32(0, st.inUse);
+  TEST_ASSERT_TRUE(st.highWater <= POOL_SLOTS);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(rounds * (threads * hold - POOL_SLOTS), heap_takes.load()); // 返し終わる前に次を取ったスレッドの分は多くなる
+
+  // 全部戻っている
+  void *p[POOL_SLOTS];
+  int slot[POOL_SLOTS];
+  for (int i = 0; i < POOL_SLOTS; i++)
+  {
+    p[i] = pool.alloc(1, &slot[i]);
+    TEST_ASSERT_TRUE(slot[i] >= 0);
+  }
+  for (int i = 0; i < POOL_SLOTS; i++)
+  {
+    pool.release(p[i], slot[i]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_exhaustion_falls_back_to_heap);
+  RUN_TEST(test_oversize_goes_to_heap);
+  RUN_TEST(test_concurrent_take_and_give);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
@@ -0,0 +1,123 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_interp/test_main.cpp
+ * @brief   Checks the fixed-point keyframe interpolation (src/mrd_interp.h) against the
+ *          profiles in double precision, and that every segment ends on the keyframe.
+ *
+ *   pio test -e native -f test_interp
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <unity.h>
+
+#include "mrd_interp.h"
+
+#include <cmath>
+#include <cstdio>
+
+#define AXES 3
+
+// 倍精度の補間の形
+static double shape_ref(int profile, double t)
+{
+  switch (profile)
+  {
+  case MRD_INTERP_CUBIC:
+    return t * t * (3 - 2 * t);
+  case MRD_INTERP_MINJERK:
+    return t * t * t * (10 - 15 * t + 6 * t * t);
+  default:
+    return t;
+  }
+}
+
+// ±90度(±9000)の範囲の移動をフレーム数を変えて補間し, 倍精度との最大誤差(0.01度単位)を返す.
+// 区間の最後のフレームで目標値ぴったりにならなければ -1
+static double max_error(int profile)
+{
+  static const short ends[] = {-9000, -4500, -1, 0, 1, 777, 4500, 9000};
+  const int n_ends = sizeof(ends) / sizeof(ends[0]);
+  double err = 0;
+  MrdInterp ip;
+  ip.begin(profile);
+  for (int frames = 1; frames <= 400; frames += (frames < 20) ? 1 : 37)
+  {
+    for (int a = 0; a < n_ends; a++)
+    {
+      for (int b = 0; b < n_ends; b++)
+      {
+        short from[AXES] = {ends[a], ends[b], (short)-ends[a]};
+        short to[AXES] = {ends[b], ends[a], (short)-ends[b]};
+        short out[AXES];
+        ip.set_pose(from, AXES);
+        ip.set_key(to, AXES, (short)((profile << 12) | frames));
+        for (int k = 1; k <= frames; k++)
+        {
+          ip.step(out);
+          double s = shape_ref(profile, (double)k / frames);
+          for (int i = 0; i < AXES; i++)
+          {
+            err = fmax(err, fabs(out[i] - (from[i] + (to[i] - from[i]) * s)));
+          }
+        }
+        for (int i = 0; i < AXES; i++)
+        {
+          if (out[i] != to[i])
+          {
+            return -1;
+          }
+        }
+        if (ip.moving())
+        {
+          return -1;
+        }
+      }
+    }
+  }
+  return err;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_linear_accuracy(void)
+{
+  double err = max_error(MRD_INTERP_LINEAR);
+  printf("linear max err:%.3f\n", err);
+  TEST_ASSERT_TRUE(err >= 0);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(0.6, err);
+}
+
+void test_cubic_accuracy(void)
+{
+  double err = max_error(MRD_INTERP_CUBIC);
+  printf("cubic max err:%.3f\n", err);
+  TEST_ASSERT_TRUE(err >= 0);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(1.1, err);
+}
+
+void test_minjerk_accuracy(void)
+{
+  double err = max_error(MRD_INTERP_MINJERK);
+  printf("minjerk max err:%.3f\n", err);
+  TEST_ASSERT_TRUE(err >= 0);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(1.9, err);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_linear_accuracy);
+  RUN_TEST(test_cubic_accuracy);
+  RUN_TEST(test_minjerk_accuracy);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
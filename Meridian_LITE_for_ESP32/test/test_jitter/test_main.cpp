@@ -0,0 +1,244 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_jitter/test_main.cpp
+ * @brief   Checks the jitter buffer for batched PC frames (src/mrd_jitter.h) with bursty, reordered,
+ *          late and missing arrivals: the playout order and the underrun, overrun, late and restart counters.
+ *
+ *   pio test -e native -f test_jitter
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <unity.h>
+
+#include "mrd_jitter.h"
+
+#include <cstdio>
+#include <cstring>
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// 先頭にフレーム番号を入れ, Meridimと同じチェックサムで閉じる
+static void make_meridim(short *m, uint16_t frame)
+{
+  for (int i = 0; i < MRD_BATCH_WORDS; i++)
+  {
+    m[i] = (short)(frame * 3 + i);
+  }
+  m[0] = (short)frame;
+  int sum = 0;
+  for (int i = 0; i < MRD_BATCH_WORDS - 1; i++)
+  {
+    sum += m[i];
+  }
+  m[MRD_BATCH_WORDS - 1] = (short)~sum;
+}
+
+// framesの順にフレームを並べたバッチパケット. 長さ(byte)を返す
+static int make_batch(short *pkt, const uint16_t *frames, int n)
+{
+  pkt[0] = (short)MRD_BATCH_MAGIC;
+  pkt[1] = (short)n;
+  for (int i = 0; i < n; i++)
+  {
+    pkt[2 + i] = (short)frames[i];
+    make_meridim(pkt + 2 + n + i * MRD_BATCH_WORDS, frames[i]);
+  }
+  return (2 + n * (1 + MRD_BATCH_WORDS)) * 2;
+}
+
+static short pkt[MRD_BATCH_MAX_BYTES / 2];
+
+// 遅延の間は何も出さず, その後はフレーム番号の順に1フレームずつ出す
+void test_playout_delay_and_order(void)
+{
+  static MrdJitterBuffer jb;
+  jb.begin(3, 16);
+  const uint16_t frames[5] = {102, 100, 104, 101, 103}; // 1つのバッチの中で順不同
+  TEST_ASSERT_EQUAL_INT(5, jb.push_batch(pkt, make_batch(pkt, frames, 5)));
+  TEST_ASSERT_TRUE(jb.active());
+  TEST_ASSERT_EQUAL_INT(5, jb.stats().depth);
+
+  short m[MRD_BATCH_WORDS];
+  for (int i = 0; i < 3; i++)
+  {
+    TEST_ASSERT_FALSE(jb.pop(m));
+  }
+  for (int i = 0; i < 5; i++)
+  {
+    TEST_ASSERT_TRUE(jb.pop(m));
+    TEST_ASSERT_EQUAL_INT(100 + i, m[0]);
+  }
+  m[1] = 12345;
+  TEST_ASSERT_FALSE(jb.pop(m)); // 届いていない: 出力は変えない
+  TEST_ASSERT_EQUAL_INT(12345, m[1]);
+  MrdJitterStats st = jb.stats();
+  TEST_ASSERT_EQUAL_UINT32(1, st.batches);
+  TEST_ASSERT_EQUAL_UINT32(5, st.queued);
+  TEST_ASSERT_EQUAL_UINT32(5, st.played);
+  TEST_ASSERT_EQUAL_UINT32(1, st.underruns);
+  TEST_ASSERT_EQUAL_INT(5, st.depth_max);
+  TEST_ASSERT_EQUAL_INT(0, st.depth_min);
+}
+
+// 4フレーム分のバッチが逆順で, 届く間隔もばらつく. 遅延より短い揺れなら出力は途切れない
+void test_bursty_reordered_stream(void)
+{
+  static MrdJitterBuffer jb;
+  jb.begin(6, 32);
+  const uint16_t base = 65530; // フレーム番号の一周をまたぐ
+  const int batches = 50;
+  const int jitter[8] = {0, 3, 1, 0, 4, 2, 0, 1}; // 届くのが遅れるフレーム数
+  int arrive[batches];
+  for (int b = 0; b < batches; b++)
+  {
+    arrive[b] = b * 4 + jitter[b % 8];
+  }
+  short m[MRD_BATCH_WORDS];
+  uint16_t expect = base;
+  int played = 0;
+  int next = 0;
+  for (int f = 0; f < batches * 4 + 12; f++)
+  {
+    while ((next < batches) and (arrive[next] <= f))
+    {
+      uint16_t frames[4];
+      for (int i = 0; i < 4; i++)
+      {
+        frames[i] = (uint16_t)(base + next * 4 + 3 - i); // 逆順
+      }
+      TEST_ASSERT_EQUAL_INT(4, jb.push_batch(pkt, make_batch(pkt, frames, 4)));
+      next++;
+    }
+    if (jb.pop(m))
+    {
+      TEST_ASSERT_EQUAL_UINT16(expect, (uint16_t)m[0]);
+      expect++;
+      played++;
+      if (played == batches * 4)
+      {
+        break;
+      }
+    }
+  }
+  MrdJitterStats st = jb.stats();
+  printf("bursty: played:%u underruns:%u depth min:%d max:%d\n", (unsigned)st.played, (unsigned)st.underruns, st.depth_min, st.depth_max);
+  TEST_ASSERT_EQUAL_INT(batches * 4, played);
+  TEST_ASSERT_EQUAL_UINT32(batches * 4, st.played);
+  TEST_ASSERT_EQUAL_UINT32(0, st.underruns);
+  TEST_ASSERT_EQUAL_UINT32(0, st.late);
+  TEST_ASSERT_EQUAL_UINT32(0, st.overruns);
+}
+
+// 再生時刻を過ぎたフレームは捨て, 足りないフレームはアンダーラン, 先すぎるフレームはオーバーラン
+void test_late_missing_and_overrun(void)
+{
+  static MrdJitterBuffer jb;
+  jb.begin(0, 8);
+  short m[MRD_BATCH_WORDS];
+  make_meridim(m, 10);
+  TEST_ASSERT_TRUE(jb.push(10, m));
+  make_meridim(m, 12); // 11は抜ける
+  TEST_ASSERT_TRUE(jb.push(12, m));
+  make_meridim(m, 17);
+  TEST_ASSERT_TRUE(jb.push(17, m)); // 先読み8フレームの最後
+  make_meridim(m, 18);
+  TEST_ASSERT_FALSE(jb.push(18, m)); // 先すぎる
+  TEST_ASSERT_EQUAL_UINT32(1, jb.stats().overruns);
+
+  TEST_ASSERT_TRUE(jb.pop(m));
+  TEST_ASSERT_EQUAL_INT(10, m[0]);
+  TEST_ASSERT_FALSE(jb.pop(m)); // 11が無い
+  TEST_ASSERT_EQUAL_INT(10, m[0]);
+  make_meridim(m, 11);
+  TEST_ASSERT_FALSE(jb.push(11, m)); // 遅れて届いた
+  make_meridim(m, 9);
+  TEST_ASSERT_FALSE(jb.push(9, m));
+  TEST_ASSERT_TRUE(jb.pop(m));
+  TEST_ASSERT_EQUAL_INT(12, m[0]);
+  make_meridim(m, 20);
+  TEST_ASSERT_TRUE(jb.push(20, m)); // 再生が進んだので入る
+
+  MrdJitterStats st = jb.stats();
+  TEST_ASSERT_EQUAL_UINT32(4, st.queued);
+  TEST_ASSERT_EQUAL_UINT32(2, st.played);
+  TEST_ASSERT_EQUAL_UINT32(1, st.underruns);
+  TEST_ASSERT_EQUAL_UINT32(2, st.late);
+  TEST_ASSERT_EQUAL_UINT32(1, st.overruns);
+  TEST_ASSERT_EQUAL_INT(8, st.depth); // 13から20まで
+}
+
+// 先読みの長さ分続けてフレームが無ければ止め, 次に届いたフレームを基準に再生し直す
+void test_restart_after_stream_stops(void)
+{
+  static MrdJitterBuffer jb;
+  jb.begin(2, 4);
+  short m[MRD_BATCH_WORDS];
+  const uint16_t first[2] = {500, 501};
+  TEST_ASSERT_EQUAL_INT(2, jb.push_batch(pkt, make_batch(pkt, first, 2)));
+  TEST_ASSERT_FALSE(jb.pop(m));
+  TEST_ASSERT_FALSE(jb.pop(m));
+  TEST_ASSERT_TRUE(jb.pop(m));
+  TEST_ASSERT_TRUE(jb.pop(m));
+  for (int i = 0; i < 3; i++)
+  {
+    TEST_ASSERT_FALSE(jb.pop(m));
+    TEST_ASSERT_TRUE(jb.active());
+  }
+  TEST_ASSERT_FALSE(jb.pop(m)); // 4回目で止まる
+  TEST_ASSERT_FALSE(jb.active());
+  MrdJitterStats st = jb.stats();
+  TEST_ASSERT_EQUAL_UINT32(1, st.restarts);
+  TEST_ASSERT_EQUAL_UINT32(0, st.underruns); // 途切れた後の分は数えない
+  TEST_ASSERT_FALSE(jb.pop(m));
+
+  const uint16_t second[2] = {9000, 9001}; // 番号が飛んでも新しいストリームとして受ける
+  TEST_ASSERT_EQUAL_INT(2, jb.push_batch(pkt, make_batch(pkt, second, 2)));
+  TEST_ASSERT_FALSE(jb.pop(m));
+  TEST_ASSERT_FALSE(jb.pop(m));
+  TEST_ASSERT_TRUE(jb.pop(m));
+  TEST_ASSERT_EQUAL_INT(9000, m[0]);
+  TEST_ASSERT_TRUE(jb.pop(m));
+  TEST_ASSERT_EQUAL_INT(9001, m[0]);
+  TEST_ASSERT_EQUAL_UINT32(4, jb.stats().played);
+}
+
+// バッチでないパケットは-1, 形式やチェックサムの誤りはフレームごとに捨てる
+void test_bad_packets(void)
+{
+  static MrdJitterBuffer jb;
+  jb.begin(0, 16);
+  short plain[MRD_BATCH_WORDS];
+  make_meridim(plain, 1);
+  TEST_ASSERT_EQUAL_INT(-1, jb.push_batch(plain, sizeof(plain)));
+
+  const uint16_t frames[3] = {1, 2, 3};
+  int len = make_batch(pkt, frames, 3);
+  pkt[2 + 3 + MRD_BATCH_WORDS + 5]++; // 2つ目のMeridimを壊す
+  TEST_ASSERT_EQUAL_INT(2, jb.push_batch(pkt, len));
+  TEST_ASSERT_EQUAL_INT(0, jb.push_batch(pkt, len - 2)); // 短い
+  pkt[1] = MRD_BATCH_MAX_FRAMES + 1;
+  TEST_ASSERT_EQUAL_INT(0, jb.push_batch(pkt, MRD_BATCH_MAX_BYTES));
+  MrdJitterStats st = jb.stats();
+  TEST_ASSERT_EQUAL_UINT32(1, st.batches);
+  TEST_ASSERT_EQUAL_UINT32(3, st.bad);
+  TEST_ASSERT_EQUAL_UINT32(2, st.queued);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_playout_delay_and_order);
+  RUN_TEST(test_bursty_reordered_stream);
+  RUN_TEST(test_late_missing_and_overrun);
+  RUN_TEST(test_restart_after_stream_stops);
+  RUN_TEST(test_bad_packets);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_krr/test_main.cpp
+ * @brief   Polls the simulated KRR-5FH in the R servo bus slot and checks Meridim[15]-[17] and the bus time.
+ *
+ *   pio test -e native -f test_krr
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config.h"
+#include "main.h"
+#include "sim.h"
+
+void setup();
+
+extern unsigned long mrd_t_mic;
+extern unsigned long krr_bus_us_max;
+extern unsigned long krr_bus_deferred;
+extern unsigned long krr_bus_err;
+extern bool krr_rsvd_flag;
+
+typedef union // main.cppのUnionDataと同じ並び
+{
+  short sval[MSG_SIZE + 4];
+  unsigned short usval[MSG_SIZE + 2];
+  uint8_t bval[MSG_SIZE * 2 + 4];
+} UnionData;
+extern UnionData s_udp_meridim;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// JOYPAD_POLLING_USが過ぎ, フレームにslack_us残った状態でKRRを読む
+void poll_krr(unsigned long slack_us)
+{
+  delay(JOYPAD_POLLING_US / 1000 + 1);
+  mrd_t_mic = micros() + slack_us;
+  krr_poll_bus_slot(2);
+}
+
+void test_no_receiver_counts_error(void)
+{
+  unsetenv("MRD_SIM_KRR_BUTTONS");
+  unsigned long err = krr_bus_err;
+  poll_krr(FRAME_DURATION_US);
+  TEST_ASSERT_EQUAL_UINT32(err + 1, krr_bus_err);
+  TEST_ASSERT_FALSE(krr_rsvd_flag);
+}
+
+void test_buttons_and_analog_reach_meridim(void)
+{
+  setenv("MRD_SIM_KRR_BUTTONS", "0x0041", 1); // 上と○
+  setenv("MRD_SIM_KRR_ANALOG", "10,20,30,40", 1);
+  krr_bus_us_max = 0;
+  poll_krr(FRAME_DURATION_US);
+  joypad_to_meridim(2);
+
+  TEST_ASSERT_TRUE(krr_rsvd_flag);
+  TEST_ASSERT_EQUAL_UINT16(pad_krr_generalize(0x0041), s_udp_meridim.usval[MRD_CONTROL_BUTTONS]);
+  TEST_ASSERT_EQUAL_UINT16(10 | (20 << 8), s_udp_meridim.usval[MRD_CONTROL_STICK_L]);
+  TEST_ASSERT_EQUAL_UINT16(30 | (40 << 8), s_udp_meridim.usval[MRD_CONTROL_STICK_R]);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, krr_bus_us_max);
+  TEST_ASSERT_LESS_THAN_UINT32(KRR_BUS_BUDGET_US, krr_bus_us_max);
+}
+
+// ポーリングではR系統のUARTを開き直さず, 最後はDynamixelの形式(1Mbps 8N1)に戻る
+void test_poll_keeps_uart_open(void)
+{
+  setenv("MRD_SIM_KRR_BUTTONS", "0x0001", 1);
+  int begins = Serial2.begin_count();
+  for (int i = 0; i < 3; i++)
+  {
+    poll_krr(FRAME_DURATION_US);
+  }
+  TEST_ASSERT_EQUAL_INT(begins, Serial2.begin_count());
+  TEST_ASSERT_EQUAL_UINT32(1000000, Serial2.baud_rate());
+  TEST_ASSERT_EQUAL_HEX32(SERIAL_8N1, Serial2.format());
+}
+
+void test_short_slack_is_deferred(void)
+{
+  setenv("MRD_SIM_KRR_BUTTONS", "0x0001", 1);
+  unsigned long deferred = krr_bus_deferred;
+  unsigned long us_max = krr_bus_us_max;
+  poll_krr(KRR_BUS_BUDGET_US / 2);
+  TEST_ASSERT_EQUAL_UINT32(deferred + 1, krr_bus_deferred);
+  TEST_ASSERT_EQUAL_UINT32(us_max, krr_bus_us_max);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  sim::set_loop_thread();
+  setup();
+  uart_r_begin(2); // MOUNT_JOYPAD 2 の構成と同じくR系統を開く
+
+  UNITY_BEGIN();
+  RUN_TEST(test_no_receiver_counts_error);
+  RUN_TEST(test_buttons_and_analog_reach_meridim);
+  RUN_TEST(test_poll_keeps_uart_open);
+  RUN_TEST(test_short_slack_is_deferred);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
@@ -0,0 +1,332 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_motion_asset/test_main.cpp
+ * @brief   Checks the motion asset upload (src/mrd_asset.h) on the file-backed flash partition,
+ *          the image check in MrdMotionStore::attach() and MrdMotionPlayer stepping through keyframes.
+ *
+ *   pio test -e native -f test_motion_asset
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "mrd_asset.h"
+#include "mrd_motion.h"
+#include "sim.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#define TEST_LABEL "motion"
+
+static char fs_root[] = "/tmp/mrd_motion_XXXXXX";
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/* テスト用のモーション: 軸数axes, キーフレームごとに (フレーム数, 停止フレーム数, 全軸の角度) */
+struct Key
+{
+  uint16_t motion;
+  uint16_t hold;
+  short pos;
+};
+
+static void put_motion(std::vector<uint8_t> &img, int axes, uint16_t flags, const Key *keys, int n)
+{
+  MrdMotionHeader h;
+  h.axes = (uint16_t)axes;
+  h.keys = (uint16_t)n;
+  h.flags = flags;
+  h.stride = MRD_MOTION_KEY_BYTES(axes);
+  const uint8_t *p = (const uint8_t *)&h;
+  img.insert(img.end(), p, p + sizeof(h));
+  for (int k = 0; k < n; k++)
+  {
+    std::vector<uint8_t> key(h.stride, 0);
+    memcpy(&key[0], &keys[k].motion, 2);
+    memcpy(&key[2], &keys[k].hold, 2);
+    for (int a = 0; a < axes; a++)
+    {
+      short v = (short)(keys[k].pos + a * 10);
+      memcpy(&key[4 + a * 2], &v, 2);
+    }
+    img.insert(img.end(), key.begin(), key.end());
+  }
+}
+
+// "wave"(3キー, 1軸おきの値)と"bow"(繰り返し)の2つのモーションのイメージ
+static std::vector<uint8_t> make_image()
+{
+  const Key wave[3] = {{10, 0, 1000}, {(MRD_INTERP_LINEAR << 12) | 5, 3, -500}, {4, 0, 0}};
+  const Key bow[2] = {{(MRD_INTERP_LINEAR << 12) | 2, 0, 300}, {(MRD_INTERP_LINEAR << 12) | 2, 0, -300}};
+  std::vector<uint8_t> body[2];
+  put_motion(body[0], 30, 0, wave, 3);
+  put_motion(body[1], 2, MRD_MOTION_LOOP, bow, 2);
+
+  std::vector<uint8_t> img(sizeof(MrdMotionImage) + 2 * sizeof(MrdMotionEntry), 0);
+  const char *names[2] = {"wave", "bow"};
+  for (int i = 0; i < 2; i++)
+  {
+    MrdMotionEntry e;
+    memset(&e, 0, sizeof(e));
+    snprintf(e.name, sizeof(e.name), "%s", names[i]);
+    e.offset = (uint32_t)img.size();
+    e.bytes = (uint32_t)body[i].size();
+    memcpy(&img[sizeof(MrdMotionImage) + i * sizeof(MrdMotionEntry)], &e, sizeof(e));
+    img.insert(img.end(), body[i].begin(), body[i].end());
+  }
+  MrdMotionImage h;
+  h.magic = MRD_MOTION_MAGIC;
+  h.version = MRD_MOTION_VERSION;
+  h.count = 2;
+  h.bytes = (uint32_t)img.size();
+  h.crc = mrd_motion_crc32(0, &img[sizeof(h)], h.bytes - sizeof(h));
+  memcpy(&img[0], &h, sizeof(h));
+  return img;
+}
+
+static MrdUploadAck send(MrdAssetStore &asset, uint16_t op, uint32_t offset, uint32_t value, const uint8_t *data = NULL, uint32_t n = 0)
+{
+  uint8_t pkt[MRD_UPLOAD_MAX_BYTES];
+  MrdUploadPacket h = {MRD_UPLOAD_MAGIC, op, offset, value};
+  memcpy(pkt, &h, sizeof(h));
+  if (n)
+  {
+    memcpy(pkt + sizeof(h), data, n);
+  }
+  MrdUploadAck ack;
+  memset(&ack, 0, sizeof(ack));
+  TEST_ASSERT_TRUE(asset.upload(pkt, sizeof(h) + n, &ack));
+  TEST_ASSERT_EQUAL_HEX16(MRD_UPLOAD_MAGIC, ack.magic);
+  TEST_ASSERT_EQUAL_UINT16(op, ack.op);
+  return ack;
+}
+
+// BEGIN, DATA x n, COMMIT. DATAはchunkバイトずつ
+static int32_t upload_all(MrdAssetStore &asset, const std::vector<uint8_t> &img, uint32_t crc, uint32_t chunk)
+{
+  MrdUploadAck ack = send(asset, MRD_UPLOAD_BEGIN, 0, (uint32_t)img.size());
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, ack.status);
+  for (uint32_t off = 0; off < img.size(); off += chunk)
+  {
+    uint32_t n = std::min<uint32_t>(chunk, (uint32_t)img.size() - off);
+    ack = send(asset, MRD_UPLOAD_DATA, off, n, &img[off], n);
+    TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, ack.status);
+    TEST_ASSERT_EQUAL_UINT32(off + n, ack.offset);
+  }
+  return send(asset, MRD_UPLOAD_COMMIT, 0, crc).status;
+}
+
+void test_upload_and_lookup(void)
+{
+  static MrdAssetStore asset;
+  TEST_ASSERT_TRUE(asset.begin(TEST_LABEL));
+  TEST_ASSERT_FALSE(asset.motions().is_ready()); // 消去済みの領域
+  std::vector<uint8_t> img = make_image();
+  uint32_t crc = mrd_motion_crc32(0, img.data(), (uint32_t)img.size());
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, upload_all(asset, img, crc, 100));
+  TEST_ASSERT_TRUE(asset.motions().is_ready());
+  TEST_ASSERT_EQUAL_INT(2, asset.motions().count());
+  TEST_ASSERT_EQUAL_UINT32(img.size(), asset.motions().bytes());
+  TEST_ASSERT_EQUAL_INT(1, asset.motions().find("bow"));
+  TEST_ASSERT_EQUAL_INT(-1, asset.motions().find("jump"));
+  TEST_ASSERT_EQUAL_UINT32(1, asset.stats().uploads);
+  TEST_ASSERT_EQUAL_UINT32((img.size() + 99) / 100, asset.stats().chunks);
+
+  // 再起動後も領域のイメージをそのまま使う
+  static MrdAssetStore again;
+  TEST_ASSERT_TRUE(again.begin(TEST_LABEL));
+  TEST_ASSERT_EQUAL_INT(2, again.motions().count());
+}
+
+// CRCが違えば使わない. BEGIN前のDATA/COMMITは状態の誤り
+void test_crc_mismatch_is_rejected(void)
+{
+  static MrdAssetStore asset;
+  TEST_ASSERT_TRUE(asset.begin(TEST_LABEL));
+  std::vector<uint8_t> img = make_image();
+  uint32_t crc = mrd_motion_crc32(0, img.data(), (uint32_t)img.size());
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_ERR_CRC, upload_all(asset, img, crc ^ 1, MRD_UPLOAD_CHUNK));
+  TEST_ASSERT_FALSE(asset.motions().is_ready());
+  TEST_ASSERT_FALSE(asset.is_uploading());
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_ERR_STATE, send(asset, MRD_UPLOAD_DATA, 0, 4, img.data(), 4).status);
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_ERR_STATE, send(asset, MRD_UPLOAD_COMMIT, 0, crc).status);
+  TEST_ASSERT_EQUAL_UINT32(3, asset.stats().errors);
+  TEST_ASSERT_EQUAL_UINT32(0, asset.stats().uploads);
+}
+
+// ackが失われて送り直されたDATA/COMMITはそのまま受け, 飛んだDATAは受け付けた位置を返す
+void test_resent_and_out_of_order_chunks(void)
+{
+  static MrdAssetStore asset;
+  TEST_ASSERT_TRUE(asset.begin(TEST_LABEL));
+  std::vector<uint8_t> img = make_image();
+  uint32_t crc = mrd_motion_crc32(0, img.data(), (uint32_t)img.size());
+  const uint32_t chunk = 64;
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, send(asset, MRD_UPLOAD_BEGIN, 0, (uint32_t)img.size()).status);
+  TEST_ASSERT_TRUE(asset.is_uploading());
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, send(asset, MRD_UPLOAD_DATA, 0, chunk, &img[0], chunk).status);
+  MrdUploadAck ack = send(asset, MRD_UPLOAD_DATA, 0, chunk, &img[0], chunk); // 同じDATA
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, ack.status);
+  TEST_ASSERT_EQUAL_UINT32(chunk, ack.offset);
+  ack = send(asset, MRD_UPLOAD_DATA, 2 * chunk, chunk, &img[2 * chunk], chunk); // 1つ抜けた
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_ERR_ORDER, ack.status);
+  TEST_ASSERT_EQUAL_UINT32(chunk, ack.offset);
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_ERR_ORDER, send(asset, MRD_UPLOAD_COMMIT, 0, crc).status); // 足りない
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_ERR_SIZE, send(asset, MRD_UPLOAD_DATA, chunk, MRD_UPLOAD_CHUNK + 1, &img[0], 0).status);
+  for (uint32_t off = chunk; off < img.size(); off += chunk)
+  {
+    uint32_t n = std::min<uint32_t>(chunk, (uint32_t)img.size() - off);
+    TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, send(asset, MRD_UPLOAD_DATA, off, n, &img[off], n).status);
+  }
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, send(asset, MRD_UPLOAD_COMMIT, 0, crc).status);
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_OK, send(asset, MRD_UPLOAD_COMMIT, 0, crc).status); // 同じCOMMIT
+  MrdAssetStats st = asset.stats();
+  TEST_ASSERT_EQUAL_UINT32(2, st.resent);
+  TEST_ASSERT_EQUAL_UINT32(3, st.errors);
+  TEST_ASSERT_EQUAL_UINT32(1, st.uploads);
+  TEST_ASSERT_EQUAL_UINT32((img.size() + chunk - 1) / chunk, st.chunks);
+  TEST_ASSERT_EQUAL_INT(2, asset.motions().count());
+}
+
+// 形式の誤りは1つずつ attach() で断り, CRCが合っていてもアップロードはERR_IMAGEで終わる
+void test_attach_refuses_bad_image(void)
+{
+  const std::vector<uint8_t> good = make_image();
+  MrdMotionStore store;
+  TEST_ASSERT_TRUE(store.attach(good.data(), (uint32_t)good.size()));
+  TEST_ASSERT_FALSE(store.attach(good.data(), (uint32_t)good.size() - 1)); // 領域より長い
+  TEST_ASSERT_FALSE(store.attach(good.data(), sizeof(MrdMotionImage) - 1));
+  TEST_ASSERT_FALSE(store.attach(NULL, 4096));
+
+  // ヘッダとモーションの各所を壊したイメージ (ヘッダより後ろを変えたものはCRCを付け直す)
+  const struct
+  {
+    size_t offset;
+    uint8_t value;
+    bool recrc;
+  } bad[] = {
+      {0, 0xFF, false},                                                               // magic
+      {4, 2, false},                                                                  // version
+      {6, 200, false},                                                                // 目次が入らない数
+      {sizeof(MrdMotionImage) + 1, 0x5A, false},                                      // CRCが合わない
+      {sizeof(MrdMotionImage) + MRD_MOTION_NAME_LEN, 0x02, true},                     // 4バイト境界でない位置
+      {sizeof(MrdMotionImage) + MRD_MOTION_NAME_LEN + 4 + 1, 0x7F, true},             // 長さが範囲外
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+  {
+    std::vector<uint8_t> img = good;
+    img[bad[i].offset] ^= bad[i].value;
+    if (bad[i].recrc)
+    {
+      uint32_t crc = mrd_motion_crc32(0, &img[sizeof(MrdMotionImage)], (uint32_t)img.size() - sizeof(MrdMotionImage));
+      memcpy(&img[12], &crc, 4);
+    }
+    TEST_ASSERT_FALSE_MESSAGE(store.attach(img.data(), (uint32_t)img.size()), "bad image attached");
+    TEST_ASSERT_FALSE(store.is_ready());
+  }
+  std::vector<uint8_t> axes = good; // モーションの軸数が0
+  uint32_t off;
+  memcpy(&off, &axes[sizeof(MrdMotionImage) + MRD_MOTION_NAME_LEN], 4);
+  axes[off] = 0;
+  axes[off + 1] = 0;
+  uint32_t crc = mrd_motion_crc32(0, &axes[sizeof(MrdMotionImage)], (uint32_t)axes.size() - sizeof(MrdMotionImage));
+  memcpy(&axes[12], &crc, 4);
+  TEST_ASSERT_FALSE(store.attach(axes.data(), (uint32_t)axes.size()));
+
+  static MrdAssetStore asset;
+  TEST_ASSERT_TRUE(asset.begin(TEST_LABEL));
+  TEST_ASSERT_EQUAL_INT32(MRD_UPLOAD_ERR_IMAGE, upload_all(asset, axes, mrd_motion_crc32(0, axes.data(), (uint32_t)axes.size()), MRD_UPLOAD_CHUNK));
+  TEST_ASSERT_FALSE(asset.motions().is_ready());
+}
+
+// キーフレームのフレーム数で到達し, 停止フレームの間止まり, 最後のキーフレームで終わる. LOOPは先頭に戻る
+void test_player_steps_through_keys(void)
+{
+  const std::vector<uint8_t> img = make_image();
+  MrdMotionStore store;
+  TEST_ASSERT_TRUE(store.attach(img.data(), (uint32_t)img.size()));
+  MrdMotionPlayer player;
+  player.begin(MRD_INTERP_LINEAR);
+  short pose[MRD_INTERP_MAX_AXES] = {0};
+  TEST_ASSERT_FALSE(player.start(store, 2, pose));
+  TEST_ASSERT_FALSE(player.playing());
+  TEST_ASSERT_TRUE(player.start(store, 0, pose));
+  TEST_ASSERT_EQUAL_INT(0, player.current());
+
+  std::vector<short> trace;
+  int frames = 0;
+  while (player.step(pose))
+  {
+    trace.push_back(pose[3]);
+    frames++;
+    TEST_ASSERT_TRUE(frames < 100);
+  }
+  TEST_ASSERT_FALSE(player.playing());
+  TEST_ASSERT_EQUAL_INT(-1, player.current());
+  // 10フレームで1030, 5フレームで-470, 3フレーム止まり, 4フレームで30
+  TEST_ASSERT_EQUAL_INT(10 + 5 + 3 + 4, frames);
+  TEST_ASSERT_EQUAL_INT(1030, trace[9]);
+  TEST_ASSERT_EQUAL_INT(1030 - 1500 / 5, trace[10]); // 直線
+  TEST_ASSERT_EQUAL_INT(-470, trace[14]);
+  TEST_ASSERT_EQUAL_INT(-470, trace[17]);
+  TEST_ASSERT_EQUAL_INT(30, trace[21]);
+  TEST_ASSERT_EQUAL_INT(290, pose[29]);
+
+  // 2軸のモーションは他の軸を変えず, 繰り返す
+  pose[5] = 777;
+  TEST_ASSERT_TRUE(player.start(store, 1, pose));
+  for (int f = 0; f < 40; f++)
+  {
+    TEST_ASSERT_TRUE(player.step(pose));
+    TEST_ASSERT_EQUAL_INT(777, pose[5]);
+    if (f % 4 == 1)
+    {
+      TEST_ASSERT_EQUAL_INT(300, pose[0]);
+      TEST_ASSERT_EQUAL_INT(310, pose[1]);
+    }
+    if (f % 4 == 3)
+    {
+      TEST_ASSERT_EQUAL_INT(-300, pose[0]);
+    }
+  }
+  player.stop();
+  TEST_ASSERT_FALSE(player.step(pose));
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  if (mkdtemp(fs_root) != NULL) // 毎回空の領域から始める
+  {
+    setenv("MRD_SIM_FS_ROOT", fs_root, 1);
+  }
+  setenv("MRD_SIM_PARTITION_KB", "64", 1);
+  sim::set_loop_thread();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_upload_and_lookup);
+  RUN_TEST(test_crc_mismatch_is_rejected);
+  RUN_TEST(test_resent_and_out_of_order_chunks);
+  RUN_TEST(test_attach_refuses_bad_image);
+  RUN_TEST(test_player_steps_through_keys);
+  int rc = UNITY_END();
+  std::string dir = std::string(fs_root) + "/partition";
+  unlink((dir + "/" TEST_LABEL ".bin").c_str());
+  rmdir(dir.c_str());
+  rmdir(fs_root);
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
@@ -0,0 +1,120 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_pad_remap/test_main.cpp
+ * @brief   Checks the compile-time remap tables (src/mrd_pad_remap.h) against the former
+ *          bit-by-bit Wiimote loop and the former KRC-5FH arithmetic for all 65536 inputs.
+ *
+ *   pio test -e native -f test_pad_remap
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config.h"
+#include "main.h"
+#include "mrd_pad_remap.h"
+
+#include <cstdio>
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// 以前のpad_wiimote_receive()の変換 (16エントリを1つずつ調べる)
+uint16_t old_wiimote_remap(const unsigned short map[16], uint16_t button)
+{
+  uint16_t pad_btn = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    uint16_t mask = 1 << i;
+    if (map[i] & button)
+    {
+      pad_btn |= mask;
+    }
+  }
+  return pad_btn;
+}
+
+// 以前のjoypad_read()にあったKRC-5FHの変換 (JOYPAD_GENERALIZEの場合)
+uint16_t old_krr_generalize(uint16_t button_1)
+{
+  unsigned short pad_btn_tmp = 0;
+  if ((button_1 & 15) == 15)
+  { // 左側十字ボタン全部押しなら start押下とみなす
+    pad_btn_tmp += 1;
+  }
+  else
+  {
+    // 左側の十字ボタン
+    pad_btn_tmp += (button_1 & 1) * 16 + ((button_1 & 2) >> 1) * 64 + ((button_1 & 4) >> 2) * 32 + ((button_1 & 8) >> 3) * 128;
+  }
+  if ((button_1 & 368) == 368)
+    pad_btn_tmp += 8; // 右側十字ボタン全部押しなら select押下とみなす
+  else
+  {
+    // 右側十字ボタン
+    pad_btn_tmp += ((button_1 & 16) >> 4) * 4096 + ((button_1 & 32) >> 5) * 16384 + ((button_1 & 64) >> 6) * 8192 + ((button_1 & 256) >> 8) * 32768;
+  }
+  // L1,L2,R1,R2
+  pad_btn_tmp += ((button_1 & 2048) >> 11) * 2048 + ((button_1 & 4096) >> 12) * 512 + ((button_1 & 512) >> 9) * 1024 + ((button_1 & 1024) >> 10) * 256;
+  return pad_btn_tmp;
+}
+
+// 変換表の値が不一致だった最初の入力を出して失敗させる
+#define CHECK_ALL_INPUTS(expected, actual)                                        \
+  do                                                                              \
+  {                                                                               \
+    int mismatches = 0;                                                           \
+    for (uint32_t in = 0; in <= 0xFFFF; in++)                                     \
+    {                                                                             \
+      uint16_t e = (expected);                                                    \
+      uint16_t a = (actual);                                                      \
+      if ((e != a) and (mismatches++ == 0))                                       \
+      {                                                                           \
+        printf("in:0x%04X expected:0x%04X actual:0x%04X\n", (unsigned)in, e, a); \
+      }                                                                           \
+    }                                                                             \
+    TEST_ASSERT_EQUAL_INT(0, mismatches);                                         \
+  } while (0)
+
+void test_wiimote_solo_matches_loop(void)
+{
+  CHECK_ALL_INPUTS(old_wiimote_remap(PAD_WIIMOTE_SOLO, in), PadRemap<PAD_WIIMOTE_SOLO>::apply(in));
+}
+
+void test_wiimote_orig_matches_loop(void)
+{
+  CHECK_ALL_INPUTS(old_wiimote_remap(PAD_WIIMOTE_ORIG, in), PadRemap<PAD_WIIMOTE_ORIG>::apply(in));
+}
+
+void test_krr_matches_old_arithmetic(void)
+{
+  CHECK_ALL_INPUTS(old_krr_generalize(in), pad_krr_generalize(in));
+}
+
+// 参照実装のconstexpr関数も同じ値で, 表はコンパイル時に作られる
+void test_reference_is_constexpr(void)
+{
+  static_assert(pad_remap_bits(PAD_WIIMOTE_SOLO, 0x1000, 0) == 0x0001, "PAD_WIIMOTE_SOLO bit 0");
+  static_assert(PadRemap<PAD_KRR5FH_SOLO>::lo[0x01] == 0x0010, "KRC-5FH left cross up");
+  CHECK_ALL_INPUTS(pad_remap_bits(PAD_KRR5FH_SOLO, in, 0), PadRemap<PAD_KRR5FH_SOLO>::apply(in));
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_wiimote_solo_matches_loop);
+  RUN_TEST(test_wiimote_orig_matches_loop);
+  RUN_TEST(test_krr_matches_old_arithmetic);
+  RUN_TEST(test_reference_is_constexpr);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
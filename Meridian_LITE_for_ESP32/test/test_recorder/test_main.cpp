@@ -0,0 +1,229 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_recorder/test_main.cpp
+ * @brief   Records frames into a small ring on the file-backed SD stand-in until it wraps,
+ *          then checks every block on disk and every frame through the replay reader,
+ *          and that looped replay of a file without a readable block ends.
+ *
+ *   pio test -e native -f test_recorder
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <unity.h>
+
+#include "mrd_recorder.h"
+#include "mrd_replay.h"
+#include "sim.h"
+
+#include <cstdio>
+#include <unistd.h>
+
+#define REC_PATH "/test_ring.mrd"
+#define REC_CAPACITY 4 // リングのブロック数
+#define REC_BLOCKS 32  // 書き込むブロック数 (16ブロックごとのヘッダ更新でファイルがフラッシュされる数にする)
+#define REC_TAIL 5     // 最後のブロックはflush()で書く途中までのブロック
+#define REC_FRAMES ((REC_BLOCKS - 1) * MRD_REC_RECORDS_PER_BLOCK + REC_TAIL)
+#define REC_FIRST_FRAME ((REC_BLOCKS - REC_CAPACITY) * MRD_REC_RECORDS_PER_BLOCK) // リングに残る最古のフレーム
+
+static MrdRecorder recorder;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// フレーム番号から決まる中身
+static void make_frame(int i, uint8_t *r, uint8_t *s)
+{
+  for (int k = 0; k < MRD_REC_MSG_BYTES; k++)
+  {
+    r[k] = (uint8_t)(i * 7 + k);
+    s[k] = (uint8_t)(i * 13 + k * 3);
+  }
+}
+
+static uint32_t frame_t_us(int i)
+{
+  return 1000000 + (uint32_t)i * 1000;
+}
+
+// ループスレッドがタスクを待つ間はタスク側が時計を進めるので, 実時間で少し待つ
+static void wait_task(void)
+{
+  sim::loop_block_begin();
+  usleep(1000);
+  sim::loop_block_end();
+}
+
+// 書き込みタスクがblocksブロック書き終えるまで待つ
+static bool wait_blocks(uint32_t blocks)
+{
+  for (int i = 0; i < 5000; i++)
+  {
+    if (recorder.stats().blocks_written >= blocks)
+    {
+      return true;
+    }
+    wait_task();
+  }
+  return false;
+}
+
+// ブロックを書き終えるのを待ちながら記録し, リングを何周もさせる
+void test_record_wraps_ring(void)
+{
+  SD.remove(REC_PATH);
+  TEST_ASSERT_TRUE(recorder.begin(SD, REC_PATH, REC_CAPACITY, NULL, 0));
+
+  uint8_t r[MRD_REC_MSG_BYTES];
+  uint8_t s[MRD_REC_MSG_BYTES];
+  for (int i = 0; i < REC_FRAMES; i++)
+  {
+    make_frame(i, r, s);
+    recorder.append(frame_t_us(i), r, s);
+    if (((i + 1) % MRD_REC_RECORDS_PER_BLOCK) == 0)
+    {
+      TEST_ASSERT_TRUE(wait_blocks((i + 1) / MRD_REC_RECORDS_PER_BLOCK));
+    }
+  }
+  recorder.flush();
+  TEST_ASSERT_TRUE(wait_blocks(REC_BLOCKS));
+
+  MrdRecStats st = recorder.stats();
+  TEST_ASSERT_EQUAL_UINT32(REC_FRAMES, st.records);
+  TEST_ASSERT_EQUAL_UINT32(0, st.dropped);
+  TEST_ASSERT_EQUAL_UINT32(REC_BLOCKS, st.blocks_written);
+  TEST_ASSERT_EQUAL_UINT32(0, st.write_errors);
+}
+
+// ファイル上のヘッダと全ブロック・全レコードを確かめる
+void test_every_block_on_disk(void)
+{
+  File f = SD.open(REC_PATH, "r");
+  TEST_ASSERT_TRUE(f);
+  TEST_ASSERT_EQUAL_UINT32(MRD_REC_SECTOR + REC_CAPACITY * MRD_REC_BLOCK_BYTES, f.size());
+
+  MrdRecFileHeader hdr;
+  TEST_ASSERT_EQUAL_UINT32(sizeof(hdr), f.read((uint8_t *)&hdr, sizeof(hdr)));
+  TEST_ASSERT_EQUAL_HEX32(MRD_REC_FILE_MAGIC, hdr.magic);
+  TEST_ASSERT_EQUAL_UINT32(MRD_REC_BLOCK_BYTES, hdr.block_bytes);
+  TEST_ASSERT_EQUAL_UINT32(REC_CAPACITY, hdr.capacity);
+  TEST_ASSERT_EQUAL_UINT32(REC_BLOCKS % REC_CAPACITY, hdr.next_block);
+  TEST_ASSERT_EQUAL_UINT32(REC_BLOCKS, hdr.block_seq);
+
+  static MrdRecBlock b;
+  uint8_t r[MRD_REC_MSG_BYTES];
+  uint8_t s[MRD_REC_MSG_BYTES];
+  for (int slot = 0; slot < REC_CAPACITY; slot++)
+  {
+    TEST_ASSERT_EQUAL_UINT32(sizeof(b), f.read((uint8_t *)&b, sizeof(b)));
+    TEST_ASSERT_EQUAL_HEX32(MRD_REC_BLOCK_MAGIC, b.magic);
+    TEST_ASSERT_EQUAL_UINT16(MRD_REC_RECORD_BYTES, b.record_size);
+    // ブロックkは k % REC_CAPACITY 番目に入り, 最後の周回のものが残る
+    uint32_t seq = REC_BLOCKS - REC_CAPACITY + 1 + (slot + REC_CAPACITY - REC_BLOCKS % REC_CAPACITY) % REC_CAPACITY;
+    TEST_ASSERT_EQUAL_UINT32(seq, b.block_seq);
+    int count = (seq == REC_BLOCKS) ? REC_TAIL : MRD_REC_RECORDS_PER_BLOCK;
+    TEST_ASSERT_EQUAL_UINT16(count, b.count);
+    for (int k = 0; k < count; k++)
+    {
+      int i = (seq - 1) * MRD_REC_RECORDS_PER_BLOCK + k;
+      make_frame(i, r, s);
+      TEST_ASSERT_EQUAL_UINT32(frame_t_us(i), b.records[k].t_us);
+      TEST_ASSERT_EQUAL_UINT8_ARRAY(r, b.records[k].r_meridim, MRD_REC_MSG_BYTES);
+      TEST_ASSERT_EQUAL_UINT8_ARRAY(s, b.records[k].s_meridim, MRD_REC_MSG_BYTES);
+    }
+  }
+  f.close();
+}
+
+// 再生は最古のブロックから始まり, リングに残った全フレームを順に返して終わる
+void test_replay_reads_every_record(void)
+{
+  static MrdReplay replay;
+  TEST_ASSERT_TRUE(replay.begin(SD, REC_PATH, false, false, NULL, 0));
+  TEST_ASSERT_EQUAL_UINT32(REC_CAPACITY, replay.stats().blocks_total);
+
+  uint8_t got[MRD_REC_MSG_BYTES];
+  uint8_t r[MRD_REC_MSG_BYTES];
+  uint8_t s[MRD_REC_MSG_BYTES];
+  int i = REC_FIRST_FRAME;
+  for (int wait = 0; (wait < 5000) and !replay.is_finished(); wait++)
+  {
+    while (replay.next(micros(), got))
+    {
+      TEST_ASSERT_TRUE(i < REC_FRAMES);
+      make_frame(i, r, s);
+      TEST_ASSERT_EQUAL_UINT8_ARRAY(r, got, MRD_REC_MSG_BYTES);
+      i++;
+    }
+    wait_task();
+  }
+  TEST_ASSERT_TRUE(replay.is_finished());
+  TEST_ASSERT_EQUAL_INT(REC_FRAMES, i);
+  MrdReplayStats st = replay.stats();
+  TEST_ASSERT_EQUAL_UINT32(REC_FRAMES - REC_FIRST_FRAME, st.frames);
+  TEST_ASSERT_EQUAL_UINT32(0, st.read_errors);
+  TEST_ASSERT_EQUAL_UINT32(0, st.loops);
+}
+
+// 読めるブロックが1つも無いファイルは, 繰り返し再生でも1周で終わる
+void test_replay_loop_stops_without_good_block(void)
+{
+  const char *path = "/test_bad.mrd";
+  File f = SD.open(path, FILE_WRITE);
+  TEST_ASSERT_TRUE(f);
+  MrdRecFileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = MRD_REC_FILE_MAGIC;
+  hdr.block_bytes = MRD_REC_BLOCK_BYTES;
+  hdr.capacity = REC_CAPACITY;
+  f.write((uint8_t *)&hdr, sizeof(hdr));
+  static MrdRecBlock b;
+  memset(&b, 0, sizeof(b));
+  b.magic = MRD_REC_BLOCK_MAGIC; // 先頭は正しいがレコードが無いブロック
+  for (int i = 0; i < REC_CAPACITY; i++)
+  {
+    b.block_seq = i + 1;
+    f.write((uint8_t *)&b, sizeof(b));
+  }
+  f.close();
+
+  static MrdReplay replay;
+  TEST_ASSERT_TRUE(replay.begin(SD, path, false, true, NULL, 0));
+  uint8_t got[MRD_REC_MSG_BYTES];
+  for (int wait = 0; (wait < 5000) and !replay.is_finished(); wait++)
+  {
+    TEST_ASSERT_FALSE(replay.next(micros(), got));
+    wait_task();
+  }
+  TEST_ASSERT_TRUE(replay.is_finished());
+  MrdReplayStats st = replay.stats();
+  TEST_ASSERT_EQUAL_UINT32(REC_CAPACITY, st.read_errors);
+  TEST_ASSERT_EQUAL_UINT32(0, st.loops);
+  TEST_ASSERT_EQUAL_UINT32(0, st.frames);
+  SD.remove(path);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  sim::set_loop_thread();
+  SD.begin();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_record_wraps_ring);
+  RUN_TEST(test_every_block_on_disk);
+  RUN_TEST(test_replay_reads_every_record);
+  RUN_TEST(test_replay_loop_stops_without_good_block);
+  int rc = UNITY_END();
+  SD.remove(REC_PATH);
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
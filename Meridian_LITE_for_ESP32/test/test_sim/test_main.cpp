@@ -0,0 +1,128 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_sim/test_main.cpp
+ * @brief   Runs the unmodified setup()/loop() in the native simulation and checks the frame timing,
+ *          and that run_bench() leaves the servo goal positions where the frame loop put them.
+ *
+ *   pio test -e native -f test_sim
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config.h"
+#include "main.h"
+#include "sim.h"
+
+#include <Dynamixel2Arduino.h>
+
+#include <algorithm>
+#include <vector>
+
+void setup();
+void loop();
+
+extern Dynamixel2Arduino dxl_L;
+extern Dynamixel2Arduino dxl_R;
+extern int idl_mount[15];
+extern int idr_mount[15];
+extern short servo_pose[30];
+int Deg2Dxl(float degree);
+
+typedef union // main.cppのUnionDataと同じ並び
+{
+  short sval[MSG_SIZE + 4];
+  unsigned short usval[MSG_SIZE + 2];
+  uint8_t bval[MSG_SIZE * 2 + 4];
+} UnionData;
+extern UnionData s_udp_meridim;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// 既定の構成(サーボ・IMU・パッド無し, PCからの受信無し)で1000フレーム回す
+void test_loop_keeps_frame_period(void)
+{
+  const int frames = 1000;
+  std::vector<uint64_t> work;
+  std::vector<uint64_t> period;
+  for (int i = 0; i < frames; i++)
+  {
+    uint64_t v0 = sim::now_us();
+    uint64_t i0 = sim::idle_total_us();
+    loop();
+    uint64_t dv = sim::now_us() - v0;
+    uint64_t di = sim::idle_total_us() - i0;
+    work.push_back((dv > di) ? dv - di : 0);
+    period.push_back(dv);
+  }
+  std::sort(work.begin(), work.end());
+  std::sort(period.begin(), period.end());
+  TEST_ASSERT_UINT32_WITHIN(FRAME_DURATION_US / 100, FRAME_DURATION_US, (uint32_t)period[frames / 2]);
+  TEST_ASSERT_LESS_THAN_UINT32(FRAME_DURATION_US, (uint32_t)work[frames * 99 / 100]);
+}
+
+// マウントしたサーボの目標位置(生値). 読めなければ-1
+static void read_goals(int32_t goal[30])
+{
+  for (int i = 0; i < 15; i++)
+  {
+    goal[i] = -1;
+    goal[i + 15] = -1;
+    if (idl_mount[i])
+    {
+      dxl_L.read(i, 116, 4, (uint8_t *)&goal[i], 4, 10);
+    }
+    if (idr_mount[i])
+    {
+      dxl_R.read(i, 116, 4, (uint8_t *)&goal[i + 15], 4, 10);
+    }
+  }
+}
+
+// ベンチマークはサーボに計測前の目標姿勢を送るだけで, サーボを動かさない
+void test_bench_keeps_servo_goals(void)
+{
+  for (int i = 0; i < 10; i++)
+  {
+    loop();
+  }
+  for (int i = 0; i < 15; i++) // 位置指定で, サーボごとに違う目標姿勢にしておく
+  {
+    servo_pose[i] = (short)(i * 150 - 1000);
+    servo_pose[i + 15] = (short)(1000 - i * 150);
+    s_udp_meridim.sval[i * 2 + 20] = 1;
+    s_udp_meridim.sval[i * 2 + 50] = 1;
+  }
+  int32_t expect[30];
+  for (int i = 0; i < 30; i++)
+  {
+    expect[i] = (((i < 15) ? idl_mount[i] : idr_mount[i - 15]) != 0) ? Deg2Dxl(servo_pose[i] * 0.01) : -1;
+  }
+  run_bench();
+  int32_t goal[30];
+  read_goals(goal);
+  TEST_ASSERT_EQUAL_INT32_ARRAY(expect, goal, 30);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  sim::set_loop_thread();
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_loop_keeps_frame_period);
+  RUN_TEST(test_bench_keeps_servo_goals);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
@@ -0,0 +1,116 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_spi_tune/test_main.cpp
+ * @brief   Checks MrdW5500Udp::tune_clock() (src/mrd_w5500.h) against the W5500 register model
+ *          with the SPI wiring limit of the sim (MRD_SIM_SPI_MAX_MHZ).
+ *
+ *   pio test -e native -f test_spi_tune
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include "config.h"
+#include "keys.h"
+#include "mrd_w5500.h"
+#include "sim.h"
+
+#define TEST_CS 5         // sim_w5500.cppの既定のCSピン
+#define TEST_APB_HZ 80000000
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// 配線の限界(MHz, 0:なし). 超えたクロックでは読んだバイトが毎回化ける
+static void spi_limit(int mhz)
+{
+  char v[16];
+  snprintf(v, sizeof(v), "%d", mhz);
+  setenv("MRD_SIM_SPI_MAX_MHZ", v, 1);
+  setenv("MRD_SIM_SPI_ERR_EVERY", "1", 1);
+}
+
+// limit_hz以下で最も速い80MHz/nのクロック (hz_min以上)
+static uint32_t fastest_step(uint32_t hz_min, uint32_t limit_hz)
+{
+  uint32_t best = hz_min;
+  for (uint32_t div = TEST_APB_HZ / hz_min; div >= 2; div--)
+  {
+    uint32_t hz = TEST_APB_HZ / div;
+    if ((hz > best) and (hz <= limit_hz))
+    {
+      best = hz;
+    }
+  }
+  return best;
+}
+
+// 余裕0段なら限界以下で最も速い段, 余裕n段ならそこからn段下
+void test_picks_fastest_step_under_limit(void)
+{
+  static MrdW5500Udp udp;
+  const int limits[4] = {20, 15, 12, 9};
+  for (int i = 0; i < 4; i++)
+  {
+    spi_limit(limits[i]);
+    uint32_t expect = fastest_step(SPI_SPEED, limits[i] * 1000000U);
+    uint32_t hz = udp.tune_clock(TEST_CS, SPI_SPEED, SPI_SPEED_MAX, 0);
+    TEST_ASSERT_EQUAL_UINT32(expect, hz);
+  }
+
+  spi_limit(15); // 13.33MHzが最速. 1段下は11.43MHz, 2段下は10MHz
+  TEST_ASSERT_EQUAL_UINT32(TEST_APB_HZ / 7, udp.tune_clock(TEST_CS, SPI_SPEED, SPI_SPEED_MAX, 1));
+  TEST_ASSERT_EQUAL_UINT32(TEST_APB_HZ / 8, udp.tune_clock(TEST_CS, SPI_SPEED, SPI_SPEED_MAX, 2));
+  TEST_ASSERT_EQUAL_UINT32(SPI_SPEED, udp.tune_clock(TEST_CS, SPI_SPEED, SPI_SPEED_MAX, 20)); // 下げきるとhz_min
+}
+
+// 配線に限界が無くても, 上限を上げても, W5500の保証する33.33MHzを超えない
+void test_clamps_to_w5500_spec(void)
+{
+  static MrdW5500Udp udp;
+  spi_limit(0);
+  TEST_ASSERT_EQUAL_UINT32(TEST_APB_HZ / 3, udp.tune_clock(TEST_CS, SPI_SPEED, SPI_SPEED_MAX, 0)); // 26.67MHz
+  TEST_ASSERT_EQUAL_UINT32(TEST_APB_HZ / 3, udp.tune_clock(TEST_CS, SPI_SPEED, TEST_APB_HZ, 0));  // 40MHzは試さない
+  spi_limit(50);
+  TEST_ASSERT_EQUAL_UINT32(TEST_APB_HZ / 3, udp.tune_clock(TEST_CS, SPI_SPEED, TEST_APB_HZ, 0));
+}
+
+// 最も遅い段でも通らなければ0を返し, init_udp()はSPI_SPEEDで開く
+void test_falls_back_when_every_step_fails(void)
+{
+  static MrdW5500Udp udp;
+  spi_limit(8);
+  TEST_ASSERT_EQUAL_UINT32(0, udp.tune_clock(TEST_CS, 10000000, SPI_SPEED_MAX, 1)); // 10MHzから上は全て化ける
+  spi_limit(1);
+  TEST_ASSERT_EQUAL_UINT32(0, udp.tune_clock(TEST_CS, SPI_SPEED, SPI_SPEED_MAX, 0));
+
+  spi_limit(8); // 安全なクロック(SPI_SPEED)ならソケットを開ける
+  TEST_ASSERT_TRUE(udp.begin(UDP_RESV_PORT, TEST_CS, SPI_SPEED));
+  spi_limit(0);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  char offset[16];
+  snprintf(offset, sizeof(offset), "%d", 10000 + getpid() % 30000); // begin()で開くポートを他のシミュレーションとずらす
+  setenv("MRD_SIM_UDP_PORT_OFFSET", offset, 0);
+  sim::set_loop_thread();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_picks_fastest_step_under_limit);
+  RUN_TEST(test_clamps_to_w5500_spec);
+  RUN_TEST(test_falls_back_when_every_step_fails);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
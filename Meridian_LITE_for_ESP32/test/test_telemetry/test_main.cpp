@@ -0,0 +1,219 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_telemetry/test_main.cpp
+ * @brief   Checks the multirate UDP output scheduler (src/mrd_telemetry.h): the divisor schedule,
+ *          the compact packet and the counters, on the scheduler itself and over UDP loopback
+ *          through the unmodified setup()/loop().
+ *
+ *   pio test -e native -f test_telemetry
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config.h"
+#include "keys.h"
+#include "mrd_telemetry.h"
+#include "sim.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+extern MrdTelemetry telemetry;
+
+static char peer_ip[16]; // ボードの送信先 (他のシミュレーションと重ならないループバックのアドレス)
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static bool checksum_ok(const short *p, int words)
+{
+  int sum = 0;
+  for (int i = 0; i < words - 1; i++)
+  {
+    sum += p[i];
+  }
+  return p[words - 1] == (short)~sum;
+}
+
+// divisorフレームに1回Meridim全体, 間のフレームは高速項目 (fastが0なら送らない)
+void test_divisor_schedule(void)
+{
+  const int divisors[4] = {1, 3, 5, 0};
+  for (int d = 0; d < 4; d++)
+  {
+    for (int fast = 0; fast < 2; fast++)
+    {
+      MrdTelemetry t;
+      t.begin(divisors[d], fast);
+      int div = (divisors[d] < 1) ? 1 : divisors[d]; // 0は1として扱う
+      for (int f = 0; f < 60; f++)
+      {
+        int expect = (f % div == 0) ? MRD_TX_FULL : (fast ? MRD_TX_FAST : MRD_TX_NONE);
+        TEST_ASSERT_EQUAL_INT(expect, t.next_frame());
+      }
+    }
+  }
+}
+
+// 通し番号は59999の次が0, 項目はfieldsの順, 末尾はMeridimと同じチェックサム
+void test_pack_fast(void)
+{
+  MrdTelemetry t;
+  t.begin(2, true);
+  short meridim[MSG_SIZE];
+  for (int i = 0; i < MSG_SIZE; i++)
+  {
+    meridim[i] = (short)(i * 101 - 3000);
+  }
+  const unsigned char fields[3] = {88, 2, 14};
+  short out[MRD_FAST_MAX_FIELDS + 3];
+  for (int n = 0; n < 60001; n++)
+  {
+    int len = t.pack_fast(out, meridim, fields, 3);
+    TEST_ASSERT_EQUAL_INT(12, len);
+    TEST_ASSERT_EQUAL_INT(n % 60000, (unsigned short)out[1]);
+  }
+  TEST_ASSERT_EQUAL_HEX16(MRD_FAST_MAGIC, (uint16_t)out[0]);
+  TEST_ASSERT_EQUAL_INT(meridim[88], out[2]);
+  TEST_ASSERT_EQUAL_INT(meridim[2], out[3]);
+  TEST_ASSERT_EQUAL_INT(meridim[14], out[4]);
+  TEST_ASSERT_TRUE(checksum_ok(out, 6));
+
+  unsigned char many[MRD_FAST_MAX_FIELDS + 8];
+  for (int i = 0; i < (int)sizeof(many); i++)
+  {
+    many[i] = (unsigned char)i;
+  }
+  TEST_ASSERT_EQUAL_INT((MRD_FAST_MAX_FIELDS + 3) * 2, t.pack_fast(out, meridim, many, sizeof(many))); // 最大数で切る
+  TEST_ASSERT_TRUE(checksum_ok(out, MRD_FAST_MAX_FIELDS + 3));
+}
+
+// 送信数とバイト数の累計, 1秒ごとのレート
+void test_counters(void)
+{
+  MrdTelemetry t;
+  t.begin(4, true);
+  uint32_t t0 = millis();
+  for (int f = 0; f < 200; f++) // 10msごと, 2秒分
+  {
+    int kind = t.next_frame();
+    t.sent(kind, (kind == MRD_TX_FULL) ? 180 : 34, t0 + (f + 1) * 10);
+  }
+  MrdTxStats st = t.stats();
+  TEST_ASSERT_EQUAL_UINT32(50, st.full_packets);
+  TEST_ASSERT_EQUAL_UINT32(150, st.fast_packets);
+  TEST_ASSERT_EQUAL_UINT32(50 * 180 + 150 * 34, st.bytes);
+  TEST_ASSERT_EQUAL_UINT32(25, st.full_per_sec); // 100Hzの1/4
+  TEST_ASSERT_EQUAL_UINT32(75, st.fast_per_sec);
+  TEST_ASSERT_EQUAL_UINT32(25 * 180 + 75 * 34, st.bytes_per_sec);
+
+  t.begin(4, true); // 計数も戻る
+  TEST_ASSERT_EQUAL_UINT32(0, t.stats().full_packets);
+  TEST_ASSERT_EQUAL_UINT32(0, t.stats().bytes);
+}
+
+/* UDPのループバック: ボードの送信先(UDP_SEND_PORT, UDP_SEND_FAST_PORT)をPCとして受ける */
+
+static int udp_listen(uint16_t port)
+{
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  inet_pton(AF_INET, peer_ip, &addr.sin_addr);
+  addr.sin_port = htons(port);
+  if (bind(sock, (sockaddr *)&addr, sizeof(addr)) != 0)
+  {
+    close(sock);
+    return -1;
+  }
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+  return sock;
+}
+
+void test_udp_loopback(void)
+{
+  int full_sock = udp_listen(UDP_SEND_PORT);
+  int fast_sock = udp_listen(UDP_SEND_FAST_PORT);
+  TEST_ASSERT_TRUE(full_sock >= 0);
+  TEST_ASSERT_TRUE(fast_sock >= 0);
+
+  const int divisor = 5;
+  const int frames = 150;
+  telemetry.begin(divisor, true);
+  for (int f = 0; f < frames; f++)
+  {
+    loop();
+  }
+
+  short buf[128];
+  ssize_t r;
+  int full = 0;
+  int fast = 0;
+  int bad = 0;
+  int prev_seq = -1;
+  while ((r = recv(full_sock, buf, sizeof(buf), 0)) > 0)
+  {
+    bad += ((r != (MSG_SIZE * 2)) or !checksum_ok(buf, MSG_SIZE)) ? 1 : 0;
+    int seq = (unsigned short)buf[1]; // Meridim全体を送るフレームだけ数える
+    bad += ((prev_seq >= 0) and (seq != prev_seq + 1)) ? 1 : 0;
+    prev_seq = seq;
+    full++;
+  }
+  while ((r = recv(fast_sock, buf, sizeof(buf), 0)) > 0)
+  {
+    int words = sizeof(UDP_FAST_FIELDS) + 3;
+    bad += ((r != words * 2) or ((uint16_t)buf[0] != MRD_FAST_MAGIC) or !checksum_ok(buf, words)) ? 1 : 0;
+    bad += ((unsigned short)buf[1] != fast) ? 1 : 0; // 通し番号は0から
+    fast++;
+  }
+  MrdTxStats st = telemetry.stats();
+  printf("loopback full:%d fast:%d bad:%d bytes:%u\n", full, fast, bad, (unsigned)st.bytes);
+  TEST_ASSERT_EQUAL_INT(0, bad);
+  TEST_ASSERT_EQUAL_INT(frames / divisor, full);
+  TEST_ASSERT_EQUAL_INT(frames - frames / divisor, fast);
+  TEST_ASSERT_EQUAL_UINT32(full, st.full_packets);
+  TEST_ASSERT_EQUAL_UINT32(fast, st.fast_packets);
+  TEST_ASSERT_EQUAL_UINT32(full * (MSG_SIZE * 2) + fast * (sizeof(UDP_FAST_FIELDS) + 3) * 2, st.bytes);
+  TEST_ASSERT_UINT32_WITHIN(1, 1000000 / FRAME_DURATION_US / divisor, st.full_per_sec); // 最初の1秒の窓
+  TEST_ASSERT_UINT32_WITHIN(1, 1000000 / FRAME_DURATION_US * (divisor - 1) / divisor, st.fast_per_sec);
+  close(full_sock);
+  close(fast_sock);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  int id = getpid() % 60000;
+  snprintf(peer_ip, sizeof(peer_ip), "127.0.%d.%d", 1 + id / 250, 1 + id % 250); // 127.0.0.1は他のシミュレーションが使う
+  setenv("MRD_SIM_PEER", peer_ip, 1);
+  char offset[16];
+  snprintf(offset, sizeof(offset), "%d", 10000 + getpid() % 30000); // 受信ポートも同時に動く他のシミュレーションとずらす
+  setenv("MRD_SIM_UDP_PORT_OFFSET", offset, 0);
+  sim::set_loop_thread();
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_divisor_schedule);
+  RUN_TEST(test_pack_fast);
+  RUN_TEST(test_counters);
+  RUN_TEST(test_udp_loopback);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
@@ -0,0 +1,206 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_traj/test_main.cpp
+ * @brief   Checks the trajectory segment queue (src/mrd_traj.h) against a sampled sine,
+ *          its handling of duplicate, late and overflowing segments, and long fast segments.
+ *
+ *   pio test -e native -f test_traj
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <unity.h>
+
+#include "mrd_traj.h"
+
+#include <cmath>
+#include <cstdio>
+
+#define FRAME_US 10000 // 100Hz
+#define SEG_FRAMES 20
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// PC側の動き: フレームfでの軸iの角度(degree x 100)と角速度(degree/s x 10)
+static double sine_pos(double f, int i)
+{
+  return 3000 * sin(f * 0.02 + i);
+}
+
+static double sine_vel(double f, int i)
+{
+  return 60 * cos(f * 0.02 + i) * (1000000.0 / FRAME_US) / 10; // degree x 100 / frame -> degree/s x 10
+}
+
+// k番目の区間(終点はフレーム (k+1)*SEG_FRAMES)を入れる
+static bool push_sine(MrdTraj &traj, int k)
+{
+  short pos[MRD_TRAJ_AXES];
+  short vel[MRD_TRAJ_AXES];
+  double f1 = (k + 1) * SEG_FRAMES;
+  for (int i = 0; i < MRD_TRAJ_AXES; i++)
+  {
+    pos[i] = (short)lround(sine_pos(f1, i));
+    vel[i] = (short)lround(sine_vel(f1, i));
+  }
+  return traj.push(pos, vel, (uint16_t)(k * SEG_FRAMES), SEG_FRAMES);
+}
+
+// 20フレームの区間で送った正弦波を毎フレーム評価し, 元の正弦波との差を見る
+void test_sine_error(void)
+{
+  static MrdTraj traj;
+  short pose[MRD_TRAJ_AXES];
+  for (int i = 0; i < MRD_TRAJ_AXES; i++)
+  {
+    pose[i] = (short)lround(sine_pos(0, i));
+  }
+  traj.begin(FRAME_US, pose);
+  const int segments = 200;
+  int pushed = 0;
+  double err = 0;
+  for (int f = 1; f <= segments * SEG_FRAMES; f++)
+  {
+    while ((pushed < segments) and (traj.stats().queued < 4)) // 4区間先まで送っておく
+    {
+      TEST_ASSERT_TRUE(push_sine(traj, pushed++));
+    }
+    traj.step(pose);
+    if (f <= SEG_FRAMES) // 最初の区間は速度0から始まる
+    {
+      continue;
+    }
+    for (int i = 0; i < MRD_TRAJ_AXES; i++)
+    {
+      err = fmax(err, fabs(pose[i] - sine_pos(f, i)));
+    }
+  }
+  printf("sine max err:%.3f deg\n", err / 100);
+  MrdTrajStats st = traj.stats();
+  TEST_ASSERT_EQUAL_UINT32(segments, st.segments);
+  TEST_ASSERT_EQUAL_UINT32(0, st.idle);
+  TEST_ASSERT_EQUAL_UINT32(0, st.late);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(1.7, err); // 0.017度
+}
+
+void test_duplicate_and_overflow(void)
+{
+  static MrdTraj traj;
+  short pose[MRD_TRAJ_AXES] = {0};
+  traj.begin(FRAME_US, pose);
+  TEST_ASSERT_TRUE(push_sine(traj, 0));
+  TEST_ASSERT_FALSE(push_sine(traj, 0)); // 再送
+  for (int k = 1; k < MRD_TRAJ_QUEUE; k++)
+  {
+    TEST_ASSERT_TRUE(push_sine(traj, k));
+  }
+  TEST_ASSERT_FALSE(push_sine(traj, MRD_TRAJ_QUEUE)); // キューが一杯
+  MrdTrajStats st = traj.stats();
+  TEST_ASSERT_EQUAL_UINT32(MRD_TRAJ_QUEUE, st.segments);
+  TEST_ASSERT_EQUAL_UINT32(1, st.duplicates);
+  TEST_ASSERT_EQUAL_UINT32(1, st.overflows);
+  TEST_ASSERT_EQUAL_INT(MRD_TRAJ_QUEUE, st.queued);
+
+  // 1区間を消化すれば, 捨てた区間を入れ直せる
+  for (int f = 0; f < SEG_FRAMES; f++)
+  {
+    traj.step(pose);
+  }
+  TEST_ASSERT_EQUAL_INT(MRD_TRAJ_QUEUE - 1, traj.stats().queued);
+  TEST_ASSERT_EQUAL_INT16((short)lround(sine_pos(SEG_FRAMES, 0)), pose[0]); // 区間の終点ちょうど
+  TEST_ASSERT_TRUE(push_sine(traj, MRD_TRAJ_QUEUE));
+}
+
+// キューが空になって止まった後, 開始時刻を過ぎて届いた区間は今から始め, 止まった姿勢から動き出す
+void test_late_segment_starts_now(void)
+{
+  static MrdTraj traj;
+  short pose[MRD_TRAJ_AXES] = {0};
+  traj.begin(FRAME_US, pose);
+  TEST_ASSERT_TRUE(push_sine(traj, 0));
+  for (int f = 0; f < SEG_FRAMES + 10; f++) // 区間の後10フレーム止まる
+  {
+    traj.step(pose);
+  }
+  short stopped[MRD_TRAJ_AXES];
+  memcpy(stopped, pose, sizeof(pose));
+  TEST_ASSERT_EQUAL_UINT32(10, traj.stats().idle);
+
+  TEST_ASSERT_TRUE(push_sine(traj, 1)); // 開始時刻はSEG_FRAMESで, 10フレーム遅れ
+  TEST_ASSERT_EQUAL_UINT32(1, traj.stats().late);
+  traj.step(pose);
+  for (int i = 0; i < MRD_TRAJ_AXES; i++)
+  {
+    TEST_ASSERT_INT_WITHIN(200, stopped[i], pose[i]); // 速度0から始めるので跳ばない
+  }
+  for (int f = 1; f < SEG_FRAMES; f++)
+  {
+    traj.step(pose);
+  }
+  for (int i = 0; i < MRD_TRAJ_AXES; i++)
+  {
+    TEST_ASSERT_EQUAL_INT16((short)lround(sine_pos(2 * SEG_FRAMES, i)), pose[i]); // 遅れても終点には着く
+  }
+  TEST_ASSERT_EQUAL_INT(0, traj.stats().queued);
+}
+
+// 倍精度の3次エルミート曲線 (始点は角度0, 速度0). 姿勢と同じくshortの範囲で飽和させる
+static double hermite_ref(double s, short pos, short vel, int frames)
+{
+  double v1 = vel * 10.0 * FRAME_US / 1000000.0 * frames; // 区間の長さで正規化した終点の角速度
+  double p = (s * s * s - s * s) * v1 + (3 * s * s - 2 * s * s * s) * pos;
+  return fmax(-32768.0, fmin(32767.0, p));
+}
+
+// 最大の角速度で最長の区間でも係数があふれず, 倍精度の曲線から1フレーム分の動き以上ずれない
+void test_long_fast_segment(void)
+{
+  static MrdTraj traj;
+  short pose[MRD_TRAJ_AXES] = {0};
+  traj.begin(FRAME_US, pose);
+  short pos[MRD_TRAJ_AXES];
+  short vel[MRD_TRAJ_AXES];
+  for (int i = 0; i < MRD_TRAJ_AXES; i++)
+  {
+    pos[i] = (short)((i & 1) ? 3000 : -3000);
+    vel[i] = (short)((i & 2) ? 32767 : -32768);
+  }
+  const int frames = MRD_TRAJ_MAX_FRAMES;
+  TEST_ASSERT_TRUE(traj.push(pos, vel, 0, frames));
+  int mismatches = 0;
+  for (int k = 1; k <= frames; k++)
+  {
+    traj.step(pose);
+    for (int i = 0; i < MRD_TRAJ_AXES; i++)
+    {
+      double p = hermite_ref((double)k / frames, pos[i], vel[i], frames);
+      double p_prev = hermite_ref((double)(k - 1) / frames, pos[i], vel[i], frames);
+      if (fabs(pose[i] - p) > fabs(p - p_prev) + 2.0)
+      {
+        mismatches++;
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(0, mismatches);
+  TEST_ASSERT_EQUAL_INT16(pos[0], pose[0]); // 終点ちょうど
+  TEST_ASSERT_EQUAL_INT16(pos[1], pose[1]);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_sine_error);
+  RUN_TEST(test_duplicate_and_overflow);
+  RUN_TEST(test_late_segment_starts_now);
+  RUN_TEST(test_long_fast_segment);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
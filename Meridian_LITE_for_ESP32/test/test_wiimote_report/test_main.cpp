@@ -0,0 +1,197 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/test/test_wiimote_report/test_main.cpp
+ * @brief   Feeds canned HID reports through TinyWiimote's HCI handler and checks the latest-state
+ *          register, the button event queue and their counters (lib/ESP32Wiimote/src/TinyWiimote.cpp).
+ *
+ *   pio test -e native -f test_wiimote_report
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include <unity.h>
+
+// ライブラリはnative環境でlib_ignoreなので, 本体をこのテストに取り込む
+#include "../../lib/ESP32Wiimote/src/TinyWiimote.cpp"
+
+#define WII_CH 0x0040  // HCIのコネクションハンドル
+#define WII_CID 0x0041 // 割り込みチャンネル(HID)
+
+static int sent_packets = 0;
+
+static void hci_send_stub(uint8_t *data, size_t len)
+{
+  (void)data;
+  (void)len;
+  sent_packets++;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// H4のACLパケット(PB=0b10, BC=0)にL2CAPのペイロードを包んで渡す
+static void feed_l2cap(uint16_t cid, const uint8_t *payload, uint16_t len)
+{
+  uint8_t buf[64];
+  buf[0] = H4_TYPE_ACL;
+  buf[1] = (uint8_t)(WII_CH & 0xFF);
+  buf[2] = (uint8_t)(((WII_CH >> 8) & 0x0F) | 0x20);
+  buf[3] = (uint8_t)((len + 4) & 0xFF);
+  buf[4] = (uint8_t)((len + 4) >> 8);
+  buf[5] = (uint8_t)(len & 0xFF);
+  buf[6] = (uint8_t)(len >> 8);
+  buf[7] = (uint8_t)(cid & 0xFF);
+  buf[8] = (uint8_t)(cid >> 8);
+  memcpy(buf + 9, payload, len);
+  handleHciData(buf, 9 + len);
+}
+
+static void feed_buttons(uint16_t buttons)
+{
+  const uint8_t report[4] = {0xA1, 0x30, (uint8_t)(buttons >> 8), (uint8_t)(buttons & 0xFF)};
+  feed_l2cap(WII_CID, report, sizeof(report));
+}
+
+// 初期化し, 接続済みのL2CAPチャンネルを1つ作る (最初のHIDレポートでLEDとレポート形式の設定が送られる)
+static void connect_wiimote(void)
+{
+  TwHciInterface hci = {hci_send_stub};
+  TinyWiimoteInit(hci);
+  TinyWiimoteResetDevice();
+  const uint8_t conn_res[12] = {L2CAP_CONNECT_RES, 0x01, 0x08, 0x00,
+                                (uint8_t)(WII_CID & 0xFF), (uint8_t)(WII_CID >> 8), 0x41, 0x00,
+                                0x00, 0x00, 0x00, 0x00};
+  feed_l2cap(0x0001, conn_res, sizeof(conn_res));
+  feed_buttons(0x0000);
+  TinyWiimoteState st;
+  TinyWiimoteReadLatest(&st);
+}
+
+// 読まずに来たレポートは最新の1つで上書きされ, 上書きの数が数えられる
+void test_latest_state_overwrites(void)
+{
+  connect_wiimote();
+  TinyWiimoteStats before = TinyWiimoteGetStats();
+  TEST_ASSERT_EQUAL_INT(0, TinyWiimoteAvailable());
+
+  feed_buttons(0x0001);
+  feed_buttons(0x0002);
+  feed_buttons(0x0804);
+  TEST_ASSERT_TRUE(TinyWiimoteAvailable());
+
+  TinyWiimoteState st;
+  TEST_ASSERT_TRUE(TinyWiimoteReadLatest(&st));
+  TEST_ASSERT_EQUAL_HEX8(0x30, st.reportId);
+  TEST_ASSERT_EQUAL_HEX16(0x0804, st.buttons);
+  TEST_ASSERT_EQUAL_UINT8(0, st.hasAccel);
+  TEST_ASSERT_EQUAL_UINT8(0, st.extLen);
+  TEST_ASSERT_EQUAL_INT(0, TinyWiimoteAvailable());
+  TEST_ASSERT_FALSE(TinyWiimoteReadLatest(&st)); // 新しいレポートはない
+  TEST_ASSERT_EQUAL_HEX16(0x0804, st.buttons);
+
+  TinyWiimoteStats after = TinyWiimoteGetStats();
+  TEST_ASSERT_EQUAL_UINT32(3, after.reports - before.reports);
+  TEST_ASSERT_EQUAL_UINT32(2, after.overwritten - before.overwritten);
+
+  // 毎回読めば上書きは増えない
+  feed_buttons(0x0010);
+  TEST_ASSERT_TRUE(TinyWiimoteReadLatest(&st));
+  feed_buttons(0x0020);
+  TEST_ASSERT_TRUE(TinyWiimoteReadLatest(&st));
+  TEST_ASSERT_EQUAL_HEX16(0x0020, st.buttons);
+  TEST_ASSERT_EQUAL_UINT32(2, TinyWiimoteGetStats().overwritten - before.overwritten);
+
+  // データレポート以外(ステータス 0x20)は状態を変えない
+  const uint8_t status[8] = {0xA1, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+  feed_l2cap(WII_CID, status, sizeof(status));
+  TEST_ASSERT_FALSE(TinyWiimoteReadLatest(&st));
+}
+
+// 加速度と拡張コントローラのバイトを取り出し, TinyWiimoteRead()は元のレポートを組み直す
+void test_accel_and_extension_decode(void)
+{
+  connect_wiimote();
+  const uint8_t r31[7] = {0xA1, 0x31, 0x00, 0x08, 0x80, 0x81, 0x9A};
+  feed_l2cap(WII_CID, r31, sizeof(r31));
+  TinyWiimoteState st;
+  TEST_ASSERT_TRUE(TinyWiimoteReadLatest(&st));
+  TEST_ASSERT_EQUAL_HEX16(0x0008, st.buttons);
+  TEST_ASSERT_EQUAL_UINT8(1, st.hasAccel);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(r31 + 4, st.accel, 3);
+  TEST_ASSERT_EQUAL_UINT8(0, st.extLen);
+
+  uint8_t r35[23] = {0xA1, 0x35, 0x10, 0x00, 0x7F, 0x80, 0x99};
+  for (int i = 7; i < 23; i++)
+  {
+    r35[i] = (uint8_t)(0x20 + i);
+  }
+  feed_l2cap(WII_CID, r35, sizeof(r35));
+  TinyWiimoteData rd = TinyWiimoteRead();
+  TEST_ASSERT_EQUAL_UINT8(sizeof(r35), rd.len);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(r35, rd.data, sizeof(r35));
+  TEST_ASSERT_EQUAL_UINT8(0, TinyWiimoteRead().len); // 読んだ後は空
+
+  const uint8_t r32[12] = {0xA1, 0x32, 0x00, 0x01, 0x7E, 0x83, 0x55, 0x66, 0x77, 0x88, 0xFF, 0xFE};
+  feed_l2cap(WII_CID, r32, sizeof(r32));
+  rd = TinyWiimoteRead();
+  TEST_ASSERT_EQUAL_UINT8(sizeof(r32), rd.len);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(r32, rd.data, sizeof(r32));
+}
+
+// ボタンの変化はイベントキューに積まれ, あふれた分は数えて捨てる
+void test_button_event_overflow(void)
+{
+  connect_wiimote();
+  TinyWiimoteButtonEvent ev;
+  while (TinyWiimoteReadButtonEvent(&ev))
+  {
+  }
+  TinyWiimoteEnableButtonEvents(true);
+  TinyWiimoteStats before = TinyWiimoteGetStats();
+
+  feed_buttons(0x0000); // 変化なしは積まない
+  const int changes = 2 * TWII_BUTTON_EVENT_MAX_NUM;
+  for (int i = 0; i < changes; i++)
+  {
+    feed_buttons((i & 1) ? 0x0000 : 0x0404);
+  }
+
+  int n = 0;
+  while (TinyWiimoteReadButtonEvent(&ev))
+  {
+    // 先頭から押す・離すが交互に並ぶ
+    TEST_ASSERT_EQUAL_HEX16((n & 1) ? 0x0000 : 0x0404, ev.pressed);
+    TEST_ASSERT_EQUAL_HEX16((n & 1) ? 0x0404 : 0x0000, ev.released);
+    n++;
+  }
+  TinyWiimoteStats after = TinyWiimoteGetStats();
+  TEST_ASSERT_EQUAL_INT(TWII_BUTTON_EVENT_MAX_NUM - 1, n); // 1つ空けて満杯を見分ける
+  TEST_ASSERT_EQUAL_UINT32(changes - n, after.eventsDropped - before.eventsDropped);
+  TEST_ASSERT_EQUAL_UINT32(changes + 1, after.reports - before.reports);
+
+  // 空けば再び積まれる
+  feed_buttons(0x0404);
+  TEST_ASSERT_TRUE(TinyWiimoteReadButtonEvent(&ev));
+  TEST_ASSERT_EQUAL_HEX16(0x0404, ev.pressed);
+  TEST_ASSERT_FALSE(TinyWiimoteReadButtonEvent(&ev));
+  TinyWiimoteEnableButtonEvents(false);
+  TEST_ASSERT_GREATER_THAN(0, sent_packets); // 接続時の設定(LED, レポート形式)は送られている
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  setenv("MRD_SIM_QUIET", "1", 0);
+  UNITY_BEGIN();
+  RUN_TEST(test_latest_state_overwrites);
+  RUN_TEST(test_accel_and_extension_decode);
+  RUN_TEST(test_button_event_overflow);
+  int rc = UNITY_END();
+  fflush(stdout);
+  _Exit(rc); // タスクのスレッドは終了しないため, 待たずに終わる
+}
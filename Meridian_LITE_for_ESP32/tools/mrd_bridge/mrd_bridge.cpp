@@ -0,0 +1,514 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/tools/mrd_bridge/mrd_bridge.cpp
+ * @brief   PC-side bridge that owns the Meridim UDP link and shares it with local programs.
+ *
+ *   pio run -e bridge
+ *   .pio/build/bridge/program [--host IP] [--port-board N] [--port-local N] [--name NAME] [--hold-ms MS] [--seconds S]
+ *   .pio/build/bridge/program --tail [--name NAME] [--priority P] [--master CMD] [--rate HZ] [--seconds S]
+ *   .pio/build/bridge/program --bench [--frames N] [--readers K] [--rate HZ] [--slow-us US] [--json]
+ *
+ * Only one program can listen on UDP_SEND_PORT. The bridge does, publishes every Meridim with
+ * a valid checksum into the shared-memory ring of mrd_bridge_ring.h, and sends the commands of
+ * the local clients to UDP_RESV_PORT of the board as one stream: only the highest priority client
+ * that wrote a command within --hold-ms (default 100) is sent, with its own sequence in Meridim[1].
+ * Client commands are picked up within 1 ms. Once a second it prints the receive / send rates and,
+ * per client, the priority, how far behind its reader is, and the commands sent / overridden.
+ *
+ * --tail is a minimal client: it reads every frame zero-copy and prints the rate, the lag behind
+ * the bridge and the time from reception to read; with --rate it also sends Meridim frames with
+ * master command --master (default 90) at --priority.
+ *
+ * --bench runs a writer and --readers reader threads (each with its own mapping, as separate
+ * processes would) on a private ring without the network. The writer publishes --frames frames at
+ * --rate (0: as fast as possible); it reports the publish throughput and, per reader, the frames read,
+ * skipped (lapped by the writer) and torn (overwritten while in use), the lag in frames and the
+ * publish-to-read latency. --slow-us makes the last reader sleep after each frame, like a slow logger.
+ * Every frame that release() accepts is checked against its checksum; a mismatch fails the run.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "keys.h"
+#include "mrd_bridge_ring.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define BRIDGE_CMD_NORMAL 90           // 通常動作のマスターコマンド
+#define BRIDGE_BENCH_NAME "/mrd_bridge_bench" // ベンチマーク用のリングの名前
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  struct Options
+  {
+    const char *host = "192.168.7.107"; // main.cpp の ip と同じ
+    int port_board = UDP_RESV_PORT;
+    int port_local = UDP_SEND_PORT;
+    const char *name = MRD_BRIDGE_NAME;
+    double hold_ms = 100;
+    double seconds = 0; // 0:止めるまで
+    bool tail = false;
+    int priority = 0;
+    int master = BRIDGE_CMD_NORMAL;
+    double rate = 0;
+    bool bench = false;
+    long frames = 200000;
+    int readers = 3;
+    long slow_us = 0;
+    bool json = false;
+  };
+
+  volatile sig_atomic_t stop = 0;
+
+  void on_signal(int)
+  {
+    stop = 1;
+  }
+
+  int64_t now_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
+
+  int64_t percentile(const std::vector<int64_t> &sorted, double p)
+  {
+    if (sorted.empty())
+    {
+      return 0;
+    }
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+  }
+
+  void usage(const char *prog)
+  {
+    fprintf(stderr,
+            "usage: %s [--host IP] [--port-board N] [--port-local N] [--name NAME] [--hold-ms MS] [--seconds S]\n"
+            "       %s --tail [--name NAME] [--priority P] [--master CMD] [--rate HZ] [--seconds S]\n"
+            "       %s --bench [--frames N] [--readers K] [--rate HZ] [--slow-us US] [--json]\n",
+            prog, prog, prog);
+  }
+
+  /* ブリッジ: ロボットとのUDPを持ち, 受信をリングに載せ, コマンドをまとめて送る */
+  int run_bridge(const Options &opt)
+  {
+    MrdBridgeRing ring;
+    if (!ring.create(opt.name))
+    {
+      return 1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons((uint16_t)opt.port_local);
+    if ((fd < 0) or (bind(fd, (sockaddr *)&local, sizeof(local)) != 0))
+    {
+      perror("bind");
+      return 1;
+    }
+    sockaddr_in board;
+    memset(&board, 0, sizeof(board));
+    board.sin_family = AF_INET;
+    board.sin_port = htons((uint16_t)opt.port_board);
+    if (inet_pton(AF_INET, opt.host, &board.sin_addr) != 1)
+    {
+      fprintf(stderr, "bad host: %s\n", opt.host);
+      close(fd);
+      return 1;
+    }
+    printf("[bridge] %s:%d <-> :%d shared as %s\n", opt.host, opt.port_board, opt.port_local, opt.name);
+    fflush(stdout);
+
+    MrdBridgeShm *m = ring.shm();
+    int64_t hold_ns = (int64_t)(opt.hold_ms * 1e6);
+    int64_t t_start = now_ns();
+    int64_t t_report = t_start + 1000000000LL;
+    uint64_t head_last = 0;
+    uint64_t tx_last = 0;
+    short rx[MRD_BRIDGE_MSG + 1]; // 長すぎるパケットを見分けるため1語多く受ける
+    short out[MRD_BRIDGE_MSG];
+    while (!stop and ((opt.seconds <= 0) or (now_ns() - t_start < (int64_t)(opt.seconds * 1e9))))
+    {
+      pollfd pfd = {fd, POLLIN, 0};
+      if (poll(&pfd, 1, 1) > 0) // コマンドを1ms以内に拾うため, 受信がなくても1msで戻る
+      {
+        ssize_t n;
+        while ((n = recv(fd, rx, sizeof(rx), MSG_DONTWAIT)) > 0)
+        {
+          if ((n == MRD_BRIDGE_MSG * 2) and (rx[MRD_BRIDGE_MSG - 1] == mrd_bridge_checksum(rx)))
+          {
+            ring.publish(rx, now_ns());
+          }
+          else
+          {
+            m->rx_bad.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      }
+
+      int64_t t = now_ns();
+      if (ring.merge(t, hold_ns, out) >= 0)
+      {
+        sendto(fd, out, sizeof(out), 0, (sockaddr *)&board, sizeof(board));
+      }
+
+      if (t >= t_report) // 1秒ごとの表示
+      {
+        ring.reap();
+        uint64_t head = m->head.load(std::memory_order_relaxed);
+        uint64_t tx = m->tx.load(std::memory_order_relaxed);
+        printf("[bridge] rx/s:%llu bad:%llu tx/s:%llu", (unsigned long long)(head - head_last),
+               (unsigned long long)m->rx_bad.load(std::memory_order_relaxed), (unsigned long long)(tx - tx_last));
+        for (int i = 0; i < MRD_BRIDGE_CLIENTS; i++)
+        {
+          const MrdBridgeClient &c = m->client[i];
+          int32_t pid = c.pid.load(std::memory_order_relaxed);
+          if (pid != 0)
+          {
+            uint64_t cursor = c.cursor.load(std::memory_order_relaxed);
+            printf(" %d:pid%d prio:%d lag:%llu sent:%llu over:%llu", i, (int)pid, c.priority,
+                   (unsigned long long)((head > cursor) ? head - cursor : 0),
+                   (unsigned long long)c.sent.load(std::memory_order_relaxed),
+                   (unsigned long long)c.overridden.load(std::memory_order_relaxed));
+          }
+        }
+        printf("\n");
+        fflush(stdout);
+        head_last = head;
+        tx_last = tx;
+        t_report += 1000000000LL;
+      }
+    }
+    close(fd);
+    return 0;
+  }
+
+  /* 最小の利用側: 全フレームを読み, --rate があればコマンドも送る */
+  int run_tail(const Options &opt)
+  {
+    MrdBridgeRing ring;
+    if (!ring.open(opt.name))
+    {
+      fprintf(stderr, "%s: no bridge\n", opt.name);
+      return 1;
+    }
+    int client = ring.join(opt.priority);
+    if (client < 0)
+    {
+      fprintf(stderr, "%s: all %d client slots are taken\n", opt.name, MRD_BRIDGE_CLIENTS);
+      return 1;
+    }
+    MrdBridgeReader reader;
+    reader.begin(&ring, client);
+
+    short cmd[MRD_BRIDGE_MSG];
+    memset(cmd, 0, sizeof(cmd));
+    cmd[0] = (short)opt.master;
+    int64_t period_ns = (opt.rate > 0) ? (int64_t)(1e9 / opt.rate) : 0;
+    int64_t t_start = now_ns();
+    int64_t t_cmd = t_start;
+    int64_t t_report = t_start + 1000000000LL;
+    long rx = 0;
+    long bad = 0;
+    uint64_t lag_max = 0;
+    std::vector<int64_t> lat_ns;
+    while (!stop and ring.alive() and ((opt.seconds <= 0) or (now_ns() - t_start < (int64_t)(opt.seconds * 1e9))))
+    {
+      const MrdBridgeSlot *s = reader.next();
+      if (s != nullptr)
+      {
+        lag_max = std::max(lag_max, reader.lag());
+        int64_t lat = now_ns() - s->t_ns;
+        bool ok = (s->meridim[MRD_BRIDGE_MSG - 1] == mrd_bridge_checksum(s->meridim));
+        if (reader.release())
+        {
+          rx++;
+          bad += ok ? 0 : 1;
+          lat_ns.push_back(lat);
+        }
+        continue;
+      }
+
+      int64_t t = now_ns();
+      if ((period_ns > 0) and (t >= t_cmd))
+      {
+        cmd[MRD_BRIDGE_MSG - 1] = mrd_bridge_checksum(cmd);
+        ring.command(client, cmd, t);
+        t_cmd += period_ns;
+      }
+      if (t >= t_report)
+      {
+        std::sort(lat_ns.begin(), lat_ns.end());
+        const MrdBridgeClient &c = ring.shm()->client[client];
+        printf("[tail] rx/s:%ld bad:%ld lag max:%llu skipped:%llu torn:%llu latency us p50:%.1f max:%.1f sent:%llu over:%llu\n",
+               rx, bad, (unsigned long long)lag_max, (unsigned long long)reader.skipped(),
+               (unsigned long long)reader.torn(), percentile(lat_ns, 0.5) / 1e3,
+               (lat_ns.empty() ? 0 : lat_ns.back()) / 1e3, (unsigned long long)c.sent.load(std::memory_order_relaxed),
+               (unsigned long long)c.overridden.load(std::memory_order_relaxed));
+        fflush(stdout);
+        rx = 0;
+        bad = 0;
+        lag_max = 0;
+        lat_ns.clear();
+        t_report += 1000000000LL;
+      }
+      usleep(200);
+    }
+    ring.leave(client);
+    return 0;
+  }
+
+  /* ベンチマークの読み手1つの結果 */
+  struct BenchReader
+  {
+    long read = 0;
+    long bad = 0; // release()が通ったのにチェックサムが合わない(検出できなかった上書き)
+    uint64_t skipped = 0;
+    uint64_t torn = 0;
+    uint64_t lag_max = 0;
+    std::vector<int64_t> lat_ns;
+  };
+
+  void bench_read(const Options &opt, bool slow, const std::atomic<bool> *done, std::atomic<int> *ready, BenchReader *res)
+  {
+    MrdBridgeRing ring; // 別プロセスと同じように自分の対応付けを持つ
+    if (!ring.open(BRIDGE_BENCH_NAME))
+    {
+      ready->fetch_add(1);
+      return;
+    }
+    MrdBridgeReader reader;
+    reader.begin(&ring);
+    res->lat_ns.reserve(opt.frames);
+    ready->fetch_add(1);
+    for (;;)
+    {
+      const MrdBridgeSlot *s = reader.next();
+      if (s == nullptr)
+      {
+        if (done->load() and (reader.lag() == 0))
+        {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      res->lag_max = std::max(res->lag_max, reader.lag());
+      int64_t lat = now_ns() - s->t_ns;
+      bool ok = (s->meridim[MRD_BRIDGE_MSG - 1] == mrd_bridge_checksum(s->meridim));
+      if (slow)
+      {
+        std::this_thread::sleep_for(std::chrono::microseconds(opt.slow_us));
+      }
+      if (reader.release())
+      {
+        res->read++;
+        res->bad += ok ? 0 : 1;
+        res->lat_ns.push_back(lat);
+      }
+    }
+    res->skipped = reader.skipped();
+    res->torn = reader.torn();
+  }
+
+  int run_bench(const Options &opt)
+  {
+    MrdBridgeRing ring;
+    if (!ring.create(BRIDGE_BENCH_NAME))
+    {
+      return 1;
+    }
+    std::atomic<bool> done(false);
+    std::atomic<int> ready(0);
+    std::vector<BenchReader> res(opt.readers);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < opt.readers; k++)
+    {
+      threads.push_back(std::thread(bench_read, std::cref(opt), (opt.slow_us > 0) and (k == opt.readers - 1), &done,
+                                    &ready, &res[k]));
+    }
+    while (ready.load() < opt.readers)
+    {
+      std::this_thread::yield();
+    }
+
+    short frame[MRD_BRIDGE_MSG];
+    uint32_t x = 2463534242UL; // xorshift. 中身はフレームごとに変える
+    int64_t period_ns = (opt.rate > 0) ? (int64_t)(1e9 / opt.rate) : 0;
+    int64_t t_start = now_ns();
+    int64_t t_pub = 0; // publish()自体にかかった時間
+    for (long n = 0; n < opt.frames; n++)
+    {
+      if (period_ns > 0)
+      {
+        while (now_ns() < t_start + n * period_ns)
+        {
+          std::this_thread::yield();
+        }
+      }
+      frame[0] = BRIDGE_CMD_NORMAL;
+      frame[1] = (short)(n % 60000);
+      for (int i = 2; i < MRD_BRIDGE_MSG - 1; i++)
+      {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        frame[i] = (short)x;
+      }
+      frame[MRD_BRIDGE_MSG - 1] = mrd_bridge_checksum(frame);
+      int64_t t = now_ns();
+      ring.publish(frame, t);
+      t_pub += now_ns() - t;
+    }
+    double elapsed = (now_ns() - t_start) / 1e9;
+    done.store(true);
+    for (size_t k = 0; k < threads.size(); k++)
+    {
+      threads[k].join();
+    }
+
+    bool fail = false;
+    if (opt.json)
+    {
+      printf("{\"frames\":%ld,\"rate_hz\":%.1f,\"seconds\":%.3f,\"frames_per_sec\":%.0f,\"publish_ns\":%.1f,\"readers\":[",
+             opt.frames, opt.rate, elapsed, opt.frames / elapsed, (double)t_pub / opt.frames);
+    }
+    else
+    {
+      printf("[bench] frames:%ld rate:%s %.3fs publish frames/s:%.0f ns/frame:%.1f\n", opt.frames,
+             (opt.rate > 0) ? "fixed" : "max", elapsed, opt.frames / elapsed, (double)t_pub / opt.frames);
+    }
+    for (int k = 0; k < opt.readers; k++)
+    {
+      BenchReader &r = res[k];
+      std::sort(r.lat_ns.begin(), r.lat_ns.end());
+      fail = fail or (r.bad > 0) or (r.read == 0);
+      if (opt.json)
+      {
+        printf("%s{\"read\":%ld,\"skipped\":%llu,\"torn\":%llu,\"bad\":%ld,\"lag_max\":%llu,"
+               "\"latency_us\":{\"p50\":%.2f,\"p99\":%.2f,\"p999\":%.2f,\"max\":%.2f}}",
+               (k > 0) ? "," : "", r.read, (unsigned long long)r.skipped, (unsigned long long)r.torn, r.bad,
+               (unsigned long long)r.lag_max, percentile(r.lat_ns, 0.5) / 1e3, percentile(r.lat_ns, 0.99) / 1e3,
+               percentile(r.lat_ns, 0.999) / 1e3, (r.lat_ns.empty() ? 0 : r.lat_ns.back()) / 1e3);
+      }
+      else
+      {
+        printf("[bench] reader %d%s read:%ld skipped:%llu torn:%llu bad:%ld lag max:%llu latency us p50:%.2f p99:%.2f "
+               "p99.9:%.2f max:%.2f\n",
+               k, ((opt.slow_us > 0) and (k == opt.readers - 1)) ? "(slow)" : "", r.read, (unsigned long long)r.skipped,
+               (unsigned long long)r.torn, r.bad, (unsigned long long)r.lag_max, percentile(r.lat_ns, 0.5) / 1e3,
+               percentile(r.lat_ns, 0.99) / 1e3, percentile(r.lat_ns, 0.999) / 1e3,
+               (r.lat_ns.empty() ? 0 : r.lat_ns.back()) / 1e3);
+      }
+    }
+    if (opt.json)
+    {
+      printf("]}\n");
+    }
+    return fail ? 1 : 0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; i++)
+  {
+    bool has_val = (i + 1 < argc);
+    if ((strcmp(argv[i], "--host") == 0) and has_val)
+    {
+      opt.host = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--port-board") == 0) and has_val)
+    {
+      opt.port_board = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--port-local") == 0) and has_val)
+    {
+      opt.port_local = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--name") == 0) and has_val)
+    {
+      opt.name = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--hold-ms") == 0) and has_val)
+    {
+      opt.hold_ms = atof(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--seconds") == 0) and has_val)
+    {
+      opt.seconds = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--tail") == 0)
+    {
+      opt.tail = true;
+    }
+    else if ((strcmp(argv[i], "--priority") == 0) and has_val)
+    {
+      opt.priority = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--master") == 0) and has_val)
+    {
+      opt.master = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--rate") == 0) and has_val)
+    {
+      opt.rate = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--bench") == 0)
+    {
+      opt.bench = true;
+    }
+    else if ((strcmp(argv[i], "--frames") == 0) and has_val)
+    {
+      opt.frames = atol(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--readers") == 0) and has_val)
+    {
+      opt.readers = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--slow-us") == 0) and has_val)
+    {
+      opt.slow_us = atol(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--json") == 0)
+    {
+      opt.json = true;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if ((opt.frames < 1) or (opt.readers < 1))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  if (opt.bench)
+  {
+    return run_bench(opt);
+  }
+  return opt.tail ? run_tail(opt) : run_bridge(opt);
+}
@@ -0,0 +1,318 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/tools/mrd_bridge/mrd_bridge_ring.cpp
+ * @brief   Shared-memory Meridim ring of the host bridge (POSIX shm).
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_bridge_ring.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the shared ring needs lock-free 64-bit atomics");
+static_assert((MRD_BRIDGE_SLOTS & (MRD_BRIDGE_SLOTS - 1)) == 0, "MRD_BRIDGE_SLOTS must be a power of 2");
+
+namespace
+{
+  bool process_alive(int32_t pid)
+  {
+    return (pid > 0) and ((kill(pid, 0) == 0) or (errno == EPERM));
+  }
+}
+
+short mrd_bridge_checksum(const short *meridim)
+{
+  int sum = 0;
+  for (int i = 0; i < MRD_BRIDGE_MSG - 1; i++)
+  {
+    sum += meridim[i];
+  }
+  return (short)~sum;
+}
+
+bool MrdBridgeRing::map(const char *name, int fd)
+{
+  void *p = mmap(nullptr, sizeof(MrdBridgeShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+  {
+    perror(name);
+    return false;
+  }
+  m = (MrdBridgeShm *)p;
+  return true;
+}
+
+bool MrdBridgeRing::create(const char *name)
+{
+  if (open(name)) // 前のブリッジのリングが残っている
+  {
+    bool live = alive();
+    close();
+    if (live)
+    {
+      fprintf(stderr, "%s: another bridge is running\n", name);
+      return false;
+    }
+  }
+  shm_unlink(name);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+  if ((fd < 0) or (ftruncate(fd, sizeof(MrdBridgeShm)) != 0)) // ftruncateで0に初期化される
+  {
+    perror(name);
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+    return false;
+  }
+  if (!map(name, fd))
+  {
+    shm_unlink(name);
+    return false;
+  }
+  m->version = MRD_BRIDGE_VERSION;
+  m->slots = MRD_BRIDGE_SLOTS;
+  m->msg = MRD_BRIDGE_MSG;
+  m->bridge_pid.store(getpid(), std::memory_order_relaxed);
+  strncpy(owned, name, sizeof(owned) - 1);
+  m->magic.store(MRD_BRIDGE_MAGIC, std::memory_order_release); // 初期化の完了を利用側に知らせる
+  return true;
+}
+
+bool MrdBridgeRing::open(const char *name)
+{
+  close();
+  int fd = shm_open(name, O_RDWR, 0);
+  struct stat st;
+  if ((fd < 0) or (fstat(fd, &st) != 0) or (st.st_size != (off_t)sizeof(MrdBridgeShm)))
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+    return false;
+  }
+  if (!map(name, fd))
+  {
+    return false;
+  }
+  if ((m->magic.load(std::memory_order_acquire) != MRD_BRIDGE_MAGIC) or (m->version != MRD_BRIDGE_VERSION) or
+      (m->slots != MRD_BRIDGE_SLOTS) or (m->msg != MRD_BRIDGE_MSG))
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MrdBridgeRing::close()
+{
+  if (m == nullptr)
+  {
+    return;
+  }
+  if (owned[0] != '\0')
+  {
+    m->bridge_pid.store(0, std::memory_order_relaxed);
+    shm_unlink(owned); // 開いている利用側はそのまま読めるが, 新しいブリッジとは別のリングになる
+    owned[0] = '\0';
+  }
+  munmap(m, sizeof(MrdBridgeShm));
+  m = nullptr;
+}
+
+bool MrdBridgeRing::alive() const
+{
+  return (m != nullptr) and process_alive(m->bridge_pid.load(std::memory_order_relaxed));
+}
+
+void MrdBridgeRing::publish(const short *meridim, int64_t t_ns)
+{
+  uint64_t n = m->head.load(std::memory_order_relaxed);
+  MrdBridgeSlot &s = m->slot[n & (MRD_BRIDGE_SLOTS - 1)];
+  s.seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release); // 奇数が中身より先に見えるように
+  s.t_ns = t_ns;
+  memcpy(s.meridim, meridim, sizeof(s.meridim));
+  s.seq.store(2 * n + 2, std::memory_order_release);
+  m->head.store(n + 1, std::memory_order_release);
+}
+
+int MrdBridgeRing::join(int priority)
+{
+  for (int i = 0; i < MRD_BRIDGE_CLIENTS; i++)
+  {
+    MrdBridgeClient &c = m->client[i];
+    int32_t expect = 0;
+    if (c.pid.compare_exchange_strong(expect, getpid()))
+    {
+      c.priority = priority; // cmd_seq は前の持ち主から続けて増やす(ブリッジが新しいコマンドと分かるように)
+      c.cursor.store(m->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+      c.sent.store(0, std::memory_order_relaxed);
+      c.overridden.store(0, std::memory_order_relaxed);
+      return i;
+    }
+  }
+  return -1;
+}
+
+void MrdBridgeRing::leave(int client)
+{
+  if ((client >= 0) and (client < MRD_BRIDGE_CLIENTS))
+  {
+    m->client[client].pid.store(0, std::memory_order_release);
+  }
+}
+
+void MrdBridgeRing::command(int client, const short *meridim, int64_t t_ns)
+{
+  MrdBridgeClient &c = m->client[client];
+  uint64_t s = c.cmd_seq.load(std::memory_order_relaxed);
+  c.cmd_seq.store(s + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  c.cmd_t_ns = t_ns;
+  memcpy(c.cmd, meridim, sizeof(c.cmd));
+  c.cmd_seq.store(s + 2, std::memory_order_release);
+}
+
+int MrdBridgeRing::merge(int64_t now_ns, int64_t hold_ns, short *out)
+{
+  bool fresh[MRD_BRIDGE_CLIENTS] = {false};
+  uint64_t seq[MRD_BRIDGE_CLIENTS] = {0};
+  int best = -1;
+  for (int i = 0; i < MRD_BRIDGE_CLIENTS; i++)
+  {
+    MrdBridgeClient &c = m->client[i];
+    int32_t pid = c.pid.load(std::memory_order_acquire);
+    if (pid != cmd_pid[i]) // 枠の持ち主が替わった
+    {
+      cmd_pid[i] = pid;
+      cmd_t[i] = 0;
+    }
+    if (pid == 0)
+    {
+      continue;
+    }
+    seq[i] = c.cmd_seq.load(std::memory_order_acquire);
+    if ((seq[i] != cmd_seen[i]) and ((seq[i] & 1) == 0)) // 新しいコマンド. 先に時刻だけ読む
+    {
+      int64_t t = c.cmd_t_ns;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (c.cmd_seq.load(std::memory_order_relaxed) == seq[i])
+      {
+        cmd_t[i] = t;
+        fresh[i] = true;
+      }
+    }
+    bool active = (cmd_t[i] != 0) and (now_ns - cmd_t[i] < hold_ns);
+    if (active and ((best < 0) or (c.priority > m->client[best].priority)))
+    {
+      best = i;
+    }
+  }
+
+  for (int i = 0; i < MRD_BRIDGE_CLIENTS; i++) // 優先度の低いクライアントの新しいコマンドは送らない
+  {
+    if (fresh[i] and (i != best))
+    {
+      cmd_seen[i] = seq[i];
+      m->client[i].overridden.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if ((best < 0) or !fresh[best])
+  {
+    return -1;
+  }
+
+  MrdBridgeClient &c = m->client[best];
+  memcpy(out, c.cmd, sizeof(c.cmd));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (c.cmd_seq.load(std::memory_order_relaxed) != seq[best]) // コピー中に書き換えられた. 次の呼び出しで読み直す
+  {
+    return -1;
+  }
+  cmd_seen[best] = seq[best];
+  out[1] = (short)tx_seq;
+  tx_seq = (tx_seq >= 59999) ? 0 : tx_seq + 1;
+  out[MRD_BRIDGE_MSG - 1] = mrd_bridge_checksum(out);
+  c.sent.fetch_add(1, std::memory_order_relaxed);
+  m->tx.fetch_add(1, std::memory_order_relaxed);
+  return best;
+}
+
+void MrdBridgeRing::reap()
+{
+  for (int i = 0; i < MRD_BRIDGE_CLIENTS; i++)
+  {
+    int32_t pid = m->client[i].pid.load(std::memory_order_relaxed);
+    if ((pid != 0) and !process_alive(pid))
+    {
+      m->client[i].pid.compare_exchange_strong(pid, 0);
+    }
+  }
+}
+
+void MrdBridgeReader::begin(MrdBridgeRing *ring, int client, bool latest)
+{
+  m = ring->shm();
+  this->client = client;
+  uint64_t h = m->head.load(std::memory_order_acquire);
+  cursor = latest ? h : ((h > MRD_BRIDGE_SLOTS) ? h - MRD_BRIDGE_SLOTS : 0);
+  cur = nullptr;
+  n_skipped = 0;
+  n_torn = 0;
+}
+
+const MrdBridgeSlot *MrdBridgeReader::next()
+{
+  for (;;)
+  {
+    uint64_t h = m->head.load(std::memory_order_acquire);
+    if (cursor >= h)
+    {
+      return nullptr;
+    }
+    if (h - cursor > MRD_BRIDGE_SLOTS) // 1周以上遅れた. 残っている最も古いフレームに飛ぶ
+    {
+      n_skipped += h - MRD_BRIDGE_SLOTS - cursor;
+      cursor = h - MRD_BRIDGE_SLOTS;
+    }
+    const MrdBridgeSlot &s = m->slot[cursor & (MRD_BRIDGE_SLOTS - 1)];
+    if (s.seq.load(std::memory_order_acquire) == 2 * cursor + 2)
+    {
+      cur = &s;
+      return cur;
+    }
+    n_skipped++; // 読む前に上書きされた(書き込み中を含む)
+    cursor++;
+  }
+}
+
+bool MrdBridgeReader::release()
+{
+  std::atomic_thread_fence(std::memory_order_acquire); // 中身を読み終えてからseqを読み直す
+  bool ok = (cur != nullptr) and (cur->seq.load(std::memory_order_relaxed) == 2 * cursor + 2);
+  n_torn += ok ? 0 : 1;
+  cursor++;
+  cur = nullptr;
+  if (client >= 0)
+  {
+    m->client[client].cursor.store(cursor, std::memory_order_relaxed);
+  }
+  return ok;
+}
+
+uint64_t MrdBridgeReader::lag() const
+{
+  uint64_t h = m->head.load(std::memory_order_acquire);
+  return (h > cursor) ? h - cursor : 0;
+}
@@ -0,0 +1,193 @@
+#ifndef __MERIDIAN_BRIDGE_RING__
+#define __MERIDIAN_BRIDGE_RING__
+
+#include <atomic>
+#include <cstdint>
+
+/*
+  PC側のブリッジ(mrd_bridge.cpp)と利用側のプログラムが共有するメモリの形式
+  ブリッジだけがロボットとのUDPを持ち, 受信したMeridimを共有メモリのリングに書く(書き手は1つ).
+  利用側(可視化, 記録, 制御など何個でも)はリングのスロットを直接読み, コピーしない.
+  各スロットはシーケンスロックで, 書き込み中は奇数, フレームnを書き終わると 2n+2 になる.
+  読んだ後にこの値が変わっていなければ, 読んでいる間に上書きされていない.
+  リングを1周以上遅れた利用側は, まだ残っている最も古いフレームに飛ぶ(飛ばした数を数える).
+
+  コマンドは利用側がクライアントの枠(優先度付き)に最新の1フレームを書き, ブリッジがまとめて
+  1つの送信列にする. 直近 hold の間にコマンドを書いた中で優先度が最も高いクライアントだけが送られ,
+  それより低いクライアントのコマンドは送らずに数える. 送るMeridimの[1]はブリッジの通し番号に
+  書き換え, チェックサムを付け直す.
+
+  プロセス間で std::atomic を使うため, 64bitのアトミックがロックフリーの環境が必要.
+*/
+#define MRD_BRIDGE_NAME "/mrd_bridge" // 共有メモリの既定の名前
+#define MRD_BRIDGE_MAGIC 0x4244524D   // "MRDB"
+#define MRD_BRIDGE_VERSION 1
+#define MRD_BRIDGE_SLOTS 1024 // リングのスロット数(2のべき乗)
+#define MRD_BRIDGE_CLIENTS 8  // クライアントの枠の数
+#define MRD_BRIDGE_MSG 90     // Meridim90の要素数
+
+/* リングの1フレーム */
+struct alignas(64) MrdBridgeSlot
+{
+  std::atomic<uint64_t> seq; // 書き込み中は奇数, フレームnを書き終わると 2n+2
+  int64_t t_ns;              // ブリッジが受信した時刻(steady_clock)
+  short meridim[MRD_BRIDGE_MSG];
+};
+
+/* 利用側のクライアントの枠 */
+struct alignas(64) MrdBridgeClient
+{
+  std::atomic<int32_t> pid;      // 0:空き
+  int32_t priority;              // 大きいほど優先
+  std::atomic<uint64_t> cmd_seq; // コマンドのシーケンスロック(スロットと同じ)
+  int64_t cmd_t_ns;              // コマンドを書いた時刻
+  short cmd[MRD_BRIDGE_MSG];
+  std::atomic<uint64_t> cursor;     // 次に読むフレーム番号(ブリッジの遅れの表示用)
+  std::atomic<uint64_t> sent;       // ブリッジがボードに送ったコマンド数
+  std::atomic<uint64_t> overridden; // 優先度の高いクライアントがいて送らなかったコマンド数
+};
+
+/* 共有メモリ全体 */
+struct MrdBridgeShm
+{
+  std::atomic<uint32_t> magic; // 初期化が終わると MRD_BRIDGE_MAGIC
+  uint32_t version;
+  uint32_t slots;
+  uint32_t msg;
+  std::atomic<int32_t> bridge_pid;
+  alignas(64) std::atomic<uint64_t> head; // 書いたフレーム数
+  std::atomic<uint64_t> rx_bad;           // チェックサムが合わず載せなかった受信数
+  std::atomic<uint64_t> tx;               // ボードに送ったコマンド数
+  MrdBridgeClient client[MRD_BRIDGE_CLIENTS];
+  MrdBridgeSlot slot[MRD_BRIDGE_SLOTS];
+};
+
+/**
+ * @brief Mapping of the shared ring, used by the bridge (create) and by consumers (open).
+ */
+class MrdBridgeRing
+{
+public:
+  ~MrdBridgeRing() { close(); }
+
+  /**
+   * @brief Create the ring (bridge side). Fails if another live bridge owns the name.
+   */
+  bool create(const char *name = MRD_BRIDGE_NAME);
+
+  /**
+   * @brief Map an existing ring (consumer side).
+   */
+  bool open(const char *name = MRD_BRIDGE_NAME);
+
+  /**
+   * @brief Unmap, and remove the name if this process created it.
+   */
+  void close();
+
+  MrdBridgeShm *shm() const { return m; }
+
+  /**
+   * @brief true while the bridge process that created the ring is running.
+   */
+  bool alive() const;
+
+  /**
+   * @brief Publish one frame (bridge side, single writer).
+   */
+  void publish(const short *meridim, int64_t t_ns);
+
+  /**
+   * @brief Take a client slot for this process.
+   *
+   * @return int Client index, or -1 if all are taken.
+   */
+  int join(int priority);
+  void leave(int client);
+
+  /**
+   * @brief Replace the latest command of a client (consumer side, one writer per client).
+   */
+  void command(int client, const short *meridim, int64_t t_ns);
+
+  /**
+   * @brief Merge the client commands into the outbound stream (bridge side).
+   *        Only the highest priority client that wrote a command within hold_ns is sent.
+   *
+   * @param[out] out Command to send, with Meridim[1] and the checksum rewritten.
+   * @return int Client of out, or -1 if there is nothing new to send.
+   */
+  int merge(int64_t now_ns, int64_t hold_ns, short *out);
+
+  /**
+   * @brief Free the slots of clients whose process has exited (bridge side).
+   */
+  void reap();
+
+private:
+  bool map(const char *name, int fd);
+
+  MrdBridgeShm *m = nullptr;
+  char owned[64] = {0};                        // create()した名前
+  int32_t cmd_pid[MRD_BRIDGE_CLIENTS] = {0};   // merge()で見た枠の持ち主
+  uint64_t cmd_seen[MRD_BRIDGE_CLIENTS] = {0}; // merge()で読んだコマンドのシーケンス
+  int64_t cmd_t[MRD_BRIDGE_CLIENTS] = {0};     // 読んだコマンドの時刻(0:なし)
+  uint16_t tx_seq = 0;                         // 送るMeridim[1]の通し番号(0-59999)
+};
+
+/**
+ * @brief Zero-copy reader of the ring. One per consumer thread.
+ *
+ *   const MrdBridgeSlot *s;
+ *   while ((s = reader.next()) != nullptr)
+ *   {
+ *     use(s->meridim);
+ *     if (!reader.release()) { ... s was overwritten while in use, drop what was derived from it }
+ *   }
+ */
+class MrdBridgeReader
+{
+public:
+  /**
+   * @brief Start reading.
+   *
+   * @param[in] client Client slot to report the position to the bridge, or -1.
+   * @param[in] latest true to start at the next frame, false at the oldest one in the ring.
+   */
+  void begin(MrdBridgeRing *ring, int client = -1, bool latest = true);
+
+  /**
+   * @brief Next frame, or nullptr if none yet. Valid until release().
+   */
+  const MrdBridgeSlot *next();
+
+  /**
+   * @brief Finish with the frame of next().
+   *
+   * @return true if it was not overwritten while in use.
+   */
+  bool release();
+
+  /**
+   * @brief Frames published but not read yet.
+   */
+  uint64_t lag() const;
+
+  uint64_t skipped() const { return n_skipped; } // 1周以上遅れて飛ばしたフレーム数
+  uint64_t torn() const { return n_torn; }       // 使っている間に上書きされたフレーム数
+
+private:
+  MrdBridgeShm *m = nullptr;
+  int client = -1;
+  uint64_t cursor = 0;
+  const MrdBridgeSlot *cur = nullptr;
+  uint64_t n_skipped = 0;
+  uint64_t n_torn = 0;
+};
+
+/**
+ * @brief Meridim checksum (~sum of the first 89 words).
+ */
+short mrd_bridge_checksum(const short *meridim);
+
+#endif
@@ -0,0 +1,232 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/tools/mrd_delta_bench/mrd_delta_bench.cpp
+ * @brief   Host benchmark of the delta Meridim wire format on recorded motion.
+ *
+ *   pio run -e delta_bench
+ *   .pio/build/delta_bench/program FILE.mrd [--interval N] [--ack-delay N] [--loss PCT] [--received] [--json]
+ *
+ * Reads a flight recorder file (mrd_recorder.h), replays the sent Meridim of every frame
+ * (or the received one with --received) through MrdDeltaEncoder / MrdDeltaDecoder and reports
+ * the bytes saved against the stock 180 byte Meridim, the keyframe count and the encode /
+ * decode time. The PC side is simulated: its ack reaches the encoder --ack-delay frames later
+ * and --loss drops that percentage of packets (deterministic), to exercise the resync path.
+ * Every decoded frame is compared with the original; any mismatch is reported and fails the run.
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "mrd_delta.h"
+#include "mrd_recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  struct Options
+  {
+    const char *path = nullptr;
+    int interval = 100; // config.h の UDP_DELTA_KEY_INTERVAL
+    int ack_delay = 2;  // PCのackがボードに届くまでのフレーム数
+    double loss = 0;    // パケットロス率(%)
+    bool received = false;
+    bool json = false;
+  };
+
+  struct Frame
+  {
+    uint32_t block_seq;
+    uint32_t t_us;
+    short meridim[MRD_DELTA_WORDS];
+  };
+
+  // 記録ファイルから有効なフレームを古い順に読み出す
+  bool load(const Options &opt, std::vector<Frame> &frames)
+  {
+    FILE *f = fopen(opt.path, "rb");
+    if (!f)
+    {
+      perror(opt.path);
+      return false;
+    }
+    MrdRecFileHeader head;
+    if ((fread(&head, sizeof(head), 1, f) != 1) or (head.magic != MRD_REC_FILE_MAGIC) or
+        (head.block_bytes != MRD_REC_BLOCK_BYTES))
+    {
+      fprintf(stderr, "%s: not a recorder file\n", opt.path);
+      fclose(f);
+      return false;
+    }
+    static MrdRecBlock blk;
+    while (fread(&blk, sizeof(blk), 1, f) == 1)
+    {
+      if ((blk.magic != MRD_REC_BLOCK_MAGIC) or (blk.block_seq == 0) or (blk.record_size != MRD_REC_RECORD_BYTES))
+      {
+        continue;
+      }
+      for (int i = 0; i < blk.count and i < MRD_REC_RECORDS_PER_BLOCK; i++)
+      {
+        Frame fr;
+        fr.block_seq = blk.block_seq;
+        fr.t_us = blk.records[i].t_us;
+        memcpy(fr.meridim, opt.received ? blk.records[i].r_meridim : blk.records[i].s_meridim, sizeof(fr.meridim));
+        frames.push_back(fr);
+      }
+    }
+    fclose(f);
+    std::stable_sort(frames.begin(), frames.end(),
+                     [](const Frame &a, const Frame &b) { return a.block_seq < b.block_seq; });
+    return true;
+  }
+
+  void usage(const char *prog)
+  {
+    fprintf(stderr, "usage: %s FILE.mrd [--interval N] [--ack-delay N] [--loss PCT] [--received] [--json]\n", prog);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; i++)
+  {
+    bool has_val = (i + 1 < argc);
+    if ((strcmp(argv[i], "--interval") == 0) and has_val)
+    {
+      opt.interval = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--ack-delay") == 0) and has_val)
+    {
+      opt.ack_delay = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--loss") == 0) and has_val)
+    {
+      opt.loss = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--received") == 0)
+    {
+      opt.received = true;
+    }
+    else if (strcmp(argv[i], "--json") == 0)
+    {
+      opt.json = true;
+    }
+    else if ((argv[i][0] != '-') and !opt.path)
+    {
+      opt.path = argv[i];
+    }
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!opt.path or (opt.interval < 1) or (opt.ack_delay < 1))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<Frame> frames;
+  if (!load(opt, frames))
+  {
+    return 1;
+  }
+  if (frames.empty())
+  {
+    fprintf(stderr, "%s: no frames\n", opt.path);
+    return 1;
+  }
+
+  MrdDeltaEncoder enc;
+  MrdDeltaDecoder dec;
+  enc.begin(opt.interval);
+  dec.begin();
+  std::vector<uint16_t> acks(opt.ack_delay + 1, MRD_DELTA_NO_KEY); // PCからボードへ向かうack
+  std::vector<int> sizes;
+  uint8_t pkt[MRD_DELTA_MAX];
+  short out[MRD_DELTA_WORDS];
+  long delivered = 0, dropped = 0, undecoded = 0, mismatched = 0;
+  int64_t enc_ns = 0, dec_ns = 0;
+  uint32_t loss_rng = 12345;
+
+  for (size_t n = 0; n < frames.size(); n++)
+  {
+    // ボード: 届いたackを反映して符号化
+    enc.set_ack(acks[n % acks.size()]);
+    Clock::time_point t0 = Clock::now();
+    int len = enc.encode(frames[n].meridim, (uint16_t)frames[n].meridim[1], pkt);
+    Clock::time_point t1 = Clock::now();
+    enc_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    sizes.push_back(len);
+
+    // 回線: 決まった系列で一部を落とす
+    loss_rng = loss_rng * 1103515245u + 12345u;
+    bool lost = ((loss_rng >> 16) % 10000) < (uint32_t)(opt.loss * 100);
+    if (lost)
+    {
+      dropped++;
+    }
+    else
+    {
+      // PC: 復号して元と比較
+      t0 = Clock::now();
+      int seq = dec.decode(pkt, len, out);
+      t1 = Clock::now();
+      dec_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+      delivered++;
+      if (seq < 0)
+      {
+        undecoded++;
+      }
+      else if (memcmp(out, frames[n].meridim, sizeof(out)) != 0)
+      {
+        mismatched++;
+      }
+    }
+    acks[(n + opt.ack_delay) % acks.size()] = dec.ack(); // ack_delayフレーム後にボードに届く
+  }
+
+  long num = (long)frames.size();
+  long raw_bytes = num * MRD_REC_MSG_BYTES;
+  long delta_bytes = 0;
+  for (int s : sizes)
+  {
+    delta_bytes += s;
+  }
+  std::vector<int> sorted = sizes;
+  std::sort(sorted.begin(), sorted.end());
+  int p50 = sorted[sorted.size() / 2];
+  int p99 = sorted[std::min(sorted.size() - 1, (size_t)(0.99 * (sorted.size() - 1) + 0.5))];
+  double saved_pct = 100.0 * (raw_bytes - delta_bytes) / raw_bytes;
+  double enc_avg = (double)enc_ns / num;
+  double dec_avg = delivered ? (double)dec_ns / delivered : 0.0;
+
+  if (opt.json)
+  {
+    printf("{\"file\":\"%s\",\"stream\":\"%s\",\"frames\":%ld,\"interval\":%d,\"ack_delay\":%d,\"loss_pct\":%.2f,"
+           "\"raw_bytes\":%ld,\"delta_bytes\":%ld,\"saved_pct\":%.1f,\"avg_bytes\":%.1f,\"p50_bytes\":%d,\"p99_bytes\":%d,"
+           "\"keyframes\":%u,\"resyncs\":%u,\"dropped\":%ld,\"undecoded\":%ld,\"mismatched\":%ld,"
+           "\"encode_ns\":%.0f,\"decode_ns\":%.0f}\n",
+           opt.path, opt.received ? "received" : "sent", num, opt.interval, opt.ack_delay, opt.loss, raw_bytes,
+           delta_bytes, saved_pct, (double)delta_bytes / num, p50, p99, enc.keyframes(), enc.resyncs(), dropped,
+           undecoded, mismatched, enc_avg, dec_avg);
+  }
+  else
+  {
+    printf("[delta] %s (%s) frames:%ld interval:%d ack_delay:%d loss:%.2f%%\n", opt.path,
+           opt.received ? "received" : "sent", num, opt.interval, opt.ack_delay, opt.loss);
+    printf("[delta] bytes raw:%ld delta:%ld saved:%.1f%% avg:%.1f p50:%d p99:%d\n", raw_bytes, delta_bytes, saved_pct,
+           (double)delta_bytes / num, p50, p99);
+    printf("[delta] keyframes:%u resyncs:%u dropped:%ld undecoded:%ld mismatched:%ld\n", enc.keyframes(), enc.resyncs(),
+           dropped, undecoded, mismatched);
+    printf("[delta] encode ns:%.0f decode ns:%.0f\n", enc_avg, dec_avg);
+  }
+  return mismatched ? 1 : 0;
+}
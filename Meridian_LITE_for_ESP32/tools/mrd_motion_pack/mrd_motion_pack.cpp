@@ -0,0 +1,437 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/tools/mrd_motion_pack/mrd_motion_pack.cpp
+ * @brief   Host packer, checker and UDP uploader for motion asset images.
+ *
+ *   pio run -e motion_pack
+ *   .pio/build/motion_pack/program -o motions.bin [NAME=]FILE.csv ...
+ *   .pio/build/motion_pack/program --list motions.bin
+ *   .pio/build/motion_pack/program --upload motions.bin [--host IP] [--port-board N] [--port-local N]
+ *
+ * Each input file is one motion; its name is NAME or the file name without extension
+ * (up to 15 characters, motion numbers follow the order of the arguments).
+ * One keyframe per line:
+ *
+ *   frames,profile,hold,deg_0,deg_1,...
+ *
+ *   frames   frames to reach the pose (0-4095)
+ *   profile  0:MOTION_INTERP_PROFILE, 1:linear, 2:cubic, 3:minimum jerk (mrd_interp.h)
+ *   hold     frames to stay at the pose afterwards
+ *   deg_i    target angle in degrees, L0-L14 then R0-R14 (all lines need the same count)
+ *
+ * Empty lines and lines starting with '#' are skipped; a line `loop` makes the motion repeat.
+ * The image (mrd_motion.h) is checked with MrdMotionStore exactly as the board does.
+ * --upload sends it to UDP_RESV_PORT of the board in MRD_UPLOAD_CHUNK pieces, waiting for the
+ * ack of each packet on UDP_SEND_PORT and resending on timeout. Works against the native
+ * simulation over loopback (run `.pio/build/native/program` with MRD_SIM_CLOCK=real).
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "keys.h"
+#include "mrd_motion.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define PACK_ACK_TIMEOUT_MS 500 // 応答待ち(ボードはセクタの消去で数十ms止まる)
+#define PACK_RETRIES 20
+
+namespace
+{
+  struct Options
+  {
+    const char *out = nullptr;
+    const char *list = nullptr;
+    const char *upload = nullptr;
+    const char *host = "192.168.7.107"; // main.cpp の ip と同じ
+    int port_board = UDP_RESV_PORT;
+    int port_local = UDP_SEND_PORT;
+    std::vector<const char *> inputs;
+  };
+
+  struct Motion
+  {
+    std::string name;
+    uint16_t flags = 0;
+    int axes = 0;
+    std::vector<uint8_t> keys; // キーフレームの並び(stride単位)
+  };
+
+  void put16(std::vector<uint8_t> &v, uint16_t x)
+  {
+    v.push_back((uint8_t)x);
+    v.push_back((uint8_t)(x >> 8));
+  }
+
+  // 1ファイル = 1モーション
+  bool parse_motion(const char *arg, Motion &m)
+  {
+    std::string path = arg;
+    size_t eq = path.find('=');
+    if (eq != std::string::npos)
+    {
+      m.name = path.substr(0, eq);
+      path = path.substr(eq + 1);
+    }
+    else
+    {
+      size_t slash = path.find_last_of('/');
+      m.name = path.substr((slash == std::string::npos) ? 0 : slash + 1);
+      m.name = m.name.substr(0, m.name.find('.'));
+    }
+    if (m.name.empty() or (m.name.size() >= MRD_MOTION_NAME_LEN))
+    {
+      fprintf(stderr, "%s: motion name must be 1-%d characters\n", arg, MRD_MOTION_NAME_LEN - 1);
+      return false;
+    }
+
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+    {
+      perror(path.c_str());
+      return false;
+    }
+    char line[1024];
+    int lineno = 0;
+    bool ok = true;
+    while (ok and fgets(line, sizeof(line), f))
+    {
+      lineno++;
+      char *p = line;
+      while ((*p == ' ') or (*p == '\t'))
+      {
+        p++;
+      }
+      if ((*p == '#') or (*p == '\n') or (*p == '\r') or (*p == '\0'))
+      {
+        continue;
+      }
+      if (strncmp(p, "loop", 4) == 0)
+      {
+        m.flags |= MRD_MOTION_LOOP;
+        continue;
+      }
+      std::vector<double> v;
+      char *end = p;
+      while (true)
+      {
+        double x = strtod(p, &end);
+        if (end == p)
+        {
+          break;
+        }
+        v.push_back(x);
+        p = end;
+        while ((*p == ',') or (*p == ' ') or (*p == '\t'))
+        {
+          p++;
+        }
+      }
+      int axes = (int)v.size() - 3;
+      if ((axes < 1) or (axes > MRD_INTERP_MAX_AXES) or ((m.axes != 0) and (axes != m.axes)))
+      {
+        fprintf(stderr, "%s:%d: expected frames,profile,hold and %d angles\n", path.c_str(), lineno, m.axes ? m.axes : MRD_INTERP_MAX_AXES);
+        ok = false;
+        break;
+      }
+      if ((v[0] < 0) or (v[0] > 4095) or (v[1] < 0) or (v[1] > 3) or (v[2] < 0) or (v[2] > 65535))
+      {
+        fprintf(stderr, "%s:%d: frames 0-4095, profile 0-3, hold 0-65535\n", path.c_str(), lineno);
+        ok = false;
+        break;
+      }
+      m.axes = axes;
+      put16(m.keys, (uint16_t)((int)v[0] | ((int)v[1] << 12)));
+      put16(m.keys, (uint16_t)v[2]);
+      for (int i = 0; i < axes; i++)
+      {
+        double deg100 = std::max(-32768.0, std::min(32767.0, std::round(v[3 + i] * 100)));
+        put16(m.keys, (uint16_t)(int16_t)deg100);
+      }
+      while (m.keys.size() % 4 != 0)
+      {
+        m.keys.push_back(0);
+      }
+    }
+    fclose(f);
+    if (ok and m.keys.empty())
+    {
+      fprintf(stderr, "%s: no keyframes\n", path.c_str());
+      ok = false;
+    }
+    return ok;
+  }
+
+  std::vector<uint8_t> build_image(const std::vector<Motion> &motions)
+  {
+    std::vector<uint8_t> img(sizeof(MrdMotionImage) + motions.size() * sizeof(MrdMotionEntry), 0);
+    for (size_t i = 0; i < motions.size(); i++)
+    {
+      const Motion &m = motions[i];
+      MrdMotionEntry e;
+      memset(&e, 0, sizeof(e));
+      snprintf(e.name, sizeof(e.name), "%s", m.name.c_str());
+      e.offset = (uint32_t)img.size();
+      e.bytes = (uint32_t)(sizeof(MrdMotionHeader) + m.keys.size());
+      memcpy(&img[sizeof(MrdMotionImage) + i * sizeof(MrdMotionEntry)], &e, sizeof(e));
+
+      MrdMotionHeader h;
+      h.axes = (uint16_t)m.axes;
+      h.stride = (uint16_t)MRD_MOTION_KEY_BYTES(m.axes);
+      h.keys = (uint16_t)(m.keys.size() / h.stride);
+      h.flags = m.flags;
+      img.insert(img.end(), (const uint8_t *)&h, (const uint8_t *)(&h + 1));
+      img.insert(img.end(), m.keys.begin(), m.keys.end());
+    }
+    MrdMotionImage head;
+    head.magic = MRD_MOTION_MAGIC;
+    head.version = MRD_MOTION_VERSION;
+    head.count = (uint16_t)motions.size();
+    head.bytes = (uint32_t)img.size();
+    head.crc = mrd_motion_crc32(0, img.data() + sizeof(head), head.bytes - sizeof(head));
+    memcpy(img.data(), &head, sizeof(head));
+    return img;
+  }
+
+  bool load_file(const char *path, std::vector<uint8_t> &data)
+  {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+      perror(path);
+      return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+      data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+  }
+
+  void list_image(const MrdMotionStore &store)
+  {
+    printf("%d motions, %u bytes\n", store.count(), store.bytes());
+    for (int i = 0; i < store.count(); i++)
+    {
+      const MrdMotionHeader *m = store.motion(i);
+      const uint8_t *k = (const uint8_t *)(m + 1);
+      uint32_t frames = 0;
+      for (int j = 0; j < m->keys; j++)
+      {
+        const uint16_t *w = (const uint16_t *)(k + j * m->stride);
+        frames += (w[0] & 0x0FFF) + w[1];
+      }
+      printf("  %2d %-15s axes:%2d keys:%4d frames:%6u%s\n", i, store.entry(i)->name, m->axes, m->keys, frames,
+             (m->flags & MRD_MOTION_LOOP) ? " loop" : "");
+    }
+  }
+
+  // 1パケットを送り, 同じopの応答が来るまで送り直す
+  bool transact(int fd, const sockaddr_in &board, const std::vector<uint8_t> &pkt, uint16_t op, MrdUploadAck &ack, int &resent)
+  {
+    for (int attempt = 0; attempt < PACK_RETRIES; attempt++)
+    {
+      if (attempt > 0)
+      {
+        resent++;
+      }
+      sendto(fd, pkt.data(), pkt.size(), 0, (const sockaddr *)&board, sizeof(board));
+      pollfd pfd = {fd, POLLIN, 0};
+      while (poll(&pfd, 1, PACK_ACK_TIMEOUT_MS) > 0)
+      {
+        uint8_t rx[2048];
+        ssize_t n = recv(fd, rx, sizeof(rx), 0);
+        if (n != (ssize_t)sizeof(MrdUploadAck)) // 通常のMeridimなどは読み捨てる
+        {
+          continue;
+        }
+        memcpy(&ack, rx, sizeof(ack));
+        if ((ack.magic == MRD_UPLOAD_MAGIC) and (ack.op == op))
+        {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  std::vector<uint8_t> make_packet(uint16_t op, uint32_t offset, uint32_t value, const uint8_t *data, uint32_t len)
+  {
+    MrdUploadPacket h = {MRD_UPLOAD_MAGIC, op, offset, value};
+    std::vector<uint8_t> pkt((const uint8_t *)&h, (const uint8_t *)(&h + 1));
+    pkt.insert(pkt.end(), data, data + len);
+    return pkt;
+  }
+
+  bool upload(const Options &opt, const std::vector<uint8_t> &img)
+  {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons((uint16_t)opt.port_local);
+    if ((fd < 0) or (bind(fd, (sockaddr *)&local, sizeof(local)) != 0))
+    {
+      perror("bind");
+      return false;
+    }
+    sockaddr_in board;
+    memset(&board, 0, sizeof(board));
+    board.sin_family = AF_INET;
+    board.sin_port = htons((uint16_t)opt.port_board);
+    if (inet_pton(AF_INET, opt.host, &board.sin_addr) != 1)
+    {
+      fprintf(stderr, "bad host %s\n", opt.host);
+      close(fd);
+      return false;
+    }
+
+    MrdUploadAck ack;
+    int resent = 0;
+    bool ok = transact(fd, board, make_packet(MRD_UPLOAD_BEGIN, 0, (uint32_t)img.size(), NULL, 0), MRD_UPLOAD_BEGIN, ack, resent) and
+              (ack.status == MRD_UPLOAD_OK);
+    uint32_t offset = 0;
+    while (ok and (offset < img.size()))
+    {
+      uint32_t n = std::min((uint32_t)MRD_UPLOAD_CHUNK, (uint32_t)img.size() - offset);
+      ok = transact(fd, board, make_packet(MRD_UPLOAD_DATA, offset, n, &img[offset], n), MRD_UPLOAD_DATA, ack, resent) and
+           ((ack.status == MRD_UPLOAD_OK) or (ack.status == MRD_UPLOAD_ERR_ORDER)); // 位置がずれたらボードの位置から送り直す
+      offset = ack.offset;
+      printf("\r%u/%zu bytes", offset, img.size());
+      fflush(stdout);
+    }
+    printf("\n");
+    uint32_t crc = mrd_motion_crc32(0, img.data(), (uint32_t)img.size());
+    ok = ok and transact(fd, board, make_packet(MRD_UPLOAD_COMMIT, 0, crc, NULL, 0), MRD_UPLOAD_COMMIT, ack, resent) and
+         (ack.status == MRD_UPLOAD_OK);
+    close(fd);
+    if (ok)
+    {
+      printf("uploaded %zu bytes (resent %d)\n", img.size(), resent);
+    }
+    else
+    {
+      fprintf(stderr, "upload failed (op %u, status %d, board offset %u)\n", ack.op, ack.status, ack.offset);
+    }
+    return ok;
+  }
+
+  void usage(const char *prog)
+  {
+    fprintf(stderr,
+            "usage: %s -o OUT.bin [NAME=]FILE.csv ...\n"
+            "       %s --list IMAGE.bin\n"
+            "       %s --upload IMAGE.bin [--host IP] [--port-board N] [--port-local N]\n",
+            prog, prog, prog);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; i++)
+  {
+    bool has_val = (i + 1 < argc);
+    if ((strcmp(argv[i], "-o") == 0) and has_val)
+    {
+      opt.out = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--list") == 0) and has_val)
+    {
+      opt.list = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--upload") == 0) and has_val)
+    {
+      opt.upload = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--host") == 0) and has_val)
+    {
+      opt.host = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--port-board") == 0) and has_val)
+    {
+      opt.port_board = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--port-local") == 0) and has_val)
+    {
+      opt.port_local = atoi(argv[++i]);
+    }
+    else if (argv[i][0] != '-')
+    {
+      opt.inputs.push_back(argv[i]);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<uint8_t> img;
+  if (opt.out)
+  {
+    std::vector<Motion> motions;
+    for (const char *in : opt.inputs)
+    {
+      Motion m;
+      if (!parse_motion(in, m))
+      {
+        return 1;
+      }
+      motions.push_back(m);
+    }
+    if (motions.empty() or (motions.size() > 0xFFFF))
+    {
+      usage(argv[0]);
+      return 2;
+    }
+    img = build_image(motions);
+    FILE *f = fopen(opt.out, "wb");
+    if (!f or (fwrite(img.data(), 1, img.size(), f) != img.size()))
+    {
+      perror(opt.out);
+      return 1;
+    }
+    fclose(f);
+  }
+  else if (opt.list or opt.upload)
+  {
+    if (!load_file(opt.list ? opt.list : opt.upload, img))
+    {
+      return 1;
+    }
+  }
+  else
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  MrdMotionStore store;
+  if (!store.attach(img.data(), (uint32_t)img.size()))
+  {
+    fprintf(stderr, "invalid motion image\n");
+    return 1;
+  }
+  list_image(store);
+  if (opt.upload and !upload(opt, img))
+  {
+    return 1;
+  }
+  return 0;
+}
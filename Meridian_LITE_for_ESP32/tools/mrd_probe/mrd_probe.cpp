@@ -0,0 +1,689 @@
+/**
+ * @file    Meridian_LITE_for_ESP32/tools/mrd_probe/mrd_probe.cpp
+ * @brief   PC-side load generator and latency probe for the Meridim UDP or serial link.
+ *
+ *   pio run -e probe
+ *   .pio/build/probe/program [--host IP] [--rate HZ] [--seconds S] [--closed] [--fast-port N] [--delta] [--json]
+ *   .pio/build/probe/program --serial /dev/ttyUSB0 [--baud B] [--rate HZ] ...
+ *
+ * Sends Meridim90 frames to UDP_RESV_PORT of the board and listens on UDP_SEND_PORT.
+ * Every frame carries a 32-bit probe tag in Meridim[80]-[81] (user data, echoed unchanged
+ * by the frame loop since s_udp_meridim is copied from r_udp_meridim in [1-3]).
+ * Meridim[1] carries the PC sequence number that the board checks in [7-1].
+ *
+ * The board answers once per frame with the last frame it received, so:
+ *   rtt       = first echo of a tag - its send time
+ *   lost      = tags never echoed (includes frames overtaken inside one board frame
+ *               when sending faster than the board frame rate)
+ *   reordered = first echo of a tag older than an already echoed tag
+ *   repeats   = echoes of a tag already seen (the board had no newer frame)
+ *
+ * Frames are sent at --rate. With --closed the next frame also waits until the previous one
+ * was echoed (or 100 ms passed), which measures the link without queueing.
+ * --fast-port also listens for the compact fast-field packets (UDP_SEND_FAST) and reports
+ * the receive rate of both kinds, to check UDP_SEND_DIVISOR / UDP_SEND_FAST.
+ * --delta sends MCMD_DELTA_ON until the first delta packet arrives, decodes the delta Meridim
+ * (mrd_delta.h) and acks the held keyframe in Meridim[87], to measure the reduced byte rate.
+ * --subscribe PORT[,DIV[,FIRST:COUNT...]] (up to 4 times, 3 ranges each) registers a subscriber on this PC with
+ * MCMD_SUBSCRIBE until its first packet arrives (mrd_fanout.h), listens on PORT, checks the
+ * packets (full Meridim or the selected fields) and removes the subscriptions at the end.
+ * --serial talks to a board built with SERIAL_LINK=1 instead: the same frames are sent and
+ * received in the COBS framing of mrd_cobs.h (the fast-field packets on channel 1), and the
+ * framing errors (CRC, noise such as monitor text) are reported. --subscribe is UDP only.
+ * Works against the board and against the native simulation over loopback
+ * (run `.pio/build/native/program` with MRD_SIM_CLOCK=real, and MRD_SIM_SERIAL_PTY=PATH for --serial).
+ *
+ * This code is licensed under the MIT License.
+ */
+
+#include "keys.h"
+#include "mrd_cobs.h"
+#include "mrd_delta.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define PROBE_MSG_SIZE 90       // Meridim90の要素数
+#define PROBE_MASTER 0          // マスターコマンドの位置
+#define PROBE_SEQ 1             // シーケンス番号の位置
+#define PROBE_TAG 80            // プローブのタグの位置(ユーザーデータ領域 [80]-[81])
+#define PROBE_CKSM 89           // チェックサムの位置
+#define PROBE_CMD_NORMAL 90     // 通常動作のマスターコマンド(0は全サーボ脱力になるため使わない)
+#define PROBE_CLOSED_TIMEOUT_US 100000
+#define PROBE_FAST_MAGIC 0x464D // 高速項目パケットの先頭 "MF"
+#define PROBE_CMD_DELTA_ON 10011 // 差分Meridim送信の開始(config.h の MCMD_DELTA_ON)
+#define PROBE_DELTA_ACK 87      // キーフレームのackの位置(config.h の UDP_DELTA_ACK_INDEX)
+#define PROBE_CMD_SUBSCRIBE 10016   // 購読者の登録(config.h の MCMD_SUBSCRIBE)
+#define PROBE_CMD_UNSUBSCRIBE 10017 // 購読者の削除(config.h の MCMD_UNSUBSCRIBE)
+#define PROBE_SUB_PARAM 80          // 購読のパラメータの位置(config.h の SUB_PARAM_INDEX)
+#define PROBE_SUB_MAX 4             // 購読者の最大数(mrd_fanout.h の MRD_SUB_MAX)
+#define PROBE_LINK_MAIN 0           // シリアルのチャンネル(mrd_link.h の MRD_LINK_MAIN)
+#define PROBE_LINK_FAST 1           // 高速項目パケットのチャンネル(mrd_link.h の MRD_LINK_FAST)
+#define PROBE_SERIAL_MAX 1472       // シリアルの1パケットの最大長(mrd_link.h の MRD_LINK_MAX_PACKET)
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  struct Subscriber
+  {
+    int port = 0;
+    int divisor = 1;
+    short ranges[3] = {0, 0, 0};    // 下位8bit:先頭, 上位8bit:個数
+    int fields = 0;                 // 0:Meridim全体
+    int fd = -1;
+    long rx = 0;
+    long bad = 0;
+    long bytes = 0;
+  };
+
+  struct Options
+  {
+    const char *host = "192.168.7.107"; // main.cpp の ip と同じ
+    int port_board = UDP_RESV_PORT;
+    int port_local = UDP_SEND_PORT;
+    int port_fast = 0; // 0:高速項目パケットを受信しない
+    double rate = 100;
+    double seconds = 10;
+    int master = PROBE_CMD_NORMAL;
+    bool closed = false;
+    bool delta = false;
+    bool json = false;
+    std::vector<Subscriber> subs;
+    const char *serial = nullptr; // nullptr:UDP
+    int baud = 2000000;           // config.h の SERIAL_LINK_BPS
+  };
+
+  // シリアルでの送受信 (--serial)
+  struct SerialPort
+  {
+    int fd = -1;
+    MrdCobsDecoder dec;
+    uint8_t rx_buf[PROBE_SERIAL_MAX + MRD_COBS_OVERHEAD];
+    long tx_bytes = 0;
+    long rx_bytes = 0; // 枠を含む受信バイト数
+  };
+
+  int64_t now_us()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+  }
+
+  short checksum(const short *m, int len = PROBE_MSG_SIZE)
+  {
+    int sum = 0;
+    for (int i = 0; i < len - 1; i++)
+    {
+      sum += m[i];
+    }
+    return (short)~sum;
+  }
+
+  int open_udp(int port)
+  {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons((uint16_t)port);
+    if ((fd < 0) or (bind(fd, (sockaddr *)&local, sizeof(local)) != 0))
+    {
+      perror("bind");
+      exit(1);
+    }
+    return fd;
+  }
+
+  speed_t baud_code(int baud)
+  {
+    switch (baud)
+    {
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+    case 460800:
+      return B460800;
+    case 921600:
+      return B921600;
+    case 1000000:
+      return B1000000;
+    case 1500000:
+      return B1500000;
+    case 2000000:
+      return B2000000;
+    case 3000000:
+      return B3000000;
+    default:
+      return B0;
+    }
+  }
+
+  // 生のモード(エコーや改行の変換なし)で開く
+  void open_serial(SerialPort *sp, const char *path, int baud)
+  {
+    sp->fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    termios tio;
+    if ((sp->fd < 0) or (tcgetattr(sp->fd, &tio) != 0))
+    {
+      perror(path);
+      exit(1);
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud_code(baud));
+    cfsetospeed(&tio, baud_code(baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    if (tcsetattr(sp->fd, TCSANOW, &tio) != 0)
+    {
+      perror("tcsetattr");
+      exit(1);
+    }
+    tcflush(sp->fd, TCIOFLUSH);
+    sp->dec.begin(sp->rx_buf, sizeof(sp->rx_buf));
+  }
+
+  // 1パケットを枠にして書き切る(送信バッファが一杯なら空くまで待つ)
+  void serial_send(SerialPort *sp, uint8_t channel, const void *packet, int len)
+  {
+    uint8_t out[MRD_COBS_FRAME_MAX(PROBE_SERIAL_MAX)];
+    int n = mrd_cobs_encode(channel, (const uint8_t *)packet, len, out);
+    for (int o = 0; o < n;)
+    {
+      ssize_t w = write(sp->fd, out + o, n - o);
+      if (w > 0)
+      {
+        o += (int)w;
+        continue;
+      }
+      if ((errno != EAGAIN) and (errno != EINTR)) // ボードが切断された
+      {
+        perror("serial");
+        exit(1);
+      }
+      pollfd pfd = {sp->fd, POLLOUT, 0};
+      poll(&pfd, 1, 10);
+    }
+    sp->tx_bytes += n;
+  }
+
+  int64_t percentile(const std::vector<int64_t> &sorted, double p)
+  {
+    if (sorted.empty())
+    {
+      return 0;
+    }
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+  }
+
+  // PORT[,DIV[,FIRST:COUNT...]]
+  bool parse_subscriber(const char *arg, Subscriber *sub)
+  {
+    char *end = NULL;
+    sub->port = (int)strtol(arg, &end, 10);
+    if ((sub->port <= 0) or (sub->port > 65535))
+    {
+      return false;
+    }
+    if (*end == ',')
+    {
+      sub->divisor = (int)strtol(end + 1, &end, 10);
+    }
+    bool mark[PROBE_MSG_SIZE] = {false};
+    for (int r = 0; *end == ','; r++)
+    {
+      int first = (int)strtol(end + 1, &end, 10);
+      int count = (*end == ':') ? (int)strtol(end + 1, &end, 10) : 1;
+      if ((r >= 3) or (first < 0) or (first >= PROBE_MSG_SIZE) or (count < 1) or (count > 255))
+      {
+        return false;
+      }
+      sub->ranges[r] = (short)(first | (count << 8));
+      for (int i = first; (i < first + count) and (i < PROBE_MSG_SIZE); i++)
+      {
+        mark[i] = true;
+      }
+    }
+    sub->fields = (int)std::count(mark, mark + PROBE_MSG_SIZE, true);
+    return (*end == '\0') and (sub->divisor >= 1);
+  }
+
+  // 購読の登録/削除のMeridimのパラメータ (IPアドレスは0.0.0.0: コマンドを送ったPC)
+  void subscribe_params(short *frame, const Subscriber &sub)
+  {
+    memset(frame + PROBE_SUB_PARAM, 0, 7 * sizeof(short)); // [87]はキーフレームのack
+    frame[PROBE_SUB_PARAM + 2] = (short)sub.port;
+    frame[PROBE_SUB_PARAM + 3] = (short)sub.divisor;
+    memcpy(frame + PROBE_SUB_PARAM + 4, sub.ranges, sizeof(sub.ranges));
+  }
+
+  void usage(const char *prog)
+  {
+    fprintf(stderr,
+            "usage: %s [--host IP] [--port-board N] [--port-local N] [--rate HZ] [--seconds S]\n"
+            "          [--master CMD] [--closed] [--fast-port N] [--delta] [--json]\n"
+            "          [--subscribe PORT[,DIV[,FIRST:COUNT...]]]...\n"
+            "       %s --serial PATH [--baud B] [--rate HZ] [--seconds S] [--master CMD] [--closed] [--delta] [--json]\n",
+            prog,
+            prog);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; i++)
+  {
+    bool has_val = (i + 1 < argc);
+    if ((strcmp(argv[i], "--host") == 0) and has_val)
+    {
+      opt.host = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--port-board") == 0) and has_val)
+    {
+      opt.port_board = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--port-local") == 0) and has_val)
+    {
+      opt.port_local = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--fast-port") == 0) and has_val)
+    {
+      opt.port_fast = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--rate") == 0) and has_val)
+    {
+      opt.rate = atof(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--seconds") == 0) and has_val)
+    {
+      opt.seconds = atof(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--master") == 0) and has_val)
+    {
+      opt.master = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--closed") == 0)
+    {
+      opt.closed = true;
+    }
+    else if (strcmp(argv[i], "--delta") == 0)
+    {
+      opt.delta = true;
+    }
+    else if (strcmp(argv[i], "--json") == 0)
+    {
+      opt.json = true;
+    }
+    else if ((strcmp(argv[i], "--serial") == 0) and has_val)
+    {
+      opt.serial = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--baud") == 0) and has_val)
+    {
+      opt.baud = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "--subscribe") == 0) and has_val and (opt.subs.size() < PROBE_SUB_MAX))
+    {
+      Subscriber sub;
+      if (!parse_subscriber(argv[++i], &sub))
+      {
+        fprintf(stderr, "bad subscriber: %s\n", argv[i]);
+        return 2;
+      }
+      opt.subs.push_back(sub);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if ((opt.rate <= 0) or (opt.seconds <= 0) or (opt.serial and (!opt.subs.empty() or (baud_code(opt.baud) == B0))))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  SerialPort sp;
+  if (opt.serial)
+  {
+    open_serial(&sp, opt.serial, opt.baud);
+  }
+  int fd = opt.serial ? sp.fd : open_udp(opt.port_local); // シリアルでは高速項目パケットも同じ口に届く
+  int fd_fast = ((opt.port_fast > 0) and !opt.serial) ? open_udp(opt.port_fast) : -1;
+  for (size_t k = 0; k < opt.subs.size(); k++)
+  {
+    opt.subs[k].fd = open_udp(opt.subs[k].port);
+  }
+  size_t sub_next = 0;  // 次に登録コマンドを送る購読者
+  bool sub_sent = false; // 直前に送ったのが登録コマンド
+  sockaddr_in board;
+  memset(&board, 0, sizeof(board));
+  board.sin_family = AF_INET;
+  board.sin_port = htons((uint16_t)opt.port_board);
+  if (!opt.serial and (inet_pton(AF_INET, opt.host, &board.sin_addr) != 1))
+  {
+    fprintf(stderr, "bad host: %s\n", opt.host);
+    return 2;
+  }
+
+  std::vector<int64_t> sent_us;                  // タグごとの送信時刻
+  std::vector<int64_t> rtt_us;                   // タグごとの往復時間(最初の返信のみ)
+  std::vector<char> echoed;                      // 返信済みのタグ
+  uint32_t max_echoed = 0;
+  bool any_echoed = false;
+  long reordered = 0;
+  long repeats = 0;
+  long rx_frames = 0;
+  long rx_bad = 0;
+  long rx_bytes = 0;
+  long rx_fast = 0;
+  long rx_fast_bad = 0;
+  long rx_delta = 0;       // 差分Meridimで受信した数
+  long rx_delta_undec = 0; // キーフレームが無く復号できなかった数
+  int seq = 0;
+  MrdDeltaDecoder delta_dec;
+  delta_dec.begin();
+
+  bool waiting = false; // --closed: 返信待ち
+
+  short frame[PROBE_MSG_SIZE];
+  memset(frame, 0, sizeof(frame));
+  auto send_frame = [&]()
+  {
+    if (opt.serial)
+    {
+      serial_send(&sp, PROBE_LINK_MAIN, frame, sizeof(frame));
+    }
+    else
+    {
+      sendto(fd, frame, sizeof(frame), 0, (sockaddr *)&board, sizeof(board));
+    }
+  };
+
+  // 高速項目パケット
+  auto on_fast = [&](const short *rx, int nf)
+  {
+    if (nf < 6)
+    {
+      return;
+    }
+    rx_bytes += nf;
+    int len = nf / 2;
+    if ((rx[0] == (short)PROBE_FAST_MAGIC) and (rx[len - 1] == checksum(rx, len)))
+    {
+      rx_fast++;
+    }
+    else
+    {
+      rx_fast_bad++;
+    }
+  };
+
+  // Meridimまたは差分Meridim
+  auto on_main = [&](short *rx, int n, int64_t t_rx)
+  {
+    if ((n >= MRD_DELTA_HEADER) and ((uint16_t)rx[0] == MRD_DELTA_MAGIC))
+    {
+      rx_frames++;
+      rx_delta++;
+      rx_bytes += n;
+      short decoded[PROBE_MSG_SIZE];
+      if (delta_dec.decode((const uint8_t *)rx, n, decoded) < 0)
+      {
+        rx_delta_undec++;
+        return;
+      }
+      memcpy(rx, decoded, sizeof(decoded));
+    }
+    else if (n == PROBE_MSG_SIZE * 2)
+    {
+      rx_frames++;
+      rx_bytes += n;
+    }
+    else
+    {
+      return;
+    }
+    if (rx[PROBE_CKSM] != checksum(rx))
+    {
+      rx_bad++;
+      return;
+    }
+    uint32_t tag = (uint16_t)rx[PROBE_TAG] | ((uint32_t)(uint16_t)rx[PROBE_TAG + 1] << 16);
+    if ((tag == 0) or (tag > sent_us.size()))
+    {
+      return; // このプローブが送ったものではない(起動直後の初期値など)
+    }
+    if (echoed[tag - 1])
+    {
+      repeats++;
+      return;
+    }
+    echoed[tag - 1] = 1;
+    rtt_us.push_back(t_rx - sent_us[tag - 1]);
+    if (any_echoed and (tag < max_echoed))
+    {
+      reordered++;
+    }
+    max_echoed = any_echoed ? std::max(max_echoed, tag) : tag;
+    any_echoed = true;
+    if (opt.closed and (tag == sent_us.size()))
+    {
+      waiting = false;
+    }
+  };
+
+  const int64_t period_us = (int64_t)(1e6 / opt.rate);
+  const int64_t t_start = now_us();
+  const int64_t t_stop = t_start + (int64_t)(opt.seconds * 1e6);
+  const int64_t t_drain = t_stop + 200000; // 最後の送信から返信を待つ時間
+  int64_t t_next = t_start;
+
+  while (true)
+  {
+    int64_t t = now_us();
+    if (t >= t_drain)
+    {
+      break;
+    }
+
+    /* 送信 */
+    bool closed_ready = (!waiting) or (t - sent_us.back() >= PROBE_CLOSED_TIMEOUT_US);
+    if ((t < t_stop) and (t >= t_next) and ((!opt.closed) or closed_ready))
+    {
+      // 未受信の購読者の登録を通常のフレームと交互に送る. パラメータがタグの位置と重なるため計測には含めない
+      const Subscriber *pending = NULL;
+      for (size_t k = 0; (k < opt.subs.size()) and !sub_sent and (frame[PROBE_MASTER] == opt.master); k++)
+      {
+        if (opt.subs[(sub_next + k) % opt.subs.size()].rx == 0)
+        {
+          pending = &opt.subs[(sub_next + k) % opt.subs.size()];
+          sub_next = (sub_next + k + 1) % opt.subs.size();
+          break;
+        }
+      }
+      sub_sent = (pending != NULL);
+      if (pending != NULL)
+      {
+        frame[PROBE_MASTER] = PROBE_CMD_SUBSCRIBE;
+        subscribe_params(frame, *pending);
+        frame[PROBE_CKSM] = checksum(frame);
+        send_frame();
+        frame[PROBE_MASTER] = (short)opt.master;
+        t_next += period_us;
+        continue;
+      }
+
+      uint32_t tag = (uint32_t)sent_us.size() + 1; // 0は起動直後の初期値と区別できないので1から
+      frame[PROBE_MASTER] = (short)((opt.delta and (rx_delta == 0)) ? PROBE_CMD_DELTA_ON : opt.master);
+      frame[PROBE_DELTA_ACK] = opt.delta ? (short)delta_dec.ack() : 0;
+      frame[PROBE_SEQ] = (short)seq;
+      frame[PROBE_TAG] = (short)(tag & 0xFFFF);
+      frame[PROBE_TAG + 1] = (short)(tag >> 16);
+      frame[PROBE_CKSM] = checksum(frame);
+      seq = (seq >= 59999) ? 0 : seq + 1;
+      sent_us.push_back(now_us());
+      echoed.push_back(0);
+      send_frame();
+      t_next += period_us;
+      waiting = true;
+      continue;
+    }
+
+    /* 次の送信時刻まで受信を待つ */
+    int64_t wait_us = (t < t_stop) ? std::max<int64_t>(0, t_next - t) : t_drain - t;
+    if (opt.closed and waiting)
+    {
+      wait_us = std::min<int64_t>(wait_us > 0 ? wait_us : PROBE_CLOSED_TIMEOUT_US, PROBE_CLOSED_TIMEOUT_US);
+    }
+    pollfd pfd[2 + PROBE_SUB_MAX] = {{fd, POLLIN, 0}, {fd_fast, POLLIN, 0}};
+    for (size_t k = 0; k < opt.subs.size(); k++)
+    {
+      pfd[2 + k] = {opt.subs[k].fd, POLLIN, 0};
+    }
+    if (poll(pfd, 2 + opt.subs.size(), (int)((wait_us + 999) / 1000)) <= 0)
+    {
+      continue;
+    }
+
+    short rx[MRD_DELTA_MAX / 2 + 1];
+    for (size_t k = 0; k < opt.subs.size(); k++)
+    {
+      Subscriber &sub = opt.subs[k];
+      if (!(pfd[2 + k].revents & POLLIN))
+      {
+        continue;
+      }
+      ssize_t ns = recv(sub.fd, rx, sizeof(rx), 0);
+      int len = (int)(ns / 2);
+      bool ok = (sub.fields == 0) ? ((len == PROBE_MSG_SIZE) and (rx[PROBE_CKSM] == checksum(rx)))
+                                  : ((len == sub.fields + 3) and (rx[0] == (short)PROBE_FAST_MAGIC) and (rx[len - 1] == checksum(rx, len)));
+      sub.rx += ok ? 1 : 0;
+      sub.bad += ok ? 0 : 1;
+      sub.bytes += (ns > 0) ? ns : 0;
+    }
+    if ((fd_fast >= 0) and (pfd[1].revents & POLLIN))
+    {
+      ssize_t nf = recv(fd_fast, rx, sizeof(rx), 0);
+      on_fast(rx, (int)nf);
+    }
+    if (!(pfd[0].revents & POLLIN))
+    {
+      continue;
+    }
+    if (opt.serial) // 届いた分を復号し, 完成したパケットを順に処理する
+    {
+      uint8_t chunk[4096];
+      ssize_t nr = read(fd, chunk, sizeof(chunk));
+      int64_t t_rx = now_us();
+      for (ssize_t i = 0; i < nr; i++)
+      {
+        int len = sp.dec.feed(chunk[i]);
+        if ((len <= 0) or (len > (int)sizeof(rx)))
+        {
+          continue;
+        }
+        memcpy(rx, sp.dec.packet(), len);
+        if (sp.dec.channel() == PROBE_LINK_FAST)
+        {
+          on_fast(rx, len);
+        }
+        else if (sp.dec.channel() == PROBE_LINK_MAIN)
+        {
+          on_main(rx, len, t_rx);
+        }
+      }
+      sp.rx_bytes += (nr > 0) ? nr : 0;
+      continue;
+    }
+    ssize_t n = recv(fd, rx, sizeof(rx), 0);
+    on_main(rx, (int)n, now_us());
+  }
+  for (size_t k = 0; k < opt.subs.size(); k++) // 購読を削除する(ボードが受け取れるようにフレームを空けて送る)
+  {
+    for (int m = 0; m < 2; m++)
+    {
+      frame[PROBE_MASTER] = (short)((m == 0) ? PROBE_CMD_UNSUBSCRIBE : opt.master);
+      subscribe_params(frame, opt.subs[k]);
+      frame[PROBE_CKSM] = checksum(frame);
+      send_frame();
+      usleep(20000);
+    }
+    close(opt.subs[k].fd);
+  }
+  close(fd);
+  if (fd_fast >= 0)
+  {
+    close(fd_fast);
+  }
+
+  long sent = (long)sent_us.size();
+  long answered = (long)rtt_us.size();
+  long lost = sent - answered;
+  double elapsed = (now_us() - t_start) / 1e6;
+  std::sort(rtt_us.begin(), rtt_us.end());
+  double loss_pct = sent ? 100.0 * lost / sent : 0.0;
+
+  const char *target = opt.serial ? opt.serial : opt.host;
+  if (opt.json)
+  {
+    printf("{\"host\":\"%s\",\"mode\":\"%s\",\"rate_hz\":%.1f,\"seconds\":%.2f,\"sent\":%ld,\"answered\":%ld,\"lost\":%ld,"
+           "\"loss_pct\":%.2f,\"reordered\":%ld,\"repeats\":%ld,\"rx_frames\":%ld,\"rx_bad_cksm\":%ld,"
+           "\"rx_fast\":%ld,\"rx_fast_bad\":%ld,\"rx_delta\":%ld,\"rx_delta_undecoded\":%ld,"
+           "\"rx_full_per_sec\":%.1f,\"rx_fast_per_sec\":%.1f,\"rx_bytes_per_sec\":%.0f,"
+           "\"serial\":{\"tx_bytes_per_sec\":%.0f,\"rx_bytes_per_sec\":%.0f,\"crc_errors\":%u,\"overflows\":%u,\"noise_bytes\":%u},"
+           "\"rtt_us\":{\"min\":%lld,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld}}\n",
+           target, opt.closed ? "closed" : "open", opt.rate, elapsed, sent, answered, lost, loss_pct, reordered, repeats,
+           rx_frames, rx_bad, rx_fast, rx_fast_bad, rx_delta, rx_delta_undec, rx_frames / elapsed, rx_fast / elapsed,
+           rx_bytes / elapsed, sp.tx_bytes / elapsed, sp.rx_bytes / elapsed, sp.dec.crc_errors(), sp.dec.overflows(),
+           sp.dec.noise_bytes(),
+           (long long)(rtt_us.empty() ? 0 : rtt_us.front()), (long long)percentile(rtt_us, 0.5),
+           (long long)percentile(rtt_us, 0.9), (long long)percentile(rtt_us, 0.99), (long long)percentile(rtt_us, 0.999),
+           (long long)(rtt_us.empty() ? 0 : rtt_us.back()));
+  }
+  else
+  {
+    printf("[probe] %s:%d %s %.1fHz %.2fs\n", target, opt.serial ? opt.baud : opt.port_board, opt.closed ? "closed" : "open", opt.rate, elapsed);
+    printf("[probe] sent:%ld answered:%ld lost:%ld (%.2f%%) reordered:%ld repeats:%ld rx:%ld bad_cksm:%ld\n", sent, answered,
+           lost, loss_pct, reordered, repeats, rx_frames, rx_bad);
+    printf("[probe] rx full/s:%.1f fast/s:%.1f (bad:%ld) B/s:%.0f\n", rx_frames / elapsed, rx_fast / elapsed, rx_fast_bad,
+           rx_bytes / elapsed);
+    if (opt.serial)
+    {
+      printf("[probe] serial tx B/s:%.0f rx B/s:%.0f (%.1f%% of %d bps) crc:%u overflow:%u noise:%u\n", sp.tx_bytes / elapsed,
+             sp.rx_bytes / elapsed, 100.0 * sp.rx_bytes * 10 / elapsed / opt.baud, opt.baud, sp.dec.crc_errors(),
+             sp.dec.overflows(), sp.dec.noise_bytes());
+    }
+    if (opt.delta)
+    {
+      printf("[probe] rx delta:%ld undecoded:%ld\n", rx_delta, rx_delta_undec);
+    }
+    for (size_t k = 0; k < opt.subs.size(); k++)
+    {
+      const Subscriber &sub = opt.subs[k];
+      printf("[probe] sub port:%d 1/%d fields:%d rx/s:%.1f B/s:%.0f bad:%ld\n", sub.port, sub.divisor, sub.fields,
+             sub.rx / elapsed, sub.bytes / elapsed, sub.bad);
+    }
+    printf("[probe] rtt us min:%lld p50:%lld p90:%lld p99:%lld p99.9:%lld max:%lld\n",
+           (long long)(rtt_us.empty() ? 0 : rtt_us.front()), (long long)percentile(rtt_us, 0.5),
+           (long long)percentile(rtt_us, 0.9), (long long)percentile(rtt_us, 0.99), (long long)percentile(rtt_us, 0.999),
+           (long long)(rtt_us.empty() ? 0 : rtt_us.back()));
+  }
+  return answered > 0 ? 0 : 1;
+}